@@ -35,6 +35,7 @@
 #include <QtCore/QDebug>
 
 #include "Engine/AppManager.h"
+#include "Engine/Cache.h"
 #include "Engine/EffectInstance.h"
 #include "Engine/Node.h"
 #include "Engine/ThreadPool.h"
@@ -49,6 +50,7 @@
 NATRON_NAMESPACE_ENTER
 
 typedef std::set<AbortableThread*> ThreadSet;
+typedef std::multiset<CacheEntryProductionPtr> ProductionSet;
 
 struct AbortableRenderInfoPrivate
 {
@@ -58,6 +60,7 @@ struct AbortableRenderInfoPrivate
     U64 age;
     mutable QMutex threadsMutex;
     ThreadSet threadsForThisRender;
+    ProductionSet waitedProductions;
     mutable QMutex timerMutex;
     bool timerStarted;
     QTimer* abortTimeoutTimer;
@@ -72,6 +75,7 @@ struct AbortableRenderInfoPrivate
         , age(age)
         , threadsMutex()
         , threadsForThisRender()
+        , waitedProductions()
         , timerMutex()
         , timerStarted(false)
         , abortTimeoutTimer(new QTimer)
@@ -130,6 +134,17 @@ AbortableRenderInfo::setAborted()
     if (abortedValue > 0) {
         return;
     }
+
+    // Wake-up the threads waiting for another render to produce an image, they check isAborted() when woken-up
+    ProductionSet productions;
+    {
+        QMutexLocker k(&_imp->threadsMutex);
+        productions = _imp->waitedProductions;
+    }
+    for (ProductionSet::const_iterator it = productions.begin(); it != productions.end(); ++it) {
+        (*it)->wakeWaiters();
+    }
+
     bool callInSeparateThread = false;
     {
         QMutexLocker k(&_imp->timerMutex);
@@ -153,6 +168,25 @@ AbortableRenderInfo::registerThreadForRender(AbortableThread* thread)
     _imp->threadsForThisRender.insert(thread);
 }
 
+void
+AbortableRenderInfo::addWaitedProduction(const CacheEntryProductionPtr& production)
+{
+    QMutexLocker k(&_imp->threadsMutex);
+
+    _imp->waitedProductions.insert(production);
+}
+
+void
+AbortableRenderInfo::removeWaitedProduction(const CacheEntryProductionPtr& production)
+{
+    QMutexLocker k(&_imp->threadsMutex);
+    ProductionSet::iterator found = _imp->waitedProductions.find(production);
+
+    if ( found != _imp->waitedProductions.end() ) {
+        _imp->waitedProductions.erase(found);
+    }
+}
+
 bool
 AbortableRenderInfo::unregisterThreadForRender(AbortableThread* thread)
 {
@@ -112,6 +112,14 @@ public:
      **/
     void setAborted();
 
+    /**
+     * @brief Registers a production of the cache that a thread of this render waits for, so that setAborted() wakes it up.
+     * The thread must check isAborted() after this call, before waiting, and call removeWaitedProduction() once done waiting.
+     **/
+    void addWaitedProduction(const CacheEntryProductionPtr& production);
+
+    void removeWaitedProduction(const CacheEntryProductionPtr& production);
+
     /**
      * @brief Get the render age. The render age identifies one single frame render in the Viewer. The older a render is, the smaller its render age is.
      * This is used in the Viewer keep and order on the render requests, even though each request runs concurrently of another.
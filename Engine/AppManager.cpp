@@ -105,6 +105,7 @@
 
 #include "Engine/AppInstance.h"
 #include "Engine/Backdrop.h"
+#include "Engine/BufferPool.h"
 #include "Engine/CLArgs.h"
 #include "Engine/DiskCacheNode.h"
 #include "Engine/Dot.h"
@@ -115,13 +116,15 @@
 #include "Engine/JoinViewsNode.h"
 #include "Engine/LibraryBinary.h"
 #include "Engine/Log.h"
-#include "Engine/MemoryInfo.h" // getSystemTotalRAM, printAsRAM
+#include "Engine/MemoryFile.h"
+#include "Engine/MemoryInfo.h" // getSystemTotalRAM, printAsRAM, getMajorPageFaultCount
 #include "Engine/Node.h"
 #include "Engine/OfxImageEffectInstance.h"
 #include "Engine/OfxEffectInstance.h"
 #include "Engine/OfxHost.h"
 #include "Engine/OSGLContext.h"
 #include "Engine/OneViewNode.h"
+#include "Engine/ParallelRenderArgs.h" // RenderPlan
 #include "Engine/ProcessHandler.h" // ProcessInputChannel
 #include "Engine/Project.h"
 #include "Engine/PrecompNode.h"
@@ -129,6 +132,7 @@
 #include "Engine/RotoPaint.h"
 #include "Engine/RotoSmear.h"
 #include "Engine/StandardPaths.h"
+#include "Engine/TaskScheduler.h"
 #include "Engine/TrackerNode.h"
 #include "Engine/ThreadPool.h"
 #include "Engine/Utils.h"
@@ -592,6 +596,7 @@ AppManager::~AppManager()
 
     ///Caches may have launched some threads to delete images, wait for them to be done
     QThreadPool::globalInstance()->waitForDone();
+    TaskScheduler::shutdown();
 
     ///Kill caches now because decreaseNCacheFilesOpened can be called
     _imp->_nodeCache->waitForDeleterThread();
@@ -1071,10 +1076,17 @@ AppManager::loadInternalAfterInitGui(const CLArgs& cl)
         U64 viewerCacheSize = _imp->_settings->getMaximumViewerDiskCacheSize();
         U64 maxDiskCacheNode = _imp->_settings->getMaximumDiskCacheNodeSize();
 
-        _imp->_nodeCache = boost::make_shared<Cache<Image> >("NodeCache", NATRON_CACHE_VERSION, maxCacheRAM, 1.);
-        _imp->_diskCache = boost::make_shared<Cache<Image> >("DiskCache", NATRON_CACHE_VERSION, maxDiskCacheNode, 0.);
-        _imp->_viewerCache = boost::make_shared<Cache<FrameEntry> >("ViewerCache", NATRON_CACHE_VERSION, viewerCacheSize, 0.);
+        // The NodeCache is looked-up by every render thread for every image: split it so that threads
+        // looking for unrelated images do not serialize on the same lock.
+        // The DiskCache and ViewerCache are accessed by much fewer threads and keep a single LRU.
+        unsigned int nodeCacheBuckets = (unsigned int)std::max(1, _imp->idealThreadCount) * NATRON_CACHE_BUCKETS_PER_THREAD;
+
+        _imp->_nodeCache = boost::make_shared<Cache<Image> >("NodeCache", NATRON_CACHE_VERSION, maxCacheRAM, 1., nodeCacheBuckets);
+        BufferPool::setMaximumPooledSize( (U64)(maxCacheRAM * NATRON_BUFFER_POOL_CACHE_FRACTION) );
+        _imp->_diskCache = boost::make_shared<Cache<Image> >("DiskCache", NATRON_CACHE_VERSION, maxDiskCacheNode, 0., 1);
+        _imp->_viewerCache = boost::make_shared<Cache<FrameEntry> >("ViewerCache", NATRON_CACHE_VERSION, viewerCacheSize, 0., 1);
         _imp->setViewerCacheTileSize();
+        setApplicationsCachesEvictionPolicy( _imp->_settings->getCacheEvictionPolicy() );
     } catch (std::logic_error&) {
         // ignore
     }
@@ -1434,6 +1446,7 @@ AppManager::wipeAndCreateDiskCacheStructure()
     _imp->cleanUpCacheDiskStructure( _imp->_diskCache->getCachePath(), false );
     assert(_imp->_viewerCache);
     _imp->cleanUpCacheDiskStructure( _imp->_viewerCache->getCachePath() , true);
+    _imp->resetCachesIndex();
 }
 
 AppInstancePtr
@@ -1496,6 +1509,7 @@ AppManager::setApplicationsCachesMaximumMemoryPercent(double p)
 
     _imp->_nodeCache->setMaximumCacheSize(maxCacheRAM);
     _imp->_nodeCache->setMaximumInMemorySize(1);
+    BufferPool::setMaximumPooledSize( (U64)(maxCacheRAM * NATRON_BUFFER_POOL_CACHE_FRACTION) );
 }
 
 void
@@ -1510,6 +1524,55 @@ AppManager::setApplicationsCachesMaximumDiskSpace(unsigned long long size)
     _imp->_diskCache->setMaximumCacheSize(size);
 }
 
+void
+AppManager::setApplicationsCachesEvictionPolicy(CacheEvictionPolicyEnum policy)
+{
+    // Only images record the time it took to render them, the viewer cache stays LRU
+    _imp->_nodeCache->setEvictionPolicy(policy);
+    _imp->_diskCache->setEvictionPolicy(policy);
+}
+
+void
+AppManager::getImageCachesStatistics(U64* nHits,
+                                     U64* nMisses,
+                                     double* recomputeTimeSaved) const
+{
+    _imp->_nodeCache->getStatistics(nHits, nMisses, recomputeTimeSaved);
+
+    U64 diskHits, diskMisses;
+    double diskTimeSaved;
+    _imp->_diskCache->getStatistics(&diskHits, &diskMisses, &diskTimeSaved);
+    *nHits += diskHits;
+    *nMisses += diskMisses;
+    *recomputeTimeSaved += diskTimeSaved;
+}
+
+void
+AppManager::getBufferPoolStatistics(U64* nHits,
+                                    U64* nMisses,
+                                    U64* pooledBytes,
+                                    double* fragmentation) const
+{
+    BufferPool::getStatistics(nHits, nMisses, pooledBytes, fragmentation);
+}
+
+void
+AppManager::getRenderPlanStatistics(U64* nBuilt,
+                                    U64* nReused,
+                                    double* buildTime) const
+{
+    RenderPlan::getStatistics(nBuilt, nReused, buildTime);
+}
+
+void
+AppManager::getDiskCacheReadStatistics(U64* nPrefetched,
+                                       U64* nPrefetchHits,
+                                       U64* nMajorPageFaults) const
+{
+    MemoryFile::getPrefetchStatistics(nPrefetched, nPrefetchHits);
+    *nMajorPageFaults = getMajorPageFaultCount();
+}
+
 void
 AppManager::loadAllPlugins()
 {
@@ -2525,6 +2588,32 @@ AppManager::getImage(const ImageKey & key,
     return _imp->_nodeCache->get(key, returnValue);
 }
 
+bool
+AppManager::getImage(const ImageKey & key,
+                     unsigned int mipMapLevel,
+                     const ImagePlaneDesc& plane,
+                     std::list<ImagePtr>* returnValue,
+                     CacheEntryProductionPtr* inFlight,
+                     bool countLookup) const
+{
+    return _imp->_nodeCache->get(key, returnValue, Image::getProductionVariant(mipMapLevel, plane), inFlight, countLookup);
+}
+
+CacheEntryProductionPtr
+AppManager::registerImageProduction(const ImageKey & key,
+                                    unsigned int mipMapLevel,
+                                    const ImagePlaneDesc& plane) const
+{
+    return _imp->_nodeCache->registerProduction( key, Image::getProductionVariant(mipMapLevel, plane) );
+}
+
+void
+AppManager::finishImageProduction(const ImageKey & key,
+                                  const CacheEntryProductionPtr& production) const
+{
+    _imp->_nodeCache->finishProduction(key, production);
+}
+
 bool
 AppManager::getImageOrCreate(const ImageKey & key,
                              const ImageParamsPtr& params,
@@ -2560,6 +2649,13 @@ AppManager::getTexture(const FrameKey & key,
     return ret;
 }
 
+bool
+AppManager::prefetchTexture(const FrameKey & key,
+                            bool forward) const
+{
+    return _imp->_viewerCache->prefetch(key, forward);
+}
+
 bool
 AppManager::getTextureOrCreate(const FrameKey & key,
                                const FrameParamsPtr& params,
@@ -2892,6 +2988,11 @@ AppManager::checkCacheFreeMemoryIsGoodEnough()
     size_t systemRAMToKeepFree = getSystemTotalRAM() * appPTR->getCurrentSettings()->getUnreachableRamPercent();
     size_t totalFreeRAM = getAmountFreePhysicalRAM();
 
+    if (totalFreeRAM <= systemRAMToKeepFree) {
+        // The free buffers of the pool go before any cached image
+        BufferPool::trim(0);
+        totalFreeRAM = getAmountFreePhysicalRAM();
+    }
     while (totalFreeRAM <= systemRAMToKeepFree) {
 #ifdef NATRON_DEBUG_CACHE
         qDebug() << "Total system free RAM is below the threshold:" << printAsRAM(totalFreeRAM)
@@ -200,6 +200,23 @@ public:
      **/
     bool getImage(const ImageKey & key, std::list<ImagePtr>* returnValue) const;
 
+    /**
+     * @brief Same as getImage, but if the image is not cached and another thread announced it is rendering it
+     * at the given mipmap level and plane, inFlight is set so that the caller can wait for it instead of rendering it again.
+     * The look-ups made after waiting for it should not be counted in the cache statistics: pass countLookup = false.
+     **/
+    bool getImage(const ImageKey & key, unsigned int mipMapLevel, const ImagePlaneDesc& plane, std::list<ImagePtr>* returnValue, CacheEntryProductionPtr* inFlight, bool countLookup = true) const;
+
+    /**
+     * @brief Announces that the calling thread is going to render the given plane of the image with the given key
+     * at the given mipmap level in the node cache.
+     * Returns NULL if another thread is already rendering it, otherwise finishImageProduction() must be called
+     * once the image is in the cache or if the render was aborted.
+     **/
+    CacheEntryProductionPtr registerImageProduction(const ImageKey & key, unsigned int mipMapLevel, const ImagePlaneDesc& plane) const WARN_UNUSED_RETURN;
+
+    void finishImageProduction(const ImageKey & key, const CacheEntryProductionPtr& production) const;
+
     /**
      * @brief Same as getImage, but if it couldn't find a matching image in the cache, it will create one with the given parameters.
      **/
@@ -218,6 +235,12 @@ public:
                             FrameEntryLocker* locker,
                             FrameEntryPtr* returnValue) const;
 
+    /**
+     * @brief Reads the texture from the disk in the background if it is only in the disk portion of the viewer cache,
+     * see Cache::prefetch()
+     **/
+    bool prefetchTexture(const FrameKey & key, bool forward) const;
+
 
     U64 getCachesTotalMemorySize() const;
     U64 getCachesTotalDiskSize() const;
@@ -229,6 +252,29 @@ public:
 
     void setApplicationsCachesMaximumDiskSpace(unsigned long long size);
 
+    void setApplicationsCachesEvictionPolicy(CacheEvictionPolicyEnum policy);
+
+    /**
+     * @brief Lookup statistics of the caches holding images rendered by nodes, see Cache::getStatistics()
+     **/
+    void getImageCachesStatistics(U64* nHits, U64* nMisses, double* recomputeTimeSaved) const;
+
+    /**
+     * @brief Lookup statistics of the pool of image and plug-in buffers, see BufferPool::getStatistics()
+     **/
+    void getBufferPoolStatistics(U64* nHits, U64* nMisses, U64* pooledBytes, double* fragmentation) const;
+
+    /**
+     * @brief Statistics of the render plans of the trees rendered by the applications, see RenderPlan::getStatistics()
+     **/
+    void getRenderPlanStatistics(U64* nBuilt, U64* nReused, double* buildTime) const;
+
+    /**
+     * @brief Statistics of the reads of the disk caches: the files prefetched and opened afterwards, see
+     * MemoryFile::getPrefetchStatistics(), and the page faults of the process that had to wait for the disk
+     **/
+    void getDiskCacheReadStatistics(U64* nPrefetched, U64* nPrefetchHits, U64* nMajorPageFaults) const;
+
     void removeFromNodeCache(const ImagePtr & image);
     void removeFromViewerCache(const FrameEntryPtr & texture);
 
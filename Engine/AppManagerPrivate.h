@@ -219,6 +219,8 @@ public:
 
     void restoreCaches();
 
+    void resetCachesIndex();
+
     static void addOpenGLRequirementsString(QString& str, OpenGLRequirementsTypeEnum type);
 
     bool checkForCacheDiskStructure(const QString & cachePath, bool isTiled);
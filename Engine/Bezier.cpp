@@ -1022,6 +1022,7 @@ Bezier::copyInternalPointsToGuiPoints()
     }
     _imp->guiIsClockwiseOriented = _imp->isClockwiseOriented;
     _imp->guiIsClockwiseOrientedStatic = _imp->isClockwiseOrientedStatic;
+    invalidateEvaluationCache();
 }
 
 bool
@@ -1039,6 +1040,7 @@ Bezier::clearAllPoints()
     _imp->featherPoints.clear();
     _imp->isClockwiseOriented.clear();
     _imp->finished = false;
+    invalidateEvaluationCache();
 }
 
 void
@@ -2358,6 +2360,9 @@ Bezier::setKeyframe(double time)
             return;
         }
 
+        // The new keyframe changes the interpolation of the shape between its neighbours
+        invalidateEvaluationCache();
+
 
         bool useFeather = useFeatherPoints();
         assert(_imp->points.size() == _imp->featherPoints.size() || !useFeather);
@@ -2630,6 +2635,171 @@ Bezier::evaluateAtTime_DeCasteljau(bool useGuiPoints,
                                          0, pointsSingleList, bbox);
 }
 
+static RectD
+getEmptyEvaluationBBox()
+{
+    return RectD( std::numeric_limits<double>::infinity(),
+                  std::numeric_limits<double>::infinity(),
+                  -std::numeric_limits<double>::infinity(),
+                  -std::numeric_limits<double>::infinity() );
+}
+
+// Outputs an evaluation as the evaluation functions do: the points are appended and the bbox is merged
+static void
+appendEvaluation(const std::list<std::list<ParametricPoint> >& evaluation,
+                 const RectD& evaluationBBox,
+                 std::list<std::list<ParametricPoint> >* points,
+                 std::list<ParametricPoint >* pointsSingleList,
+                 RectD* bbox)
+{
+    if (points) {
+        points->insert( points->end(), evaluation.begin(), evaluation.end() );
+    } else {
+        for (std::list<std::list<ParametricPoint> >::const_iterator it = evaluation.begin(); it != evaluation.end(); ++it) {
+            pointsSingleList->insert( pointsSingleList->end(), it->begin(), it->end() );
+        }
+    }
+    if (bbox) {
+        bbox->x1 = std::min(bbox->x1, evaluationBBox.x1);
+        bbox->x2 = std::max(bbox->x2, evaluationBBox.x2);
+        bbox->y1 = std::min(bbox->y1, evaluationBBox.y1);
+        bbox->y2 = std::max(bbox->y2, evaluationBBox.y2);
+    }
+}
+
+static bool
+isSameTransform(const Transform::Matrix3x3& a,
+                const Transform::Matrix3x3& b)
+{
+    return a.a == b.a && a.b == b.b && a.c == b.c &&
+           a.d == b.d && a.e == b.e && a.f == b.f &&
+           a.g == b.g && a.h == b.h && a.i == b.i;
+}
+
+BezierEvaluation*
+Bezier::findEvaluation(bool useGuiCurves,
+                       double time,
+                       unsigned int mipMapLevel,
+#ifdef ROTO_BEZIER_EVAL_ITERATIVE
+                       int nbPointsPerSegment,
+#else
+                       double errorScale,
+#endif
+                       const Transform::Matrix3x3& transform) const
+{
+    assert( !_imp->evaluationCacheMutex.tryLock() );
+    std::list<BezierEvaluation>& cache = _imp->evaluationCache;
+
+    for (std::list<BezierEvaluation>::iterator it = cache.begin(); it != cache.end(); ++it) {
+        if ( (it->useGuiCurves == useGuiCurves) && (it->time == time) && (it->mipMapLevel == mipMapLevel) &&
+#ifdef ROTO_BEZIER_EVAL_ITERATIVE
+             (it->nbPointsPerSegment == nbPointsPerSegment) &&
+#else
+             (it->errorScale == errorScale) &&
+#endif
+             isSameTransform(it->transform, transform) ) {
+            cache.splice(cache.begin(), cache, it);
+
+            return &cache.front();
+        }
+    }
+
+    if (cache.size() >= NATRON_BEZIER_EVALUATION_CACHE_SIZE) {
+        cache.pop_back();
+    }
+    cache.push_front( BezierEvaluation() );
+    BezierEvaluation& evaluation = cache.front();
+    evaluation.useGuiCurves = useGuiCurves;
+    evaluation.time = time;
+    evaluation.mipMapLevel = mipMapLevel;
+#ifdef ROTO_BEZIER_EVAL_ITERATIVE
+    evaluation.nbPointsPerSegment = nbPointsPerSegment;
+#else
+    evaluation.errorScale = errorScale;
+#endif
+    evaluation.transform = transform;
+
+    return &evaluation;
+}
+
+void
+Bezier::invalidateEvaluationCache() const
+{
+    QMutexLocker k(&_imp->evaluationCacheMutex);
+
+    ++_imp->evaluationCacheAge;
+    _imp->evaluationCache.clear();
+}
+
+void
+Bezier::incrementNodesAge()
+{
+    invalidateEvaluationCache();
+    RotoDrawableItem::incrementNodesAge();
+}
+
+RotoBezierTrianglesPtr
+Bezier::getCachedTriangles(double time,
+                           unsigned int mipMapLevel,
+#ifdef ROTO_BEZIER_EVAL_ITERATIVE
+                           int nbPointsPerSegment,
+#else
+                           double errorScale,
+#endif
+                           double featherDist,
+                           U64* age) const
+{
+    Transform::Matrix3x3 transform;
+
+    getTransformAtTime(time, &transform);
+
+    QMutexLocker k(&_imp->evaluationCacheMutex);
+    BezierEvaluation* evaluation = findEvaluation(false, time, mipMapLevel,
+#ifdef ROTO_BEZIER_EVAL_ITERATIVE
+                                                  nbPointsPerSegment,
+#else
+                                                  errorScale,
+#endif
+                                                  transform);
+    *age = _imp->evaluationCacheAge;
+    if ( evaluation->triangles && (evaluation->featherDist == featherDist) ) {
+        return evaluation->triangles;
+    }
+
+    return RotoBezierTrianglesPtr();
+}
+
+void
+Bezier::setCachedTriangles(double time,
+                           unsigned int mipMapLevel,
+#ifdef ROTO_BEZIER_EVAL_ITERATIVE
+                           int nbPointsPerSegment,
+#else
+                           double errorScale,
+#endif
+                           double featherDist,
+                           U64 age,
+                           const RotoBezierTrianglesPtr& triangles) const
+{
+    Transform::Matrix3x3 transform;
+
+    getTransformAtTime(time, &transform);
+
+    QMutexLocker k(&_imp->evaluationCacheMutex);
+    if (age != _imp->evaluationCacheAge) {
+        return;
+    }
+    BezierEvaluation* evaluation = findEvaluation(false, time, mipMapLevel,
+#ifdef ROTO_BEZIER_EVAL_ITERATIVE
+                                                  nbPointsPerSegment,
+#else
+                                                  errorScale,
+#endif
+                                                  transform);
+    evaluation->featherDist = featherDist;
+    evaluation->triangles = triangles;
+}
+
 void
 Bezier::evaluateAtTime_DeCasteljau_internal(bool useGuiCurves,
                                             double time,
@@ -2647,15 +2817,53 @@ Bezier::evaluateAtTime_DeCasteljau_internal(bool useGuiCurves,
     Transform::Matrix3x3 transform;
 
     getTransformAtTime(time, &transform);
-    QMutexLocker l(&itemMutex);
-    deCastelJau(isOpenBezier(), useGuiCurves, _imp->points, time, mipMapLevel, _imp->finished,
+
+    U64 age;
+    {
+        QMutexLocker k(&_imp->evaluationCacheMutex);
+        BezierEvaluation* evaluation = findEvaluation(useGuiCurves, time, mipMapLevel,
 #ifdef ROTO_BEZIER_EVAL_ITERATIVE
-                nbPointsPerSegment,
+                                                      nbPointsPerSegment,
 #else
-                errorScale,
+                                                      errorScale,
 #endif
-                transform, points, pointsSingleList, bbox);
-}
+                                                      transform);
+        if (evaluation->hasContour) {
+            appendEvaluation(evaluation->contour, evaluation->contourBBox, points, pointsSingleList, bbox);
+
+            return;
+        }
+        age = _imp->evaluationCacheAge;
+    }
+
+    std::list<std::list<ParametricPoint> > contour;
+    RectD contourBBox = getEmptyEvaluationBBox();
+    {
+        QMutexLocker l(&itemMutex);
+        deCastelJau(isOpenBezier(), useGuiCurves, _imp->points, time, mipMapLevel, _imp->finished,
+#ifdef ROTO_BEZIER_EVAL_ITERATIVE
+                    nbPointsPerSegment,
+#else
+                    errorScale,
+#endif
+                    transform, &contour, NULL, &contourBBox);
+    }
+    appendEvaluation(contour, contourBBox, points, pointsSingleList, bbox);
+
+    QMutexLocker k(&_imp->evaluationCacheMutex);
+    if (age == _imp->evaluationCacheAge) {
+        BezierEvaluation* evaluation = findEvaluation(useGuiCurves, time, mipMapLevel,
+#ifdef ROTO_BEZIER_EVAL_ITERATIVE
+                                                      nbPointsPerSegment,
+#else
+                                                      errorScale,
+#endif
+                                                      transform);
+        evaluation->hasContour = true;
+        evaluation->contour.swap(contour);
+        evaluation->contourBBox = contourBBox;
+    }
+} // Bezier::evaluateAtTime_DeCasteljau_internal
 
 void
 Bezier::evaluateAtTime_DeCasteljau_autoNbPoints(bool useGuiPoints,
@@ -2711,40 +2919,61 @@ Bezier::evaluateFeatherPointsAtTime_DeCasteljau_internal(bool useGuiPoints,
 {
     assert((points && !pointsSingleList) || (!points && pointsSingleList));
     assert( useFeatherPoints() );
-    QMutexLocker l(&itemMutex);
 
+    Transform::Matrix3x3 transform;
+    getTransformAtTime(time, &transform);
+
+    // Only the complete feather is cached
+    U64 age = 0;
+    if (evaluateIfEqual) {
+        QMutexLocker k(&_imp->evaluationCacheMutex);
+        BezierEvaluation* evaluation = findEvaluation(useGuiPoints, time, mipMapLevel,
+#ifdef ROTO_BEZIER_EVAL_ITERATIVE
+                                                      nbPointsPerSegment,
+#else
+                                                      errorScale,
+#endif
+                                                      transform);
+        if (evaluation->hasFeatherContour) {
+            appendEvaluation(evaluation->featherContour, evaluation->featherContourBBox, points, pointsSingleList, bbox);
 
-    if ( _imp->points.empty() ) {
-        return;
-    }
-    BezierCPs::const_iterator itCp = _imp->points.begin();
-    BezierCPs::const_iterator next = _imp->featherPoints.begin();
-    if ( next != _imp->featherPoints.end() ) {
-        ++next;
-    }
-    BezierCPs::const_iterator nextCp = itCp;
-    if ( nextCp != _imp->points.end() ) {
-        ++nextCp;
+            return;
+        }
+        age = _imp->evaluationCacheAge;
     }
 
-    Transform::Matrix3x3 transform;
-    getTransformAtTime(time, &transform);
+    std::list<std::list<ParametricPoint> > contour;
+    RectD contourBBox = getEmptyEvaluationBBox();
+    {
+        QMutexLocker l(&itemMutex);
 
-    for (BezierCPs::const_iterator it = _imp->featherPoints.begin(); it != _imp->featherPoints.end();
-         ++it) {
-        if ( next == _imp->featherPoints.end() ) {
-            next = _imp->featherPoints.begin();
+        if ( _imp->points.empty() ) {
+            return;
         }
-        if ( nextCp == _imp->points.end() ) {
-            if (!_imp->finished) {
-                break;
-            }
-            nextCp = _imp->points.begin();
+        BezierCPs::const_iterator itCp = _imp->points.begin();
+        BezierCPs::const_iterator next = _imp->featherPoints.begin();
+        if ( next != _imp->featherPoints.end() ) {
+            ++next;
         }
-        if ( !evaluateIfEqual && bezierSegmenEqual(useGuiPoints, time, ViewIdx(0), **itCp, **nextCp, **it, **next) ) {
-            continue;
+        BezierCPs::const_iterator nextCp = itCp;
+        if ( nextCp != _imp->points.end() ) {
+            ++nextCp;
         }
-        if (points) {
+
+        for (BezierCPs::const_iterator it = _imp->featherPoints.begin(); it != _imp->featherPoints.end();
+             ++it) {
+            if ( next == _imp->featherPoints.end() ) {
+                next = _imp->featherPoints.begin();
+            }
+            if ( nextCp == _imp->points.end() ) {
+                if (!_imp->finished) {
+                    break;
+                }
+                nextCp = _imp->points.begin();
+            }
+            if ( !evaluateIfEqual && bezierSegmenEqual(useGuiPoints, time, ViewIdx(0), **itCp, **nextCp, **it, **next) ) {
+                continue;
+            }
             std::list<ParametricPoint> segmentPoints;
             bezierSegmentEval(useGuiPoints, *(*it), *(*next), time, ViewIdx(0),  mipMapLevel,
 #ifdef ROTO_BEZIER_EVAL_ITERATIVE
@@ -2752,7 +2981,7 @@ Bezier::evaluateFeatherPointsAtTime_DeCasteljau_internal(bool useGuiPoints,
 #else
                               errorScale,
 #endif
-                              transform, &segmentPoints, bbox);
+                              transform, &segmentPoints, &contourBBox);
 
             // If we are a closed bezier or we are not on the last segment, remove the last point so we don't add duplicates
             if (!isOpenBezier() || next != _imp->featherPoints.end()) {
@@ -2760,37 +2989,38 @@ Bezier::evaluateFeatherPointsAtTime_DeCasteljau_internal(bool useGuiPoints,
                     segmentPoints.pop_back();
                 }
             }
-            points->push_back(segmentPoints);
-        } else {
-            assert(pointsSingleList);
-            bezierSegmentEval(useGuiPoints, *(*it), *(*next), time, ViewIdx(0),  mipMapLevel,
+            contour.push_back(segmentPoints);
+
+            // increment for next iteration
+            if ( itCp != _imp->featherPoints.end() ) {
+                ++itCp;
+            }
+            if ( next != _imp->featherPoints.end() ) {
+                ++next;
+            }
+            if ( nextCp != _imp->featherPoints.end() ) {
+                ++nextCp;
+            }
+        } // for(it)
+    }
+    appendEvaluation(contour, contourBBox, points, pointsSingleList, bbox);
+
+    if (evaluateIfEqual) {
+        QMutexLocker k(&_imp->evaluationCacheMutex);
+        if (age == _imp->evaluationCacheAge) {
+            BezierEvaluation* evaluation = findEvaluation(useGuiPoints, time, mipMapLevel,
 #ifdef ROTO_BEZIER_EVAL_ITERATIVE
-                              nbPointsPerSegment,
+                                                          nbPointsPerSegment,
 #else
-                              errorScale,
+                                                          errorScale,
 #endif
-                              transform, pointsSingleList, bbox);
-            // If we are a closed bezier or we are not on the last segment, remove the last point so we don't add duplicates
-            if (!isOpenBezier() || next != _imp->featherPoints.end()) {
-                if (!pointsSingleList->empty()) {
-                    pointsSingleList->pop_back();
-                }
-            }
-        }
-
-        // increment for next iteration
-        if ( itCp != _imp->featherPoints.end() ) {
-            ++itCp;
-        }
-        if ( next != _imp->featherPoints.end() ) {
-            ++next;
+                                                          transform);
+            evaluation->hasFeatherContour = true;
+            evaluation->featherContour.swap(contour);
+            evaluation->featherContourBBox = contourBBox;
         }
-        if ( nextCp != _imp->featherPoints.end() ) {
-            ++nextCp;
-        }
-    } // for(it)
-
-}
+    }
+} // Bezier::evaluateFeatherPointsAtTime_DeCasteljau_internal
 
 void
 Bezier::evaluateFeatherPointsAtTime_DeCasteljau(bool useGuiPoints,
@@ -3323,6 +3553,7 @@ Bezier::load(const RotoItemSerialization & obj)
     const BezierSerialization & s = dynamic_cast<const BezierSerialization &>(obj);
     {
         QMutexLocker l(&itemMutex);
+        invalidateEvaluationCache();
         _imp->isOpenBezier = s._isOpenBezier;
         _imp->finished = s._closed && !_imp->isOpenBezier;
 
@@ -3413,18 +3644,23 @@ void
 Bezier::setKeyFrameInterpolation(KeyframeTypeEnum interp,
                                  int index)
 {
-    QMutexLocker l(&itemMutex);
-    bool useFeather = useFeatherPoints();
-    BezierCPs::iterator fp = _imp->featherPoints.begin();
+    {
+        QMutexLocker l(&itemMutex);
+        bool useFeather = useFeatherPoints();
+        BezierCPs::iterator fp = _imp->featherPoints.begin();
 
-    for (BezierCPs::iterator it = _imp->points.begin(); it != _imp->points.end(); ++it) {
-        (*it)->setKeyFrameInterpolation(false, interp, index);
+        for (BezierCPs::iterator it = _imp->points.begin(); it != _imp->points.end(); ++it) {
+            (*it)->setKeyFrameInterpolation(false, interp, index);
 
-        if (useFeather) {
-            (*fp)->setKeyFrameInterpolation(false, interp, index);
-            ++fp;
+            if (useFeather) {
+                (*fp)->setKeyFrameInterpolation(false, interp, index);
+                ++fp;
+            }
         }
     }
+
+    // The shape changes between the keyframes
+    incrementNodesAge();
 }
 
 void
@@ -50,6 +50,10 @@ CLANG_DIAG_ON(deprecated-declarations)
 
 #define ROTO_BEZIER_EVAL_ITERATIVE
 
+// The number of entries of the evaluation cache of each Bezier: e.g. the renders at a few times and mipmap levels and the
+// drawing of the overlay
+#define NATRON_BEZIER_EVALUATION_CACHE_SIZE 8
+
 NATRON_NAMESPACE_ENTER
 
 
@@ -72,6 +76,7 @@ struct ParametricPoint
     double x,y,t;
 };
 
+struct BezierEvaluation;
 struct BezierPrivate;
 class Bezier
     : public RotoDrawableItem
@@ -596,8 +601,57 @@ public:
 
     bool dequeueGuiActions();
 
+    /**
+     * @brief Returns the triangles computed by RotoContextPrivate::computeTriangles() with the same arguments if they
+     * are in the evaluation cache of the Bezier, NULL otherwise. In the latter case, age receives the age of the cache,
+     * to pass to setCachedTriangles() with the triangles once they are computed.
+     **/
+    RotoBezierTrianglesPtr getCachedTriangles(double time,
+                                              unsigned int mipMapLevel,
+#ifdef ROTO_BEZIER_EVAL_ITERATIVE
+                                              int nbPointsPerSegment,
+#else
+                                              double errorScale,
+#endif
+                                              double featherDist,
+                                              U64* age) const;
+
+    /**
+     * @brief Inserts the triangles in the evaluation cache, unless the shape was edited since age was returned by
+     * getCachedTriangles().
+     **/
+    void setCachedTriangles(double time,
+                            unsigned int mipMapLevel,
+#ifdef ROTO_BEZIER_EVAL_ITERATIVE
+                            int nbPointsPerSegment,
+#else
+                            double errorScale,
+#endif
+                            double featherDist,
+                            U64 age,
+                            const RotoBezierTrianglesPtr& triangles) const;
+
+    virtual void incrementNodesAge() OVERRIDE FINAL;
+
 private:
 
+    /**
+     * @brief Returns the entry of the evaluation cache for the given arguments and moves it first. If there is none,
+     * it is created, and the least recently used entry is removed if the cache is full.
+     * evaluationCacheMutex must be locked.
+     **/
+    BezierEvaluation* findEvaluation(bool useGuiCurves,
+                                     double time,
+                                     unsigned int mipMapLevel,
+#ifdef ROTO_BEZIER_EVAL_ITERATIVE
+                                     int nbPointsPerSegment,
+#else
+                                     double errorScale,
+#endif
+                                     const Transform::Matrix3x3& transform) const;
+
+    void invalidateEvaluationCache() const;
+
     virtual void onTransformSet(double time) OVERRIDE FINAL;
 
     bool isFeatherPolygonClockwiseOrientedInternal(bool useGuiCurve, double time) const;
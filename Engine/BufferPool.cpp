@@ -0,0 +1,314 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * Copyright (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "BufferPool.h"
+
+#include <cstdlib>
+#include <map>
+#include <new>
+#include <utility>
+#include <vector>
+
+#if defined(__NATRON_LINUX__)
+#include <sys/mman.h>      // mmap, munmap, madvise.
+#endif
+
+#include <QtCore/QMutex>
+
+#include "Engine/NumaTopology.h"
+
+NATRON_NAMESPACE_ENTER
+
+// Smaller buffers are left to malloc, which handles them well
+#define NATRON_BUFFER_POOL_MIN_SIZE (64 * 1024)
+
+// Larger buffers are mapped separately on Linux, see allocateBlock()
+#define NATRON_BUFFER_POOL_HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+NATRON_NAMESPACE_ANONYMOUS_ENTER
+
+// A free buffer and the NUMA node of its pages, -1 if it was allocated by a thread that was not bound
+struct FreeBuffer
+{
+    void* ptr;
+    int node;
+
+    FreeBuffer(void* ptr,
+               int node)
+        : ptr(ptr)
+        , node(node)
+    {
+    }
+};
+
+struct BufferPoolPrivate
+{
+    // The free buffers of each size class, the most recently freed last: its pages are more likely to be resident
+    typedef std::map<std::size_t, std::vector<FreeBuffer> > FreeBuffersMap;
+
+    QMutex lock;
+    FreeBuffersMap freeBuffers;
+
+    // The NUMA node of the buffers in use that were allocated by a bound thread
+    std::map<void*, int> bufferNodes;
+    U64 maximumPooledBytes;
+    U64 pooledBytes;
+    U64 nHits;
+    U64 nMisses;
+
+    // Requested and allocated sizes of the pooled buffers in use
+    U64 requestedBytesInUse;
+    U64 allocatedBytesInUse;
+
+    BufferPoolPrivate()
+        : lock()
+        , freeBuffers()
+        , bufferNodes()
+        , maximumPooledBytes(0)
+        , pooledBytes(0)
+        , nHits(0)
+        , nMisses(0)
+        , requestedBytesInUse(0)
+        , allocatedBytesInUse(0)
+    {
+    }
+
+    static BufferPoolPrivate& instance()
+    {
+        // Never destroyed: buffers may still be released by the destructors of other static objects at exit
+        static BufferPoolPrivate* pool = new BufferPoolPrivate;
+
+        return *pool;
+    }
+};
+
+NATRON_NAMESPACE_ANONYMOUS_EXIT
+
+
+static void*
+allocateBlock(std::size_t size)
+{
+#if defined(__NATRON_LINUX__)
+    if (size >= NATRON_BUFFER_POOL_HUGE_PAGE_SIZE) {
+        void* ret = ::mmap(0, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (ret == MAP_FAILED) {
+            return 0;
+        }
+#ifdef MADV_HUGEPAGE
+        // only a hint: it fails if transparent huge pages are disabled
+        ::madvise(ret, size, MADV_HUGEPAGE);
+#endif
+
+        // The pages are placed when they are first written, possibly by another thread
+        NumaTopology::placeOnCurrentThreadNode(ret, size);
+
+        return ret;
+    }
+#endif
+
+    return std::malloc(size);
+}
+
+static void
+freeBlock(void* ptr,
+          std::size_t size)
+{
+#if defined(__NATRON_LINUX__)
+    if (size >= NATRON_BUFFER_POOL_HUGE_PAGE_SIZE) {
+        ::munmap(ptr, size);
+
+        return;
+    }
+#endif
+    std::free(ptr);
+}
+
+std::size_t
+BufferPool::getSizeClass(std::size_t nBytes)
+{
+    if (nBytes < NATRON_BUFFER_POOL_MIN_SIZE) {
+        return nBytes;
+    }
+
+    // Round up to a multiple of 1/8 of the largest power of 2 below nBytes
+    int highestBit = 0;
+    for (std::size_t n = nBytes - 1; n > 1; n >>= 1) {
+        ++highestBit;
+    }
+    std::size_t step = (std::size_t)1 << (highestBit - 3);
+
+    return (nBytes + step - 1) & ~(step - 1);
+}
+
+void*
+BufferPool::allocate(std::size_t nBytes)
+{
+    if (nBytes < NATRON_BUFFER_POOL_MIN_SIZE) {
+        void* ret = std::malloc(nBytes);
+        if (!ret) {
+            throw std::bad_alloc();
+        }
+
+        return ret;
+    }
+
+    BufferPoolPrivate& pool = BufferPoolPrivate::instance();
+    std::size_t size = getSizeClass(nBytes);
+    // A thread bound to a NUMA node only reuses the buffers of its node
+    int node = NumaTopology::getCurrentThreadNode();
+    {
+        QMutexLocker k(&pool.lock);
+        pool.requestedBytesInUse += nBytes;
+        pool.allocatedBytesInUse += size;
+        BufferPoolPrivate::FreeBuffersMap::iterator found = pool.freeBuffers.find(size);
+        if ( found != pool.freeBuffers.end() ) {
+            std::vector<FreeBuffer>& buffers = found->second;
+            for (int i = (int)buffers.size() - 1; i >= 0; --i) {
+                if ( (node >= 0) && (buffers[i].node != node) ) {
+                    continue;
+                }
+                void* ret = buffers[i].ptr;
+                if (buffers[i].node >= 0) {
+                    pool.bufferNodes[ret] = buffers[i].node;
+                }
+                buffers.erase(buffers.begin() + i);
+                pool.pooledBytes -= size;
+                ++pool.nHits;
+
+                return ret;
+            }
+        }
+        ++pool.nMisses;
+    }
+
+    void* ret = allocateBlock(size);
+    if (!ret) {
+        // The free buffers of other sizes may be what is missing
+        trim(0);
+        ret = allocateBlock(size);
+    }
+    if (!ret) {
+        QMutexLocker k(&pool.lock);
+        pool.requestedBytesInUse -= nBytes;
+        pool.allocatedBytesInUse -= size;
+        throw std::bad_alloc();
+    }
+    if (node >= 0) {
+        QMutexLocker k(&pool.lock);
+        pool.bufferNodes[ret] = node;
+    }
+
+    return ret;
+}
+
+void
+BufferPool::deallocate(void* ptr,
+                       std::size_t nBytes)
+{
+    if (!ptr) {
+        return;
+    }
+    if (nBytes < NATRON_BUFFER_POOL_MIN_SIZE) {
+        std::free(ptr);
+
+        return;
+    }
+
+    BufferPoolPrivate& pool = BufferPoolPrivate::instance();
+    std::size_t size = getSizeClass(nBytes);
+    {
+        QMutexLocker k(&pool.lock);
+        pool.requestedBytesInUse -= nBytes;
+        pool.allocatedBytesInUse -= size;
+        int node = -1;
+        if ( !pool.bufferNodes.empty() ) {
+            std::map<void*, int>::iterator found = pool.bufferNodes.find(ptr);
+            if ( found != pool.bufferNodes.end() ) {
+                node = found->second;
+                pool.bufferNodes.erase(found);
+            }
+        }
+        if (pool.pooledBytes + size <= pool.maximumPooledBytes) {
+            pool.freeBuffers[size].push_back( FreeBuffer(ptr, node) );
+            pool.pooledBytes += size;
+
+            return;
+        }
+    }
+    freeBlock(ptr, size);
+}
+
+void
+BufferPool::setMaximumPooledSize(U64 nBytes)
+{
+    BufferPoolPrivate& pool = BufferPoolPrivate::instance();
+
+    {
+        QMutexLocker k(&pool.lock);
+        pool.maximumPooledBytes = nBytes;
+    }
+    trim(nBytes);
+}
+
+void
+BufferPool::trim(U64 nBytes)
+{
+    BufferPoolPrivate& pool = BufferPoolPrivate::instance();
+    // The buffers are freed once the lock is released
+    std::vector<std::pair<void*, std::size_t> > toFree;
+    {
+        QMutexLocker k(&pool.lock);
+        BufferPoolPrivate::FreeBuffersMap::reverse_iterator it = pool.freeBuffers.rbegin();
+        while ( pool.pooledBytes > nBytes && it != pool.freeBuffers.rend() ) {
+            if ( it->second.empty() ) {
+                ++it;
+                continue;
+            }
+            // the least recently freed first
+            toFree.push_back( std::make_pair(it->second.front().ptr, it->first) );
+            it->second.erase( it->second.begin() );
+            pool.pooledBytes -= it->first;
+        }
+    }
+    for (std::size_t i = 0; i < toFree.size(); ++i) {
+        freeBlock(toFree[i].first, toFree[i].second);
+    }
+}
+
+void
+BufferPool::getStatistics(U64* nHits,
+                          U64* nMisses,
+                          U64* pooledBytes,
+                          double* fragmentation)
+{
+    BufferPoolPrivate& pool = BufferPoolPrivate::instance();
+    QMutexLocker k(&pool.lock);
+
+    *nHits = pool.nHits;
+    *nMisses = pool.nMisses;
+    *pooledBytes = pool.pooledBytes;
+    *fragmentation = pool.allocatedBytesInUse ? 1. - (double)pool.requestedBytesInUse / pool.allocatedBytesInUse : 0.;
+}
+
+NATRON_NAMESPACE_EXIT
@@ -0,0 +1,93 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * Copyright (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+#ifndef NATRON_ENGINE_BUFFERPOOL_H
+#define NATRON_ENGINE_BUFFERPOOL_H
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include <cstddef>
+
+#include "Global/GlobalDefines.h"
+
+//The free buffers kept by the pool take at most this fraction of the memory cache budget, which does not account for them
+#define NATRON_BUFFER_POOL_CACHE_FRACTION 0.125
+
+NATRON_NAMESPACE_ENTER
+
+/**
+ * @brief A process-wide pool of the large buffers allocated by RamBuffer, that is for the images and the memory
+ * of the plug-ins. The freed buffers are kept for the next allocation of the same size class instead of being
+ * returned to the system: this avoids the page faults of freshly allocated memory and the fragmentation of the heap
+ * caused by allocating and freeing images of several megabytes for each frame.
+ * The size classes are 8 per power of 2, so that a buffer is at most 12.5% larger than requested: the images
+ * of a given format always fall in the same class. On Linux, the buffers larger than a huge page are mapped
+ * separately and may be backed by transparent huge pages.
+ * The pool only keeps up to setMaximumPooledSize() bytes of free buffers, which the AppManager derives from the
+ * memory cache budget.
+ * In the NUMA mode, a thread bound to a node only reuses the free buffers of that node, see NumaTopology.
+ **/
+class BufferPool
+{
+    BufferPool();
+
+public:
+
+    /**
+     * @brief Returns a buffer of at least nBytes bytes. Throws std::bad_alloc on failure.
+     **/
+    static void* allocate(std::size_t nBytes);
+
+    /**
+     * @brief Gives back a buffer returned by allocate(nBytes): it is either kept in the pool or freed.
+     **/
+    static void deallocate(void* ptr, std::size_t nBytes);
+
+    /**
+     * @brief Returns the size of the buffer actually allocated for nBytes, or nBytes if it is too small to be pooled.
+     **/
+    static std::size_t getSizeClass(std::size_t nBytes);
+
+    /**
+     * @brief Sets the maximum size of the free buffers kept in the pool, and frees the ones above that size.
+     **/
+    static void setMaximumPooledSize(U64 nBytes);
+
+    /**
+     * @brief Frees the buffers of the pool until it holds at most nBytes bytes, starting with the largest ones.
+     **/
+    static void trim(U64 nBytes);
+
+    /**
+     * @brief Statistics of the pool since the start of the application.
+     * nHits and nMisses count the allocations of pooled sizes that did or did not reuse a buffer, pooledBytes
+     * is the size of the free buffers held by the pool and fragmentation is the fraction of the buffers in use
+     * that is allocated but was not requested.
+     **/
+    static void getStatistics(U64* nHits, U64* nMisses, U64* pooledBytes, double* fragmentation);
+};
+
+NATRON_NAMESPACE_EXIT
+
+#endif // NATRON_ENGINE_BUFFERPOOL_H
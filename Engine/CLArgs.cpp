@@ -338,7 +338,17 @@ CLArgs::printUsage(const std::string& programName)
         "     breakdown contains information about each nodes, render times etc...\n"
         "     This option is useful for debugging purposes or to control that a render\n"
         "     is working correctly.\n"
-        "     **Please note** that it does not work when writing video files."
+        "     **Please note** that it does not work when writing video files.\n"
+        "  --read-ahead <frames>\n"
+        "     Number of frames rendered ahead of the frame being encoded by the\n"
+        "     Write nodes that encode the frames in order (e.g. video files).\n"
+        "     0 renders the Write node and its input one frame after the other.\n"
+        "     This is a shortcut for --setting writerReadAhead=<frames>.\n"
+        "  --numa\n"
+        "     Binds each frame rendered in parallel, its threads and its images to\n"
+        "     one NUMA node of the machine. The nodes may be simulated by setting\n"
+        "     the NATRON_NUMA_NODES environment variable, e.g. to \"0-3;4-7\".\n"
+        "     This is a shortcut for --setting numaRendering=True.\n"
         "Sample uses:\n"
         "  %1 /Users/Me/MyNatronProjects/MyProject.ntp\n"
         "  %1 -b -w MyWriter /Users/Me/MyNatronProjects/MyProject.ntp\n"
@@ -1014,6 +1024,36 @@ CLArgsPrivate::parse()
         args.erase(it, next);
     } // for (;;)
 
+    {
+        QStringList::iterator it = hasToken( QString::fromUtf8("read-ahead"), QString() );
+        if ( it != args.end() ) {
+            QStringList::iterator next = it;
+            ++next;
+            bool ok = false;
+            int readAheadFrames = -1;
+            if ( next != args.end() ) {
+                readAheadFrames = next->toInt(&ok);
+            }
+            if ( !ok || (readAheadFrames < 0) ) {
+                std::cout << tr("You must specify a number of frames greater or equal to 0 when using the --read-ahead option").toStdString() << std::endl;
+                error = 1;
+
+                return;
+            }
+            settingCommands.push_back( "NatronEngine.natron.getSettings().getParam(\"writerReadAhead\").setValue(" + QString::number(readAheadFrames).toStdString() + ")" );
+            ++next;
+            args.erase(it, next);
+        }
+    }
+
+    {
+        QStringList::iterator it = hasToken( QString::fromUtf8("numa"), QString() );
+        if ( it != args.end() ) {
+            settingCommands.push_back("NatronEngine.natron.getSettings().getParam(\"numaRendering\").setValue(True)");
+            args.erase(it);
+        }
+    }
+
     //Parse python commands
     for (;; ) {
         QStringList::iterator it = hasToken( QString::fromUtf8("cmd"), QString::fromUtf8("c") );
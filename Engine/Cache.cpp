@@ -26,8 +26,120 @@
 
 #include <cassert>
 #include <stdexcept>
+#include <algorithm> // max
 
 NATRON_NAMESPACE_ENTER
+
+// Index of the least significant set bit of a non-zero word
+static inline int
+findFirstSet(U64 word)
+{
+    assert(word != 0);
+#if defined(__GNUC__)
+    return __builtin_ctzll(word);
+#else
+    int ret = 0;
+    while ( (word & 0xFF) == 0 ) {
+        word >>= 8;
+        ret += 8;
+    }
+    while ( (word & 1) == 0 ) {
+        word >>= 1;
+        ++ret;
+    }
+
+    return ret;
+#endif
+}
+
+TileCacheFile::TileCacheFile()
+    : file()
+    , _freeTiles()
+    , _nTiles(0)
+    , _nUsedTiles(0)
+{
+}
+
+void
+TileCacheFile::initTiles(std::size_t nTiles)
+{
+    _nTiles = nTiles;
+    _nUsedTiles = 0;
+    _freeTiles.clear();
+
+    // Build the levels bottom-up until a level fits in a single word. Bits past the last tile (or past the last word
+    // of the level below) stay cleared so that they are never returned by findFreeTile()
+    std::size_t nBits = nTiles;
+    do {
+        std::size_t nWords = std::max( (std::size_t)1, (nBits + 63) / 64 );
+        std::vector<U64> level(nWords, ~(U64)0);
+        if (nBits % 64) {
+            level.back() = ( (U64)1 << (nBits % 64) ) - 1;
+        } else if (nBits == 0) {
+            level.back() = 0;
+        }
+        _freeTiles.push_back(level);
+        nBits = nWords;
+    } while (nBits > 1);
+}
+
+bool
+TileCacheFile::isTileUsed(std::size_t index) const
+{
+    assert(index < _nTiles);
+
+    return ( _freeTiles[0][index / 64] & ( (U64)1 << (index % 64) ) ) == 0;
+}
+
+void
+TileCacheFile::setTileUsed(std::size_t index,
+                           bool used)
+{
+    assert(index < _nTiles);
+    if (isTileUsed(index) == used) {
+        return;
+    }
+    if (used) {
+        ++_nUsedTiles;
+        // Clear the bit and propagate to the upper levels as long as words become full
+        for (std::size_t l = 0; l < _freeTiles.size(); ++l) {
+            U64& word = _freeTiles[l][index / 64];
+            word &= ~( (U64)1 << (index % 64) );
+            if (word != 0) {
+                break;
+            }
+            index /= 64;
+        }
+    } else {
+        --_nUsedTiles;
+        // Set the bit and propagate to the upper levels as long as words were full
+        for (std::size_t l = 0; l < _freeTiles.size(); ++l) {
+            U64& word = _freeTiles[l][index / 64];
+            bool wasFull = word == 0;
+            word |= ( (U64)1 << (index % 64) );
+            if (!wasFull) {
+                break;
+            }
+            index /= 64;
+        }
+    }
+}
+
+int
+TileCacheFile::findFreeTile() const
+{
+    if ( _freeTiles.empty() || (_freeTiles.back()[0] == 0) ) {
+        return -1;
+    }
+    std::size_t index = 0;
+    for (int l = (int)_freeTiles.size() - 1; l >= 0; --l) {
+        index = index * 64 + findFirstSet(_freeTiles[l][index]);
+    }
+    assert(index < _nTiles);
+
+    return (int)index;
+}
+
 NATRON_NAMESPACE_EXIT
 
 NATRON_NAMESPACE_USING
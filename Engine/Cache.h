@@ -31,19 +31,23 @@
 #include <sstream> // stringstream
 #include <fstream>
 #include <functional>
+#include <iterator> // advance
 #include <list>
+#include <map>
 #include <set>
 #include <cstddef>
 #include <utility>
 #include <algorithm> // min, max
 #include <string>
 #include <stdexcept>
+#include <limits>
 
 #include "Global/GlobalDefines.h"
 #include "Global/StrUtils.h"
 
 GCC_DIAG_OFF(deprecated)
 #include <QtCore/QMutex>
+#include <QtCore/QAtomicInt>
 #include <QtCore/QThread>
 #include <QtCore/QWaitCondition>
 #include <QtCore/QMutexLocker>
@@ -54,13 +58,16 @@ GCC_DIAG_ON(deprecated)
 #if !defined(Q_MOC_RUN) && !defined(SBK_RUN)
 #include <boost/shared_ptr.hpp>
 #include <boost/make_shared.hpp>
+#include <boost/scoped_ptr.hpp>
 #endif
 
 #include "Engine/AppManager.h" //for access to settings
 #include "Engine/CacheEntry.h"
+#include "Engine/CacheIndexFile.h"
 #include "Engine/ImageLocker.h"
 #include "Engine/LRUHashTable.h"
 #include "Engine/MemoryInfo.h" // getSystemTotalRAM
+#include "Engine/NumaTopology.h"
 #include "Engine/Settings.h"
 #include "Engine/StandardPaths.h"
 
@@ -71,6 +78,15 @@ GCC_DIAG_ON(deprecated)
 
 #define NATRON_TILE_CACHE_FILE_SIZE_BYTES 2000000000
 
+// The unit of the memory size of the buckets read without their lock, in elements (see CacheBucket::memoryCacheSizeHint)
+#define NATRON_CACHE_BUCKET_SIZE_HINT_UNIT 1024
+
+//Number of buckets per hardware thread for caches that are hit by all render threads (see the Cache constructor)
+#define NATRON_CACHE_BUCKETS_PER_THREAD 4
+
+//Number of least recently used entries among which the GreedyDual-Size policy picks the entry to evict
+#define NATRON_CACHE_EVICTION_CANDIDATES 16
+
 ///When defined, number of opened files, memory size and disk size of the cache are printed whenever there's activity.
 //#define NATRON_DEBUG_CACHE
 
@@ -324,6 +340,88 @@ private:
 };
 
 
+/**
+ * @brief Announces that a thread is producing an entry that is not yet in the cache.
+ * The first thread that misses an entry registers itself as the producer (see Cache::registerProduction())
+ * and other threads missing the same entry get this object back from Cache::get() so they can wait
+ * for the producer instead of producing the same entry a second time.
+ * Once finished, the waiting threads should look-up the cache again: the producer may have given up
+ * (e.g: the render was aborted) in which case they have to produce the entry themselves.
+ * A waiting thread may also be woken-up with wakeWaiters() before the production is finished, e.g: when its own
+ * work is aborted.
+ **/
+class CacheEntryProduction
+{
+    mutable QMutex _lock;
+    mutable QWaitCondition _cond;
+    bool _finished;
+    int _wakeUps;
+
+public:
+
+    CacheEntryProduction()
+        : _lock()
+        , _cond()
+        , _finished(false)
+        , _wakeUps(0)
+    {
+    }
+
+    /**
+     * @brief The number of calls to wakeWaiters() so far, to pass to waitForProduction().
+     **/
+    int getWakeUps() const
+    {
+        QMutexLocker k(&_lock);
+
+        return _wakeUps;
+    }
+
+    /**
+     * @brief Blocks until the producer is done or wakeWaiters() is called. Returns true if the producer is done.
+     * wakeUps is the value of getWakeUps() read before the caller checked its own wake-up condition (e.g: whether
+     * it was aborted), so that a wakeWaiters() call made in-between is not missed.
+     **/
+    bool waitForProduction(int wakeUps) const
+    {
+        QMutexLocker k(&_lock);
+
+        while (!_finished && _wakeUps == wakeUps) {
+            _cond.wait(&_lock);
+        }
+
+        return _finished;
+    }
+
+    bool isFinished() const
+    {
+        QMutexLocker k(&_lock);
+
+        return _finished;
+    }
+
+    /**
+     * @brief Wakes-up the threads waiting on the production without finishing it: they check their wake-up condition
+     * and wait again if it does not apply to them.
+     **/
+    void wakeWaiters()
+    {
+        QMutexLocker k(&_lock);
+
+        ++_wakeUps;
+        _cond.wakeAll();
+    }
+
+    void finish()
+    {
+        QMutexLocker k(&_lock);
+
+        _finished = true;
+        _cond.wakeAll();
+    }
+};
+
+
 class CacheSignalEmitter
     : public QObject
 {
@@ -395,9 +493,12 @@ public:
     typedef boost::shared_ptr<param_t> ParamsTypePtr;
     typedef boost::shared_ptr<EntryType> EntryTypePtr;
 
-    struct SerializedEntry;
+    // Serialization of the key and params of an entry in the payload of a CacheIndexRecord, see CacheSerialization.h
+    typedef bool (*IndexPayloadEncoder)(const typename EntryType::key_type & key, const ParamsTypePtr & params, std::string* payload);
+    typedef bool (*IndexPayloadDecoder)(const char* payload, std::size_t payloadSize, typename EntryType::key_type* key, ParamsTypePtr* params);
 
-    typedef std::list<SerializedEntry> CacheTOC;
+    static bool encodeIndexPayload(const typename EntryType::key_type & key, const ParamsTypePtr & params, std::string* payload);
+    static bool decodeIndexPayload(const char* payload, std::size_t payloadSize, typename EntryType::key_type* key, ParamsTypePtr* params);
 
 public:
 
@@ -473,15 +574,128 @@ private:
      */
     mutable std::size_t _memoryCacheSize;     // current size of the cache in bytes
     mutable std::size_t _diskCacheSize;
-    mutable QMutex _sizeLock; // protects _memoryCacheSize & _diskCacheSize & _maximumInMemorySize & _maximumCacheSize
-    mutable QMutex _lock; //protects _memoryCache & _diskCache
-    mutable QMutex _getLock;  //prevents get() and getOrCreate() to be called simultaneously
+    CacheEvictionPolicyEnum _evictionPolicy;
+    mutable QMutex _sizeLock; // protects _memoryCacheSize & _diskCacheSize & _maximumInMemorySize & _maximumCacheSize & _evictionPolicy
+
+    /**
+     * @brief A partition of the cache. Entries are dispatched to a bucket according to their hash
+     * so that threads looking up unrelated entries do not contend on the same mutexes.
+     * A cache that is not sharded has a single bucket.
+     * The global budget (_memoryCacheSize, _diskCacheSize) is still enforced by the cache itself.
+     **/
+    struct CacheBucket
+    {
+        mutable QMutex lock; //protects memoryCache & diskCache & memoryCacheSize
+        mutable QMutex getLock;  //prevents get() and getOrCreate() to be called simultaneously for entries of this bucket
+
+        /*These 2 are mutable because we need to modify the LRU list even
+             when we call get() and we want this function to be const.*/
+        mutable CacheContainer memoryCache;
+        mutable CacheContainer diskCache;
+
+        // Size of the entries in memoryCache as advertised by their params.
+        // The real memory footprint is _memoryCacheSize
+        mutable std::size_t memoryCacheSize;
+
+        // memoryCacheSize in units of NATRON_CACHE_BUCKET_SIZE_HINT_UNIT elements, rounded up, and the number of
+        // hashes of diskCache. They are read without the lock to pick the buckets to evict from, see updateSizeHints()
+        mutable QAtomicInt memoryCacheSizeHint;
+        mutable QAtomicInt diskCacheSizeHint;
+
+        // Priority of the last entry evicted with the GreedyDual-Size policy: entries accessed since then
+        // have a priority greater than this, so that entries that are not accessed anymore are eventually evicted
+        mutable double evictionInflation;
+
+        // Statistics of the lookups in this bucket
+        mutable U64 nHits, nMisses;
+        mutable double recomputeTimeSaved; // sum of the recompute cost of the entries found, in seconds
 
+        // Records of the index (see restore()) of this bucket that were not looked-up yet: they are turned into
+        // entries of the disk portion the first time their hash is looked-up.
+        mutable std::multimap<hash_type, U32> pendingIndexRecords;
 
-    /*These 2 are mutable because we need to modify the LRU list even
-         when we call get() and we want this function to be const.*/
-    mutable CacheContainer _memoryCache;
-    mutable CacheContainer _diskCache;
+        // The same records, least recently used first, used to evict them. Records that were looked-up since are skipped.
+        mutable std::list<U32> pendingIndexRecordsByAge;
+
+        // Entries of this bucket that are not in the cache yet but that a thread announced it is producing.
+        // There may be several keys with the same hash, they are told apart with operator==. Entries that share
+        // a key (e.g: the mipmap levels and planes of an image) are told apart by the variant of the production.
+        struct InFlightProduction
+        {
+            typename EntryType::key_type key;
+            U64 variant;
+            CacheEntryProductionPtr production;
+        };
+
+        typedef std::list<InFlightProduction> ProductionList;
+        mutable std::map<hash_type, ProductionList> inFlight;
+
+        CacheBucket()
+            : lock()
+            , getLock()
+            , memoryCache()
+            , diskCache()
+            , memoryCacheSize(0)
+            , memoryCacheSizeHint(0)
+            , diskCacheSizeHint(0)
+            , evictionInflation(0.)
+            , nHits(0)
+            , nMisses(0)
+            , recomputeTimeSaved(0.)
+            , pendingIndexRecords()
+            , pendingIndexRecordsByAge()
+            , inFlight()
+        {
+        }
+
+        CacheEntryProductionPtr findProduction(const typename EntryType::key_type & key,
+                                               U64 variant) const
+        {
+            typename std::map<hash_type, ProductionList>::const_iterator found = inFlight.find( key.getHash() );
+
+            if ( found != inFlight.end() ) {
+                for (typename ProductionList::const_iterator it = found->second.begin(); it != found->second.end(); ++it) {
+                    if ( (it->variant == variant) && (it->key == key) ) {
+                        return it->production;
+                    }
+                }
+            }
+
+            return CacheEntryProductionPtr();
+        }
+
+        void addMemoryEntrySize(const EntryTypePtr& entry) const
+        {
+            memoryCacheSize += entry->getElementsCountFromParams();
+            updateSizeHints();
+        }
+
+        void removeMemoryEntrySize(const EntryTypePtr& entry) const
+        {
+            std::size_t size = entry->getElementsCountFromParams();
+
+            memoryCacheSize = size > memoryCacheSize ? 0 : memoryCacheSize - size;
+            updateSizeHints();
+        }
+
+        /**
+         * @brief Publishes the sizes of the bucket to the threads that do not hold its lock.
+         * Must be called with the lock held, after memoryCacheSize or diskCache changed.
+         **/
+        void updateSizeHints() const
+        {
+            const std::size_t maxHint = (std::size_t)std::numeric_limits<int>::max();
+            std::size_t memoryHint = (memoryCacheSize + NATRON_CACHE_BUCKET_SIZE_HINT_UNIT - 1) / NATRON_CACHE_BUCKET_SIZE_HINT_UNIT;
+
+            memoryCacheSizeHint.fetchAndStoreRelaxed( (int)std::min(memoryHint, maxHint) );
+            diskCacheSizeHint.fetchAndStoreRelaxed( (int)std::min( (std::size_t)diskCache.size(), maxHint ) );
+        }
+    };
+
+    typedef boost::shared_ptr<CacheBucket> CacheBucketPtr;
+
+    // Never empty, the bucket count is fixed at construction
+    std::vector<CacheBucketPtr> _buckets;
     const std::string _cacheName;
     const unsigned int _version;
 
@@ -508,27 +722,41 @@ private:
     // Used when the cache is tiled
     std::set<TileCacheFilePtr> _cacheFiles;
 
-    // When set these are used for fast search of a free tile
-    TileCacheFileWPtr _nextAvailableCacheFile;
-    int _nextAvailableCacheFileIndex;
+    // Subset of _cacheFiles that have at least one free tile, so that allocTile() never visits full files
+    std::set<TileCacheFilePtr> _cacheFilesWithFreeTiles;
+
+    // Binary index of the disk portion of the cache, opened by restore() and synced by save()
+    mutable QMutex _indexLock; // protects _index & _indexRecordOfEntry. Never take a bucket lock, _tileCacheMutex or _sizeLock while holding it
+    boost::scoped_ptr<CacheIndexFile> _index;
+
+    // The record of the entries that were restored from the index or written to it by save()
+    mutable std::map<const EntryType*, U32> _indexRecordOfEntry;
+
+    // Incremented by markIndexDirty(): save() only marks the index clean if nothing changed while it was syncing it
+    mutable U64 _indexGeneration;
+    IndexPayloadEncoder _indexPayloadEncoder;
+    IndexPayloadDecoder _indexPayloadDecoder;
 public:
 
 
+    /**
+     * @param nBuckets The number of partitions of the cache. Each partition has its own locks and LRU list so that
+     * threads accessing unrelated entries do not serialize. A value of 1 gives a single global LRU.
+     **/
     Cache(const std::string & cacheName,
           unsigned int version,
           U64 maximumCacheSize,      // total size
-          double maximumInMemoryPercentage //how much should live in RAM
+          double maximumInMemoryPercentage, //how much should live in RAM
+          unsigned int nBuckets = 1
           )
         : CacheAPI()
         , _maximumInMemorySize(maximumCacheSize * maximumInMemoryPercentage)
         , _maximumCacheSize(maximumCacheSize)
         , _memoryCacheSize(0)
         , _diskCacheSize(0)
+        , _evictionPolicy(eCacheEvictionPolicyLRU)
         , _sizeLock()
-        , _lock()
-        , _getLock()
-        , _memoryCache()
-        , _diskCache()
+        , _buckets()
         , _cacheName(cacheName)
         , _version(version)
         , _signalEmitter()
@@ -542,19 +770,38 @@ public:
         , _tileByteSize(0)
         , _clearingCache(false)
         , _cacheFiles()
-        , _nextAvailableCacheFile()
-        , _nextAvailableCacheFileIndex(-1)
+        , _cacheFilesWithFreeTiles()
+        , _indexLock()
+        , _index()
+        , _indexRecordOfEntry()
+        , _indexGeneration(0)
+        , _indexPayloadEncoder(0)
+        , _indexPayloadDecoder(0)
     {
         _signalEmitter = boost::make_shared<CacheSignalEmitter>();
+        _buckets.resize( std::max(1u, nBuckets) );
+        for (std::size_t i = 0; i < _buckets.size(); ++i) {
+            _buckets[i] = boost::make_shared<CacheBucket>();
+        }
     }
 
     virtual ~Cache()
     {
-        QMutexLocker locker(&_lock);
-
         _tearingDown = true;
-        _memoryCache.clear();
-        _diskCache.clear();
+        for (std::size_t i = 0; i < _buckets.size(); ++i) {
+            QMutexLocker locker(&_buckets[i]->lock);
+            _buckets[i]->memoryCache.clear();
+            _buckets[i]->diskCache.clear();
+            _buckets[i]->memoryCacheSize = 0;
+        }
+    }
+
+    /**
+     * @brief Returns the number of partitions of the cache, see the constructor.
+     **/
+    std::size_t getNumberOfBuckets() const
+    {
+        return _buckets.size();
     }
 
     virtual bool isTileCache() const OVERRIDE FINAL
@@ -602,17 +849,442 @@ public:
     bool get(const typename EntryType::key_type & key,
              std::list<EntryTypePtr>* returnValue) const
     {
+        const CacheBucket& bucket = getBucket( key.getHash() );
         ///Be atomic, so it cannot be created by another thread in the meantime
-        QMutexLocker getlocker(&_getLock);
+        QMutexLocker getlocker(&bucket.getLock);
 
         ///lock the cache before reading it.
-        QMutexLocker locker(&_lock);
+        QMutexLocker locker(&bucket.lock);
 
-        return getInternal(key, returnValue);
+        return getInternal(bucket, key, returnValue);
     } // get
 
+    /**
+     * @brief Same as get(key, returnValue) except that if no entry could be found but another thread announced
+     * with registerProduction() that it is producing the given variant of it, inFlight is set to the production so
+     * that the caller may wait for it instead of producing the same entry again. It is left untouched otherwise.
+     * If countLookup is false, the look-up is not accounted in the hits and misses of the cache statistics: this is
+     * for the look-ups of a caller that already counted a miss and waited for the production of the entry.
+     **/
+    bool get(const typename EntryType::key_type & key,
+             std::list<EntryTypePtr>* returnValue,
+             U64 variant,
+             CacheEntryProductionPtr* inFlight,
+             bool countLookup = true) const
+    {
+        const CacheBucket& bucket = getBucket( key.getHash() );
+        ///Be atomic, so it cannot be created by another thread in the meantime
+        QMutexLocker getlocker(&bucket.getLock);
+
+        ///lock the cache before reading it.
+        QMutexLocker locker(&bucket.lock);
+
+        if ( getInternal(bucket, key, returnValue, countLookup) ) {
+            return true;
+        }
+        CacheEntryProductionPtr production = bucket.findProduction(key, variant);
+        if (production) {
+            *inFlight = production;
+        }
+
+        return false;
+    }
+
+    /**
+     * @brief If the entries matching the key are only in the disk portion of the cache, asks the system to read their
+     * files in the background, without mapping them or counting a lookup: a get() of the key shortly after does not
+     * wait for the disk. This is meant for the entries that are likely to be looked up next, e.g. the next frames
+     * of a playback, forward being true if it plays forward. Returns true if a file was prefetched.
+     **/
+    bool prefetch(const typename EntryType::key_type & key,
+                  bool forward) const
+    {
+        if (_isTiled) {
+            return false;
+        }
+
+        std::list<std::string> filePaths;
+        {
+            const CacheBucket& bucket = getBucket( key.getHash() );
+            QMutexLocker locker(&bucket.lock);
+
+            if ( !bucket.pendingIndexRecords.empty() ) {
+                restorePendingIndexEntries( bucket, key.getHash() );
+            }
+            if ( bucket.memoryCache( key.getHash() ) != bucket.memoryCache.end() ) {
+                return false;
+            }
+            CacheIterator diskCached = bucket.diskCache( key.getHash() );
+            if ( diskCached == bucket.diskCache.end() ) {
+                return false;
+            }
+            std::list<EntryTypePtr> & entries = getValueFromIterator(diskCached);
+            for (typename std::list<EntryTypePtr>::const_iterator it = entries.begin(); it != entries.end(); ++it) {
+                if ( (*it)->getKey() == key ) {
+                    filePaths.push_back( (*it)->getFilePath() );
+                }
+            }
+        }
+
+        bool ret = false;
+        for (std::list<std::string>::const_iterator it = filePaths.begin(); it != filePaths.end(); ++it) {
+            if ( !it->empty() && MemoryFile::prefetchFile(*it, forward) ) {
+                ret = true;
+            }
+        }
+
+        return ret;
+    }
+
+    /**
+     * @brief Announces that the calling thread is going to produce the entry with the given key, so that other
+     * threads looking it up with get() wait for it rather than producing it too.
+     * The variant tells apart the entries sharing the key that the caller produces (e.g: the mipmap level and the
+     * plane of an image): a thread looking up another variant does not wait for this production.
+     * @returns NULL if another thread is already producing this variant of the entry. Otherwise the caller is the
+     * producer and must call finishProduction() with the returned object once the entry is in the cache or if it
+     * gave up producing it, otherwise threads waiting on it would only be released by their own abort.
+     **/
+    CacheEntryProductionPtr registerProduction(const typename EntryType::key_type & key,
+                                               U64 variant) const
+    {
+        const CacheBucket& bucket = getBucket( key.getHash() );
+        QMutexLocker locker(&bucket.lock);
+
+        if ( bucket.findProduction(key, variant) ) {
+            return CacheEntryProductionPtr();
+        }
+        typename CacheBucket::InFlightProduction production;
+        production.key = key;
+        production.variant = variant;
+        production.production = boost::make_shared<CacheEntryProduction>();
+        bucket.inFlight[key.getHash()].push_back(production);
+
+        return production.production;
+    }
+
+    /**
+     * @brief Removes a production registered with registerProduction() and wakes-up the threads waiting on it.
+     **/
+    void finishProduction(const typename EntryType::key_type & key,
+                          const CacheEntryProductionPtr& production) const
+    {
+        if (!production) {
+            return;
+        }
+        {
+            const CacheBucket& bucket = getBucket( key.getHash() );
+            QMutexLocker locker(&bucket.lock);
+            typename std::map<hash_type, typename CacheBucket::ProductionList>::iterator found = bucket.inFlight.find( key.getHash() );
+            if ( found != bucket.inFlight.end() ) {
+                for (typename CacheBucket::ProductionList::iterator it = found->second.begin(); it != found->second.end(); ++it) {
+                    if (it->production == production) {
+                        found->second.erase(it);
+                        break;
+                    }
+                }
+                if ( found->second.empty() ) {
+                    bucket.inFlight.erase(found);
+                }
+            }
+        }
+        production->finish();
+    }
+
 private:
 
+    const CacheBucket& getBucket(hash_type hash) const
+    {
+        if (_buckets.size() == 1) {
+            return *_buckets.front();
+        }
+        // Fold the high bits into the low bits so that entries are spread evenly whatever the number of buckets
+        U64 h = (U64)hash;
+
+        return *_buckets[(std::size_t)( ( h ^ (h >> 32) ) % _buckets.size() )];
+    }
+
+    /**
+     * @brief Evicts an entry of the in-memory portion of the cache, from callerBucket first: the bucket of the entry
+     * the caller is adding, if any. If it has nothing left to evict, the other buckets are visited, the ones holding
+     * the most memory first. Their sizes are read without locking them, so that threads evicting from their own
+     * bucket do not serialize.
+     * If callerBucketLocked, the caller holds the lock of callerBucket and the other buckets are only visited if
+     * their lock is free: waiting for it could deadlock with a thread doing the same from that bucket. Otherwise,
+     * the caller must not hold any bucket lock.
+     **/
+    bool tryEvictInMemoryEntryFromAnyBucket(const CacheBucket* callerBucket,
+                                            bool callerBucketLocked,
+                                            std::list<EntryTypePtr> & entriesToBeDeleted) const
+    {
+        if (callerBucket) {
+            if (callerBucketLocked) {
+                if ( tryEvictInMemoryEntry(*callerBucket, entriesToBeDeleted) ) {
+                    return true;
+                }
+            } else {
+                QMutexLocker locker(&callerBucket->lock);
+                if ( tryEvictInMemoryEntry(*callerBucket, entriesToBeDeleted) ) {
+                    return true;
+                }
+            }
+        }
+
+        std::vector<std::pair<int, std::size_t> > bucketsBySize;
+        for (std::size_t i = 0; i < _buckets.size(); ++i) {
+            int size = (int)_buckets[i]->memoryCacheSizeHint;
+            if ( (size > 0) && (_buckets[i].get() != callerBucket) ) {
+                bucketsBySize.push_back( std::make_pair(size, i) );
+            }
+        }
+        std::sort( bucketsBySize.begin(), bucketsBySize.end(), std::greater<std::pair<int, std::size_t> >() );
+        for (std::size_t i = 0; i < bucketsBySize.size(); ++i) {
+            const CacheBucket& bucket = *_buckets[bucketsBySize[i].second];
+            if (callerBucketLocked) {
+                if ( !bucket.lock.tryLock() ) {
+                    continue;
+                }
+                bool evicted = tryEvictInMemoryEntry(bucket, entriesToBeDeleted);
+                bucket.lock.unlock();
+                if (evicted) {
+                    return true;
+                }
+            } else {
+                QMutexLocker locker(&bucket.lock);
+                if ( tryEvictInMemoryEntry(bucket, entriesToBeDeleted) ) {
+                    return true;
+                }
+            }
+        }
+
+        return false;
+    }
+
+    /**
+     * @brief Same as tryEvictInMemoryEntryFromAnyBucket() but for the disk portion: the other buckets are visited
+     * if callerBucket has nothing left to evict, the ones with the most entries first.
+     * The caller must not hold any bucket lock.
+     **/
+    bool tryEvictDiskEntryFromAnyBucket(const CacheBucket* callerBucket,
+                                        std::list<EntryTypePtr> & entriesToBeDeleted) const
+    {
+        if (callerBucket) {
+            QMutexLocker locker(&callerBucket->lock);
+            if ( tryEvictDiskEntry(*callerBucket, entriesToBeDeleted) ) {
+                return true;
+            }
+        }
+
+        std::vector<std::pair<int, std::size_t> > bucketsBySize;
+        for (std::size_t i = 0; i < _buckets.size(); ++i) {
+            int size = (int)_buckets[i]->diskCacheSizeHint;
+            if ( (size > 0) && (_buckets[i].get() != callerBucket) ) {
+                bucketsBySize.push_back( std::make_pair(size, i) );
+            }
+        }
+        std::sort( bucketsBySize.begin(), bucketsBySize.end(), std::greater<std::pair<int, std::size_t> >() );
+        for (std::size_t i = 0; i < bucketsBySize.size(); ++i) {
+            const CacheBucket& bucket = *_buckets[bucketsBySize[i].second];
+            QMutexLocker locker(&bucket.lock);
+            if ( tryEvictDiskEntry(bucket, entriesToBeDeleted) ) {
+                return true;
+            }
+        }
+
+        // Everything that was looked-up is in use: evict an entry of the index that was never looked-up
+        return tryEvictPendingIndexEntry(entriesToBeDeleted);
+    }
+
+    /**
+     * @brief Evicts the least recently used record of the index that was not looked-up since the cache was restored.
+     * The caller must not hold any bucket lock.
+     **/
+    bool tryEvictPendingIndexEntry(std::list<EntryTypePtr> & entriesToBeDeleted) const
+    {
+        for (std::size_t i = 0; i < _buckets.size(); ++i) {
+            const CacheBucket& bucket = *_buckets[i];
+            QMutexLocker locker(&bucket.lock);
+            while ( !bucket.pendingIndexRecordsByAge.empty() ) {
+                U32 recordIndex = bucket.pendingIndexRecordsByAge.front();
+                bucket.pendingIndexRecordsByAge.pop_front();
+                if ( !removePendingIndexRecord(bucket, recordIndex) ) {
+                    // Already looked-up
+                    continue;
+                }
+                EntryTypePtr entry = restoreEntryFromIndex(recordIndex);
+                if (entry) {
+                    if (!_isTiled) {
+                        entry->removeAnyBackingFile();
+                    }
+                    entriesToBeDeleted.push_back(entry);
+                }
+
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    /**
+     * @brief Removes the given record from the pending records of the bucket. Returns false if it was not pending.
+     **/
+    bool removePendingIndexRecord(const CacheBucket& bucket,
+                                  U32 recordIndex) const
+    {
+        assert( !bucket.lock.tryLock() );
+        hash_type hash;
+        {
+            QMutexLocker k(&_indexLock);
+            if ( !_index || ( recordIndex >= _index->getNumRecords() ) ) {
+                return false;
+            }
+            hash = _index->getRecord(recordIndex).hash;
+        }
+        std::pair<typename std::multimap<hash_type, U32>::iterator, typename std::multimap<hash_type, U32>::iterator> range = bucket.pendingIndexRecords.equal_range(hash);
+        for (typename std::multimap<hash_type, U32>::iterator it = range.first; it != range.second; ++it) {
+            if (it->second == recordIndex) {
+                bucket.pendingIndexRecords.erase(it);
+
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    /**
+     * @brief Moves the pending records of the index with the given hash to the disk portion of the bucket.
+     **/
+    void restorePendingIndexEntries(const CacheBucket& bucket,
+                                    hash_type hash) const
+    {
+        assert( !bucket.lock.tryLock() );
+        std::pair<typename std::multimap<hash_type, U32>::iterator, typename std::multimap<hash_type, U32>::iterator> range = bucket.pendingIndexRecords.equal_range(hash);
+        if (range.first == range.second) {
+            return;
+        }
+        std::vector<U32> records;
+        for (typename std::multimap<hash_type, U32>::iterator it = range.first; it != range.second; ++it) {
+            records.push_back(it->second);
+        }
+        bucket.pendingIndexRecords.erase(range.first, range.second);
+
+        for (std::size_t i = 0; i < records.size(); ++i) {
+            EntryTypePtr entry = restoreEntryFromIndex(records[i]);
+            if (entry) {
+                sealEntry(bucket, entry, false);
+            }
+        }
+    }
+
+    std::string getIndexRecordFilePath(const CacheIndexRecord& record) const
+    {
+        QString path = getCachePath();
+        StrUtils::ensureLastPathSeparator(path);
+        path.append( QString::fromUtf8(record.fileName) );
+
+        return path.toStdString();
+    }
+
+    /**
+     * @brief Creates the entry described by a record of the index. The key and params are decoded and checked only now.
+     * If the entry cannot be restored, the record is removed from the index and NULL is returned.
+     * The caller must have removed the record from the pending records of its bucket.
+     **/
+    EntryTypePtr restoreEntryFromIndex(U32 recordIndex) const
+    {
+        CacheIndexRecord record;
+        std::string payload;
+        {
+            QMutexLocker k(&_indexLock);
+            if ( !_index || ( recordIndex >= _index->getNumRecords() ) ) {
+                return EntryTypePtr();
+            }
+            record = _index->getRecord(recordIndex);
+            if (record.flags & CacheIndexRecord::eFlagRemoved) {
+                return EntryTypePtr();
+            }
+            const char* data = _index->getPayload(record);
+            if (data) {
+                payload.assign(data, record.payloadSize);
+            }
+        }
+
+        // The size of pending records is accounted in the disk portion by restore(), the entry accounts for itself once restored
+        {
+            QMutexLocker k(&_sizeLock);
+            _diskCacheSize = record.size > _diskCacheSize ? 0 : _diskCacheSize - record.size;
+        }
+
+        std::string filePath = getIndexRecordFilePath(record);
+        typename EntryType::key_type key;
+        ParamsTypePtr params;
+        EntryType* value = NULL;
+        if ( !payload.empty() && _indexPayloadDecoder && _indexPayloadDecoder(payload.data(), payload.size(), &key, &params) &&
+             params && ( key.getHash() == record.hash ) ) {
+            try {
+                value = new EntryType(key, params, this);
+                ///This will not put the entry back into RAM, instead we just insert back the entry into the disk cache
+                value->restoreMetadataFromFile(record.size, filePath, record.dataOffsetInFile);
+            } catch (const std::exception & e) {
+                qDebug() << e.what();
+                delete value;
+                value = NULL;
+            }
+        }
+
+        if (!value) {
+            qDebug() << "WARNING: could not restore cache entry from" << filePath.c_str();
+            {
+                QMutexLocker k(&_indexLock);
+                _index->removeRecord(recordIndex);
+            }
+            if (_isTiled) {
+                // Release the tile reserved by restore()
+                TileCacheFilePtr tileFile;
+                {
+                    QMutexLocker k(&_tileCacheMutex);
+                    for (std::set<TileCacheFilePtr>::const_iterator it = _cacheFiles.begin(); it != _cacheFiles.end(); ++it) {
+                        if ( (*it)->file->path() == filePath ) {
+                            tileFile = *it;
+                            break;
+                        }
+                    }
+                }
+                if (tileFile) {
+                    const_cast<Cache<EntryType>*>(this)->freeTile(tileFile, record.dataOffsetInFile);
+                }
+            } else {
+                QFile::remove( QString::fromUtf8( filePath.c_str() ) );
+            }
+
+            return EntryTypePtr();
+        }
+
+        {
+            QMutexLocker k(&_indexLock);
+            _indexRecordOfEntry[value] = recordIndex;
+            _index->setLRUStamp( recordIndex, _index->tickLRUClock() );
+        }
+
+        return EntryTypePtr(value);
+    } // restoreEntryFromIndex
+
+    /**
+     * @brief Called whenever the content of the cache changes: the index no longer matches the disk portion until the next save().
+     * The caller must not hold _sizeLock.
+     **/
+    void markIndexDirty() const
+    {
+        QMutexLocker k(&_indexLock);
+
+        ++_indexGeneration;
+        if ( _index && _index->isClean() ) {
+            _index->setClean(false);
+        }
+    }
+
 
 
     virtual TileCacheFilePtr getTileCacheFile(const std::string& filepath, std::size_t dataOffset) OVERRIDE FINAL WARN_UNUSED_RETURN
@@ -628,8 +1300,11 @@ private:
 
                 // The dataOffset should be a multiple of the tile size
                 assert(_tileByteSize * index == dataOffset);
-                assert(!(*it)->usedTiles[index]);
-                (*it)->usedTiles[index] = true;
+                // The tile is already marked used if it was reserved when opening the index, see restore()
+                (*it)->setTileUsed(index, true);
+                if ( (*it)->isFull() ) {
+                    _cacheFilesWithFreeTiles.erase(*it);
+                }
                 return *it;
             }
         }
@@ -639,15 +1314,17 @@ private:
             TileCacheFilePtr ret = boost::make_shared<TileCacheFile>();
             ret->file = boost::make_shared<MemoryFile>(filepath, MemoryFile::eFileOpenModeEnumIfExistsKeepElseFail);
             std::size_t nTilesPerFile = std::floor( ( (double)NATRON_TILE_CACHE_FILE_SIZE_BYTES ) / _tileByteSize );
-            ret->usedTiles.resize(nTilesPerFile, false);
+            ret->initTiles(nTilesPerFile);
             int index = dataOffset / _tileByteSize;
 
             // The dataOffset should be a multiple of the tile size
             assert(_tileByteSize * index == dataOffset);
-            assert(index >= 0 && index < (int)ret->usedTiles.size());
-            assert(!ret->usedTiles[index]);
-            ret->usedTiles[index] = true;
+            assert( index >= 0 && index < (int)ret->getNumTiles() );
+            ret->setTileUsed(index, true);
             _cacheFiles.insert(ret);
+            if ( !ret->isFull() ) {
+                _cacheFilesWithFreeTiles.insert(ret);
+            }
             return ret;
 
         }
@@ -671,36 +1348,15 @@ private:
         if (!_isTiled) {
             throw std::logic_error("allocTile() but cache is not tiled!");
         }
-        // First, search for a file with available space.
-        // If not found create one
+        // First, take a file with available space.
+        // If there is none create one
         TileCacheFilePtr foundAvailableFile;
         int foundTileIndex = -1;
-        {
-            foundAvailableFile = _nextAvailableCacheFile.lock();
-            if (_nextAvailableCacheFileIndex != -1 && foundAvailableFile) {
-                foundTileIndex = _nextAvailableCacheFileIndex;
-                *dataOffset = foundTileIndex * _tileByteSize;
-                _nextAvailableCacheFileIndex = -1;
-                _nextAvailableCacheFile.reset();
-            } else {
-                foundTileIndex = -1;
-                foundAvailableFile.reset();
-            }
-        }
-        if (foundTileIndex == -1) {
-            for (std::set<TileCacheFilePtr>::iterator it = _cacheFiles.begin(); it != _cacheFiles.end(); ++it) {
-                for (std::size_t i = 0; i < (*it)->usedTiles.size(); ++i) {
-                    if (!(*it)->usedTiles[i])  {
-                        foundTileIndex = i;
-                        *dataOffset = i * _tileByteSize;
-                        break;
-                    }
-                }
-                if (foundTileIndex != -1) {
-                    foundAvailableFile = *it;
-                    break;
-                }
-            }
+        if ( !_cacheFilesWithFreeTiles.empty() ) {
+            foundAvailableFile = *_cacheFilesWithFreeTiles.begin();
+            foundTileIndex = foundAvailableFile->findFreeTile();
+            assert(foundTileIndex != -1);
+            *dataOffset = foundTileIndex * _tileByteSize;
         }
 
         if (!foundAvailableFile) {
@@ -715,16 +1371,18 @@ private:
             std::size_t nTilesPerFile = std::floor(((double)NATRON_TILE_CACHE_FILE_SIZE_BYTES) / _tileByteSize);
             std::size_t cacheFileSize = nTilesPerFile * _tileByteSize;
             foundAvailableFile->file->resize(cacheFileSize);
-            foundAvailableFile->usedTiles.resize(nTilesPerFile, false);
+            foundAvailableFile->initTiles(nTilesPerFile);
             *dataOffset = 0;
             foundTileIndex = 0;
             _cacheFiles.insert(foundAvailableFile);
-            _nextAvailableCacheFile = foundAvailableFile;
-            _nextAvailableCacheFileIndex = 1;
+            _cacheFilesWithFreeTiles.insert(foundAvailableFile);
         }
 
         // Notify the memory file that this portion of the file is valid
-        foundAvailableFile->usedTiles[foundTileIndex] = true;
+        foundAvailableFile->setTileUsed(foundTileIndex, true);
+        if ( foundAvailableFile->isFull() ) {
+            _cacheFilesWithFreeTiles.erase(foundAvailableFile);
+        }
         return foundAvailableFile;
     }
 
@@ -748,35 +1406,33 @@ private:
 
         // The dataOffset should be a multiple of the tile size
         assert(_tileByteSize * index == dataOffset);
-        assert(index >= 0 && index < (int)(*foundTileFile)->usedTiles.size());
-        assert((*foundTileFile)->usedTiles[index]);
-        (*foundTileFile)->usedTiles[index] = false;
-
-        // If the file does not have any tile associated, remove it
-        // A use_count of 2 means that the tile file is only referenced by the cache itself and the entry calling
-        // the freeTile() function, hence once its freed, no tile should be using it anymore
-        if ((*foundTileFile).use_count() <= 2) {
+        assert( index >= 0 && index < (int)(*foundTileFile)->getNumTiles() );
+        assert( (*foundTileFile)->isTileUsed(index) );
+        (*foundTileFile)->setTileUsed(index, false);
+        _cacheFilesWithFreeTiles.insert(*foundTileFile);
+
+        // If the file does not have any tile allocated anymore, remove it
+        if ( (*foundTileFile)->getNumUsedTiles() == 0 ) {
             // Do not remove the file except if we are clearing the cache
             if (_clearingCache) {
                 (*foundTileFile)->file->remove();
+                _cacheFilesWithFreeTiles.erase(*foundTileFile);
                 _cacheFiles.erase(foundTileFile);
             } else {
                 // Invalidate this portion of the cache
                 (*foundTileFile)->file->flush(MemoryFile::eFlushTypeInvalidate, (*foundTileFile)->file->data() + dataOffset, _tileByteSize);
             }
-        } else {
-            _nextAvailableCacheFile = *foundTileFile;
-            _nextAvailableCacheFileIndex = index;
         }
     }
 
 
-    void createInternal(const typename EntryType::key_type & key,
+    void createInternal(const CacheBucket& bucket,
+                        const typename EntryType::key_type & key,
                         const ParamsTypePtr & params,
                         ImageLockerHelper<EntryType>* entryLocker,
                         EntryTypePtr* returnValue) const
     {
-        //_lock must not be taken here
+        //bucket.lock must not be taken here
 
         ///Before allocating the memory check that there's enough space to fit in memory
         appPTR->checkCacheFreeMemoryIsGoodEnough();
@@ -802,14 +1458,13 @@ private:
             maximumInMemorySize = std::max( (std::size_t)1, _maximumInMemorySize );
         }
         {
-            QMutexLocker locker(&_lock);
             std::list<EntryTypePtr> entriesToBeDeleted;
             double occupationPercentage = (double)memoryCacheSize / maximumInMemorySize;
             ///While the current cache size can't fit the new entry, erase the last recently used entries.
             ///Also if the total free RAM is under the limit of the system free RAM to keep free, erase LRU entries.
             while (occupationPercentage > NATRON_CACHE_LIMIT_PERCENT) {
                 std::list<EntryTypePtr> deleted;
-                if ( !tryEvictInMemoryEntry(deleted) ) {
+                if ( !tryEvictInMemoryEntryFromAnyBucket(&bucket, false, deleted) ) {
                     break;
                 }
 
@@ -844,7 +1499,6 @@ private:
         }
         if (_isTiled) {
 
-            QMutexLocker locker(&_lock);
             // For tiled caches, we insert directly into the disk cache, so make sure there is room for it
             std::list<EntryTypePtr> entriesToBeDeleted;
             U64 diskCacheSize, maximumDiskCacheSize;
@@ -856,7 +1510,7 @@ private:
             double diskPercentage = (double)diskCacheSize / maximumDiskCacheSize;
             while (diskPercentage >= NATRON_CACHE_LIMIT_PERCENT) {
                 std::list<EntryTypePtr> deleted;
-                if ( !tryEvictDiskEntry(deleted) ) {
+                if ( !tryEvictDiskEntryFromAnyBucket(&bucket, deleted) ) {
                     break;
                 }
 
@@ -877,7 +1531,7 @@ private:
 
         }
         {
-            QMutexLocker locker(&_lock);
+            QMutexLocker locker(&bucket.lock);
 
             try {
                 returnValue->reset( new EntryType(key, params, this ) );
@@ -896,7 +1550,7 @@ private:
                 if (entryLocker) {
                     entryLocker->lock(*returnValue);
                 }
-                sealEntry(*returnValue, _isTiled ? false : true);
+                sealEntry(bucket, *returnValue, _isTiled ? false : true);
             }
         }
     } // createInternal
@@ -906,16 +1560,18 @@ public:
     void swapOrInsert(const EntryTypePtr& entryToBeEvicted,
                       const EntryTypePtr& newEntry)
     {
-        QMutexLocker locker(&_lock);
+        typename EntryType::hash_type hash = entryToBeEvicted->getHashKey();
+        const CacheBucket& bucket = getBucket(hash);
+        QMutexLocker locker(&bucket.lock);
 
         const typename EntryType::key_type& key = entryToBeEvicted->getKey();
-        typename EntryType::hash_type hash = entryToBeEvicted->getHashKey();
         ///find a matching value in the internal memory container
-        CacheIterator memoryCached = _memoryCache(hash);
-        if ( memoryCached != _memoryCache.end() ) {
+        CacheIterator memoryCached = bucket.memoryCache(hash);
+        if ( memoryCached != bucket.memoryCache.end() ) {
             std::list<EntryTypePtr> & ret = getValueFromIterator(memoryCached);
             for (typename std::list<EntryTypePtr>::iterator it = ret.begin(); it != ret.end(); ++it) {
                 if ( ( (*it)->getKey() == key ) && ( (*it)->getParams() == entryToBeEvicted->getParams() ) ) {
+                    bucket.removeMemoryEntrySize(*it);
                     ret.erase(it);
                     break;
                 }
@@ -924,8 +1580,8 @@ public:
             ret.push_back(newEntry);
         } else {
             ///Look in disk cache
-            CacheIterator diskCached = _diskCache(hash);
-            if ( diskCached != _diskCache.end() ) {
+            CacheIterator diskCached = bucket.diskCache(hash);
+            if ( diskCached != bucket.diskCache.end() ) {
                 ///Remove the old entry
                 std::list<EntryTypePtr> & ret = getValueFromIterator(diskCached);
                 for (typename std::list<EntryTypePtr>::iterator it = ret.begin(); it != ret.end(); ++it) {
@@ -936,8 +1592,9 @@ public:
                 }
             }
             ///Insert in mem cache
-            _memoryCache.insert(hash, newEntry);
+            bucket.memoryCache.insert(hash, newEntry);
         }
+        bucket.addMemoryEntrySize(newEntry);
     }
 
     /**
@@ -976,13 +1633,14 @@ public:
         ///so that the memory freeing (which might be expensive for large images) doesn't happen while under the lock
 
         {
+            const CacheBucket& bucket = getBucket( key.getHash() );
             ///Be atomic, so it cannot be created by another thread in the meantime
-            QMutexLocker getlocker(&_getLock);
+            QMutexLocker getlocker(&bucket.getLock);
             std::list<EntryTypePtr> entries;
             bool didGetSucceed;
             {
-                QMutexLocker locker(&_lock);
-                didGetSucceed = getInternal(key, &entries);
+                QMutexLocker locker(&bucket.lock);
+                didGetSucceed = getInternal(bucket, key, &entries);
             }
             if (didGetSucceed) {
                 for (typename std::list<EntryTypePtr>::iterator it = entries.begin(); it != entries.end(); ++it) {
@@ -994,7 +1652,7 @@ public:
                 }
             }
 
-            createInternal(key, params, locker, returnValue);
+            createInternal(bucket, key, params, locker, returnValue);
 
             return false;
         } // getlocker
@@ -1016,13 +1674,17 @@ public:
             ///block signals otherwise the we would be spammed of notifications
             _signalEmitter->blockSignals(true);
         }
-        QMutexLocker locker(&_lock);
-        std::pair<hash_type, EntryTypePtr> evictedFromMemory = _memoryCache.evict();
-        while (evictedFromMemory.second) {
-            if ( !_isTiled && evictedFromMemory.second->isStoredOnDisk() ) {
-                evictedFromMemory.second->removeAnyBackingFile();
+        for (std::size_t i = 0; i < _buckets.size(); ++i) {
+            const CacheBucket& bucket = *_buckets[i];
+            QMutexLocker locker(&bucket.lock);
+            std::pair<hash_type, EntryTypePtr> evictedFromMemory = bucket.memoryCache.evict();
+            while (evictedFromMemory.second) {
+                if ( !_isTiled && evictedFromMemory.second->isStoredOnDisk() ) {
+                    evictedFromMemory.second->removeAnyBackingFile();
+                }
+                bucket.removeMemoryEntrySize(evictedFromMemory.second);
+                evictedFromMemory = bucket.memoryCache.evict();
             }
-            evictedFromMemory = _memoryCache.evict();
         }
 
         if (_signalEmitter) {
@@ -1046,19 +1708,37 @@ public:
             ///block signals otherwise the we would be spammed of notifications
             _signalEmitter->blockSignals(true);
         }
-        QMutexLocker locker(&_lock);
+        for (std::size_t i = 0; i < _buckets.size(); ++i) {
+            const CacheBucket& bucket = *_buckets[i];
+            QMutexLocker locker(&bucket.lock);
+
+            /// An entry which has a use_count greater than 1 is not removable:
+            /// The backing file must not be removed because it might be read/written to
+            /// at the same time. The best we can do is just let it here in the cache.
+            std::pair<hash_type, EntryTypePtr> evictedFromDisk = bucket.diskCache.evict();
+            //if the cache couldn't evict that means all entries are used somewhere and we shall not remove them!
+            //we'll let the user of these entries purge the extra entries left in the cache later on
+            while (evictedFromDisk.second) {
+                if (!_isTiled) {
+                    evictedFromDisk.second->removeAnyBackingFile();
+                }
+                evictedFromDisk = bucket.diskCache.evict();
+            }
 
-        /// An entry which has a use_count greater than 1 is not removable:
-        /// The backing file must not be removed because it might be read/written to
-        /// at the same time. The best we can do is just let it here in the cache.
-        std::pair<hash_type, EntryTypePtr> evictedFromDisk = _diskCache.evict();
-        //if the cache couldn't evict that means all entries are used somewhere and we shall not remove them!
-        //we'll let the user of these entries purge the extra entries left in the cache later on
-        while (evictedFromDisk.second) {
-            if (!_isTiled) {
-                evictedFromDisk.second->removeAnyBackingFile();
+            // Entries of the index that were never looked-up are not used by anyone
+            std::list<EntryTypePtr> pendingEntries;
+            for (typename std::multimap<hash_type, U32>::iterator it = bucket.pendingIndexRecords.begin(); it != bucket.pendingIndexRecords.end(); ++it) {
+                EntryTypePtr entry = restoreEntryFromIndex(it->second);
+                if (entry) {
+                    if (!_isTiled) {
+                        entry->removeAnyBackingFile();
+                    }
+                    pendingEntries.push_back(entry);
+                }
             }
-            evictedFromDisk = _diskCache.evict();
+            bucket.pendingIndexRecords.clear();
+            bucket.pendingIndexRecordsByAge.clear();
+            bucket.updateSizeHints();
         }
 
 
@@ -1075,51 +1755,56 @@ public:
             ///block signals otherwise the we would be spammed of notifications
             _signalEmitter->blockSignals(true);
         }
-        QMutexLocker locker(&_lock);
-        std::pair<hash_type, EntryTypePtr> evictedFromMemory = _memoryCache.evict();
-        while (evictedFromMemory.second) {
-            // Move back the entry on disk if it can be store on disk
-            // For tiled caches, the tile is sharing the same file with other entries
-            // so we cannot close it, just remove the entry
-            if ( evictedFromMemory.second->isStoredOnDisk() && !_isTiled) {
-                evictedFromMemory.second->deallocate();
-                /*insert it back into the disk portion */
-
-                U64 diskCacheSize, maximumCacheSize;
-                {
-                    QMutexLocker k(&_sizeLock);
-                    diskCacheSize = _diskCacheSize;
-                    maximumCacheSize = _maximumCacheSize;
-                }
-
-                /*before that we need to clear the disk cache if it exceeds the maximum size allowed*/
-                while (diskCacheSize + evictedFromMemory.second->size() >= maximumCacheSize) {
-                    {
-                        std::pair<hash_type, EntryTypePtr> evictedFromDisk = _diskCache.evict();
-                        //if the cache couldn't evict that means all entries are used somewhere and we shall not remove them!
-                        //we'll let the user of these entries purge the extra entries left in the cache later on
-                        if (!evictedFromDisk.second) {
-                            break;
-                        }
-                        ///Erase the file from the disk if we reach the limit.
-                        evictedFromDisk.second->removeAnyBackingFile();
-                    }
+        for (std::size_t i = 0; i < _buckets.size(); ++i) {
+            const CacheBucket& bucket = *_buckets[i];
+            QMutexLocker locker(&bucket.lock);
+            std::pair<hash_type, EntryTypePtr> evictedFromMemory = bucket.memoryCache.evict();
+            while (evictedFromMemory.second) {
+                bucket.removeMemoryEntrySize(evictedFromMemory.second);
+                // Move back the entry on disk if it can be store on disk
+                // For tiled caches, the tile is sharing the same file with other entries
+                // so we cannot close it, just remove the entry
+                if ( evictedFromMemory.second->isStoredOnDisk() && !_isTiled) {
+                    evictedFromMemory.second->deallocate();
+                    /*insert it back into the disk portion */
+
+                    U64 diskCacheSize, maximumCacheSize;
                     {
                         QMutexLocker k(&_sizeLock);
                         diskCacheSize = _diskCacheSize;
                         maximumCacheSize = _maximumCacheSize;
                     }
-                }
 
-                /*update the disk cache size*/
-                CacheIterator existingDiskCacheEntry = _diskCache( evictedFromMemory.second->getHashKey() );
-                /*if the entry doesn't exist on the disk cache,make a new list and insert it*/
-                if ( existingDiskCacheEntry == _diskCache.end() ) {
-                    _diskCache.insert(evictedFromMemory.second->getHashKey(), evictedFromMemory.second);
+                    /*before that we need to clear the disk cache if it exceeds the maximum size allowed*/
+                    while (diskCacheSize + evictedFromMemory.second->size() >= maximumCacheSize) {
+                        {
+                            std::pair<hash_type, EntryTypePtr> evictedFromDisk = evictFromContainer(bucket, bucket.diskCache);
+                            //if the cache couldn't evict that means all entries are used somewhere and we shall not remove them!
+                            //we'll let the user of these entries purge the extra entries left in the cache later on
+                            if (!evictedFromDisk.second) {
+                                break;
+                            }
+                            ///Erase the file from the disk if we reach the limit.
+                            evictedFromDisk.second->removeAnyBackingFile();
+                        }
+                        {
+                            QMutexLocker k(&_sizeLock);
+                            diskCacheSize = _diskCacheSize;
+                            maximumCacheSize = _maximumCacheSize;
+                        }
+                    }
+
+                    /*update the disk cache size*/
+                    CacheIterator existingDiskCacheEntry = bucket.diskCache( evictedFromMemory.second->getHashKey() );
+                    /*if the entry doesn't exist on the disk cache,make a new list and insert it*/
+                    if ( existingDiskCacheEntry == bucket.diskCache.end() ) {
+                        bucket.diskCache.insert(evictedFromMemory.second->getHashKey(), evictedFromMemory.second);
+                    }
                 }
-            }
 
-            evictedFromMemory = _memoryCache.evict();
+                evictedFromMemory = bucket.memoryCache.evict();
+            }
+            bucket.updateSizeHints();
         }
 
         _signalEmitter->blockSignals(false);
@@ -1135,7 +1820,6 @@ public:
         std::list<EntryTypePtr> entriesToBeDeleted;
 
         {
-            QMutexLocker locker(&_lock);
             U64 memoryCacheSize, maximumInMemorySize;
             {
                 QMutexLocker k(&_sizeLock);
@@ -1145,7 +1829,7 @@ public:
             double occupationPercentage = (double)memoryCacheSize / maximumInMemorySize;
             while (occupationPercentage >= NATRON_CACHE_LIMIT_PERCENT) {
                 std::list<EntryTypePtr> deleted;
-                if ( !tryEvictInMemoryEntry(deleted) ) {
+                if ( !tryEvictInMemoryEntryFromAnyBucket(NULL, false, deleted) ) {
                     break;
                 }
 
@@ -1167,7 +1851,7 @@ public:
             double diskPercentage = (double)diskCacheSize / maximumDiskCacheSize;
             while (diskPercentage >= NATRON_CACHE_LIMIT_PERCENT) {
                 std::list<EntryTypePtr> deleted;
-                if ( !tryEvictDiskEntry(deleted) ) {
+                if ( !tryEvictDiskEntryFromAnyBucket(NULL, deleted) ) {
                     break;
                 }
 
@@ -1177,8 +1861,6 @@ public:
                 }
                 diskPercentage = (double)diskCacheSize / maximumDiskCacheSize;
             }
-            
-
         }
     }
 
@@ -1189,15 +1871,18 @@ public:
      **/
     void getCopy(std::list<EntryTypePtr>* copy) const
     {
-        QMutexLocker locker(&_lock);
+        for (std::size_t i = 0; i < _buckets.size(); ++i) {
+            const CacheBucket& bucket = *_buckets[i];
+            QMutexLocker locker(&bucket.lock);
 
-        for (CacheIterator it = _memoryCache.begin(); it != _memoryCache.end(); ++it) {
-            const std::list<EntryTypePtr> & entries = getValueFromIterator(it);
-            copy->insert( copy->end(), entries.begin(), entries.end() );
-        }
-        for (CacheIterator it = _diskCache.begin(); it != _diskCache.end(); ++it) {
-            const std::list<EntryTypePtr> & entries = getValueFromIterator(it);
-            copy->insert( copy->end(), entries.begin(), entries.end() );
+            for (CacheIterator it = bucket.memoryCache.begin(); it != bucket.memoryCache.end(); ++it) {
+                const std::list<EntryTypePtr> & entries = getValueFromIterator(it);
+                copy->insert( copy->end(), entries.begin(), entries.end() );
+            }
+            for (CacheIterator it = bucket.diskCache.begin(); it != bucket.diskCache.end(); ++it) {
+                const std::list<EntryTypePtr> & entries = getValueFromIterator(it);
+                copy->insert( copy->end(), entries.begin(), entries.end() );
+            }
         }
     }
 
@@ -1211,11 +1896,7 @@ public:
         ///Make sure the shared_ptrs live in this list and are destroyed not while under the lock
         ///so that the memory freeing (which might be expensive for large images) doesn't happen while under the lock
         std::list<EntryTypePtr> entriesToBeDeleted;
-        bool ret;
-        {
-            QMutexLocker locker(&_lock);
-            ret = tryEvictInMemoryEntry(entriesToBeDeleted);
-        }
+        bool ret = tryEvictInMemoryEntryFromAnyBucket(NULL, false, entriesToBeDeleted);
 
         return ret;
     }
@@ -1227,10 +1908,8 @@ public:
      **/
     bool evictLRUDiskEntry() const
     {
-
-        QMutexLocker locker(&_lock);
         std::list<EntryTypePtr> entriesToBeDeleted;
-        return tryEvictDiskEntry(entriesToBeDeleted);
+        return tryEvictDiskEntryFromAnyBucket(NULL, entriesToBeDeleted);
     }
 
     /**
@@ -1268,6 +1947,9 @@ public:
     {
         ///The entry has notified it's memory layout has changed, it must have been due to an action from the cache, hence the
         ///lock should already be taken.
+        if (storage == eStorageModeDisk) {
+            markIndexDirty();
+        }
         QMutexLocker k(&_sizeLock);
 
         if (storage == eStorageModeDisk) {
@@ -1297,6 +1979,9 @@ public:
                                       std::size_t size,
                                       StorageModeEnum storage) const OVERRIDE FINAL
     {
+        if (storage == eStorageModeDisk) {
+            markIndexDirty();
+        }
         QMutexLocker k(&_sizeLock);
 
         if (storage == eStorageModeRAM) {
@@ -1336,6 +2021,9 @@ public:
         if (_tearingDown) {
             return;
         }
+        if ( (oldStorage == eStorageModeDisk) || (newStorage == eStorageModeDisk) ) {
+            markIndexDirty();
+        }
         QMutexLocker k(&_sizeLock);
 
         assert(oldStorage != newStorage);
@@ -1401,12 +2089,22 @@ public:
         return cacheFolderName;
     }
 
-    std::string getRestoreFilePath() const
+    std::string getIndexFilePath() const
     {
         QString newCachePath( getCachePath() );
         StrUtils::ensureLastPathSeparator(newCachePath);
 
-        newCachePath.append( QString::fromUtf8("restoreFile." NATRON_CACHE_FILE_EXT) );
+        newCachePath.append( QString::fromUtf8("index." NATRON_CACHE_FILE_EXT) );
+
+        return newCachePath.toStdString();
+    }
+
+    std::string getIndexPayloadFilePath() const
+    {
+        QString newCachePath( getCachePath() );
+        StrUtils::ensureLastPathSeparator(newCachePath);
+
+        newCachePath.append( QString::fromUtf8("index_data." NATRON_CACHE_FILE_EXT) );
 
         return newCachePath.toStdString();
     }
@@ -1453,6 +2151,40 @@ public:
         return _diskCacheSize;
     }
 
+    void setEvictionPolicy(CacheEvictionPolicyEnum policy)
+    {
+        QMutexLocker k(&_sizeLock);
+
+        _evictionPolicy = policy;
+    }
+
+    CacheEvictionPolicyEnum getEvictionPolicy() const
+    {
+        QMutexLocker k(&_sizeLock);
+
+        return _evictionPolicy;
+    }
+
+    /**
+     * @brief Returns the number of lookups that found an entry and the ones that did not since the cache was created,
+     * and the time it took to compute the entries that were found, i.e: the time saved by the cache.
+     **/
+    void getStatistics(U64* nHits,
+                       U64* nMisses,
+                       double* recomputeTimeSaved) const
+    {
+        *nHits = 0;
+        *nMisses = 0;
+        *recomputeTimeSaved = 0.;
+        for (std::size_t i = 0; i < _buckets.size(); ++i) {
+            const CacheBucket& bucket = *_buckets[i];
+            QMutexLocker locker(&bucket.lock);
+            *nHits += bucket.nHits;
+            *nMisses += bucket.nMisses;
+            *recomputeTimeSaved += bucket.recomputeTimeSaved;
+        }
+    }
+
     CacheSignalEmitterPtr activateSignalEmitter() const
     {
         return _signalEmitter;
@@ -1470,23 +2202,25 @@ public:
         std::list<EntryTypePtr> toRemove;
 
         {
-            QMutexLocker l(&_lock);
-            CacheIterator existingEntry = _memoryCache( entry->getHashKey() );
-            if ( existingEntry != _memoryCache.end() ) {
+            const CacheBucket& bucket = getBucket( entry->getHashKey() );
+            QMutexLocker l(&bucket.lock);
+            CacheIterator existingEntry = bucket.memoryCache( entry->getHashKey() );
+            if ( existingEntry != bucket.memoryCache.end() ) {
                 std::list<EntryTypePtr> & ret = getValueFromIterator(existingEntry);
                 for (typename std::list<EntryTypePtr>::iterator it = ret.begin(); it != ret.end(); ++it) {
                     if ( (*it)->getKey() == entry->getKey() ) {
                         toRemove.push_back(*it);
+                        bucket.removeMemoryEntrySize(*it);
                         ret.erase(it);
                         break;
                     }
                 }
                 if ( ret.empty() ) {
-                    _memoryCache.erase(existingEntry);
+                    bucket.memoryCache.erase(existingEntry);
                 }
             } else {
-                existingEntry = _diskCache( entry->getHashKey() );
-                if ( existingEntry != _diskCache.end() ) {
+                existingEntry = bucket.diskCache( entry->getHashKey() );
+                if ( existingEntry != bucket.diskCache.end() ) {
                     std::list<EntryTypePtr> & ret = getValueFromIterator(existingEntry);
                     for (typename std::list<EntryTypePtr>::iterator it = ret.begin(); it != ret.end(); ++it) {
                         if ( (*it)->getKey() == entry->getKey() ) {
@@ -1496,11 +2230,12 @@ public:
                         }
                     }
                     if ( ret.empty() ) {
-                        _diskCache.erase(existingEntry);
+                        bucket.diskCache.erase(existingEntry);
+                        bucket.updateSizeHints();
                     }
                 }
             }
-        } // QMutexLocker l(&_lock);
+        } // QMutexLocker l(&bucket.lock);
         if ( !toRemove.empty() ) {
             _deleterThread.appendToQueue(toRemove);
 
@@ -1514,25 +2249,28 @@ public:
     {
         std::list<EntryTypePtr> toRemove;
         {
-            QMutexLocker l(&_lock);
-            CacheIterator existingEntry = _memoryCache( hash);
-            if ( existingEntry != _memoryCache.end() ) {
+            const CacheBucket& bucket = getBucket(hash);
+            QMutexLocker l(&bucket.lock);
+            CacheIterator existingEntry = bucket.memoryCache( hash);
+            if ( existingEntry != bucket.memoryCache.end() ) {
                 std::list<EntryTypePtr> & ret = getValueFromIterator(existingEntry);
                 for (typename std::list<EntryTypePtr>::iterator it = ret.begin(); it != ret.end(); ++it) {
                     toRemove.push_back(*it);
+                    bucket.removeMemoryEntrySize(*it);
                 }
-                _memoryCache.erase(existingEntry);
+                bucket.memoryCache.erase(existingEntry);
             } else {
-                existingEntry = _diskCache( hash );
-                if ( existingEntry != _diskCache.end() ) {
+                existingEntry = bucket.diskCache( hash );
+                if ( existingEntry != bucket.diskCache.end() ) {
                     std::list<EntryTypePtr> & ret = getValueFromIterator(existingEntry);
                     for (typename std::list<EntryTypePtr>::iterator it = ret.begin(); it != ret.end(); ++it) {
                         toRemove.push_back(*it);
                     }
-                    _diskCache.erase(existingEntry);
+                    bucket.diskCache.erase(existingEntry);
+                    bucket.updateSizeHints();
                 }
             }
-        } // QMutexLocker l(&_lock);
+        } // QMutexLocker l(&bucket.lock);
 
         if ( !toRemove.empty() ) {
             _deleterThread.appendToQueue(toRemove);
@@ -1543,13 +2281,25 @@ public:
         }
     }
 
-    /*Saves cache to disk as a settings file.
-     */
-    void save(CacheTOC* tableOfContents);
+    /**
+     * @brief Syncs the index of the disk portion of the cache: entries that are new since the last save are appended
+     * and entries that were removed are flagged, the rest of the index is left untouched.
+     * The memory portion is moved to the disk portion first.
+     **/
+    void save();
+
 
+    /**
+     * @brief Opens the index of the cache. The records are only checked against the tiles/files they reference:
+     * keys and params are decoded lazily, when an entry with the same hash is looked-up.
+     * Returns false if the index could not be used, in which case the cache starts empty.
+     **/
+    bool restore();
 
-    /*Restores the cache from disk.*/
-    void restore(const CacheTOC & tableOfContents);
+    /**
+     * @brief Starts a new empty index, e.g: after the cache directory was cleaned up.
+     **/
+    void resetIndex();
 
 
     void removeAllEntriesWithDifferentNodeHashForHolderPublic(const CacheEntryHolder* holder,
@@ -1576,29 +2326,32 @@ public:
         *diskOccupied = 0;
 
         std::string holderID = holder->getCacheID();
-        QMutexLocker locker(&_lock);
+        for (std::size_t i = 0; i < _buckets.size(); ++i) {
+            const CacheBucket& bucket = *_buckets[i];
+            QMutexLocker locker(&bucket.lock);
 
-        for (CacheIterator memIt = _memoryCache.begin(); memIt != _memoryCache.end(); ++memIt) {
-            std::list<EntryTypePtr> & entries = getValueFromIterator(memIt);
-            if ( !entries.empty() ) {
-                const EntryTypePtr & front = entries.front();
+            for (CacheIterator memIt = bucket.memoryCache.begin(); memIt != bucket.memoryCache.end(); ++memIt) {
+                std::list<EntryTypePtr> & entries = getValueFromIterator(memIt);
+                if ( !entries.empty() ) {
+                    const EntryTypePtr & front = entries.front();
 
-                if (front->getKey().getCacheHolderID() == holderID) {
-                    for (typename std::list<EntryTypePtr>::iterator it = entries.begin(); it != entries.end(); ++it) {
-                        *ramOccupied += (*it)->size();
+                    if (front->getKey().getCacheHolderID() == holderID) {
+                        for (typename std::list<EntryTypePtr>::iterator it = entries.begin(); it != entries.end(); ++it) {
+                            *ramOccupied += (*it)->size();
+                        }
                     }
                 }
             }
-        }
 
-        for (CacheIterator memIt = _diskCache.begin(); memIt != _diskCache.end(); ++memIt) {
-            std::list<EntryTypePtr> & entries = getValueFromIterator(memIt);
-            if ( !entries.empty() ) {
-                const EntryTypePtr & front = entries.front();
+            for (CacheIterator memIt = bucket.diskCache.begin(); memIt != bucket.diskCache.end(); ++memIt) {
+                std::list<EntryTypePtr> & entries = getValueFromIterator(memIt);
+                if ( !entries.empty() ) {
+                    const EntryTypePtr & front = entries.front();
 
-                if (front->getKey().getCacheHolderID() == holderID) {
-                    for (typename std::list<EntryTypePtr>::iterator it = entries.begin(); it != entries.end(); ++it) {
-                        *diskOccupied += (*it)->size();
+                    if (front->getKey().getCacheHolderID() == holderID) {
+                        for (typename std::list<EntryTypePtr>::iterator it = entries.begin(); it != entries.end(); ++it) {
+                            *diskOccupied += (*it)->size();
+                        }
                     }
                 }
             }
@@ -1612,11 +2365,13 @@ private:
                                                                        bool removeAll) OVERRIDE FINAL
     {
         std::list<EntryTypePtr> toDelete;
-        CacheContainer newMemCache, newDiskCache;
-        {
-            QMutexLocker locker(&_lock);
+        for (std::size_t i = 0; i < _buckets.size(); ++i) {
+            const CacheBucket& bucket = *_buckets[i];
+            CacheContainer newMemCache, newDiskCache;
+            std::size_t newMemCacheSize = 0;
+            QMutexLocker locker(&bucket.lock);
 
-            for (CacheIterator memIt = _memoryCache.begin(); memIt != _memoryCache.end(); ++memIt) {
+            for (CacheIterator memIt = bucket.memoryCache.begin(); memIt != bucket.memoryCache.end(); ++memIt) {
                 std::list<EntryTypePtr> & entries = getValueFromIterator(memIt);
                 if ( !entries.empty() ) {
                     const EntryTypePtr & front = entries.front();
@@ -1629,11 +2384,14 @@ private:
                     } else {
                         typename EntryType::hash_type hash = front->getHashKey();
                         newMemCache.insert(hash, entries);
+                        for (typename std::list<EntryTypePtr>::iterator it = entries.begin(); it != entries.end(); ++it) {
+                            newMemCacheSize += (*it)->getElementsCountFromParams();
+                        }
                     }
                 }
             }
 
-            for (CacheIterator dIt = _diskCache.begin(); dIt != _diskCache.end(); ++dIt) {
+            for (CacheIterator dIt = bucket.diskCache.begin(); dIt != bucket.diskCache.end(); ++dIt) {
                 std::list<EntryTypePtr> & entries = getValueFromIterator(dIt);
                 if ( !entries.empty() ) {
                     const EntryTypePtr & front = entries.front();
@@ -1650,9 +2408,11 @@ private:
                 }
             }
 
-            _memoryCache = newMemCache;
-            _diskCache = newDiskCache;
-        } // QMutexLocker locker(&_lock);
+            bucket.memoryCache = newMemCache;
+            bucket.diskCache = newDiskCache;
+            bucket.memoryCacheSize = newMemCacheSize;
+            bucket.updateSizeHints();
+        } // for each bucket
 
         if ( !toDelete.empty() ) {
             _deleterThread.appendToQueue(toDelete);
@@ -1663,16 +2423,70 @@ private:
         }
     } // removeAllEntriesWithDifferentNodeHashForHolderPrivate
 
-    bool getInternal(const typename EntryType::key_type & key,
-                     std::list<EntryTypePtr>* returnValue) const
+    bool getInternal(const CacheBucket& bucket,
+                     const typename EntryType::key_type & key,
+                     std::list<EntryTypePtr>* returnValue,
+                     bool countLookup = true) const
+    {
+        std::size_t nAlreadyFound = returnValue->size();
+
+        if ( !lookupInternal(bucket, key, returnValue) ) {
+            if (countLookup) {
+                ++bucket.nMisses;
+            }
+
+            return false;
+        }
+
+        if (countLookup) {
+            ++bucket.nHits;
+        }
+        typename std::list<EntryTypePtr>::iterator it = returnValue->begin();
+        std::advance(it, nAlreadyFound);
+        for (; it != returnValue->end(); ++it) {
+            (*it)->setEvictionInflation(bucket.evictionInflation);
+            if (countLookup) {
+                bucket.recomputeTimeSaved += (*it)->getRecomputeCost();
+            }
+        }
+
+        // In NUMA mode, the entries in the memory of the node of the calling thread come first, in the same order
+        int node = NumaTopology::getCurrentThreadNode();
+        if ( (node >= 0) && (returnValue->size() > nAlreadyFound + 1) ) {
+            std::list<EntryTypePtr> localEntries;
+            it = returnValue->begin();
+            std::advance(it, nAlreadyFound);
+            while ( it != returnValue->end() ) {
+                typename std::list<EntryTypePtr>::iterator next = it;
+                ++next;
+                if ( (*it)->getNumaNode() == node ) {
+                    localEntries.splice(localEntries.end(), *returnValue, it);
+                }
+                it = next;
+            }
+            it = returnValue->begin();
+            std::advance(it, nAlreadyFound);
+            returnValue->splice(it, localEntries);
+        }
+
+        return true;
+    }
+
+    bool lookupInternal(const CacheBucket& bucket,
+                        const typename EntryType::key_type & key,
+                        std::list<EntryTypePtr>* returnValue) const
     {
         ///Private should be locked
-        assert( !_lock.tryLock() );
+        assert( !bucket.lock.tryLock() );
+
+        if ( !bucket.pendingIndexRecords.empty() ) {
+            restorePendingIndexEntries( bucket, key.getHash() );
+        }
 
         ///find a matching value in the internal memory container
-        CacheIterator memoryCached = _memoryCache( key.getHash() );
+        CacheIterator memoryCached = bucket.memoryCache( key.getHash() );
 
-        if ( memoryCached != _memoryCache.end() ) {
+        if ( memoryCached != bucket.memoryCache.end() ) {
             ///we found something with a matching hash key. There may be several entries linked to
             ///this key, we need to find one with matching params
             std::list<EntryTypePtr> & ret = getValueFromIterator(memoryCached);
@@ -1691,9 +2505,9 @@ private:
             return returnValue->size() > 0;
         } else {
             ///fallback on the disk cache internal container
-            CacheIterator diskCached = _diskCache( key.getHash() );
+            CacheIterator diskCached = bucket.diskCache( key.getHash() );
 
-            if ( diskCached == _diskCache.end() ) {
+            if ( diskCached == bucket.diskCache.end() ) {
                 /*the entry was neither in memory or disk, just allocate a new one*/
                 return false;
             } else {
@@ -1725,7 +2539,8 @@ private:
                             }
 
                             //put it back into the RAM
-                            _memoryCache.insert( (*it)->getHashKey(), *it );
+                            bucket.memoryCache.insert( (*it)->getHashKey(), *it );
+                            bucket.addMemoryEntrySize(*it);
 
 
                             U64 memoryCacheSize, maximumInMemorySize;
@@ -1737,8 +2552,9 @@ private:
                             std::list<EntryTypePtr> entriesToBeDeleted;
 
                             //now clear extra entries from the disk cache so it doesn't exceed the RAM limit.
+                            //The lock of this bucket is held: the other buckets are only evicted from if they are not locked
                             while (memoryCacheSize > maximumInMemorySize) {
-                                if ( !tryEvictInMemoryEntry(entriesToBeDeleted) ) {
+                                if ( !tryEvictInMemoryEntryFromAnyBucket(&bucket, true, entriesToBeDeleted) ) {
                                     break;
                                 }
 
@@ -1748,6 +2564,9 @@ private:
                                     maximumInMemorySize = _maximumInMemorySize;
                                 }
                             }
+                            if ( !entriesToBeDeleted.empty() ) {
+                                _deleterThread.appendToQueue(entriesToBeDeleted);
+                            }
                         }
                         
                         returnValue->push_back(*it);
@@ -1762,7 +2581,8 @@ private:
                             ret.erase(it);
 
                             ///Remove it from the disk cache
-                            _diskCache.erase(diskCached);
+                            bucket.diskCache.erase(diskCached);
+                            bucket.updateSizeHints();
                         }
 
                         return true;
@@ -1774,46 +2594,81 @@ private:
                 return false;
             }
         }
-    } // getInternal
+    } // lookupInternal
 
     /** @brief Inserts into the cache an entry that was previously allocated by the createInternal()
      * function. This is called directly by createInternal() if the allocation was successful
      **/
-    void sealEntry(const EntryTypePtr & entry,
+    void sealEntry(const CacheBucket& bucket,
+                   const EntryTypePtr & entry,
                    bool inMemory) const
     {
-        assert( !_lock.tryLock() );   // must be locked
+        assert( !bucket.lock.tryLock() );   // must be locked
         typename EntryType::hash_type hash = entry->getHashKey();
 
+        entry->setEvictionInflation(bucket.evictionInflation);
         if (inMemory) {
             /*if the entry doesn't exist on the memory cache,make a new list and insert it*/
-            CacheIterator existingEntry = _memoryCache(hash);
-            if ( existingEntry == _memoryCache.end() ) {
-                _memoryCache.insert(hash, entry);
+            CacheIterator existingEntry = bucket.memoryCache(hash);
+            if ( existingEntry == bucket.memoryCache.end() ) {
+                bucket.memoryCache.insert(hash, entry);
             } else {
                 /*append to the existing list*/
                 getValueFromIterator(existingEntry).push_back(entry);
             }
+            bucket.addMemoryEntrySize(entry);
         } else {
-            CacheIterator existingEntry = _diskCache(hash);
-            if ( existingEntry == _diskCache.end() ) {
-                _diskCache.insert(hash, entry);
+            CacheIterator existingEntry = bucket.diskCache(hash);
+            if ( existingEntry == bucket.diskCache.end() ) {
+                bucket.diskCache.insert(hash, entry);
             } else {
                 /*append to the existing list*/
                 getValueFromIterator(existingEntry).push_back(entry);
             }
+            bucket.updateSizeHints();
         }
     }
 
-    bool tryEvictInMemoryEntry(std::list<EntryTypePtr> & entriesToBeDeleted) const
+    struct EvictionPriority
     {
-        assert( !_lock.tryLock() );
-        std::pair<hash_type, EntryTypePtr> evicted = _memoryCache.evict();
+        double operator()(const EntryTypePtr& entry) const
+        {
+            return entry->getEvictionPriority();
+        }
+    };
+
+    /**
+     * @brief Removes from the container the entry to evict according to the eviction policy of the cache.
+     * Returns a NULL entry if all entries are in use.
+     **/
+    std::pair<hash_type, EntryTypePtr> evictFromContainer(const CacheBucket& bucket,
+                                                          CacheContainer& container) const
+    {
+        assert( !bucket.lock.tryLock() );
+        if (getEvictionPolicy() == eCacheEvictionPolicyLRU) {
+            return container.evict();
+        }
+
+        std::pair<hash_type, EntryTypePtr> evicted = container.evictLowestPriority(EvictionPriority(), NATRON_CACHE_EVICTION_CANDIDATES);
+        if (evicted.second) {
+            // GreedyDual-Size: age all the entries of the bucket
+            bucket.evictionInflation = std::max( bucket.evictionInflation, evicted.second->getEvictionPriority() );
+        }
+
+        return evicted;
+    }
+
+    bool tryEvictInMemoryEntry(const CacheBucket& bucket,
+                               std::list<EntryTypePtr> & entriesToBeDeleted) const
+    {
+        assert( !bucket.lock.tryLock() );
+        std::pair<hash_type, EntryTypePtr> evicted = evictFromContainer(bucket, bucket.memoryCache);
         //if the cache couldn't evict that means all entries are used somewhere and we shall not remove them!
         //we'll let the user of these entries purge the extra entries left in the cache later on
         if (!evicted.second) {
             return false;
         }
+        bucket.removeMemoryEntrySize(evicted.second);
 
         // If it is stored on disk, remove it from memory
         // If the cache is tiled, the entry is sharing the same file with other entries so we cannot close the file.
@@ -1839,7 +2694,7 @@ private:
 
             /*before that we need to clear the disk cache if it exceeds the maximum size allowed*/
             while ( ( diskCacheSize  + evicted.second->size() ) >= (maximumCacheSize - maximumInMemorySize) ) {
-                std::pair<hash_type, EntryTypePtr> evictedFromDisk = _diskCache.evict();
+                std::pair<hash_type, EntryTypePtr> evictedFromDisk = evictFromContainer(bucket, bucket.diskCache);
                 //if the cache couldn't evict that means all entries are used somewhere and we shall not remove them!
                 //we'll let the user of these entries purge the extra entries left in the cache later on
                 if (!evictedFromDisk.second) {
@@ -1863,23 +2718,25 @@ private:
                 diskCacheSize -= fsize;
             }
 
-            CacheIterator existingDiskCacheEntry = _diskCache(evicted.first);
+            CacheIterator existingDiskCacheEntry = bucket.diskCache(evicted.first);
             /*if the entry doesn't exist on the disk cache,make a new list and insert it*/
-            if ( existingDiskCacheEntry == _diskCache.end() ) {
-                _diskCache.insert(evicted.first, evicted.second);
+            if ( existingDiskCacheEntry == bucket.diskCache.end() ) {
+                bucket.diskCache.insert(evicted.first, evicted.second);
             } else {   /*append to the existing list*/
                 getValueFromIterator(existingDiskCacheEntry).push_back(evicted.second);
             }
+            bucket.updateSizeHints();
         } // if (!evicted.second->isStoredOnDisk())
 
         return true;
     } // tryEvictEntry
 
-    bool tryEvictDiskEntry(std::list<EntryTypePtr> & entriesToBeDeleted) const
+    bool tryEvictDiskEntry(const CacheBucket& bucket,
+                           std::list<EntryTypePtr> & entriesToBeDeleted) const
     {
 
-        assert( !_lock.tryLock() );
-        std::pair<hash_type, EntryTypePtr> evicted = _diskCache.evict();
+        assert( !bucket.lock.tryLock() );
+        std::pair<hash_type, EntryTypePtr> evicted = evictFromContainer(bucket, bucket.diskCache);
         //if the cache couldn't evict that means all entries are used somewhere and we shall not remove them!
         //we'll let the user of these entries purge the extra entries left in the cache later on
         if (!evicted.second) {
@@ -1889,7 +2746,9 @@ private:
             // Erase the file from the disk if we reach the limit.
             evicted.second->removeAnyBackingFile();
         }
+        bucket.updateSizeHints();
         entriesToBeDeleted.push_back(evicted.second);
+
         return true;
     }
 
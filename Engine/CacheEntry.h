@@ -50,6 +50,7 @@
 #include <boost/scoped_ptr.hpp>
 #endif
 
+#include <QtCore/QAtomicInt>
 #include <QtCore/QFile>
 #include <QtCore/QMutex>
 #include <QtCore/QReadWriteLock>
@@ -61,9 +62,11 @@
 #endif
 
 #include "Engine/Hash64.h"
+#include "Engine/BufferPool.h"
 #include "Engine/CacheEntryHolder.h"
 #include "Engine/MemoryFile.h"
 #include "Engine/NonKeyParams.h"
+#include "Engine/NumaTopology.h"
 #include "Engine/Texture.h"
 #include "Engine/EngineFwd.h"
 #include "Global/GlobalDefines.h"
@@ -80,11 +83,15 @@ class RamBuffer
     T* data;
     U64 count;
 
+    // The NUMA node of the thread that allocated the data, -1 if it was not bound
+    int node;
+
 public:
 
     RamBuffer()
         : data(0)
         , count(0)
+        , node(-1)
     {
     }
 
@@ -102,6 +109,7 @@ public:
     {
         std::swap(data, other.data);
         std::swap(count, other.count);
+        std::swap(node, other.node);
     }
 
     U64 size() const
@@ -109,51 +117,92 @@ public:
         return count;
     }
 
+    int getNumaNode() const
+    {
+        return node;
+    }
+
     void resize(U64 size)
     {
         if (size == 0) {
             return;
         }
-        count = size;
         if (data) {
-            free(data);
+            BufferPool::deallocate( data, count * sizeof(T) );
             data = 0;
         }
-        if (count == 0) {
-            return;
-        }
-        data = (T*)malloc( size * sizeof(T) );
-        if (!data) {
-            throw std::bad_alloc();
-        }
+        data = (T*)BufferPool::allocate( size * sizeof(T) );
+        count = size;
+        // A bound thread is given the buffers of its node
+        node = NumaTopology::getCurrentThreadNode();
     }
 
     void clear()
     {
-        count = 0;
         if (data) {
-            free(data);
+            BufferPool::deallocate( data, count * sizeof(T) );
             data = 0;
         }
+        count = 0;
+        node = -1;
     }
 
     ~RamBuffer()
     {
         if (data) {
-            free(data);
+            BufferPool::deallocate( data, count * sizeof(T) );
             data = 0;
         }
     }
 };
 
 // This is a cache file with a fixed size that is a multiple of the tileByteSize.
-// A bitset represents the allocated tiles in the file.
-// A value of true means that a tile is used by a cache entry.
+// The free tiles of the file are indexed by a hierarchical bitmap: a set bit at the first level means that
+// the tile is free and a set bit at level n means that the corresponding 64 bits word of level n-1 has at least one free tile.
+// Finding a free tile is then a find-first-set per level instead of a scan of all the tiles of the file.
 class TileCacheFile
 {
 public:
     MemoryFilePtr file;
-    std::vector<bool> usedTiles;
+
+    TileCacheFile();
+
+    /**
+     * @brief Resets the index to nTiles tiles, all free.
+     **/
+    void initTiles(std::size_t nTiles);
+
+    std::size_t getNumTiles() const
+    {
+        return _nTiles;
+    }
+
+    std::size_t getNumUsedTiles() const
+    {
+        return _nUsedTiles;
+    }
+
+    bool isFull() const
+    {
+        return _nUsedTiles == _nTiles;
+    }
+
+    bool isTileUsed(std::size_t index) const;
+
+    void setTileUsed(std::size_t index, bool used);
+
+    /**
+     * @brief Returns the index of the first free tile of the file or -1 if the file is full.
+     * This is O(log64(nTiles)).
+     **/
+    int findFreeTile() const;
+
+private:
+
+    // _freeTiles[0] has one bit per tile, the last level is a single word
+    std::vector<std::vector<U64> > _freeTiles;
+    std::size_t _nTiles;
+    std::size_t _nUsedTiles;
 };
 
 typedef TileCacheFilePtr TileCacheFilePtr;
@@ -555,6 +604,8 @@ public:
             _backingFile.reset();
             throw std::bad_alloc();
         }
+        // The entry was found in the cache and is about to be read: read it from the disk while the caller gets to it
+        _backingFile->prefetch();
     }
 
     void restoreBufferFromFile(const std::string & path, std::size_t dataOffset, AbstractCacheEntryBase* entry, bool isTileCache)
@@ -693,6 +744,18 @@ public:
         return _storageMode;
     }
 
+    /**
+     * @brief Returns the NUMA node of the data, or -1 if it is unknown or not in RAM.
+     **/
+    int getNumaNode() const
+    {
+        if ( (_storageMode != eStorageModeRAM) || !_buffer ) {
+            return -1;
+        }
+
+        return _buffer->getNumaNode();
+    }
+
     U32 getGLTextureID() const
     {
         return _glTexture ? _glTexture->getTexID() : 0;
@@ -770,6 +833,10 @@ public:
         , _cache()
         , _entryLock(QReadWriteLock::Recursive)
         , _removeBackingFileBeforeDestruction(false)
+        , _recomputeCostMutex()
+        , _recomputeCost(0.)
+        , _evictionInflation(0.)
+        , _numaNode(-1)
     {
     }
 
@@ -788,6 +855,10 @@ public:
         , _cache(cache)
         , _entryLock(QReadWriteLock::Recursive)
         , _removeBackingFileBeforeDestruction(false)
+        , _recomputeCostMutex()
+        , _recomputeCost(0.)
+        , _evictionInflation(0.)
+        , _numaNode(-1)
     {
     }
 
@@ -845,6 +916,7 @@ public:
                 return;
             }
             allocate();
+            _numaNode.fetchAndStoreRelaxed( _data.getNumaNode() );
             onMemoryAllocated(false);
         }
 
@@ -949,6 +1021,7 @@ public:
         {
             QWriteLocker k(&_entryLock);
             _data.reOpenFileMapping();
+            _numaNode.fetchAndStoreRelaxed( _data.getNumaNode() );
         }
         if (_cache) {
             _cache->notifyEntryStorageChanged( eStorageModeDisk, eStorageModeRAM, getTime(), size() );
@@ -967,6 +1040,7 @@ public:
             QWriteLocker k(&_entryLock);
             dataAllocated = _data.isAllocated();
             _data.deallocate();
+            _numaNode.fetchAndStoreRelaxed(-1);
         }
 
         if (_cache) {
@@ -1036,6 +1110,15 @@ public:
         return _data.isAllocated();
     }
 
+    /**
+     * @brief Returns the NUMA node of the data, or -1. This does not lock the entry: it is called by the cache
+     * look-ups with the bucket locked.
+     **/
+    int getNumaNode() const
+    {
+        return (int)_numaNode;
+    }
+
     virtual void syncBackingFile() const OVERRIDE FINAL
     {
         QWriteLocker k(&_entryLock);
@@ -1085,6 +1168,42 @@ public:
         return _key.getTime();
     }
 
+    /**
+     * @brief Adds to the time it took to compute the data of this entry, in seconds.
+     * This is what is lost if the entry is evicted from the cache.
+     **/
+    void addRecomputeCost(double seconds)
+    {
+        QMutexLocker k(&_recomputeCostMutex);
+
+        _recomputeCost += seconds;
+    }
+
+    double getRecomputeCost() const
+    {
+        QMutexLocker k(&_recomputeCostMutex);
+
+        return _recomputeCost;
+    }
+
+    /**
+     * @brief Called by the cache whenever the entry is inserted or looked-up, with the priority of the last entry
+     * evicted by the GreedyDual-Size policy, so that entries that are not accessed anymore age.
+     * This is protected by the lock of the cache bucket containing the entry.
+     **/
+    void setEvictionInflation(double inflation)
+    {
+        _evictionInflation = inflation;
+    }
+
+    /**
+     * @brief GreedyDual-Size priority: entries with the lowest priority are evicted first.
+     **/
+    double getEvictionPriority() const
+    {
+        return _evictionInflation + getRecomputeCost() / std::max( (U64)1, getElementsCountFromParams() );
+    }
+
     ParamsTypePtr getParams() const WARN_UNUSED_RETURN
     {
         return _params;
@@ -1141,6 +1260,8 @@ protected:
         size_t oldSize = size();
 
         _data.swap(other._data);
+        _numaNode.fetchAndStoreRelaxed( _data.getNumaNode() );
+        other._numaNode.fetchAndStoreRelaxed( other._data.getNumaNode() );
         if (_cache) {
             _cache->notifyEntrySizeChanged( oldSize, size() );
         }
@@ -1252,6 +1373,11 @@ protected:
     const CacheAPI* _cache;
     mutable QReadWriteLock _entryLock;
     bool _removeBackingFileBeforeDestruction;
+    mutable QMutex _recomputeCostMutex;
+    double _recomputeCost;
+    double _evictionInflation;
+    // The NUMA node of _data, set when it is allocated so that it can be read without taking _entryLock
+    QAtomicInt _numaNode;
 };
 
 NATRON_NAMESPACE_EXIT
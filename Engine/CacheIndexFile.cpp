@@ -0,0 +1,311 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * Copyright (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "CacheIndexFile.h"
+
+#include <cassert>
+#include <cstring> // memcpy, memcmp
+#include <stdexcept>
+#include <vector>
+#include <algorithm> // max
+
+#include "Engine/MemoryFile.h"
+
+// The records start at this offset in the records file, after the header
+#define NATRON_CACHE_INDEX_RECORDS_OFFSET 64
+
+// Number of records allocated when creating an index
+#define NATRON_CACHE_INDEX_INITIAL_CAPACITY 1024
+
+NATRON_NAMESPACE_ENTER
+
+static const char kCacheIndexMagic[8] = { 'N', 'T', 'C', 'I', 'N', 'D', 'E', 'X' };
+
+struct CacheIndexFile::CacheIndexHeader
+{
+    char magic[8];
+    U32 layoutVersion;
+    U32 cacheVersion;
+    U32 nRecords;
+    U32 recordsCapacity;
+    U32 nRemovedRecords;
+    U32 clean;
+    U64 payloadSize;
+    U64 lruClock;
+};
+
+CacheIndexFile::CacheIndexFile(const std::string& recordsFilePath,
+                               const std::string& payloadFilePath)
+    : _recordsFilePath(recordsFilePath)
+    , _payloadFilePath(payloadFilePath)
+    , _recordsFile()
+    , _payloadFile()
+{
+    assert(sizeof(CacheIndexHeader) <= NATRON_CACHE_INDEX_RECORDS_OFFSET);
+}
+
+CacheIndexFile::~CacheIndexFile()
+{
+}
+
+CacheIndexFile::CacheIndexHeader*
+CacheIndexFile::header() const
+{
+    assert(_recordsFile && _recordsFile->data());
+
+    return reinterpret_cast<CacheIndexHeader*>( _recordsFile->data() );
+}
+
+CacheIndexRecord*
+CacheIndexFile::records() const
+{
+    assert(_recordsFile && _recordsFile->data());
+
+    return reinterpret_cast<CacheIndexRecord*>(_recordsFile->data() + NATRON_CACHE_INDEX_RECORDS_OFFSET);
+}
+
+bool
+CacheIndexFile::open(unsigned int cacheVersion)
+{
+    bool valid = false;
+
+    try {
+        _recordsFile.reset( new MemoryFile(_recordsFilePath, MemoryFile::eFileOpenModeEnumIfExistsKeepElseFail) );
+        _payloadFile.reset( new MemoryFile(_payloadFilePath, MemoryFile::eFileOpenModeEnumIfExistsKeepElseFail) );
+
+        if ( _recordsFile->data() && (_recordsFile->size() >= NATRON_CACHE_INDEX_RECORDS_OFFSET) ) {
+            const CacheIndexHeader* h = header();
+            valid = std::memcmp( h->magic, kCacheIndexMagic, sizeof(kCacheIndexMagic) ) == 0 &&
+                    h->layoutVersion == NATRON_CACHE_INDEX_LAYOUT_VERSION &&
+                    h->cacheVersion == cacheVersion &&
+                    h->clean &&
+                    h->nRecords <= h->recordsCapacity &&
+                    h->nRemovedRecords <= h->nRecords &&
+                    _recordsFile->size() >= NATRON_CACHE_INDEX_RECORDS_OFFSET + (std::size_t)h->recordsCapacity * sizeof(CacheIndexRecord) &&
+                    _payloadFile->size() >= h->payloadSize;
+        }
+    } catch (const std::exception& /*e*/) {
+        valid = false;
+    }
+
+    if (!valid) {
+        reset(cacheVersion);
+    }
+
+    return valid;
+}
+
+void
+CacheIndexFile::reset(unsigned int cacheVersion)
+{
+    _recordsFile.reset( new MemoryFile(_recordsFilePath, MemoryFile::eFileOpenModeEnumIfExistsTruncateElseCreate) );
+    _payloadFile.reset( new MemoryFile(_payloadFilePath, MemoryFile::eFileOpenModeEnumIfExistsTruncateElseCreate) );
+    _recordsFile->resize(NATRON_CACHE_INDEX_RECORDS_OFFSET + NATRON_CACHE_INDEX_INITIAL_CAPACITY * sizeof(CacheIndexRecord));
+
+    CacheIndexHeader* h = header();
+    std::memset( h, 0, sizeof(CacheIndexHeader) );
+    std::memcpy( h->magic, kCacheIndexMagic, sizeof(kCacheIndexMagic) );
+    h->layoutVersion = NATRON_CACHE_INDEX_LAYOUT_VERSION;
+    h->cacheVersion = cacheVersion;
+    h->recordsCapacity = NATRON_CACHE_INDEX_INITIAL_CAPACITY;
+}
+
+void
+CacheIndexFile::remove()
+{
+    if (_recordsFile) {
+        _recordsFile->remove();
+        _recordsFile.reset();
+    }
+    if (_payloadFile) {
+        _payloadFile->remove();
+        _payloadFile.reset();
+    }
+}
+
+U32
+CacheIndexFile::getNumRecords() const
+{
+    return header()->nRecords;
+}
+
+U32
+CacheIndexFile::getNumRemovedRecords() const
+{
+    return header()->nRemovedRecords;
+}
+
+const CacheIndexRecord&
+CacheIndexFile::getRecord(U32 index) const
+{
+    assert( index < getNumRecords() );
+
+    return records()[index];
+}
+
+const char*
+CacheIndexFile::getPayload(const CacheIndexRecord& record) const
+{
+    if ( (record.payloadSize == 0) || (record.payloadOffset + record.payloadSize > header()->payloadSize) ) {
+        return 0;
+    }
+
+    return _payloadFile->data() + record.payloadOffset;
+}
+
+void
+CacheIndexFile::ensureRecordsCapacity(U32 nRecords)
+{
+    U32 capacity = header()->recordsCapacity;
+
+    if (nRecords <= capacity) {
+        return;
+    }
+    capacity = std::max(nRecords, capacity * 2);
+    // resize() invalidates the pointers returned by header() and records()
+    _recordsFile->resize(NATRON_CACHE_INDEX_RECORDS_OFFSET + (std::size_t)capacity * sizeof(CacheIndexRecord));
+    header()->recordsCapacity = capacity;
+}
+
+U32
+CacheIndexFile::appendRecord(const CacheIndexRecord& record,
+                             const char* payload,
+                             std::size_t payloadSize)
+{
+    U32 index = header()->nRecords;
+
+    ensureRecordsCapacity(index + 1);
+
+    U64 payloadOffset = header()->payloadSize;
+    if (payloadOffset + payloadSize > _payloadFile->size()) {
+        _payloadFile->resize( std::max( (std::size_t)(payloadOffset + payloadSize), std::max( (std::size_t)65536, _payloadFile->size() * 2 ) ) );
+    }
+    if (payloadSize) {
+        std::memcpy(_payloadFile->data() + payloadOffset, payload, payloadSize);
+    }
+
+    CacheIndexRecord& r = records()[index];
+    r = record;
+    r.payloadOffset = payloadOffset;
+    r.payloadSize = (U32)payloadSize;
+    r.fileName[NATRON_CACHE_INDEX_FILENAME_SIZE - 1] = 0;
+
+    CacheIndexHeader* h = header();
+    h->payloadSize = payloadOffset + payloadSize;
+    h->nRecords = index + 1;
+
+    return index;
+}
+
+void
+CacheIndexFile::removeRecord(U32 index)
+{
+    assert( index < getNumRecords() );
+    CacheIndexRecord& r = records()[index];
+
+    if ( !(r.flags & CacheIndexRecord::eFlagRemoved) ) {
+        r.flags |= CacheIndexRecord::eFlagRemoved;
+        ++header()->nRemovedRecords;
+    }
+}
+
+void
+CacheIndexFile::setLRUStamp(U32 index,
+                            U64 stamp)
+{
+    assert( index < getNumRecords() );
+    records()[index].lruStamp = stamp;
+}
+
+U64
+CacheIndexFile::tickLRUClock()
+{
+    return ++header()->lruClock;
+}
+
+void
+CacheIndexFile::compact()
+{
+    const CacheIndexHeader* h = header();
+
+    if (h->nRemovedRecords == 0) {
+        return;
+    }
+
+    unsigned int cacheVersion = h->cacheVersion;
+    U64 lruClock = h->lruClock;
+    bool clean = h->clean != 0;
+    std::vector<CacheIndexRecord> liveRecords;
+    std::string payloads;
+    liveRecords.reserve(h->nRecords - h->nRemovedRecords);
+    for (U32 i = 0; i < h->nRecords; ++i) {
+        const CacheIndexRecord& r = records()[i];
+        const char* payload = getPayload(r);
+        if ( (r.flags & CacheIndexRecord::eFlagRemoved) || !payload ) {
+            continue;
+        }
+        liveRecords.push_back(r);
+        liveRecords.back().payloadOffset = payloads.size();
+        payloads.append(payload, r.payloadSize);
+    }
+
+    reset(cacheVersion);
+    ensureRecordsCapacity( (U32)liveRecords.size() );
+    for (std::size_t i = 0; i < liveRecords.size(); ++i) {
+        appendRecord(liveRecords[i], payloads.data() + liveRecords[i].payloadOffset, liveRecords[i].payloadSize);
+    }
+    header()->lruClock = lruClock;
+    header()->clean = clean;
+}
+
+void
+CacheIndexFile::setClean(bool clean)
+{
+    header()->clean = clean ? 1 : 0;
+    if (clean) {
+        flush();
+    } else {
+        // The dirty flag must reach the disk before the cache is modified
+        _recordsFile->flush(MemoryFile::eFlushTypeSync, _recordsFile->data(), NATRON_CACHE_INDEX_RECORDS_OFFSET);
+    }
+}
+
+bool
+CacheIndexFile::isClean() const
+{
+    return header()->clean != 0;
+}
+
+void
+CacheIndexFile::flush()
+{
+    if ( _payloadFile && _payloadFile->data() ) {
+        _payloadFile->flush(MemoryFile::eFlushTypeSync, 0, 0);
+    }
+    if ( _recordsFile && _recordsFile->data() ) {
+        _recordsFile->flush(MemoryFile::eFlushTypeSync, 0, 0);
+    }
+}
+
+NATRON_NAMESPACE_EXIT
@@ -0,0 +1,163 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * Copyright (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+#ifndef NATRON_ENGINE_CACHEINDEXFILE_H
+#define NATRON_ENGINE_CACHEINDEXFILE_H
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include <string>
+#include <cstddef>
+
+#if !defined(Q_MOC_RUN) && !defined(SBK_RUN)
+#include <boost/scoped_ptr.hpp>
+#endif
+
+#include "Global/GlobalDefines.h"
+#include "Engine/EngineFwd.h"
+
+// Bump whenever the layout of CacheIndexHeader or CacheIndexRecord changes
+#define NATRON_CACHE_INDEX_LAYOUT_VERSION 1
+
+// Maximum length of the file name of an entry, relative to the cache directory
+#define NATRON_CACHE_INDEX_FILENAME_SIZE 64
+
+NATRON_NAMESPACE_ENTER
+
+/**
+ * @brief One entry of the cache index. This is written as is in the index file, hence only plain fixed-size types.
+ * The key and params of the entry are variable-sized and are stored in the payload file of the index: they are only
+ * decoded when the entry is looked-up for the first time.
+ **/
+struct CacheIndexRecord
+{
+    enum FlagsEnum
+    {
+        eFlagRemoved = 0x1
+    };
+
+    U64 hash;
+    U64 dataOffsetInFile;
+    U64 size;
+    U64 lruStamp;
+    U64 payloadOffset;
+    U32 payloadSize;
+    U32 flags;
+    char fileName[NATRON_CACHE_INDEX_FILENAME_SIZE]; // relative to the cache directory, nul terminated
+};
+
+/**
+ * @brief A versioned binary index of the entries of a disk cache, memory-mapped so that opening it does not
+ * depend on the number of entries. The index is made of 2 files: the records file (a header followed by an array
+ * of CacheIndexRecord) and an append-only payload file.
+ * Records are never moved while the index is opened: removing a record only flags it, so that record numbers
+ * remain valid handles. compact() gets rid of the removed records.
+ * This is not MT-safe.
+ **/
+class CacheIndexFile
+{
+public:
+
+    CacheIndexFile(const std::string& recordsFilePath,
+                   const std::string& payloadFilePath);
+
+    ~CacheIndexFile();
+
+    /**
+     * @brief Maps an existing index and checks its header. Returns false if the index does not exist, has another layout or cache version
+     * or was not closed properly (see setClean()), in which case the index is empty and ready to be filled.
+     * This only reads the header: records are validated by the cache when they are used.
+     **/
+    bool open(unsigned int cacheVersion);
+
+    /**
+     * @brief Resets the index to an empty one.
+     **/
+    void reset(unsigned int cacheVersion);
+
+    /**
+     * @brief Removes both files of the index.
+     **/
+    void remove();
+
+    U32 getNumRecords() const;
+
+    U32 getNumRemovedRecords() const;
+
+    const CacheIndexRecord& getRecord(U32 index) const;
+
+    const char* getPayload(const CacheIndexRecord& record) const;
+
+    /**
+     * @brief Appends a record and its payload. The payloadOffset and payloadSize of the record are set by this function.
+     * Returns the record number.
+     **/
+    U32 appendRecord(const CacheIndexRecord& record, const char* payload, std::size_t payloadSize);
+
+    void removeRecord(U32 index);
+
+    void setLRUStamp(U32 index, U64 stamp);
+
+    /**
+     * @brief Increments and returns the clock used for the LRU stamps of the records.
+     **/
+    U64 tickLRUClock();
+
+    /**
+     * @brief Rewrites the index without the removed records. Record numbers are invalidated.
+     **/
+    void compact();
+
+    /**
+     * @brief When not clean, the index will be discarded by the next call to open().
+     * The cache marks the index dirty as soon as the content of the disk portion of the cache may no longer
+     * match the index and clean once the index has been synced.
+     **/
+    void setClean(bool clean);
+
+    bool isClean() const;
+
+    /**
+     * @brief Syncs the mapped files with the disk.
+     **/
+    void flush();
+
+private:
+
+    void ensureRecordsCapacity(U32 nRecords);
+
+    struct CacheIndexHeader;
+
+    CacheIndexHeader* header() const;
+
+    CacheIndexRecord* records() const;
+
+    std::string _recordsFilePath, _payloadFilePath;
+    boost::scoped_ptr<MemoryFile> _recordsFile;
+    boost::scoped_ptr<MemoryFile> _payloadFile;
+};
+
+NATRON_NAMESPACE_EXIT
+
+#endif // NATRON_ENGINE_CACHEINDEXFILE_H
@@ -28,8 +28,14 @@
 #include "Global/Macros.h"
 
 #include <list>
+#include <map>
 #include <set>
+#include <vector>
+#include <cmath> // floor
 #include <cstddef>
+#include <cstring> // memset, strncpy
+#include <algorithm> // sort
+#include <sstream> // istringstream, ostringstream
 #include <stdexcept>
 
 #if !defined(Q_MOC_RUN) && !defined(SBK_RUN)
@@ -56,10 +62,6 @@ GCC_DIAG_ON(unused-parameter)
 #include "Engine/FrameParamsSerialization.h"
 #include "Engine/EngineFwd.h"
 
-// Note: these classes are used for cache serialization and do not have to maintain backward compatibility
-#define SERIALIZED_ENTRY_INTRODUCES_SIZE 2
-#define SERIALIZED_ENTRY_VERSION SERIALIZED_ENTRY_INTRODUCES_SIZE
-
 //Beyond that percentage of occupation, the cache will start evicting LRU entries
 #define NATRON_CACHE_LIMIT_PERCENT 0.9
 
@@ -68,100 +70,294 @@ GCC_DIAG_ON(unused-parameter)
 
 NATRON_NAMESPACE_ENTER
 
-/*Saves cache to disk as a settings file.
+template<typename EntryType>
+bool
+Cache<EntryType>::encodeIndexPayload(const typename EntryType::key_type & key,
+                                     const ParamsTypePtr & params,
+                                     std::string* payload)
+{
+    try {
+        std::ostringstream ss;
+        {
+            boost::archive::binary_oarchive oArchive(ss, boost::archive::no_header);
+            oArchive << key;
+            oArchive << params;
+        }
+        *payload = ss.str();
+    } catch (const std::exception & e) {
+        qDebug() << "Failed to serialize cache entry:" << e.what();
+
+        return false;
+    }
+
+    return true;
+}
+
+template<typename EntryType>
+bool
+Cache<EntryType>::decodeIndexPayload(const char* payload,
+                                     std::size_t payloadSize,
+                                     typename EntryType::key_type* key,
+                                     ParamsTypePtr* params)
+{
+    try {
+        std::istringstream ss( std::string(payload, payloadSize) );
+        boost::archive::binary_iarchive iArchive(ss, boost::archive::no_header);
+        iArchive >> *key;
+        iArchive >> *params;
+    } catch (const std::exception & e) {
+        qDebug() << "Failed to deserialize cache entry:" << e.what();
+
+        return false;
+    }
+
+    return true;
+}
+
+inline bool
+compareCacheIndexRecordsLRU(const std::pair<U32, CacheIndexRecord>& lhs,
+                            const std::pair<U32, CacheIndexRecord>& rhs)
+{
+    return lhs.second.lruStamp < rhs.second.lruStamp;
+}
+
+template<typename EntryType>
+void
+Cache<EntryType>::resetIndex()
+{
+    _indexPayloadEncoder = &Cache<EntryType>::encodeIndexPayload;
+    _indexPayloadDecoder = &Cache<EntryType>::decodeIndexPayload;
+
+    QMutexLocker k(&_indexLock);
+    _indexRecordOfEntry.clear();
+    try {
+        _index.reset( new CacheIndexFile( getIndexFilePath(), getIndexPayloadFilePath() ) );
+        _index->reset(_version);
+        _index->setClean(false);
+    } catch (const std::exception & e) {
+        qDebug() << "Failed to create the cache index:" << e.what();
+        _index.reset();
+    }
+}
+
+/*Saves cache to disk.
  */
 template<typename EntryType>
 void
-Cache<EntryType>::save(CacheTOC* tableOfContents)
+Cache<EntryType>::save()
 {
     clearInMemoryPortion(false);
+
     {
-        QMutexLocker l(&_lock);     // must be locked
+        QMutexLocker k(&_indexLock);
+        if (!_index) {
+            k.unlock();
+            resetIndex();
+        }
+    }
+
+    std::vector<bool> liveRecords;
+    U64 generation;
+    {
+        QMutexLocker k(&_indexLock);
+        if (!_index) {
+            return;
+        }
+        liveRecords.resize(_index->getNumRecords(), false);
+        generation = _indexGeneration;
+    }
+
+    QString cachePath = getCachePath();
+    StrUtils::ensureLastPathSeparator(cachePath);
+    const std::string cacheDir = cachePath.toStdString();
+
+    std::map<const EntryType*, U32> recordOfEntry;
+    for (std::size_t i = 0; i < _buckets.size(); ++i) {
+        const CacheBucket& bucket = *_buckets[i];
+        QMutexLocker l(&bucket.lock);     // must be locked
+
+        // Records that were not looked-up are still valid
+        for (typename std::multimap<hash_type, U32>::const_iterator it = bucket.pendingIndexRecords.begin(); it != bucket.pendingIndexRecords.end(); ++it) {
+            if ( it->second < liveRecords.size() ) {
+                liveRecords[it->second] = true;
+            }
+        }
 
-        for (CacheIterator it = _diskCache.begin(); it != _diskCache.end(); ++it) {
+        for (CacheIterator it = bucket.diskCache.begin(); it != bucket.diskCache.end(); ++it) {
             std::list<EntryTypePtr> & listOfValues  = getValueFromIterator(it);
             for (typename std::list<EntryTypePtr>::const_iterator it2 = listOfValues.begin(); it2 != listOfValues.end(); ++it2) {
-                if ( (*it2)->isStoredOnDisk() ) {
-                    SerializedEntry serialization;
-                    serialization.hash = (*it2)->getHashKey();
-                    serialization.params = (*it2)->getParams();
-                    serialization.key = (*it2)->getKey();
-                    serialization.size = (*it2)->dataSize();
-                    serialization.filePath = (*it2)->getFilePath();
-                    serialization.dataOffsetInFile = (*it2)->getOffsetInFile();
-
-                    (*it2)->syncBackingFile();
-                    
-                    tableOfContents->push_back(serialization);
+                if ( !(*it2)->isStoredOnDisk() ) {
+                    continue;
+                }
+                (*it2)->syncBackingFile();
+
+                const std::string filePath = (*it2)->getFilePath();
+                if ( (filePath.compare(0, cacheDir.size(), cacheDir) != 0) ||
+                     (filePath.size() - cacheDir.size() >= NATRON_CACHE_INDEX_FILENAME_SIZE) ) {
+                    qDebug() << "WARNING: Cache entry file is not in the cache directory or its name is too long:" << filePath.c_str();
+                    continue;
+                }
+                const std::string fileName = filePath.substr( cacheDir.size() );
+                const hash_type hash = (*it2)->getHashKey();
+                const std::size_t dataOffsetInFile = (*it2)->getOffsetInFile();
+
 #ifdef DEBUG
-                    if ( !_isTiled && !CacheAPI::checkFileNameMatchesHash(serialization.filePath, serialization.hash) ) {
-                        qDebug() << "WARNING: Cache entry filename is not the same as the serialized hash key";
-                    }
+                if ( !_isTiled && !CacheAPI::checkFileNameMatchesHash(filePath, hash) ) {
+                    qDebug() << "WARNING: Cache entry filename is not the same as the serialized hash key";
+                }
 #endif
+
+                // If the entry is already in the index, leave its record untouched
+                {
+                    QMutexLocker k(&_indexLock);
+                    typename std::map<const EntryType*, U32>::const_iterator found = _indexRecordOfEntry.find( it2->get() );
+                    if ( ( found != _indexRecordOfEntry.end() ) && ( found->second < liveRecords.size() ) ) {
+                        const CacheIndexRecord& record = _index->getRecord(found->second);
+                        if ( !(record.flags & CacheIndexRecord::eFlagRemoved) && (record.hash == hash) &&
+                             (record.dataOffsetInFile == dataOffsetInFile) && (fileName == record.fileName) ) {
+                            liveRecords[found->second] = true;
+                            recordOfEntry[it2->get()] = found->second;
+                            continue;
+                        }
+                    }
+                }
+
+                std::string payload;
+                if ( !_indexPayloadEncoder( (*it2)->getKey(), (*it2)->getParams(), &payload ) ) {
+                    continue;
                 }
+                CacheIndexRecord record;
+                std::memset( &record, 0, sizeof(CacheIndexRecord) );
+                record.hash = hash;
+                record.dataOffsetInFile = dataOffsetInFile;
+                record.size = (*it2)->dataSize();
+                std::strncpy(record.fileName, fileName.c_str(), NATRON_CACHE_INDEX_FILENAME_SIZE - 1);
+
+                QMutexLocker k(&_indexLock);
+                record.lruStamp = _index->tickLRUClock();
+                recordOfEntry[it2->get()] = _index->appendRecord( record, payload.data(), payload.size() );
             }
         }
     }
-}
+
+    QMutexLocker k(&_indexLock);
+    for (std::size_t i = 0; i < liveRecords.size(); ++i) {
+        if (!liveRecords[i]) {
+            _index->removeRecord(i);
+        }
+    }
+    _indexRecordOfEntry.swap(recordOfEntry);
+
+    // If entries were added or removed in the meantime the index may not describe the cache: leave it dirty
+    // so that the next launch discards it.
+    if (_indexGeneration == generation) {
+        _index->setClean(true);
+    } else {
+        _index->flush();
+    }
+} // save
 
 /*Restores the cache from disk.*/
 template<typename EntryType>
-void
-Cache<EntryType>::restore(const CacheTOC & tableOfContents)
+bool
+Cache<EntryType>::restore()
 {
-    ///Make sure the shared_ptrs live in this list and are destroyed not while under the lock
-    ///so that the memory freeing (which might be expensive for large images) doesn't happen while under the lock
-    std::list<EntryTypePtr> entriesToBeDeleted;
+    _indexPayloadEncoder = &Cache<EntryType>::encodeIndexPayload;
+    _indexPayloadDecoder = &Cache<EntryType>::decodeIndexPayload;
 
-    std::set<QString> usedFilePaths;
-    for (typename CacheTOC::const_iterator it =
-             tableOfContents.begin(); it != tableOfContents.end(); ++it) {
-        if ( it->hash != it->key.getHash() ) {
-            /*
-             * If this warning is printed this means that the value computed by it->key()
-             * is different than the value stored prior to serialiazing this entry. In other words there're
-             * 2 possibilities:
-             * 1) The key has changed since it has been added to the cache: maybe you forgot to serialize some
-             * members of the key or you didn't save them correctly.
-             * 2) The hash key computation is unreliable and is depending upon changing or non-deterministic
-             * parameters which is wrong.
-             */
-            qDebug() << "WARNING: serialized hash key different than the restored one";
+    const std::size_t tileSizeBytes = getTileSizeBytes();
+    const bool isTiled = isTileCache();
+    const std::size_t nTilesPerFile = isTiled ? std::floor( ( (double)NATRON_TILE_CACHE_FILE_SIZE_BYTES ) / tileSizeBytes ) : 0;
+
+    // Only the header is read and the records are mapped: nothing is decoded here
+    std::vector<std::pair<U32, CacheIndexRecord> > records;
+    std::vector<std::string> unusedFiles;
+    bool valid;
+    {
+        QMutexLocker k(&_indexLock);
+        try {
+            _index.reset( new CacheIndexFile( getIndexFilePath(), getIndexPayloadFilePath() ) );
+            valid = _index->open(_version);
+        } catch (const std::exception & e) {
+            qDebug() << "Failed to open the cache index:" << e.what();
+            _index.reset();
+
+            return false;
+        }
+        if ( valid && (_index->getNumRemovedRecords() > _index->getNumRecords() / 2) ) {
+            _index->compact();
         }
 
-#ifdef DEBUG
-        if ( !_isTiled && !checkFileNameMatchesHash(it->filePath, it->hash) ) {
-            qDebug() << "WARNING: Cache entry filename is not the same as the serialized hash key";
+        U32 nRecords = _index->getNumRecords();
+        records.reserve(nRecords);
+        for (U32 i = 0; i < nRecords; ++i) {
+            const CacheIndexRecord& record = _index->getRecord(i);
+            if (record.flags & CacheIndexRecord::eFlagRemoved) {
+                continue;
+            }
+            if (record.size != tileSizeBytes) {
+                if (!isTiled) {
+                    unusedFiles.push_back( getIndexRecordFilePath(record) );
+                }
+                _index->removeRecord(i);
+                continue;
+            }
+            records.push_back( std::make_pair(i, record) );
         }
-#endif
+    }
+    for (std::size_t i = 0; i < unusedFiles.size(); ++i) {
+        QFile::remove( QString::fromUtf8( unusedFiles[i].c_str() ) );
+    }
 
-        EntryType* value = NULL;
+    // Least recently used first, so that pending records are evicted in LRU order
+    std::sort(records.begin(), records.end(), compareCacheIndexRecordsLRU);
 
-        try {
-            value = new EntryType(it->key, it->params, this);
-            if (it->size != getTileSizeBytes()) {
-                delete value;
+    std::set<QString> usedFilePaths;
+    std::set<std::pair<std::string, U64> > usedTiles;
+    std::vector<U32> invalidRecords;
+    std::size_t restoredSize = 0;
+    for (std::size_t i = 0; i < records.size(); ++i) {
+        const CacheIndexRecord& record = records[i].second;
+        const std::string filePath = getIndexRecordFilePath(record);
+
+        if (isTiled) {
+            // Reserve the tile now so that it is not handed out to a new entry before this one is looked-up
+            bool validTile = (record.dataOffsetInFile % tileSizeBytes == 0) && (record.dataOffsetInFile / tileSizeBytes < nTilesPerFile) &&
+                             usedTiles.insert( std::make_pair(filePath, record.dataOffsetInFile) ).second;
+            if ( !validTile || !getTileCacheFile(filePath, record.dataOffsetInFile) ) {
+                invalidRecords.push_back(records[i].first);
                 continue;
             }
-            ///This will not put the entry back into RAM, instead we just insert back the entry into the disk cache
-            value->restoreMetadataFromFile(it->size, it->filePath, it->dataOffsetInFile);
-        } catch (const std::exception & e) {
-            qDebug() << e.what();
-            delete value;
-            continue;
         }
-        const std::string& filePath = value->getFilePath();
-        usedFilePaths.insert(QString::fromUtf8(filePath.c_str()));
-        {
-            QMutexLocker locker(&_lock);
-            sealEntry(EntryTypePtr(value), false /*inMemory*/);
+        usedFilePaths.insert( QString::fromUtf8( filePath.c_str() ) );
+        restoredSize += record.size;
+
+        const CacheBucket& bucket = getBucket(record.hash);
+        QMutexLocker locker(&bucket.lock);
+        bucket.pendingIndexRecords.insert( std::make_pair(record.hash, records[i].first) );
+        bucket.pendingIndexRecordsByAge.push_back(records[i].first);
+    }
+
+    {
+        QMutexLocker k(&_sizeLock);
+        _diskCacheSize += restoredSize;
+    }
+
+    // From now on the index no longer matches the cache until the next save()
+    markIndexDirty();
+    {
+        QMutexLocker k(&_indexLock);
+        for (std::size_t i = 0; i < invalidRecords.size(); ++i) {
+            _index->removeRecord(invalidRecords[i]);
         }
     }
 
-    // Remove from the cache all files that are not referenced by the table of contents
-    QString cachePath = getCachePath();
-    if (isTileCache()) {
-        QDir cacheFolder(cachePath);
+    // Remove from the cache all files that are not referenced by the index
+    if (isTiled) {
+        usedFilePaths.insert( QString::fromUtf8( getIndexFilePath().c_str() ) );
+        usedFilePaths.insert( QString::fromUtf8( getIndexPayloadFilePath().c_str() ) );
+
+        QDir cacheFolder( getCachePath() );
         QString absolutePath = cacheFolder.absolutePath();
         QStringList etr = cacheFolder.entryList(QDir::NoDotAndDotDot);
         for (QStringList::iterator it = etr.begin(); it!=etr.end(); ++it) {
@@ -172,62 +368,10 @@ Cache<EntryType>::restore(const CacheTOC & tableOfContents)
                 cacheFolder.remove(*it);
             }
         }
-    } else {
-        for (U32 i = 0x00; i <= 0xF; ++i) {
-            for (U32 j = 0x00; j <= 0xF; ++j) {
-                char str[3] = { '0', '0', 0 };
-                str[0] += i;
-                str[1] += j;
-
-                QDir cacheFolder(cachePath + QLatin1Char('/') + QString::fromUtf8(str));
-                QString absolutePath = cacheFolder.absolutePath();
-                QStringList etr = cacheFolder.entryList(QDir::NoDotAndDotDot);
-                for (QStringList::iterator it = etr.begin(); it!=etr.end(); ++it) {
-                    QString entryFilePath = absolutePath + QLatin1Char('/') + *it;
-
-                    std::set<QString>::iterator foundUsed = usedFilePaths.find(entryFilePath);
-                    if (foundUsed == usedFilePaths.end()) {
-                        cacheFolder.remove(*it);
-                    }
-                }
-            }
-        }
-
-    }
-}
-
-template<typename EntryType>
-struct Cache<EntryType>::SerializedEntry
-{
-    hash_type hash;
-    typename EntryType::key_type key;
-    ParamsTypePtr params;
-    std::size_t size; //< the data size in bytes
-    std::string filePath; //< we need to serialize it as several entries can have the same hash, hence we index them
-    std::size_t dataOffsetInFile;
-
-    SerializedEntry()
-        : hash(0)
-          , key()
-          , params()
-          , size(0)
-          , filePath()
-          , dataOffsetInFile(0)
-    {
     }
 
-    template<class Archive>
-    void serialize(Archive & ar,
-                   const unsigned int /*version*/)
-    {
-        ar & ::boost::serialization::make_nvp("Hash", hash);
-        ar & ::boost::serialization::make_nvp("Key", key);
-        ar & ::boost::serialization::make_nvp("Params", params);
-        ar & ::boost::serialization::make_nvp("Size", size);
-        ar & ::boost::serialization::make_nvp("Filename", filePath);
-        ar & ::boost::serialization::make_nvp("Offset", dataOffsetInFile);
-    }
-};
+    return valid;
+} // restore
 
 NATRON_NAMESPACE_EXIT
 
@@ -32,6 +32,7 @@
 GCC_DIAG_UNUSED_LOCAL_TYPEDEFS_OFF
 #include <boost/math/special_functions/fpclassify.hpp>
 GCC_DIAG_UNUSED_LOCAL_TYPEDEFS_ON
+#include <boost/make_shared.hpp>
 #endif
 #include "Engine/AppManager.h"
 
@@ -304,6 +305,7 @@ Curve::setPeriodic(bool periodic)
     QMutexLocker k(&_imp->_lock);
     _imp->isPeriodic = periodic;
     _imp->keyFrames.clear();
+    _imp->invalidateSnapshot();
 }
 
 bool
@@ -324,6 +326,7 @@ Curve::clearKeyFrames()
     QMutexLocker l(&_imp->_lock);
 
     _imp->keyFrames.clear();
+    _imp->invalidateSnapshot();
 }
 
 bool
@@ -783,42 +786,48 @@ Curve::getKeyFrameWithTime(double time,
     return true;
 }
 
-/// compute interpolation parameters from keyframes and an iterator
-/// to the next keyframe (the first with time > t)
-static void
-interParams(const KeyFrameSet &keyFrames,
-            bool isPeriodic,
-            double xMin,
-            double xMax,
-            double *t,
-            KeyFrameSet::const_iterator itup,
-            double *tcur,
-            double *vcur,
-            double *vcurDerivRight,
-            KeyframeTypeEnum *interp,
-            double *tnext,
-            double *vnext,
-            double *vnextDerivLeft,
-            KeyframeTypeEnum *interpNext)
+/// if the curve is periodic, bring back t in the curve keyframes range
+static double
+periodicTime(double t,
+             double firstKeyFrameTime,
+             double xMin,
+             double xMax)
 {
-
-    assert(keyFrames.size() >= 1);
-    assert( itup == keyFrames.end() || *t < itup->getTime() );
     double period = xMax - xMin;
-    if (isPeriodic) {
-        // if the curve is periodic, bring back t in the curve keyframes range
-        double minKeyFrameX = keyFrames.begin()->getTime() + xMin;
-        assert(xMin < xMax);
-        if (*t < minKeyFrameX || *t > minKeyFrameX + period) {
-            // This will bring t either in minTime <= t <= maxTime or t in the range minTime - (maxTime - minTime) < t < minTime
-            *t = std::fmod(*t - minKeyFrameX, period ) + minKeyFrameX;
-            if (*t < minKeyFrameX) {
-                *t += period;
-            }
-            assert(*t >= minKeyFrameX && *t <= minKeyFrameX + period);
+    double minKeyFrameX = firstKeyFrameTime + xMin;
+
+    assert(xMin < xMax);
+    if (t < minKeyFrameX || t > minKeyFrameX + period) {
+        // This will bring t either in minTime <= t <= maxTime or t in the range minTime - (maxTime - minTime) < t < minTime
+        t = std::fmod(t - minKeyFrameX, period ) + minKeyFrameX;
+        if (t < minKeyFrameX) {
+            t += period;
         }
-        itup = keyFrames.upper_bound(KeyFrame(*t, 0.));
+        assert(t >= minKeyFrameX && t <= minKeyFrameX + period);
     }
+
+    return t;
+}
+
+/// compute the interpolation parameters of the segment ending at the keyframe itup
+/// (keyFrames.end() for the segment after the last keyframe)
+static void
+segmentParams(const KeyFrameSet &keyFrames,
+              bool isPeriodic,
+              double xMin,
+              double xMax,
+              KeyFrameSet::const_iterator itup,
+              double *tcur,
+              double *vcur,
+              double *vcurDerivRight,
+              KeyframeTypeEnum *interp,
+              double *tnext,
+              double *vnext,
+              double *vnextDerivLeft,
+              KeyframeTypeEnum *interpNext)
+{
+    assert(keyFrames.size() >= 1);
+    double period = xMax - xMin;
     if ( itup == keyFrames.begin() ) {
         // We are in the case where all keys have a greater time
         // If periodic, we are in between xMin and the first keyframe
@@ -873,10 +882,9 @@ interParams(const KeyFrameSet &keyFrames,
         
     } else {
         // between two keyframes
-        // get the last keyframe with time <= t
+        // the previous keyframe
         KeyFrameSet::const_iterator itcur = itup;
         --itcur;
-        assert(itcur->getTime() <= *t);
         *tcur = itcur->getTime();
         *vcur = itcur->getValue();
         *vcurDerivRight = itcur->getRightDerivative();
@@ -888,13 +896,157 @@ interParams(const KeyFrameSet &keyFrames,
     }
 }
 
+/// compute interpolation parameters from keyframes and an iterator
+/// to the next keyframe (the first with time > t)
+static void
+interParams(const KeyFrameSet &keyFrames,
+            bool isPeriodic,
+            double xMin,
+            double xMax,
+            double *t,
+            KeyFrameSet::const_iterator itup,
+            double *tcur,
+            double *vcur,
+            double *vcurDerivRight,
+            KeyframeTypeEnum *interp,
+            double *tnext,
+            double *vnext,
+            double *vnextDerivLeft,
+            KeyframeTypeEnum *interpNext)
+{
+    assert(keyFrames.size() >= 1);
+    assert( itup == keyFrames.end() || *t < itup->getTime() );
+    if (isPeriodic) {
+        *t = periodicTime(*t, keyFrames.begin()->getTime(), xMin, xMax);
+        itup = keyFrames.upper_bound(KeyFrame(*t, 0.));
+    }
+    assert( itup == keyFrames.begin() || (--KeyFrameSet::const_iterator(itup))->getTime() <= *t );
+    segmentParams(keyFrames, isPeriodic, xMin, xMax, itup, tcur, vcur, vcurDerivRight, interp, tnext, vnext, vnextDerivLeft, interpNext);
+}
+
+CurveSnapshot::CurveSnapshot(const CurvePrivate& curve)
+    : times()
+    , segments()
+    , owner(curve.owner)
+    , dimensionInOwner(curve.dimensionInOwner)
+    , type(curve.type)
+    , xMin(curve.xMin)
+    , xMax(curve.xMax)
+    , yMin(curve.yMin)
+    , yMax(curve.yMax)
+    , isPeriodic(curve.isPeriodic)
+    , mustClamp( curve.owner || curve.yMin != -std::numeric_limits<double>::infinity() || curve.yMax != std::numeric_limits<double>::infinity() )
+{
+    if ( curve.keyFrames.empty() ) {
+        return;
+    }
+    times.reserve( curve.keyFrames.size() );
+    segments.resize(curve.keyFrames.size() + 1);
+
+    std::vector<Segment>::iterator segment = segments.begin();
+    for (KeyFrameSet::const_iterator itup = curve.keyFrames.begin(); ; ++itup, ++segment) {
+        double tcur, tnext;
+        double vcurDerivRight, vnextDerivLeft, vcur, vnext;
+        KeyframeTypeEnum interp, interpNext;
+        segmentParams(curve.keyFrames, isPeriodic, xMin, xMax, itup,
+                      &tcur, &vcur, &vcurDerivRight, &interp,
+                      &tnext, &vnext, &vnextDerivLeft, &interpNext);
+        Interpolation::interpolationCoeffs(tcur, vcur,
+                                           vcurDerivRight,
+                                           vnextDerivLeft,
+                                           tnext, vnext,
+                                           interp,
+                                           interpNext,
+                                           &segment->t0, &segment->t1, segment->coeffs);
+        if ( itup == curve.keyFrames.end() ) {
+            break;
+        }
+        times.push_back( itup->getTime() );
+    }
+}
+
+double
+CurveSnapshot::interpolate(double t) const
+{
+    assert( !times.empty() );
+    if (isPeriodic) {
+        t = periodicTime(t, times.front(), xMin, xMax);
+    }
+    // find the first keyframe with time greater than t
+    const Segment& segment = segments[std::upper_bound(times.begin(), times.end(), t) - times.begin()];
+
+    return Interpolation::interpolateWithCoeffs(segment.coeffs, segment.t0, segment.t1, t);
+}
+
+CurveSnapshotPtr
+CurvePrivate::getSnapshot() const
+{
+    CurveSnapshotPtr ret = boost::atomic_load(&snapshot);
+
+    if (ret) {
+        return ret;
+    }
+
+    // the curve changed: build a new snapshot, the keyframes must not change meanwhile
+    QMutexLocker l(&_lock);
+    ret = boost::atomic_load(&snapshot);
+    if (!ret) {
+        ret = boost::make_shared<CurveSnapshot>(*this);
+        boost::atomic_store(&snapshot, ret);
+    }
+
+    return ret;
+}
+
+void
+CurvePrivate::invalidateSnapshot()
+{
+    // PRIVATE - should not lock
+    boost::atomic_store( &snapshot, CurveSnapshotPtr() );
+}
+
+/// the range of the values of a curve held by owner, or [yMin, yMax] if it has no owner
+static Curve::YRange
+getOwnerYRange(KnobI* owner,
+               int dimensionInOwner,
+               double yMin,
+               double yMax)
+{
+    if (!owner) {
+        return Curve::YRange(yMin, yMax);
+    }
+
+    KnobDoubleBase* isDouble = dynamic_cast<KnobDoubleBase*>(owner);
+    KnobIntBase* isInt = dynamic_cast<KnobIntBase*>(owner);
+    if (isDouble) {
+        double min = isDouble->getMinimum(dimensionInOwner);
+        if (min <= -DBL_MAX) {
+            min = -std::numeric_limits<double>::infinity();
+        }
+        double max = isDouble->getMaximum(dimensionInOwner);
+        if (max >= DBL_MAX) {
+            max = std::numeric_limits<double>::infinity();
+        }
+
+        return Curve::YRange(min, max);
+    } else if (isInt) {
+        double min = isInt->getMinimum(dimensionInOwner);
+        double max = isInt->getMaximum(dimensionInOwner);
+
+        return Curve::YRange(min, max);
+    } else {
+        return Curve::YRange( -std::numeric_limits<double>::infinity(), std::numeric_limits<double>::infinity() );
+    }
+}
+
 double
 Curve::getValueAt(double t,
                   bool doClamp) const
 {
-    QMutexLocker l(&_imp->_lock);
+    // Lock-free: the keyframes are read from the last snapshot of the curve
+    CurveSnapshotPtr snapshot = _imp->getSnapshot();
 
-    if ( _imp->keyFrames.empty() ) {
+    if ( snapshot->times.empty() ) {
         //throw std::runtime_error("Curve has no control points!");
 
         // A curve with no control points is considered to be 0
@@ -902,62 +1054,21 @@ Curve::getValueAt(double t,
         return 0.;
 
         // There is no special case for a curve with one (1) keyframe: the result is a linear curve before and after the keyframe.
-    //} else if (_imp->keyFrames.size() == 1) {
-    //    return _imp->keyFrames.begin()->getValue();
     }
 
-    double v;
-#ifdef NATRON_CURVE_USE_CACHE
-    std::map<double, double>::const_iterator foundCached = _imp->resultCache.find(t);
-    if ( foundCached != _imp->resultCache.end() ) {
-        v = foundCached->second;
-    } else
-#endif
-    {
-        // even when there is only one keyframe, there may be tangents!
-        //if (_imp->keyFrames.size() == 1) {
-        //    //if there's only 1 keyframe, don't bother interpolating
-        //    return (*_imp->keyFrames.begin()).getValue();
-        //}
-        double tcur, tnext;
-        double vcurDerivRight, vnextDerivLeft, vcur, vnext;
-        KeyframeTypeEnum interp, interpNext;
-        KeyFrame k(t, 0.);
-        // find the first keyframe with time greater than t
-        KeyFrameSet::const_iterator itup;
-        itup = _imp->keyFrames.upper_bound(k);
-        interParams(_imp->keyFrames,
-                    _imp->isPeriodic,
-                    _imp->xMin,
-                    _imp->xMax,
-                    &t,
-                    itup,
-                    &tcur,
-                    &vcur,
-                    &vcurDerivRight,
-                    &interp,
-                    &tnext,
-                    &vnext,
-                    &vnextDerivLeft,
-                    &interpNext);
-
-        v = Interpolation::interpolate(tcur, vcur,
-                                       vcurDerivRight,
-                                       vnextDerivLeft,
-                                       tnext, vnext,
-                                       t,
-                                       interp,
-                                       interpNext);
-#ifdef NATRON_CURVE_USE_CACHE
-        _imp->resultCache[t] = v;
-#endif
-    }
+    // even when there is only one keyframe, there may be tangents!
+    double v = snapshot->interpolate(t);
 
-    if ( doClamp && mustClamp() ) {
-        v = clampValueToCurveYRange(v);
+    if (doClamp && snapshot->mustClamp) {
+        YRange minmax = getOwnerYRange(snapshot->owner, snapshot->dimensionInOwner, snapshot->yMin, snapshot->yMax);
+        if (v > minmax.max) {
+            v = minmax.max;
+        } else if (v < minmax.min) {
+            v = minmax.min;
+        }
     }
 
-    switch (_imp->type) {
+    switch (snapshot->type) {
     case CurvePrivate::eCurveTypeString:
     case CurvePrivate::eCurveTypeInt:
 
@@ -1191,48 +1302,8 @@ Curve::YRange Curve::getCurveYRange() const
     if ( !mustClamp() ) {
         return YRange( -std::numeric_limits<double>::infinity(), std::numeric_limits<double>::infinity() );
     }
-    if (!_imp->owner) {
-        return YRange(_imp->yMin, _imp->yMax);
-    }
-
-    KnobDoubleBase* isDouble = dynamic_cast<KnobDoubleBase*>(_imp->owner);
-    KnobIntBase* isInt = dynamic_cast<KnobIntBase*>(_imp->owner);
-    if (isDouble) {
-        double min = isDouble->getMinimum(_imp->dimensionInOwner);
-        if (min <= -DBL_MAX) {
-            min = -std::numeric_limits<double>::infinity();
-        }
-        double max = isDouble->getMaximum(_imp->dimensionInOwner);
-        if (max >= DBL_MAX) {
-            max = std::numeric_limits<double>::infinity();
-        }
-
-        return YRange(min, max);
-    } else if (isInt) {
-        double min = isInt->getMinimum(_imp->dimensionInOwner);
-        double max = isInt->getMaximum(_imp->dimensionInOwner);
-
-        return YRange(min, max);
-    } else {
-        return YRange( -std::numeric_limits<double>::infinity(), std::numeric_limits<double>::infinity() );
-    }
-
-}
-
-double
-Curve::clampValueToCurveYRange(double v) const
-{
-    // PRIVATE - should not lock
-    ////clamp to min/max if the owner of the curve is a Double or Int knob.
-    YRange minmax = getCurveYRange();
-
-    if (v > minmax.max) {
-        return minmax.max;
-    } else if (v < minmax.min) {
-        return minmax.min;
-    }
 
-    return v;
+    return getOwnerYRange(_imp->owner, _imp->dimensionInOwner, _imp->yMin, _imp->yMax);
 }
 
 bool
@@ -1252,6 +1323,7 @@ Curve::setXRange(double a,
 
     _imp->xMin = a;
     _imp->xMax = b;
+    _imp->invalidateSnapshot();
 }
 
 std::pair<double, double> Curve::getXRange() const
@@ -1817,6 +1889,7 @@ Curve::setYRange(double yMin,
 
     _imp->yMin = yMin;
     _imp->yMax = yMax;
+    _imp->invalidateSnapshot();
 }
 
 bool
@@ -1833,9 +1906,7 @@ Curve::onCurveChanged()
     if (_imp->owner) {
         _imp->owner->clearExpressionsResults(_imp->dimensionInOwner);
     }
-#ifdef NATRON_CURVE_USE_CACHE
-    _imp->resultCache.clear();
-#endif
+    _imp->invalidateSnapshot();
 }
 
 void
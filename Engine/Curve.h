@@ -370,8 +370,6 @@ private:
 
     void removeKeyFrame(KeyFrameSet::const_iterator it);
 
-    double clampValueToCurveYRange(double v) const WARN_UNUSED_RETURN;
-
     void setKeyframesInternal(const KeyFrameSet& keys, bool refreshDerivatives);
 
     ///returns an iterator to the new keyframe in the keyframe set and
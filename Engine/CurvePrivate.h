@@ -27,6 +27,8 @@
 
 #include "Global/Macros.h"
 
+#include <vector>
+
 #if !defined(Q_MOC_RUN) && !defined(SBK_RUN)
 #include <boost/shared_ptr.hpp>
 #endif
@@ -39,10 +41,11 @@
 #include "Engine/KnobFile.h"
 #include "Engine/EngineFwd.h"
 
-//#define NATRON_CURVE_USE_CACHE
-
 NATRON_NAMESPACE_ENTER
 
+struct CurveSnapshot;
+typedef boost::shared_ptr<const CurveSnapshot> CurveSnapshotPtr;
+
 struct CurvePrivate
 {
     enum CurveTypeEnum
@@ -57,9 +60,9 @@ struct CurvePrivate
 
     KeyFrameSet keyFrames;
 
-#ifdef NATRON_CURVE_USE_CACHE
-    std::map<double, double> resultCache; //< a cache for interpolations
-#endif
+    // Published with boost::atomic_load/atomic_store only: getValueAt() reads it without taking _lock.
+    // It is reset when the curve changes and built again by the next getValueAt() call.
+    mutable CurveSnapshotPtr snapshot;
 
     KnobI* owner;
     int dimensionInOwner;
@@ -72,9 +75,7 @@ struct CurvePrivate
 
     CurvePrivate()
         : keyFrames()
-#ifdef NATRON_CURVE_USE_CACHE
-        , resultCache()
-#endif
+        , snapshot()
         , owner(NULL)
         , dimensionInOwner(-1)
         , type(eCurveTypeDouble)
@@ -106,9 +107,51 @@ struct CurvePrivate
         yMin = other.yMin;
         yMax = other.yMax;
         isPeriodic = other.isPeriodic;
+        invalidateSnapshot();
     }
 
-    
+    /**
+     * @brief Returns the snapshot of the current state of the curve, building it if needed.
+     * Does not lock unless the curve changed since the last call.
+     **/
+    CurveSnapshotPtr getSnapshot() const;
+
+    /**
+     * @brief Must be called with _lock held whenever the keyframes or the ranges of the curve change.
+     **/
+    void invalidateSnapshot();
+};
+
+/**
+ * @brief An immutable copy of a curve, evaluated without locking. Each segment holds the cubic
+ * computed by Interpolation::interpolationCoeffs(), so that evaluating the curve is a binary search
+ * in the keyframe times followed by a polynomial evaluation, with exactly the results of Interpolation::interpolate().
+ **/
+struct CurveSnapshot
+{
+    struct Segment
+    {
+        double t0, t1;
+        double coeffs[4];
+    };
+
+    std::vector<double> times; //< the keyframe times, in increasing order
+    std::vector<Segment> segments; //< times.size() + 1 segments: before the first keyframe, between keyframes and after the last one
+
+    KnobI* owner;
+    int dimensionInOwner;
+    CurvePrivate::CurveTypeEnum type;
+    double xMin, xMax;
+    double yMin, yMax;
+    bool isPeriodic;
+    bool mustClamp;
+
+    explicit CurveSnapshot(const CurvePrivate& curve);
+
+    /**
+     * @brief Returns the interpolated value at t, before clamping and rounding. The curve must have keyframes.
+     **/
+    double interpolate(double t) const WARN_UNUSED_RETURN;
 };
 
 NATRON_NAMESPACE_EXIT
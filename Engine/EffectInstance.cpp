@@ -55,6 +55,7 @@ GCC_DIAG_UNUSED_LOCAL_TYPEDEFS_ON
 #include "Engine/AppInstance.h"
 #include "Engine/AppManager.h"
 #include "Engine/BlockingBackgroundRender.h"
+#include "Engine/Cache.h" // CacheEntryProduction
 #include "Engine/DiskCacheNode.h"
 #include "Engine/Image.h"
 #include "Engine/ImageParams.h"
@@ -472,7 +473,9 @@ EffectInstance::Implementation::aborted(bool isRenderResponseToUserInteraction,
 }
 
 bool
-EffectInstance::aborted() const
+EffectInstance::getAbortInfo(bool* isRenderUserInteraction,
+                             AbortableRenderInfoPtr* abortInfo,
+                             EffectInstancePtr* treeRoot) const
 {
     QThread* thisThread = QThread::currentThread();
 
@@ -487,12 +490,7 @@ EffectInstance::aborted() const
        Threads that start a render generally already have the AbortableThread::setAbortInfo function called on them, but
        threads spawned from the thread pool may not.
      **/
-    bool isRenderUserInteraction;
-    AbortableRenderInfoPtr abortInfo;
-    EffectInstancePtr treeRoot;
-
-
-    if ( !isAbortableThread || !isAbortableThread->getAbortInfo(&isRenderUserInteraction, &abortInfo, &treeRoot) ) {
+    if ( !isAbortableThread || !isAbortableThread->getAbortInfo(isRenderUserInteraction, abortInfo, treeRoot) ) {
         // If this thread is not abortable or we did not set the abort info for this render yet, retrieve them from the TLS of this node.
         EffectTLSDataPtr tls = _imp->tlsData->getTLSData();
         if (!tls) {
@@ -502,17 +500,31 @@ EffectInstance::aborted() const
             return false;
         }
         const ParallelRenderArgsPtr & args = tls->frameArgs.back();
-        isRenderUserInteraction = args->isRenderResponseToUserInteraction;
-        abortInfo = args->abortInfo.lock();
+        *isRenderUserInteraction = args->isRenderResponseToUserInteraction;
+        *abortInfo = args->abortInfo.lock();
         if (args->treeRoot) {
-            treeRoot = args->treeRoot->getEffectInstance();
+            *treeRoot = args->treeRoot->getEffectInstance();
         }
 
         if (isAbortableThread) {
-            isAbortableThread->setAbortInfo(isRenderUserInteraction, abortInfo, treeRoot);
+            isAbortableThread->setAbortInfo(*isRenderUserInteraction, *abortInfo, *treeRoot);
         }
     }
 
+    return true;
+}
+
+bool
+EffectInstance::aborted() const
+{
+    bool isRenderUserInteraction;
+    AbortableRenderInfoPtr abortInfo;
+    EffectInstancePtr treeRoot;
+
+    if ( !getAbortInfo(&isRenderUserInteraction, &abortInfo, &treeRoot) ) {
+        return false;
+    }
+
     // The internal function that given a AbortableRenderInfoPtr determines if a render was aborted or not
     return Implementation::aborted(isRenderUserInteraction,
                                    abortInfo,
@@ -1474,6 +1486,7 @@ static void
 getOrCreateFromCacheInternal(const ImageKey & key,
                              const ImageParamsPtr & params,
                              bool useCache,
+                             BitmapStorageEnum bitmapStorage,
                              ImagePtr* image)
 {
     if (!useCache) {
@@ -1501,7 +1514,9 @@ getOrCreateFromCacheInternal(const ImageKey & key,
         /*
          * Note that at this point the image is already exposed to other threads and another one might already have allocated it.
          * This function does nothing if it has been reallocated already.
+         * If it is, its bitmap is converted to the requested storage.
          */
+        (*image)->setBitmapStorage(bitmapStorage);
         (*image)->allocateMemory();
 
 
@@ -1525,7 +1540,7 @@ EffectInstance::convertOpenGLTextureToCachedRAMImage(const ImagePtr& image)
     info.mode = eStorageModeRAM;
 
     ImagePtr ramImage;
-    getOrCreateFromCacheInternal(image->getKey(), params, true /*useCache*/, &ramImage);
+    getOrCreateFromCacheInternal(image->getKey(), params, true /*useCache*/, image->getBitmapStorage(), &ramImage);
     if (!ramImage) {
         return ramImage;
     }
@@ -1608,7 +1623,7 @@ EffectInstance::convertRAMImageToOpenGLTexture(const ImagePtr& image)
 
     // The creation of the image will use glTexImage2D and will get filled with the PBO
     ImagePtr gpuImage;
-    getOrCreateFromCacheInternal(image->getKey(), params, false /*useCache*/, &gpuImage);
+    getOrCreateFromCacheInternal(image->getKey(), params, false /*useCache*/, eBitmapStoragePixels, &gpuImage);
 
     // it is good idea to release PBOs with ID 0 after use.
     // Once bound with 0, all pixel operations are back to normal ways.
@@ -1658,7 +1673,38 @@ EffectInstance::getImageFromCacheAndConvertIfNeeded(bool /*useCache*/,
     if (!isCached) {
         // For textures, we lookup for a RAM image, if found we convert it to a texture
         if ( (storage == eStorageModeRAM) || (storage == eStorageModeGLTex) ) {
-            isCached = appPTR->getImage(key, &cachedImages);
+            // Only the first look-up counts in the cache statistics, the ones after waiting for another render do not
+            bool isRenderUserInteraction;
+            AbortableRenderInfoPtr abortInfo;
+            EffectInstancePtr treeRoot;
+            getAbortInfo(&isRenderUserInteraction, &abortInfo, &treeRoot);
+            for (bool countLookup = true;; countLookup = false) {
+                CacheEntryProductionPtr inFlight;
+                isCached = appPTR->getImage(key, mipMapLevel, components, &cachedImages, &inFlight, countLookup);
+                if (isCached || !inFlight) {
+                    break;
+                }
+                // Another thread is rendering this image: wait for it rather than rendering it twice, then look-up again.
+                // If it gave up (e.g: its render was aborted) the image will not be there and we render it ourselves.
+                // Aborting our render wakes us up (see AbortableRenderInfo::setAborted()).
+                if (abortInfo) {
+                    abortInfo->addWaitedProduction(inFlight);
+                }
+                bool isAborted = false;
+                for (;;) {
+                    int wakeUps = inFlight->getWakeUps();
+                    isAborted = aborted();
+                    if ( isAborted || inFlight->waitForProduction(wakeUps) ) {
+                        break;
+                    }
+                }
+                if (abortInfo) {
+                    abortInfo->removeWaitedProduction(inFlight);
+                }
+                if (isAborted) {
+                    break;
+                }
+            }
         } else if (storage == eStorageModeDisk) {
             isCached = appPTR->getImage_diskCache(key, &cachedImages);
         }
@@ -1774,7 +1820,7 @@ EffectInstance::getImageFromCacheAndConvertIfNeeded(bool /*useCache*/,
 
 
                 ImagePtr img;
-                getOrCreateFromCacheInternal(key, imageParams, imageToConvert->usesBitMap(), &img);
+                getOrCreateFromCacheInternal(key, imageParams, imageToConvert->usesBitMap(), imageToConvert->getBitmapStorage(), &img);
                 if (!img) {
                     return;
                 }
@@ -1992,6 +2038,7 @@ EffectInstance::allocateImagePlane(const ImageKey & key,
                                    bool renderFullScaleThenDownscale,
                                    StorageModeEnum storage,
                                    bool createInCache,
+                                   BitmapStorageEnum bitmapStorage,
                                    ImagePtr* fullScaleImage,
                                    ImagePtr* downscaleImage)
 {
@@ -2013,7 +2060,7 @@ EffectInstance::allocateImagePlane(const ImageKey & key,
         //The upscaled image will be rendered with input images at full def, it is then the best possibly rendered image so cache it!
 
         fullScaleImage->reset();
-        getOrCreateFromCacheInternal(key, upscaledImageParams, createInCache, fullScaleImage);
+        getOrCreateFromCacheInternal(key, upscaledImageParams, createInCache, bitmapStorage, fullScaleImage);
 
         if (!*fullScaleImage) {
             return false;
@@ -2037,7 +2084,7 @@ EffectInstance::allocateImagePlane(const ImageKey & key,
         ///When calling allocateMemory() on the image, the cache already has the lock since it added it
         ///so taking this lock now ensures the image will be allocated completely
 
-        getOrCreateFromCacheInternal(key, cachedImgParams, createInCache, downscaleImage);
+        getOrCreateFromCacheInternal(key, cachedImgParams, createInCache, bitmapStorage, downscaleImage);
         if (!*downscaleImage) {
             return false;
         }
@@ -2176,8 +2223,11 @@ EffectInstance::Implementation::tiledRenderingFunctor(EffectInstance::Implementa
                                                                         args.processChannels,
                                                                         args.planes);
 
-    //Exit of the host frame threading thread
-    appPTR->getAppTLS()->cleanupTLSForThread();
+    //Exit of the host frame threading thread. The calling thread may also render tiles while it waits for the others:
+    //its TLS must be kept
+    if (callingThread != curThread) {
+        appPTR->getAppTLS()->cleanupTLSForThread();
+    }
 
     return ret;
 }
@@ -2404,6 +2454,9 @@ EffectInstance::Implementation::renderHandler(const EffectTLSDataPtr& tls,
         timeRecorder = boost::make_shared<TimeLapse>();
     }
 
+    // Measures the cost of recomputing the images rendered here, used by the cache eviction policy
+    TimeLapse renderTimer;
+
     const EffectInstance::PlaneToRender & firstPlane = planes.planes.begin()->second;
     const double time = tls->currentRenderArgs.time;
     const ViewIdx view = tls->currentRenderArgs.view;
@@ -2747,6 +2800,7 @@ EffectInstance::Implementation::renderHandler(const EffectTLSDataPtr& tls,
 
     assert(!renderAborted);
 
+    const double renderTime = renderTimer.getTimeSinceCreation();
     bool unPremultIfNeeded = planes.outputPremult == eImagePremultiplicationPremultiplied;
     bool useMaskMix = _publicInterface->isHostMaskingEnabled() || _publicInterface->isHostMixingEnabled();
     double mix = useMaskMix ? _publicInterface->getNode()->getHostMixingValue(time, view) : 1.;
@@ -2907,6 +2961,14 @@ EffectInstance::Implementation::renderHandler(const EffectTLSDataPtr& tls,
             } // if (renderFullScaleThenDownscale) {
         } // if (it->second.isAllocatedOnTheFly) {
 
+        // All planes are produced by the same render action: recomputing any of them costs the whole render
+        if (it->second.fullscaleImage) {
+            it->second.fullscaleImage->addRecomputeCost(renderTime);
+        }
+        if ( it->second.downscaleImage && (it->second.downscaleImage != it->second.fullscaleImage) ) {
+            it->second.downscaleImage->addRecomputeCost(renderTime);
+        }
+
         if ( frameArgs->stats && frameArgs->stats->isInDepthProfilingEnabled() ) {
             frameArgs->stats->addRenderInfosForNode( _publicInterface->getNode(),  NodePtr(), it->first.getChannelsLabel(), renderMappedRectToRender, timeRecorder->getTimeSinceCreation() );
         }
@@ -2961,6 +3023,7 @@ EffectInstance::allocateImagePlaneAndSetInThreadLocalStorage(const ImagePlaneDes
                                  false,
                                  img->getParams()->getStorageInfo().mode,
                                  useCache,
+                                 img->getBitmapStorage(),
                                  &p.fullscaleImage,
                                  &p.downscaleImage);
     if (!ok) {
@@ -1052,6 +1052,13 @@ public:
        in the engine function.*/
     bool aborted() const WARN_UNUSED_RETURN;
 
+    /**
+     * @brief Retrieves the infos aborted() checks for the render of the calling thread. Returns false if there is no render.
+     **/
+    bool getAbortInfo(bool* isRenderUserInteraction,
+                      AbortableRenderInfoPtr* abortInfo,
+                      EffectInstancePtr* treeRoot) const;
+
 
     /** @brief Returns the image computed by the input 'inputNb' at the given time and scale for the given view.
      * @param dontUpscale If the image is retrieved is downscaled but the plug-in doesn't support the user of
@@ -2223,6 +2230,7 @@ private:
                             bool renderFullScaleThenDownscale,
                             StorageModeEnum storage,
                             bool createInCache,
+                            BitmapStorageEnum bitmapStorage,
                             ImagePtr* fullScaleImage,
                             ImagePtr* downscaleImage);
 
@@ -25,6 +25,7 @@
 #include "EffectInstance.h"
 #include "EffectInstancePrivate.h"
 
+#include <list>
 #include <map>
 #include <sstream>
 #include <algorithm> // min, max
@@ -73,6 +74,7 @@ GCC_DIAG_UNUSED_LOCAL_TYPEDEFS_ON
 #include "Engine/RotoContext.h"
 #include "Engine/RotoDrawableItem.h"
 #include "Engine/Settings.h"
+#include "Engine/TaskScheduler.h"
 #include "Engine/Timer.h"
 #include "Engine/Transform.h"
 #include "Engine/ThreadPool.h"
@@ -319,6 +321,59 @@ public:
 };
 #endif // #if NATRON_ENABLE_TRIMAP
 
+/**
+ * @brief Announces to the node cache that this thread is rendering the planes of an image at a mipmap level that are
+ * not cached yet, so that other threads looking them up in getImageFromCacheAndConvertIfNeeded() wait for it instead
+ * of rendering them too.
+ * The production ends when release() is called or when this object is destroyed.
+ **/
+class ImageProduction_RAII
+{
+    boost::scoped_ptr<ImageKey> _key;
+    std::list<CacheEntryProductionPtr> _productions;
+
+public:
+
+    ImageProduction_RAII()
+        : _key()
+        , _productions()
+    {
+    }
+
+    ~ImageProduction_RAII()
+    {
+        release();
+    }
+
+    /**
+     * @brief Registers the production of each plane, except the ones that another thread is already rendering.
+     **/
+    void registerProduction(const ImageKey& key,
+                            unsigned int mipMapLevel,
+                            const std::map<ImagePlaneDesc, EffectInstance::PlaneToRender>& planes)
+    {
+        assert( _productions.empty() );
+        for (std::map<ImagePlaneDesc, EffectInstance::PlaneToRender>::const_iterator it = planes.begin(); it != planes.end(); ++it) {
+            CacheEntryProductionPtr production = appPTR->registerImageProduction(key, mipMapLevel, it->first);
+            if (production) {
+                _productions.push_back(production);
+            }
+        }
+        if ( !_productions.empty() ) {
+            _key.reset( new ImageKey(key) );
+        }
+    }
+
+    void release()
+    {
+        for (std::list<CacheEntryProductionPtr>::const_iterator it = _productions.begin(); it != _productions.end(); ++it) {
+            appPTR->finishImageProduction(*_key, *it);
+        }
+        _productions.clear();
+        _key.reset();
+    }
+};
+
 EffectInstance::RenderRoIRetCode
 EffectInstance::renderRoI(const RenderRoIArgs & args,
                           std::map<ImagePlaneDesc, ImagePtr>* outputPlanes)
@@ -1103,6 +1158,14 @@ EffectInstance::renderRoI(const RenderRoIArgs & args,
         return eRenderRoIRetCodeFailed;
     }
 
+    ///The image is not cached: let other threads that need it wait for us rather than rendering it (and its inputs) a second time.
+    ///The production ends once the planes are allocated in the cache and marked as being rendered (the trimap handles concurrent renders
+    ///from there) or as soon as we return because the render failed or was aborted.
+    ImageProduction_RAII production;
+    if ( !isPlaneCached && createInCache && !byPassCache && (storage == eStorageModeRAM) ) {
+        production.registerProduction(*key, renderMappedMipMapLevel, planesToRender->planes);
+    }
+
     ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
     ////////////////////////////// Determine rectangles left to render /////////////////////////////////////////////////////
 
@@ -1266,9 +1329,10 @@ EffectInstance::renderRoI(const RenderRoIArgs & args,
         // If the plug-in is eRenderSafetyFullySafeFrame that means it wants the host to perform SMP aka slice up the RoI into chunks
         // but if the effect doesn't support tiles it won't work.
         // Also check that the number of threads indicating by the settings are appropriate for this render mode.
+        // The tiles are run by the task scheduler: when its threads are busy, the current thread renders them.
+        // When the scheduler renders as many frames in parallel as there are threads, each frame gets a single thread.
         if ( !frameArgs->tilesSupported || (nbThreads == -1) || (nbThreads == 1) ||
-            ( (nbThreads == 0) && (appPTR->getHardwareIdealThreadCount() == 1) ) ||
-            ( QThreadPool::globalInstance()->activeThreadCount() >= QThreadPool::globalInstance()->maxThreadCount() )) {
+            ( (nbThreads == 0) && ( (appPTR->getHardwareIdealThreadCount() == 1) || (frameArgs->threadBudget == 1) ) ) ) {
             safety = eRenderSafetyFullySafe;
         }
     }
@@ -1413,7 +1477,8 @@ EffectInstance::renderRoI(const RenderRoIArgs & args,
             }
 
             if (!it->second.fullscaleImage) {
-                ///The image is not cached
+                ///The image is not cached.
+                ///The effects that do not support tiles render the image in one go: a bitmap per tile is enough
                 allocateImagePlane(*key,
                                    rod,
                                    downscaledImageBounds,
@@ -1428,6 +1493,7 @@ EffectInstance::renderRoI(const RenderRoIArgs & args,
                                    renderFullScaleThenDownscale,
                                    storage,
                                    createInCache,
+                                   frameArgs->tilesSupported ? eBitmapStoragePixels : eBitmapStorageTiles,
                                    &it->second.fullscaleImage,
                                    &it->second.downscaleImage);
             } else {
@@ -1512,6 +1578,8 @@ EffectInstance::renderRoI(const RenderRoIArgs & args,
             // scoped_ptr
             guard.reset(new ImageBitMapMarker_RAII(planesToRender->planes, renderFullScaleThenDownscale, roi, this));
         }
+        // Threads waiting for the image will now find it in the cache and wait on the regions marked as being rendered
+        production.release();
 #endif // NATRON_ENABLE_TRIMAP
     } // hasSomethingToRender
       ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -1646,6 +1714,12 @@ EffectInstance::renderRoI(const RenderRoIArgs & args,
 
     } // if (!hasSomethingToRender) {
 
+#if !NATRON_ENABLE_TRIMAP
+    // Without the trimap, threads waiting for the image cannot wait on the regions being rendered: release them once it is
+    // rendered, they will find it in the cache
+    production.release();
+#endif // !NATRON_ENABLE_TRIMAP
+
 #if NATRON_ENABLE_TRIMAP
     assert(guard);
     if (renderAborted && renderRetCode != EffectInstance::eRenderRoIStatusImageRendered  && renderRetCode != EffectInstance::eRenderRoIStatusImageAlreadyRendered) {
@@ -1995,14 +2069,13 @@ EffectInstance::renderRoIInternal(EffectInstance* self,
 #else
 
 
-            QFuture<RenderingFunctorRetEnum> ret = QtConcurrent::mapped( planesToRender->rectsToRender,
-                                                                         boost::bind(&EffectInstance::Implementation::tiledRenderingFunctor,
-                                                                                     self->_imp.get(),
-                                                                                     *tiledArgs,
-                                                                                     _1,
-                                                                                     currentThread) );
-            ret.waitForFinished();
-            QFuture<EffectInstance::RenderingFunctorRetEnum>::const_iterator it2;
+            std::vector<RenderingFunctorRetEnum> ret = TaskScheduler::mapped( planesToRender->rectsToRender,
+                                                                              boost::bind(&EffectInstance::Implementation::tiledRenderingFunctor,
+                                                                                          self->_imp.get(),
+                                                                                          *tiledArgs,
+                                                                                          _1,
+                                                                                          currentThread) );
+            std::vector<EffectInstance::RenderingFunctorRetEnum>::const_iterator it2;
 
 #endif
             for (it2 = ret.begin(); it2 != ret.end(); ++it2) {
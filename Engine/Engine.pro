@@ -74,8 +74,10 @@ SOURCES += \
     Bezier.cpp \
     BezierCP.cpp \
     BlockingBackgroundRender.cpp \
+    BufferPool.cpp \
     CLArgs.cpp \
     Cache.cpp \
+    CacheIndexFile.cpp \
     CoonsRegularization.cpp \
     CreateNodeArgs.cpp \
     Curve.cpp \
@@ -109,6 +111,7 @@ SOURCES += \
     ImageMaskMix.cpp \
     ImageParamsSerialization.cpp \
     ImagePlaneDesc.cpp \
+    ImageSIMD.cpp \
     Interpolation.cpp \
     JoinViewsNode.cpp \
     Knob.cpp \
@@ -122,6 +125,7 @@ SOURCES += \
     Markdown.cpp \
     MemoryFile.cpp \
     MemoryInfo.cpp \
+    NativeExpression.cpp \
     NoOpBase.cpp \
     Node.cpp \
     NodeDocumentation.cpp \
@@ -136,6 +140,7 @@ SOURCES += \
     Noise.cpp \
     NonKeyParams.cpp \
     NonKeyParamsSerialization.cpp \
+    NumaTopology.cpp \
     OSGLContext.cpp \
     OSGLContext_mac.cpp \
     OSGLContext_win.cpp \
@@ -170,12 +175,14 @@ SOURCES += \
     RectD.cpp \
     RectI.cpp \
     RenderStats.cpp \
+    RenderThreadBudget.cpp \
     RotoContext.cpp \
     RotoDrawableItem.cpp \
     RotoItem.cpp \
     RotoLayer.cpp \
     RotoPaint.cpp \
     RotoPaintInteract.cpp \
+    RotoRasterizer.cpp \
     RotoSmear.cpp \
     RotoStrokeItem.cpp \
     RotoUndoCommand.cpp \
@@ -185,6 +192,7 @@ SOURCES += \
     StandardPaths.cpp \
     StringAnimationManager.cpp \
     TLSHolder.cpp \
+    TaskScheduler.cpp \
     Texture.cpp \
     TextureRect.cpp \
     ThreadPool.cpp \
@@ -269,9 +277,11 @@ HEADERS += \
     BezierCPSerialization.h \
     BezierSerialization.h \
     BlockingBackgroundRender.h \
+    BufferPool.h \
     BufferableObject.h \
     CLArgs.h \
     Cache.h \
+    CacheIndexFile.h \
     CacheEntry.h \
     CacheEntryHolder.h \
     CacheSerialization.h \
@@ -315,6 +325,7 @@ HEADERS += \
     ImageParams.h \
     ImageParamsSerialization.h \
     ImagePlaneDesc.h \
+    ImageSIMD.h \
     ImageSerialization.h \
     Interpolation.h \
     JoinViewsNode.h \
@@ -335,6 +346,7 @@ HEADERS += \
     MemoryFile.h \
     MemoryInfo.h \
     MergingEnum.h \
+    NativeExpression.h \
     NoOpBase.h \
     Node.h \
     NodeGraphI.h \
@@ -348,6 +360,7 @@ HEADERS += \
     NoiseTables.h \
     NonKeyParams.h \
     NonKeyParamsSerialization.h \
+    NumaTopology.h \
     OSGLContext.h \
     OSGLContext_mac.h \
     OSGLContext_win.h \
@@ -388,6 +401,7 @@ HEADERS += \
     RectI.h \
     RectISerialization.h \
     RenderStats.h \
+    RenderThreadBudget.h \
     RotoContext.h \
     RotoContextPrivate.h \
     RotoContextSerialization.h \
@@ -400,6 +414,7 @@ HEADERS += \
     RotoPaint.h \
     RotoPaintInteract.h \
     RotoPoint.h \
+    RotoRasterizer.h \
     RotoSmear.h \
     RotoStrokeItem.h \
     RotoStrokeItemSerialization.h \
@@ -412,6 +427,7 @@ HEADERS += \
     StringAnimationManager.h \
     TLSHolder.h \
     TLSHolderImpl.h \
+    TaskScheduler.h \
     Texture.h \
     TextureRect.h \
     TextureRectSerialization.h \
@@ -130,6 +130,7 @@ class BlockingBackgroundRender;
 class BufferableObject;
 class CLArgs;
 class CacheEntryHolder;
+class CacheEntryProduction;
 class CacheSignalEmitter;
 class ChoiceExtraData;
 class CreateNodeArgs;
@@ -193,6 +194,7 @@ class KnobTable;
 class LibraryBinary;
 class LogEntry;
 class MemoryFile;
+class NativeExpression;
 class Node;
 class NodeCollection;
 class NodeFrameRequest;
@@ -233,8 +235,12 @@ class ProjectSerialization;
 class RectD;
 class RectI;
 class RenderEngine;
+class RenderPlan;
 class RenderStats;
+class RenderThreadBudget;
+struct RenderThreadBudgetStats;
 class RenderingFlagSetter;
+struct RotoBezierTriangles;
 class RotoContext;
 class RotoDrawableItem;
 class RotoItem;
@@ -244,8 +250,10 @@ class RotoLayerSerialization;
 class RotoPaint;
 class RotoPaintInteract;
 class RotoPoint;
+class RotoRasterizer;
 class RotoStrokeItem;
 class RotoStrokeItemSerialization;
+class RotoStrokeRasterizer;
 class Settings;
 class StringAnimationManager;
 class TLSHolderBase;
@@ -329,6 +337,7 @@ typedef boost::shared_ptr<Bezier> BezierPtr;
 typedef boost::shared_ptr<BezierCP> BezierCPPtr;
 typedef boost::shared_ptr<BezierSerialization> BezierSerializationPtr;
 typedef boost::shared_ptr<BufferableObject> BufferableObjectPtr;
+typedef boost::shared_ptr<CacheEntryProduction> CacheEntryProductionPtr;
 typedef boost::shared_ptr<CacheSignalEmitter> CacheSignalEmitterPtr;
 typedef boost::shared_ptr<Curve> CurvePtr;
 typedef boost::shared_ptr<EffectInstance> EffectInstancePtr;
@@ -378,6 +387,7 @@ typedef boost::shared_ptr<KnobString> KnobStringPtr;
 typedef boost::shared_ptr<KnobTLSData> KnobTLSDataPtr;
 typedef boost::shared_ptr<KnobTable> KnobTablePtr;
 typedef boost::shared_ptr<MemoryFile> MemoryFilePtr;
+typedef boost::shared_ptr<NativeExpression> NativeExpressionPtr;
 typedef boost::shared_ptr<Node> NodePtr;
 typedef boost::shared_ptr<NodeCollection> NodeCollectionPtr;
 typedef boost::shared_ptr<NodeFrameRequest> NodeFrameRequestPtr;
@@ -399,8 +409,10 @@ typedef boost::shared_ptr<PrecompNode> PrecompNodePtr;
 typedef boost::shared_ptr<ProcessHandler> ProcessHandlerPtr;
 typedef boost::shared_ptr<Project> ProjectPtr;
 typedef boost::shared_ptr<RenderEngine> RenderEnginePtr;
+typedef boost::shared_ptr<RenderPlan const> RenderPlanConstPtr;
 typedef boost::shared_ptr<RenderStats> RenderStatsPtr;
 typedef boost::shared_ptr<RenderingFlagSetter> RenderingFlagSetterPtr;
+typedef boost::shared_ptr<RotoBezierTriangles const> RotoBezierTrianglesPtr;
 typedef boost::shared_ptr<RotoContext> RotoContextPtr;
 typedef boost::shared_ptr<RotoDrawableItem> RotoDrawableItemPtr;
 typedef boost::shared_ptr<RotoItem const> RotoItemConstPtr;
@@ -67,6 +67,15 @@ public:
         return _time;
     };
 
+    /**
+     * @brief Makes this the key of the same texture at another frame
+     **/
+    void setTime(SequenceTime time)
+    {
+        _time = time;
+        resetHash();
+    }
+
     int getBitDepth() const WARN_UNUSED_RETURN
     {
         return _bitDepth;
@@ -24,45 +24,138 @@
 
 #include "Hash64.h"
 
-#include <algorithm>  // for std::for_each
 #include <cassert>
+#include <cstring> // memcpy
 #include <stdexcept>
 
-#if !defined(Q_MOC_RUN) && !defined(SBK_RUN)
-#include <boost/crc.hpp>
-#endif
 #include <QtCore/QString>
+#include <QtCore/QAtomicInt>
 
 #include "Engine/Node.h"
 
 NATRON_NAMESPACE_ENTER
 
+NATRON_NAMESPACE_ANONYMOUS_ENTER
+
+// The CRC-64 used by boost::crc_optimal<64, 0x42F0E1EBA9EA3693ULL, 0, 0, false, false>, 8 bytes at a time (slicing-by-8):
+// table[k][b] is the CRC of the byte b followed by k zero bytes.
+class CRC64Tables
+{
+public:
+
+    U64 table[8][256];
+
+    CRC64Tables()
+    {
+        const U64 polynomial = 0x42F0E1EBA9EA3693ULL;
+
+        for (int b = 0; b < 256; ++b) {
+            U64 crc = (U64)b << 56;
+            for (int bit = 0; bit < 8; ++bit) {
+                crc = (crc & 0x8000000000000000ULL) ? ( (crc << 1) ^ polynomial ) : (crc << 1);
+            }
+            table[0][b] = crc;
+        }
+        for (int k = 1; k < 8; ++k) {
+            for (int b = 0; b < 256; ++b) {
+                table[k][b] = (table[k - 1][b] << 8) ^ table[0][table[k - 1][b] >> 56];
+            }
+        }
+    }
+};
+
+static const CRC64Tables crc64Tables;
+// Read by every hash reset, from any thread
+static QAtomicInt hashAlgorithm(Hash64::eHashAlgorithmFast);
+
+NATRON_NAMESPACE_ANONYMOUS_EXIT
+
+U64
+Hash64::crc64(U64 crc,
+              U64 value)
+{
+    // the bytes of value in memory order, the first one in the most significant byte
+    unsigned char bytes[8];
+
+    std::memcpy(bytes, &value, sizeof(value));
+    for (int i = 0; i < 8; ++i) {
+        crc ^= (U64)bytes[i] << (56 - 8 * i);
+    }
+
+    return crc64Tables.table[7][crc >> 56] ^
+           crc64Tables.table[6][(crc >> 48) & 0xff] ^
+           crc64Tables.table[5][(crc >> 40) & 0xff] ^
+           crc64Tables.table[4][(crc >> 32) & 0xff] ^
+           crc64Tables.table[3][(crc >> 24) & 0xff] ^
+           crc64Tables.table[2][(crc >> 16) & 0xff] ^
+           crc64Tables.table[1][(crc >> 8) & 0xff] ^
+           crc64Tables.table[0][crc & 0xff];
+}
+
 void
 Hash64::computeHash()
 {
-    if ( node_values.empty() ) {
+    if (count == 0) {
         return;
     }
 
-    const unsigned char* data = reinterpret_cast<const unsigned char*>( &node_values.front() );
-    boost::crc_optimal<64, 0x42F0E1EBA9EA3693ULL, 0, 0, false, false> crc_64;
-    crc_64 = std::for_each( data, data + node_values.size() * sizeof(node_values[0]), crc_64 );
-    hash = crc_64();
+    if (algorithm == eHashAlgorithmFast) {
+        // xxHash64 avalanche
+        U64 h = state + count * sizeof(U64);
+        h ^= h >> 33;
+        h *= 0xC2B2AE3D27D4EB4FULL;
+        h ^= h >> 29;
+        h *= 0x165667B19E3779F9ULL;
+        h ^= h >> 32;
+        hash = h;
+    } else {
+        hash = state;
+    }
 }
 
 void
 Hash64::reset()
 {
-    node_values.clear();
+    algorithm = getAlgorithm();
     hash = 0;
+    // the CRC-64 starts from 0, the other hash from the xxHash64 seed
+    state = algorithm == eHashAlgorithmFast ? 0x27D4EB2F165667C5ULL : 0;
+    count = 0;
+}
+
+void
+Hash64::setAlgorithm(HashAlgorithmEnum algorithm)
+{
+    hashAlgorithm.fetchAndStoreRelaxed( (int)algorithm );
+}
+
+Hash64::HashAlgorithmEnum
+Hash64::getAlgorithm()
+{
+    return (HashAlgorithmEnum)(int)hashAlgorithm;
 }
 
 void
 Hash64_appendQString(Hash64* hash,
                      const QString & str)
 {
-    Q_FOREACH (QChar ch, str) {
-        hash->append<unsigned short>( ch.unicode() );
+    if (hash->getHashAlgorithm() == Hash64::eHashAlgorithmCRC64) {
+        Q_FOREACH (QChar ch, str) {
+            hash->append<unsigned short>( ch.unicode() );
+        }
+
+        return;
+    }
+
+    // 4 characters per value, the last one is completed with zeroes
+    const ushort* data = str.utf16();
+    int n = str.size();
+    for (int i = 0; i < n; i += 4) {
+        U64 value = 0;
+        for (int j = 0; j < 4 && i + j < n; ++j) {
+            value |= (U64)data[i + j] << (16 * j);
+        }
+        hash->appendU64(value);
     }
 }
 
@@ -38,22 +38,33 @@
 
 NATRON_NAMESPACE_ENTER
 
-/*The hash of a Node is the checksum of the vector of data containing:
+/*The hash of a Node is the checksum of the data containing:
     - the values of the current knob for this node + the name of the node
     - the hash values for the  tree upstream
+   The values are hashed as they are appended: nothing is stored.
  */
 
 class Hash64
 {
 public:
+
+    /**
+     * @brief The function used to hash the appended values.
+     * The CRC-64 is the one used by the previous versions: it gives the keys they computed.
+     **/
+    enum HashAlgorithmEnum
+    {
+        eHashAlgorithmFast = 0, //< the 64-bit multiply and rotate rounds of xxHash64, one per value
+        eHashAlgorithmCRC64 //< the CRC-64 (ECMA-182 polynomial) of the bytes of the values
+    };
+
     Hash64()
     {
-        hash = 0;
+        reset();
     }
 
     ~Hash64()
     {
-        node_values.clear();
     }
 
     U64 value() const
@@ -86,9 +97,32 @@ GCC_DIAG_UNUSED_LOCAL_TYPEDEFS_ON
     template<typename T>
     void append(T value)
     {
-        node_values.push_back( toU64(value) );
+        appendU64( toU64(value) );
+    }
+
+    void appendU64(U64 value)
+    {
+        if (algorithm == eHashAlgorithmFast) {
+            state ^= fastRound(value);
+            state = rotl(state, 27) * 0x9E3779B185EBCA87ULL + 0x85EBCA77C2B2AE63ULL;
+        } else {
+            state = crc64(state, value);
+        }
+        ++count;
+    }
+
+    HashAlgorithmEnum getHashAlgorithm() const
+    {
+        return algorithm;
     }
 
+    /**
+     * @brief The algorithm of the hashes created or reset afterwards, in any thread. Since it changes all the keys of the caches,
+     * it must not be changed while they are used.
+     **/
+    static void setAlgorithm(HashAlgorithmEnum algorithm);
+    static HashAlgorithmEnum getAlgorithm();
+
     bool operator== (const Hash64 & h) const
     {
         return this->hash == h.value();
@@ -115,8 +149,24 @@ private:
         };
     };
 
+    static U64 rotl(U64 x,
+                    int r)
+    {
+        return (x << r) | ( x >> (64 - r) );
+    }
+
+    static U64 fastRound(U64 value)
+    {
+        return rotl(value * 0xC2B2AE3D27D4EB4FULL, 31) * 0x9E3779B185EBCA87ULL;
+    }
+
+    /// the CRC-64 of crc followed by the 8 bytes of value, as they are laid out in memory
+    static U64 crc64(U64 crc, U64 value);
+
     U64 hash;
-    std::vector<U64> node_values;
+    U64 state;
+    U64 count;
+    HashAlgorithmEnum algorithm;
 };
 
 void Hash64_appendQString(Hash64* hash, const QString & str);
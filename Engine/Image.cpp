@@ -33,15 +33,19 @@
 GCC_DIAG_UNUSED_LOCAL_TYPEDEFS_OFF
 #include <boost/math/special_functions/fpclassify.hpp>
 GCC_DIAG_UNUSED_LOCAL_TYPEDEFS_ON
+#include <boost/bind.hpp>
 #endif
 
 #include <QtCore/QDebug>
 
 #include "Engine/AppManager.h"
+#include "Engine/ImageSIMD.h"
 #include "Engine/ViewIdx.h"
 #include "Engine/GPUContextPool.h"
 #include "Engine/OSGLContext.h"
 #include "Engine/GLShader.h"
+#include "Engine/Hash64.h"
+#include "Engine/TaskScheduler.h"
 
 NATRON_NAMESPACE_ENTER
 
@@ -49,6 +53,15 @@ NATRON_NAMESPACE_ENTER
 
 #define PIXEL_UNAVAILABLE 2
 
+///State of the tiles of a Bitmap with eBitmapStorageTiles whose pixels do not all have the same state
+#define BITMAP_TILE_MIXED 3
+
+///Size of the tiles of a Bitmap with eBitmapStorageTiles
+#define NATRON_BITMAP_TILE_SIZE 64
+
+///Size of the tiles of the last mipmap level computed concurrently
+#define NATRON_MIPMAP_TILE_SIZE 128
+
 template <int trimap>
 RectI
 minimalNonMarkedBbox_internal(const RectI& roi,
@@ -66,39 +79,19 @@ minimalNonMarkedBbox_internal(const RectI& roi,
         const char* buf = BM_GET( i, bbox.left() );
 
         if (trimap) {
-            const char* lineEnd = buf + bbox.width();
-            bool metUnavailablePixel = false;
-            while (buf < lineEnd) {
-                if (!*buf) {
-                    buf = 0;
-                    break;
-                } else if (*buf == PIXEL_UNAVAILABLE) {
-                    metUnavailablePixel = true;
-                }
-                ++buf;
-            }
-            if (!buf) {
+            if ( std::memchr( buf, 0, bbox.width() ) ) {
                 break;
-            } else if (metUnavailablePixel) {
+            }
+            if ( std::memchr( buf, PIXEL_UNAVAILABLE, bbox.width() ) ) {
                 *isBeingRenderedElsewhere = true; //< only flag if the whole row is not 0
-                ++bbox.y1;
-            } else {
-                ++bbox.y1;
             }
+            ++bbox.y1;
         } else {
-            const char* lineEnd = buf + bbox.width();
-            while (buf < lineEnd) {
-                if ( !*buf || (*buf == PIXEL_UNAVAILABLE) ) {
-                    buf = 0;
-                    break;
-                }
-                ++buf;
-            }
-            if (!buf) {
+            // the row is rendered if it only contains 1s
+            if ( ImageSIMD::findFirstNotEqual( buf, 1, bbox.width() ) < (std::size_t)bbox.width() ) {
                 break;
-            } else {
-                ++bbox.y1;
             }
+            ++bbox.y1;
         }
     }
 
@@ -107,39 +100,19 @@ minimalNonMarkedBbox_internal(const RectI& roi,
         const char* buf = BM_GET( i, bbox.left() );
 
         if (trimap) {
-            const char* lineEnd = buf + bbox.width();
-            bool metUnavailablePixel = false;
-            while (buf < lineEnd) {
-                if (!*buf) {
-                    buf = 0;
-                    break;
-                } else if (*buf == PIXEL_UNAVAILABLE) {
-                    metUnavailablePixel = true;
-                }
-                ++buf;
-            }
-            if (!buf) {
+            if ( std::memchr( buf, 0, bbox.width() ) ) {
                 break;
-            } else if (metUnavailablePixel) {
+            }
+            if ( std::memchr( buf, PIXEL_UNAVAILABLE, bbox.width() ) ) {
                 *isBeingRenderedElsewhere = true; //< only flag if the whole row is not 0
-                --bbox.y2;
-            } else {
-                --bbox.y2;
             }
+            --bbox.y2;
         } else {
-            const char* lineEnd = buf + bbox.width();
-            while (buf < lineEnd) {
-                if ( !*buf || (*buf == PIXEL_UNAVAILABLE) ) {
-                    buf = 0;
-                    break;
-                }
-                ++buf;
-            }
-            if (!buf) {
+            // the row is rendered if it only contains 1s
+            if ( ImageSIMD::findFirstNotEqual( buf, 1, bbox.width() ) < (std::size_t)bbox.width() ) {
                 break;
-            } else {
-                --bbox.y2;
             }
+            --bbox.y2;
         }
     }
 
@@ -208,16 +181,12 @@ minimalNonMarkedBbox_internal(const RectI& roi,
 } // minimalNonMarkedBbox_internal
 
 
-template <int trimap>
-void
-minimalNonMarkedRects_internal(const RectI & roi,
-                               const RectI& _bounds,
-                               const std::vector<char>& _map,
-                               std::list<RectI>& ret,
-                               bool* isBeingRenderedElsewhere)
+///Any out of bounds portion is pushed to the rectangles to render
+static void
+pushOutOfBoundsRects(const RectI & roi,
+                     const RectI& _bounds,
+                     std::list<RectI>& ret)
 {
-    assert(ret.empty());
-    ///Any out of bounds portion is pushed to the rectangles to render
     RectI intersection;
 
     roi.intersect(_bounds, &intersection);
@@ -245,7 +214,17 @@ minimalNonMarkedRects_internal(const RectI & roi,
             ret.push_back(top);
         }
     }
+}
 
+///Pushes the rectangles to render in intersection, which is in the bounds
+template <int trimap>
+void
+minimalNonMarkedRectsInBounds_internal(const RectI & intersection,
+                                       const RectI& _bounds,
+                                       const std::vector<char>& _map,
+                                       std::list<RectI>& ret,
+                                       bool* isBeingRenderedElsewhere)
+{
     if ( intersection.isNull() ) {
         return;
     }
@@ -292,24 +271,13 @@ minimalNonMarkedRects_internal(const RectI & roi,
     for (int i = bboxX.bottom(); i < bboxX.top(); ++i) {
         const char* buf = BM_GET( i, bboxX.left() );
         if (trimap) {
-            const char* lineEnd = buf + bboxX.width();
-            bool metUnavailablePixel = false;
-            while (buf < lineEnd) {
-                if (*buf == 1) {
-                    buf = 0;
-                    break;
-                } else if ( (*buf == PIXEL_UNAVAILABLE) && trimap ) {
-                    buf = 0;
-                    metUnavailablePixel = true;
-                    break;
-                }
-                ++buf;
-            }
-            if (buf) {
+            // the row is not rendered if it only contains 0s
+            std::size_t marked = ImageSIMD::findFirstNotEqual( buf, 0, bboxX.width() );
+            if ( marked == (std::size_t)bboxX.width() ) {
                 ++bboxX.y1;
                 bboxA.y2 = bboxX.y1;
             } else {
-                if (metUnavailablePixel) {
+                if (buf[marked] == PIXEL_UNAVAILABLE) {
                     *isBeingRenderedElsewhere = true;
                 }
                 break;
@@ -335,24 +303,13 @@ minimalNonMarkedRects_internal(const RectI & roi,
         const char* buf = BM_GET( i, bboxX.left() );
 
         if (trimap) {
-            const char* lineEnd = buf + bboxX.width();
-            bool metUnavailablePixel = false;
-            while (buf < lineEnd) {
-                if (*buf == 1) {
-                    buf = 0;
-                    break;
-                } else if ( (*buf == PIXEL_UNAVAILABLE) && trimap ) {
-                    buf = 0;
-                    metUnavailablePixel = true;
-                    break;
-                }
-                ++buf;
-            }
-            if (buf) {
+            // the row is not rendered if it only contains 0s
+            std::size_t marked = ImageSIMD::findFirstNotEqual( buf, 0, bboxX.width() );
+            if ( marked == (std::size_t)bboxX.width() ) {
                 --bboxX.y2;
                 bboxB.y1 = bboxX.y2;
             } else {
-                if (metUnavailablePixel) {
+                if (buf[marked] == PIXEL_UNAVAILABLE) {
                     *isBeingRenderedElsewhere = true;
                 }
                 break;
@@ -464,8 +421,340 @@ minimalNonMarkedRects_internal(const RectI & roi,
     }
 
 #endif // NATRON_BITMAP_DISABLE_OPTIMIZATION
+} // minimalNonMarkedRectsInBounds_internal
+
+template <int trimap>
+void
+minimalNonMarkedRects_internal(const RectI & roi,
+                               const RectI& _bounds,
+                               const std::vector<char>& _map,
+                               std::list<RectI>& ret,
+                               bool* isBeingRenderedElsewhere)
+{
+    assert(ret.empty());
+    pushOutOfBoundsRects(roi, _bounds, ret);
+
+    RectI intersection;
+    roi.intersect(_bounds, &intersection);
+    minimalNonMarkedRectsInBounds_internal<trimap>(intersection, _bounds, _map, ret, isBeingRenderedElsewhere);
 } // minimalNonMarkedRects
 
+void
+Bitmap::initialize(const RectI & bounds)
+{
+    _bounds = bounds;
+    _tilePixels.clear();
+    if (_storage == eBitmapStoragePixels) {
+        _tilesPerRow = 0;
+        _map.resize( _bounds.area() );
+    } else {
+        int tilesPerColumn = 0;
+        if ( _bounds.isNull() ) {
+            _tilesPerRow = 0;
+        } else {
+            _tilesPerRow = (_bounds.width() + NATRON_BITMAP_TILE_SIZE - 1) / NATRON_BITMAP_TILE_SIZE;
+            tilesPerColumn = (_bounds.height() + NATRON_BITMAP_TILE_SIZE - 1) / NATRON_BITMAP_TILE_SIZE;
+        }
+        _map.resize(_tilesPerRow * tilesPerColumn);
+        _tilePixels.resize( _map.size() );
+    }
+    std::fill(_map.begin(), _map.end(), 0);
+}
+
+void
+Bitmap::setTo1()
+{
+    std::fill(_map.begin(), _map.end(), 1);
+    for (std::size_t i = 0; i < _tilePixels.size(); ++i) {
+        std::vector<char>().swap(_tilePixels[i]);
+    }
+}
+
+void
+Bitmap::setStorage(BitmapStorageEnum storage)
+{
+    if (storage == _storage) {
+        return;
+    }
+    if ( _map.empty() ) {
+        _storage = storage;
+
+        return;
+    }
+
+    Bitmap converted;
+    converted._storage = storage;
+    converted.initialize(_bounds);
+    std::vector<char> scratch;
+    for (int y = _bounds.y1; y < _bounds.y2; ++y) {
+        converted.setRow( y, _bounds.x1, _bounds.x2, getRow(y, _bounds.x1, _bounds.x2, &scratch) );
+    }
+    for (int i = 0; i < (int)converted._tilePixels.size(); ++i) {
+        converted.compactTile(i);
+    }
+
+    _storage = storage;
+    _map.swap(converted._map);
+    _tilePixels.swap(converted._tilePixels);
+    _tilesPerRow = converted._tilesPerRow;
+}
+
+void
+Bitmap::getTileRange(const RectI & roi,
+                     int* tx1,
+                     int* ty1,
+                     int* tx2,
+                     int* ty2) const
+{
+    assert( _bounds.contains(roi) && !roi.isNull() );
+    *tx1 = (roi.x1 - _bounds.x1) / NATRON_BITMAP_TILE_SIZE;
+    *ty1 = (roi.y1 - _bounds.y1) / NATRON_BITMAP_TILE_SIZE;
+    *tx2 = (roi.x2 - 1 - _bounds.x1) / NATRON_BITMAP_TILE_SIZE + 1;
+    *ty2 = (roi.y2 - 1 - _bounds.y1) / NATRON_BITMAP_TILE_SIZE + 1;
+}
+
+RectI
+Bitmap::getTileRect(int tileIndex) const
+{
+    int x1 = _bounds.x1 + (tileIndex % _tilesPerRow) * NATRON_BITMAP_TILE_SIZE;
+    int y1 = _bounds.y1 + (tileIndex / _tilesPerRow) * NATRON_BITMAP_TILE_SIZE;
+
+    return RectI( x1, y1, std::min(x1 + NATRON_BITMAP_TILE_SIZE, _bounds.x2), std::min(y1 + NATRON_BITMAP_TILE_SIZE, _bounds.y2) );
+}
+
+char*
+Bitmap::getMixedTilePixels(int tileIndex)
+{
+    if (_map[tileIndex] != BITMAP_TILE_MIXED) {
+        _tilePixels[tileIndex].assign( getTileRect(tileIndex).area(), _map[tileIndex] );
+        _map[tileIndex] = BITMAP_TILE_MIXED;
+    }
+
+    return &_tilePixels[tileIndex].front();
+}
+
+void
+Bitmap::setTileUniform(int tileIndex,
+                       char value)
+{
+    _map[tileIndex] = value;
+    if ( !_tilePixels[tileIndex].empty() ) {
+        std::vector<char>().swap(_tilePixels[tileIndex]);
+    }
+}
+
+void
+Bitmap::compactTile(int tileIndex)
+{
+    if (_map[tileIndex] != BITMAP_TILE_MIXED) {
+        return;
+    }
+    const std::vector<char>& pixels = _tilePixels[tileIndex];
+    if ( ImageSIMD::findFirstNotEqual( &pixels.front(), pixels.front(), pixels.size() ) == pixels.size() ) {
+        setTileUniform( tileIndex, pixels.front() );
+    }
+}
+
+int
+Bitmap::getUniformState(const RectI & roi) const
+{
+    int tx1, ty1, tx2, ty2;
+
+    getTileRange(roi, &tx1, &ty1, &tx2, &ty2);
+    const char state = _map[ty1 * _tilesPerRow + tx1];
+    if (state == BITMAP_TILE_MIXED) {
+        return -1;
+    }
+    for (int ty = ty1; ty < ty2; ++ty) {
+        const char* tiles = &_map[ty * _tilesPerRow + tx1];
+        if ( ImageSIMD::findFirstNotEqual(tiles, state, tx2 - tx1) < (std::size_t)(tx2 - tx1) ) {
+            return -1;
+        }
+    }
+
+    return state;
+}
+
+RectI
+Bitmap::getNonRenderedTilesBbox(const RectI & roi) const
+{
+    int tx1, ty1, tx2, ty2;
+
+    getTileRange(roi, &tx1, &ty1, &tx2, &ty2);
+    int minTx = tx2, minTy = ty2, maxTx = tx1 - 1, maxTy = ty1 - 1;
+    for (int ty = ty1; ty < ty2; ++ty) {
+        const char* tiles = &_map[ty * _tilesPerRow];
+        std::size_t first = ImageSIMD::findFirstNotEqual(tiles + tx1, 1, tx2 - tx1);
+        if ( first == (std::size_t)(tx2 - tx1) ) {
+            continue;
+        }
+        int last = tx2 - 1;
+        while (tiles[last] == 1) {
+            --last;
+        }
+        minTx = std::min(minTx, tx1 + (int)first);
+        maxTx = std::max(maxTx, last);
+        minTy = std::min(minTy, ty);
+        maxTy = ty;
+    }
+    if (maxTy < minTy) {
+        return RectI();
+    }
+    RectI tilesBbox = getTileRect(minTy * _tilesPerRow + minTx);
+    tilesBbox.merge( getTileRect(maxTy * _tilesPerRow + maxTx) );
+    RectI ret;
+    roi.intersect(tilesBbox, &ret);
+
+    return ret;
+}
+
+void
+Bitmap::readRow(int y,
+                int x1,
+                int x2,
+                char* states) const
+{
+    assert( y >= _bounds.y1 && y < _bounds.y2 && x1 >= _bounds.x1 && x2 <= _bounds.x2 );
+    if (_storage == eBitmapStoragePixels) {
+        std::memcpy(states, BM_GET(y, x1), x2 - x1);
+
+        return;
+    }
+
+    const int ty = (y - _bounds.y1) / NATRON_BITMAP_TILE_SIZE;
+    int x = x1;
+    while (x < x2) {
+        const int tileIndex = ty * _tilesPerRow + (x - _bounds.x1) / NATRON_BITMAP_TILE_SIZE;
+        const RectI tile = getTileRect(tileIndex);
+        const int segmentEnd = std::min(tile.x2, x2);
+        if (_map[tileIndex] == BITMAP_TILE_MIXED) {
+            std::memcpy(states + (x - x1), &_tilePixels[tileIndex][(y - tile.y1) * tile.width() + (x - tile.x1)], segmentEnd - x);
+        } else {
+            std::memset(states + (x - x1), _map[tileIndex], segmentEnd - x);
+        }
+        x = segmentEnd;
+    }
+}
+
+const char*
+Bitmap::getRow(int y,
+               int x1,
+               int x2,
+               std::vector<char>* scratch) const
+{
+    if (_storage == eBitmapStoragePixels) {
+        return BM_GET(y, x1);
+    }
+    scratch->resize( std::max(x2 - x1, 1) );
+    readRow(y, x1, x2, &scratch->front());
+
+    return &scratch->front();
+}
+
+void
+Bitmap::setRow(int y,
+               int x1,
+               int x2,
+               const char* states)
+{
+    assert( y >= _bounds.y1 && y < _bounds.y2 && x1 >= _bounds.x1 && x2 <= _bounds.x2 );
+    if (_storage == eBitmapStoragePixels) {
+        std::memcpy(BM_GET(y, x1), states, x2 - x1);
+
+        return;
+    }
+
+    const int ty = (y - _bounds.y1) / NATRON_BITMAP_TILE_SIZE;
+    int x = x1;
+    while (x < x2) {
+        const int tileIndex = ty * _tilesPerRow + (x - _bounds.x1) / NATRON_BITMAP_TILE_SIZE;
+        const RectI tile = getTileRect(tileIndex);
+        const int segmentEnd = std::min(tile.x2, x2);
+        const char* segment = states + (x - x1);
+        // Do not split a uniform tile for states it already has
+        if ( (_map[tileIndex] == BITMAP_TILE_MIXED) ||
+             ( ImageSIMD::findFirstNotEqual(segment, _map[tileIndex], segmentEnd - x) < (std::size_t)(segmentEnd - x) ) ) {
+            char* pixels = getMixedTilePixels(tileIndex);
+            std::memcpy(pixels + (y - tile.y1) * tile.width() + (x - tile.x1), segment, segmentEnd - x);
+        }
+        x = segmentEnd;
+    }
+}
+
+void
+Bitmap::toPixels(const RectI & roi,
+                 Bitmap* pixels) const
+{
+    assert(pixels->_storage == eBitmapStoragePixels);
+    pixels->initialize(roi);
+    for (int y = roi.y1; y < roi.y2; ++y) {
+        readRow( y, roi.x1, roi.x2, pixels->getBitmapAt(roi.x1, y) );
+    }
+}
+
+template <int trimap>
+RectI
+Bitmap::minimalNonMarkedBboxForStorage(const RectI & roi,
+                                       bool* isBeingRenderedElsewhere) const
+{
+    if ( (_storage == eBitmapStoragePixels) || roi.isNull() ) {
+        return minimalNonMarkedBbox_internal<trimap>(roi, _bounds, _map, isBeingRenderedElsewhere);
+    }
+
+    assert( _bounds.contains(roi) );
+    RectI inBounds;
+    if ( !roi.intersect(_bounds, &inBounds) || inBounds.isNull() ) {
+        return RectI();
+    }
+
+    // Most lookups are on images that are entirely rendered, or not at all
+    int state = getUniformState(inBounds);
+    if (state == 1) {
+        return RectI();
+    } else if (state == 0) {
+        return inBounds;
+    }
+    // The rendered tiles around the others are not in the result: only expand the pixels of the remaining ones
+    inBounds = getNonRenderedTilesBbox(inBounds);
+    Bitmap pixels;
+    toPixels(inBounds, &pixels);
+
+    return minimalNonMarkedBbox_internal<trimap>(inBounds, pixels._bounds, pixels._map, isBeingRenderedElsewhere);
+}
+
+template <int trimap>
+void
+Bitmap::minimalNonMarkedRectsForStorage(const RectI & roi,
+                                        std::list<RectI>& ret,
+                                        bool* isBeingRenderedElsewhere) const
+{
+    if (_storage == eBitmapStoragePixels) {
+        minimalNonMarkedRects_internal<trimap>(roi, _bounds, _map, ret, isBeingRenderedElsewhere);
+
+        return;
+    }
+
+    assert(ret.empty());
+    pushOutOfBoundsRects(roi, _bounds, ret);
+
+    RectI intersection;
+    if ( !roi.intersect(_bounds, &intersection) || intersection.isNull() ) {
+        return;
+    }
+    int state = getUniformState(intersection);
+    if (state == 1) {
+        return;
+    } else if (state == 0) {
+        ret.push_back(intersection);
+
+        return;
+    }
+    intersection = getNonRenderedTilesBbox(intersection);
+    Bitmap pixels;
+    toPixels(intersection, &pixels);
+    minimalNonMarkedRectsInBounds_internal<trimap>(intersection, pixels._bounds, pixels._map, ret, isBeingRenderedElsewhere);
+}
+
 RectI
 Bitmap::minimalNonMarkedBbox(const RectI & roi) const
 {
@@ -475,9 +764,9 @@ Bitmap::minimalNonMarkedBbox(const RectI & roi) const
             return RectI();
         }
 
-        return minimalNonMarkedBbox_internal<0>(realRoi, _bounds, _map, NULL);
+        return minimalNonMarkedBboxForStorage<0>(realRoi, NULL);
     } else {
-        return minimalNonMarkedBbox_internal<0>(roi, _bounds, _map, NULL);
+        return minimalNonMarkedBboxForStorage<0>(roi, NULL);
     }
 }
 
@@ -490,9 +779,9 @@ Bitmap::minimalNonMarkedRects(const RectI & roi,
         if ( !roi.intersect(_dirtyZone, &realRoi) ) {
             return;
         }
-        minimalNonMarkedRects_internal<0>(realRoi, _bounds, _map, ret, NULL);
+        minimalNonMarkedRectsForStorage<0>(realRoi, ret, NULL);
     } else {
-        minimalNonMarkedRects_internal<0>(roi, _bounds, _map, ret, NULL);
+        minimalNonMarkedRectsForStorage<0>(roi, ret, NULL);
     }
 }
 
@@ -509,9 +798,9 @@ Bitmap::minimalNonMarkedBbox_trimap(const RectI & roi,
             return RectI();
         }
 
-        return minimalNonMarkedBbox_internal<1>(realRoi, _bounds, _map, isBeingRenderedElsewhere);
+        return minimalNonMarkedBboxForStorage<1>(realRoi, isBeingRenderedElsewhere);
     } else {
-        return minimalNonMarkedBbox_internal<1>(roi, _bounds, _map, isBeingRenderedElsewhere);
+        return minimalNonMarkedBboxForStorage<1>(roi, isBeingRenderedElsewhere);
     }
 }
 
@@ -527,9 +816,9 @@ Bitmap::minimalNonMarkedRects_trimap(const RectI & roi,
 
             return;
         }
-        minimalNonMarkedRects_internal<1>(realRoi, _bounds, _map, ret, isBeingRenderedElsewhere);
+        minimalNonMarkedRectsForStorage<1>(realRoi, ret, isBeingRenderedElsewhere);
     } else {
-        minimalNonMarkedRects_internal<1>(roi, _bounds, _map, ret, isBeingRenderedElsewhere);
+        minimalNonMarkedRectsForStorage<1>(roi, ret, isBeingRenderedElsewhere);
     }
 }
 
@@ -543,14 +832,44 @@ Bitmap::markFor(const RectI & roi, char value)
     int x2 = std::min(roi.x2, _bounds.x2);
     int y2 = std::min(roi.y2, _bounds.y2);
 
-    char* buf = BM_GET(y1, x1);
-    int w = _bounds.width();
-    int roiw = x2 - x1;
+    if ( (x1 >= x2) || (y1 >= y2) ) {
+        return;
+    }
+
+    if (_storage == eBitmapStoragePixels) {
+        char* buf = BM_GET(y1, x1);
+        int w = _bounds.width();
+        int roiw = x2 - x1;
+
+        for (int i = y1; i < y2; ++i, buf += w) {
+            std::memset( buf, value, roiw);
+        }
 
-    for (int i = y1; i < y2; ++i, buf += w) {
-        std::memset( buf, value, roiw);
+        return;
     }
-}
+
+    const RectI clipped(x1, y1, x2, y2);
+    int tx1, ty1, tx2, ty2;
+    getTileRange(clipped, &tx1, &ty1, &tx2, &ty2);
+    for (int ty = ty1; ty < ty2; ++ty) {
+        for (int tx = tx1; tx < tx2; ++tx) {
+            const int tileIndex = ty * _tilesPerRow + tx;
+            const RectI tile = getTileRect(tileIndex);
+            RectI inter;
+            tile.intersect(clipped, &inter);
+            if (inter == tile) {
+                setTileUniform(tileIndex, value);
+            } else if (_map[tileIndex] != value) {
+                char* pixels = getMixedTilePixels(tileIndex);
+                for (int y = inter.y1; y < inter.y2; ++y) {
+                    std::memset( pixels + (y - tile.y1) * tile.width() + (inter.x1 - tile.x1), value, inter.width() );
+                }
+                // The tile may be complete now
+                compactTile(tileIndex);
+            }
+        }
+    }
+} // markFor
 
 bool
 Bitmap::isNonMarked(const RectI & roi) const
@@ -560,17 +879,21 @@ Bitmap::isNonMarked(const RectI & roi) const
     int x2 = std::min(roi.x2, _bounds.x2);
     int y2 = std::min(roi.y2, _bounds.y2);
 
-    const char* buf = BM_GET(y1, x1);
-    int w = _bounds.width();
-    int roiw = x2 - x1;
+    if ( (x1 >= x2) || (y1 >= y2) ) {
+        return true;
+    }
+    if ( (_storage == eBitmapStorageTiles) && (getUniformState( RectI(x1, y1, x2, y2) ) == 0) ) {
+        return true;
+    }
 
-    for (int i = y1; i < y2; ++i, buf += w) {
-        for (int j = 0; j < roiw; ++j) {
-            if (buf[j]) {
-                return false;
-            }
+    std::vector<char> scratch;
+    int roiw = x2 - x1;
+    for (int i = y1; i < y2; ++i) {
+        if ( ImageSIMD::findFirstNotEqual(getRow(i, x1, x2, &scratch), 0, roiw) < (std::size_t)roiw ) {
+            return false;
         }
     }
+
     return true;
 }
 
@@ -587,6 +910,9 @@ void
 Bitmap::swap(Bitmap& other)
 {
     _map.swap(other._map);
+    _tilePixels.swap(other._tilePixels);
+    std::swap(_storage, other._storage);
+    std::swap(_tilesPerRow, other._tilesPerRow);
     _bounds = other._bounds;
     _dirtyZone.clear(); //merge(other._dirtyZone);
     _dirtyZoneSet = false;
@@ -596,6 +922,7 @@ const char*
 Bitmap::getBitmapAt(int x,
                     int y) const
 {
+    assert(_storage == eBitmapStoragePixels);
     if ( ( x >= _bounds.left() ) && ( x < _bounds.right() ) && ( y >= _bounds.bottom() ) && ( y < _bounds.top() ) ) {
         return BM_GET(y, x);
     } else {
@@ -607,6 +934,7 @@ char*
 Bitmap::getBitmapAt(int x,
                     int y)
 {
+    assert(_storage == eBitmapStoragePixels);
     if ( ( x >= _bounds.left() ) && ( x < _bounds.right() ) && ( y >= _bounds.bottom() ) && ( y < _bounds.top() ) ) {
         return BM_GET(y, x);
     } else {
@@ -622,9 +950,7 @@ Image::printUnrenderedPixels(const RectI& roi) const
         return;
     }
     QReadLocker k(&_entryLock);
-    const char* bm = _bitmap.getBitmapAt(roi.x1, roi.y1);
-    int roiw = roi.x2 - roi.x1;
-    int boundsW = _bitmap.getBounds().width();
+    std::vector<char> scratch;
     RectD bboxUnrendered;
     bboxUnrendered.setupInfinity();
     RectD bboxUnavailable;
@@ -633,8 +959,8 @@ Image::printUnrenderedPixels(const RectI& roi) const
     bool hasUnrendered = false;
     bool hasUnavailable = false;
 
-    for ( int y = roi.y1; y < roi.y2; ++y,
-          bm += (boundsW - roiw) ) {
+    for (int y = roi.y1; y < roi.y2; ++y) {
+        const char* bm = _bitmap.getRow(y, roi.x1, roi.x2, &scratch);
         for (int x = roi.x1; x < roi.x2; ++x, ++bm) {
             if (*bm == 0) {
                 if (x < bboxUnrendered.x1) {
@@ -795,6 +1121,26 @@ Image::onMemoryAllocated(bool diskRestoration)
 #endif
 }
 
+void
+Image::setBitmapStorage(BitmapStorageEnum storage)
+{
+    QWriteLocker k(&_entryLock);
+    std::size_t oldSize = size();
+
+    _bitmap.setStorage(storage);
+    if (_cache) {
+        _cache->notifyEntrySizeChanged( oldSize, size() );
+    }
+}
+
+BitmapStorageEnum
+Image::getBitmapStorage() const
+{
+    QReadLocker k(&_entryLock);
+
+    return _bitmap.getStorage();
+}
+
 void
 Image::setBitmapDirtyZone(const RectI& zone)
 {
@@ -815,6 +1161,19 @@ Image::makeKey(const CacheEntryHolder* holder,
     return ImageKey(holder, nodeHashKey, frameVaryingOrAnimated, time, view, 1., draftMode, fullScaleWithDownscaleInputs);
 }
 
+U64
+Image::getProductionVariant(unsigned int mipMapLevel,
+                            const ImagePlaneDesc& plane)
+{
+    Hash64 hash;
+
+    hash.append(mipMapLevel);
+    Hash64_appendQString( &hash, QString::fromUtf8( plane.getPlaneID().c_str() ) );
+    hash.computeHash();
+
+    return hash.value();
+}
+
 ImageParamsPtr
 Image::makeParams(const RectD & rod,
                   const double par,
@@ -995,12 +1354,15 @@ Image::resizeInternal(const Image* srcImg,
                                        srcImg->getPremultiplication(),
                                        srcImg->getFieldingOrder(),
                                        srcImg->usesBitMap() );
+        (*outputImage)->_bitmap.setStorage( srcImg->_bitmap.getStorage() );
     } else {
         ImageParamsPtr params = boost::make_shared<ImageParams>( *srcImg->getParams() );
         params->setBounds(merge);
         *outputImage = boost::make_shared<Image>( srcImg->getKey(), params, srcImg->getCacheAPI() );
+        (*outputImage)->_bitmap.setStorage( srcImg->_bitmap.getStorage() );
         (*outputImage)->allocateMemory();
     }
+    const bool markBitmap = setBitmapTo1 && (*outputImage)->usesBitMap();
     ImageBitDepthEnum depth = srcImg->getBitDepth();
 
     if (fillWithBlackAndTransparent) {
@@ -1049,10 +1411,8 @@ Image::resizeInternal(const Image* srcImg,
             double a = aRect.area();
             std::size_t memsize = a * pixelSize;
             std::memset(pix, 0, memsize);
-            if ( setBitmapTo1 && (*outputImage)->usesBitMap() ) {
-                char* bm = wacc.bitmapAt(aRect.x1, aRect.y1);
-                assert(bm);
-                std::memset(bm, 1, a);
+            if (markBitmap) {
+                (*outputImage)->_bitmap.markForRendered(aRect);
             }
         }
         if ( !cRect.isNull() ) {
@@ -1061,10 +1421,8 @@ Image::resizeInternal(const Image* srcImg,
             double a = cRect.area();
             std::size_t memsize = a * pixelSize;
             std::memset(pix, 0, memsize);
-            if ( setBitmapTo1 && (*outputImage)->usesBitMap() ) {
-                char* bm = (char*)wacc.bitmapAt(cRect.x1, cRect.y1);
-                assert(bm);
-                std::memset(bm, 1, a);
+            if (markBitmap) {
+                (*outputImage)->_bitmap.markForRendered(cRect);
             }
         }
         if ( !bRect.isNull() ) {
@@ -1072,15 +1430,12 @@ Image::resizeInternal(const Image* srcImg,
             assert(pix);
             int mw = merge.width();
             std::size_t rowsize = mw * pixelSize;
-            int bw = bRect.width();
-            std::size_t rectRowSize = bw * pixelSize;
-            char* bm = ( setBitmapTo1 && (*outputImage)->usesBitMap() ) ? wacc.bitmapAt(bRect.x1, bRect.y1) : 0;
+            std::size_t rectRowSize = bRect.width() * pixelSize;
             for (int y = bRect.y1; y < bRect.y2; ++y, pix += rowsize) {
                 std::memset(pix, 0, rectRowSize);
-                if (bm) {
-                    std::memset(bm, 1, bw);
-                    bm += mw;
-                }
+            }
+            if (markBitmap) {
+                (*outputImage)->_bitmap.markForRendered(bRect);
             }
         }
         if ( !dRect.isNull() ) {
@@ -1088,15 +1443,12 @@ Image::resizeInternal(const Image* srcImg,
             assert(pix);
             int mw = merge.width();
             std::size_t rowsize = mw * pixelSize;
-            int dw = dRect.width();
-            std::size_t rectRowSize = dw * pixelSize;
-            char* bm = ( setBitmapTo1 && (*outputImage)->usesBitMap() ) ? wacc.bitmapAt(dRect.x1, dRect.y1) : 0;
+            std::size_t rectRowSize = dRect.width() * pixelSize;
             for (int y = dRect.y1; y < dRect.y2; ++y, pix += rowsize) {
                 std::memset(pix, 0, rectRowSize);
-                if (bm) {
-                    std::memset(bm, 1, dw);
-                    bm += mw;
-                }
+            }
+            if (markBitmap) {
+                (*outputImage)->_bitmap.markForRendered(dRect);
             }
         }
     } // fillWithBlackAndTransparent
@@ -1807,77 +2159,83 @@ Image::getRowElements() const
     return getComponentsCount() * _bounds.width();
 }
 
-// code proofread and fixed by @devernay on 4/12/2014
-template <typename PIX, int maxValue>
-void
-Image::halveRoIForDepth(const RectI & roi,
-                        bool copyBitMap,
-                        Image* output) const
+///The pixels of the halved image that are computed from the roi of the source image
+static RectI
+getHalvedRoI(const RectI & roi,
+             const RectI & srcBounds)
 {
-    assert( (getBitDepth() == eImageBitDepthByte && sizeof(PIX) == 1) ||
-            (getBitDepth() == eImageBitDepthShort && sizeof(PIX) == 2) ||
-            (getBitDepth() == eImageBitDepthFloat && sizeof(PIX) == 4) );
+    RectI dstRoI;
+    RectI srcRoI = roi;
 
-    ///handle case where there is only 1 column/row
-    if ( (roi.width() == 1) || (roi.height() == 1) ) {
-        assert( !(roi.width() == 1 && roi.height() == 1) ); /// can't be 1x1
-        halve1DImage(roi, output);
+    srcRoI.intersect(srcBounds, &srcRoI); // intersect srcRoI with the region of definition
 
-        return;
-    }
+    dstRoI.x1 = (srcRoI.x1 + 1) / 2; // equivalent to ceil(srcRoI.x1/2.0)
+    dstRoI.y1 = (srcRoI.y1 + 1) / 2; // equivalent to ceil(srcRoI.y1/2.0)
+    dstRoI.x2 = srcRoI.x2 / 2; // equivalent to floor(srcRoI.x2/2.0)
+    dstRoI.y2 = srcRoI.y2 / 2; // equivalent to floor(srcRoI.y2/2.0)
 
-    /// Take the lock for both bitmaps since we're about to read/write from them!
-    QWriteLocker k1(&output->_entryLock);
-    QReadLocker k2(&_entryLock);
+    return dstRoI;
+}
+
+///Splits rect in tiles of at most tileSize x tileSize pixels
+static void
+splitInTiles(const RectI & rect,
+             int tileSize,
+             std::vector<RectI>* tiles)
+{
+    for (int y = rect.y1; y < rect.y2; y += tileSize) {
+        for (int x = rect.x1; x < rect.x2; x += tileSize) {
+            tiles->push_back( RectI( x, y, std::min(x + tileSize, rect.x2), std::min(y + tileSize, rect.y2) ) );
+        }
+    }
+}
 
+template <typename PIX>
+void
+Image::halveRectForDepth(const RectI & dstRect,
+                         bool copyBitMap,
+                         Image* output) const
+{
     ///The source rectangle, intersected to this image region of definition in pixels
     const RectI &srcBounds = _bounds;
     const RectI &dstBounds = output->_bounds;
     const RectI &srcBmBounds = _bitmap.getBounds();
-    const RectI &dstBmBounds = output->_bitmap.getBounds();
-    assert( !copyBitMap || usesBitMap() );
-    assert( !usesBitMap() || (srcBmBounds == srcBounds && dstBmBounds == dstBounds) );
-
-    // the srcRoD of the output should be enclosed in half the roi.
-    // It does not have to be exactly half of the input.
-    //    assert(dstRoD.x1*2 >= roi.x1 &&
-    //           dstRoD.x2*2 <= roi.x2 &&
-    //           dstRoD.y1*2 >= roi.y1 &&
-    //           dstRoD.y2*2 <= roi.y2 &&
-    //           dstRoD.width()*2 <= roi.width() &&
-    //           dstRoD.height()*2 <= roi.height());
-    assert( getComponents() == output->getComponents() );
-
-    RectI dstRoI;
-    RectI srcRoI = roi;
-    srcRoI.intersect(srcBounds, &srcRoI); // intersect srcRoI with the region of definition
 
-    dstRoI.x1 = (srcRoI.x1 + 1) / 2; // equivalent to ceil(srcRoI.x1/2.0)
-    dstRoI.y1 = (srcRoI.y1 + 1) / 2; // equivalent to ceil(srcRoI.y1/2.0)
-    dstRoI.x2 = srcRoI.x2 / 2; // equivalent to floor(srcRoI.x2/2.0)
-    dstRoI.y2 = srcRoI.y2 / 2; // equivalent to floor(srcRoI.y2/2.0)
+    assert( !copyBitMap || usesBitMap() );
+    assert( !usesBitMap() || (srcBmBounds == srcBounds && output->_bitmap.getBounds() == dstBounds) );
 
+    // The tiles are halved concurrently: the output bitmap is a local one, whose pixels can be written by several threads.
+    // The source bitmap is read row by row, it may be stored per tile.
+    assert( !copyBitMap || output->_bitmap.getStorage() == eBitmapStoragePixels );
 
     const PIX* const srcPixels      = (const PIX*)pixelAt(srcBounds.x1,   srcBounds.y1);
-    const char* const srcBmPixels   = _bitmap.getBitmapAt(srcBmBounds.x1, srcBmBounds.y1);
     PIX* const dstPixels          = (PIX*)output->pixelAt(dstBounds.x1,   dstBounds.y1);
-    char* const dstBmPixels = output->_bitmap.getBitmapAt(dstBmBounds.x1, dstBmBounds.y1);
     int srcRowSize = srcBounds.width() * _nbComponents;
     int dstRowSize = dstBounds.width() * _nbComponents;
 
     // offset pointers so that srcData and dstData correspond to pixel (0,0)
     const PIX* const srcData = srcPixels - (srcBounds.x1 * _nbComponents + srcRowSize * srcBounds.y1);
     PIX* const dstData       = dstPixels - (dstBounds.x1 * _nbComponents + dstRowSize * dstBounds.y1);
-    const int srcBmRowSize = srcBmBounds.width();
-    const int dstBmRowSize = dstBmBounds.width();
-    const char* const srcBmData = srcBmPixels - (srcBmBounds.x1 + srcBmRowSize * srcBmBounds.y1);
-    char* const dstBmData       = dstBmPixels - (dstBmBounds.x1 + dstBmRowSize * dstBmBounds.y1);
 
-    for (int y = dstRoI.y1; y < dstRoI.y2; ++y) {
+    // The source bitmap columns covered by dstRect
+    const int srcBmX1 = std::max(dstRect.x1 * 2, srcBmBounds.x1);
+    const int srcBmX2 = std::min(dstRect.x2 * 2, srcBmBounds.x2);
+    std::vector<char> srcBmScratch0, srcBmScratch1;
+
+    // Only the first and last columns may cover a single source column:
+    // the columns in between are computed with the vectorized kernel.
+    int firstFullCol = dstRect.x1;
+    int lastFullCol = dstRect.x2;
+    if ( (dstRect.x1 < dstRect.x2) && (dstRect.x1 * 2 < srcBounds.x1) ) {
+        ++firstFullCol;
+    }
+    if ( (firstFullCol < lastFullCol) && ( (dstRect.x2 - 1) * 2 + 1 >= srcBounds.x2 ) ) {
+        --lastFullCol;
+    }
+
+    for (int y = dstRect.y1; y < dstRect.y2; ++y) {
         const PIX* const srcLineStart    = srcData + y * 2 * srcRowSize;
         PIX* const dstLineStart          = dstData + y     * dstRowSize;
-        const char* const srcBmLineStart = srcBmData + y * 2 * srcBmRowSize;
-        char* const dstBmLineStart       = dstBmData + y     * dstBmRowSize;
 
         // The current dst row, at y, covers the src rows y*2 (thisRow) and y*2+1 (nextRow).
         // Check that if are within srcBounds.
@@ -1887,11 +2245,36 @@ Image::halveRoIForDepth(const RectI & roi,
         int sumH = (int)pickNextRow + (int)pickThisRow;
         assert(sumH == 1 || sumH == 2);
 
-        for (int x = dstRoI.x1; x < dstRoI.x2; ++x) {
+        // offset the bitmap rows so that they are indexed by the x coordinate
+        const char* srcBmThisRow = 0;
+        const char* srcBmNextRow = 0;
+        char* dstBmRow = 0;
+        if (copyBitMap) {
+            if (pickThisRow) {
+                srcBmThisRow = _bitmap.getRow(srcy, srcBmX1, srcBmX2, &srcBmScratch0) - srcBmX1;
+            }
+            if (pickNextRow) {
+                srcBmNextRow = _bitmap.getRow(srcy + 1, srcBmX1, srcBmX2, &srcBmScratch1) - srcBmX1;
+            }
+            dstBmRow = output->_bitmap.getBitmapAt(dstRect.x1, y) - dstRect.x1;
+        }
+
+        int x = dstRect.x1;
+        while (x < dstRect.x2) {
+            if ( (sumH == 2) && (x == firstFullCol) && (firstFullCol < lastFullCol) ) {
+                ImageSIMD::halveRows(srcLineStart + x * 2 * _nbComponents,
+                                     srcLineStart + x * 2 * _nbComponents + srcRowSize,
+                                     dstLineStart + x * _nbComponents,
+                                     lastFullCol - firstFullCol,
+                                     _nbComponents);
+                if (!copyBitMap) {
+                    x = lastFullCol;
+                    continue;
+                }
+            }
+
             const PIX* const srcPixStart    = srcLineStart   + x * 2 * _nbComponents;
-            const char* const srcBmPixStart = srcBmLineStart + x * 2;
             PIX* const dstPixStart          = dstLineStart   + x * _nbComponents;
-            char* const dstBmPixStart       = dstBmLineStart + x;
 
             // The current dst col, at y, covers the src cols x*2 (thisCol) and x*2+1 (nextCol).
             // Check that if are within srcBounds.
@@ -1908,33 +2291,37 @@ Image::halveRoIForDepth(const RectI & roi,
                     dstPixStart[k] = 0;
                 }
                 if (copyBitMap) {
-                    dstBmPixStart[0] = 0;
+                    dstBmRow[x] = 0;
                 }
+                ++x;
                 continue;
             }
 
-            for (int k = 0; k < _nbComponents; ++k) {
-                ///a b
-                ///c d
+            // the pixels of the full columns were computed above, only the bitmap remains
+            if ( (sumH != 2) || (x < firstFullCol) || (x >= lastFullCol) ) {
+                for (int k = 0; k < _nbComponents; ++k) {
+                    ///a b
+                    ///c d
 
-                const PIX a = (pickThisCol && pickThisRow) ? *(srcPixStart + k) : 0;
-                const PIX b = (pickNextCol && pickThisRow) ? *(srcPixStart + k + _nbComponents) : 0;
-                const PIX c = (pickThisCol && pickNextRow) ? *(srcPixStart + k + srcRowSize) : 0;
-                const PIX d = (pickNextCol && pickNextRow) ? *(srcPixStart + k + srcRowSize  + _nbComponents)  : 0;
+                    const PIX a = (pickThisCol && pickThisRow) ? *(srcPixStart + k) : 0;
+                    const PIX b = (pickNextCol && pickThisRow) ? *(srcPixStart + k + _nbComponents) : 0;
+                    const PIX c = (pickThisCol && pickNextRow) ? *(srcPixStart + k + srcRowSize) : 0;
+                    const PIX d = (pickNextCol && pickNextRow) ? *(srcPixStart + k + srcRowSize  + _nbComponents)  : 0;
 
-                assert( sumW == 2 || ( sumW == 1 && ( (a == 0 && c == 0) || (b == 0 && d == 0) ) ) );
-                assert( sumH == 2 || ( sumH == 1 && ( (a == 0 && b == 0) || (c == 0 && d == 0) ) ) );
-                dstPixStart[k] = (a + b + c + d) / sum;
+                    assert( sumW == 2 || ( sumW == 1 && ( (a == 0 && c == 0) || (b == 0 && d == 0) ) ) );
+                    assert( sumH == 2 || ( sumH == 1 && ( (a == 0 && b == 0) || (c == 0 && d == 0) ) ) );
+                    dstPixStart[k] = (a + b + c + d) / sum;
+                }
             }
 
             if (copyBitMap) {
                 ///a b
                 ///c d
 
-                char a = (pickThisCol && pickThisRow) ? *(srcBmPixStart) : 0;
-                char b = (pickNextCol && pickThisRow) ? *(srcBmPixStart + 1) : 0;
-                char c = (pickThisCol && pickNextRow) ? *(srcBmPixStart + srcBmRowSize) : 0;
-                char d = (pickNextCol && pickNextRow) ? *(srcBmPixStart + srcBmRowSize  + 1)  : 0;
+                char a = (pickThisCol && pickThisRow) ? srcBmThisRow[srcx] : 0;
+                char b = (pickNextCol && pickThisRow) ? srcBmThisRow[srcx + 1] : 0;
+                char c = (pickThisCol && pickNextRow) ? srcBmNextRow[srcx] : 0;
+                char d = (pickNextCol && pickNextRow) ? srcBmNextRow[srcx + 1]  : 0;
 #if NATRON_ENABLE_TRIMAP
                 /*
                    The only correct solution is to convert pixels being rendered to 0 otherwise the caller
@@ -1957,11 +2344,77 @@ Image::halveRoIForDepth(const RectI & roi,
                 assert( sumH == 2 || ( sumH == 1 && ( (a == 0 && b == 0) || (c == 0 && d == 0) ) ) );
                 assert(a + b + c + d <= sum); // bitmaps are 0 or 1
                 // the following is an integer division, the result can be 0 or 1
-                dstBmPixStart[0] = (a + b + c + d) / sum;
-                assert(dstBmPixStart[0] == 0 || dstBmPixStart[0] == 1);
+                dstBmRow[x] = (a + b + c + d) / sum;
+                assert(dstBmRow[x] == 0 || dstBmRow[x] == 1);
             }
+            ++x;
         }
     }
+} // halveRectForDepth
+
+void
+Image::halveRect(const RectI & dstRect,
+                 bool copyBitMap,
+                 Image* output) const
+{
+    switch ( getBitDepth() ) {
+    case eImageBitDepthByte:
+        halveRectForDepth<unsigned char>(dstRect, copyBitMap, output);
+        break;
+    case eImageBitDepthShort:
+        halveRectForDepth<unsigned short>(dstRect, copyBitMap, output);
+        break;
+    case eImageBitDepthHalf:
+        assert(false);
+        break;
+    case eImageBitDepthFloat:
+        halveRectForDepth<float>(dstRect, copyBitMap, output);
+        break;
+    case eImageBitDepthNone:
+        break;
+    }
+}
+
+// code proofread and fixed by @devernay on 4/12/2014
+template <typename PIX, int maxValue>
+void
+Image::halveRoIForDepth(const RectI & roi,
+                        bool copyBitMap,
+                        Image* output) const
+{
+    assert( (getBitDepth() == eImageBitDepthByte && sizeof(PIX) == 1) ||
+            (getBitDepth() == eImageBitDepthShort && sizeof(PIX) == 2) ||
+            (getBitDepth() == eImageBitDepthFloat && sizeof(PIX) == 4) );
+
+    ///handle case where there is only 1 column/row
+    if ( (roi.width() == 1) || (roi.height() == 1) ) {
+        assert( !(roi.width() == 1 && roi.height() == 1) ); /// can't be 1x1
+        halve1DImage(roi, output);
+
+        return;
+    }
+
+    /// Take the lock for both bitmaps since we're about to read/write from them!
+    QWriteLocker k1(&output->_entryLock);
+    QReadLocker k2(&_entryLock);
+
+    // the srcRoD of the output should be enclosed in half the roi.
+    // It does not have to be exactly half of the input.
+    //    assert(dstRoD.x1*2 >= roi.x1 &&
+    //           dstRoD.x2*2 <= roi.x2 &&
+    //           dstRoD.y1*2 >= roi.y1 &&
+    //           dstRoD.y2*2 <= roi.y2 &&
+    //           dstRoD.width()*2 <= roi.width() &&
+    //           dstRoD.height()*2 <= roi.height());
+    assert( getComponents() == output->getComponents() );
+
+    RectI dstRoI = getHalvedRoI(roi, _bounds);
+
+    ///Rows are independent: the tiles are computed concurrently, the locks are held by this thread.
+    ///The calling thread takes part in the work, so this is safe from a render thread of the scheduler too.
+    std::vector<RectI> tiles;
+    splitInTiles(dstRoI, NATRON_MIPMAP_TILE_SIZE, &tiles);
+    TaskScheduler::map( tiles, boost::bind(&Image::halveRectForDepth<PIX>, this, _1, copyBitMap, output) );
 } // halveRoIForDepth
 
 // code proofread and fixed by @devernay on 8/8/2014
@@ -2087,7 +2540,7 @@ Image::downscaleMipMap(const RectD& dstRod,
 //    roiCanonical.toPixelEnclosing(toLevel, par , &dstRoI);
     unsigned int downscaleLvls = toLevel - fromLevel;
 
-    assert( !copyBitMap || _bitmap.getBitmap() );
+    assert( !copyBitMap || _bitmap.getMemorySize() );
 
     RectI dstRoI  = roi.downscalePowerOfTwoSmallestEnclosing(downscaleLvls);
     ImagePtr tmpImg = boost::make_shared<Image>( getComponents(), dstRod, dstRoI, toLevel, par, getBitDepth(), getPremultiplication(), getFieldingOrder(), true);
@@ -2265,44 +2718,84 @@ Image::buildMipMapLevel(const RectD& dstRoD,
         return;
     }
 
-    const Image* srcImg = this;
-    Image* dstImg = NULL;
-    bool mustFreeSrc = false;
+    ///Allocate all the mipmap levels until we reach the one we are interested in
+    std::vector<MipMapLevel> levels(level);
     RectI previousRoI = roi;
-    ///Build all the mipmap levels until we reach the one we are interested in
+    RectI previousBounds = _bounds;
+    bool has1DLevel = false;
     for (unsigned int i = 1; i <= level; ++i) {
         ///Halve the smallest enclosing po2 rect as we need to render a minimum of the renderWindow
         RectI halvedRoI = previousRoI.downscalePowerOfTwoSmallestEnclosing(1);
 
         ///Allocate an image with half the size of the source image
-        dstImg = new Image( getComponents(), dstRoD, halvedRoI, getMipMapLevel() + i, getPixelAspectRatio(), getBitDepth(), getPremultiplication(), getFieldingOrder(), true);
+        MipMapLevel& lvl = levels[i - 1];
+        lvl.image = boost::make_shared<Image>( getComponents(), dstRoD, halvedRoI, getMipMapLevel() + i, getPixelAspectRatio(), getBitDepth(), getPremultiplication(), getFieldingOrder(), true);
 
-        ///Half the source image into dstImg.
-        ///We pass the closestPo2 roi which might not be the entire size of the source image
+        ///We halve the closestPo2 roi which might not be the entire size of the source image
         ///If the source image'sroi was originally a po2.
-        srcImg->halveRoI(previousRoI, copyBitMap, dstImg);
-
-        ///Clean-up, we should use shared_ptrs for safety
-        if (mustFreeSrc) {
-            delete srcImg;
+        lvl.roi = getHalvedRoI(previousRoI, previousBounds);
+        if ( (previousRoI.width() == 1) || (previousRoI.height() == 1) ) {
+            has1DLevel = true;
         }
 
         ///Switch for next pass
         previousRoI = halvedRoI;
-        srcImg = dstImg;
-        mustFreeSrc = true;
+        previousBounds = halvedRoI;
     }
 
-    assert(srcImg->getBounds() == lastLevelRoI);
+    if (has1DLevel) {
+        ///Rows or columns cannot be halved independently, build the levels one after the other
+        const Image* srcImg = this;
+        RectI srcRoI = roi;
+        for (std::size_t i = 0; i < levels.size(); ++i) {
+            srcImg->halveRoI( srcRoI, copyBitMap, levels[i].image.get() );
+            srcRoI = levels[i].image->getBounds();
+            srcImg = levels[i].image.get();
+        }
+    } else {
+        ///Go through all the levels tile by tile: the source image is read only once and each level
+        ///is halved while it is still in the CPU caches.
+        ///The intermediate levels are not shared, only the lock of this image is needed.
+        QReadLocker k(&_entryLock);
+        std::vector<RectI> tiles;
+        splitInTiles( levels.back().roi, std::max(1, NATRON_MIPMAP_TILE_SIZE >> (level - 1) ), &tiles );
+        TaskScheduler::map( tiles, boost::bind(&Image::halveTileThroughLevels, this, &levels, _1, copyBitMap) );
+    }
+
+    const ImagePtr& lastLevel = levels.back().image;
+    assert(lastLevel->getBounds() == lastLevelRoI);
 
     ///Finally copy the last mipmap level into output.
-    output->pasteFrom( *srcImg, srcImg->getBounds(), copyBitMap);
+    output->pasteFrom( *lastLevel, lastLevel->getBounds(), copyBitMap);
+} // buildMipMapLevel
 
-    ///Clean-up, we should use shared_ptrs for safety
-    if (mustFreeSrc) {
-        delete srcImg;
+void
+Image::halveTileThroughLevels(const std::vector<MipMapLevel>* levels,
+                              const RectI & tile,
+                              bool copyBitMap) const
+{
+    ///Go up from the tile to the parts of the previous levels it depends on
+    std::vector<RectI> rects( levels->size() );
+
+    rects.back() = tile;
+    for (std::size_t i = levels->size() - 1; i > 0; --i) {
+        const RectI & rect = rects[i];
+        if ( rect.isNull() ) {
+            continue;
+        }
+        RectI srcRect(rect.x1 * 2, rect.y1 * 2, rect.x2 * 2, rect.y2 * 2);
+        srcRect.intersect(levels->at(i - 1).roi, &rects[i - 1]);
     }
-} // buildMipMapLevel
+
+    const Image* srcImg = this;
+    for (std::size_t i = 0; i < levels->size(); ++i) {
+        Image* dstImg = levels->at(i).image.get();
+        if ( !rects[i].isNull() ) {
+            srcImg->halveRect(rects[i], copyBitMap, dstImg);
+        }
+        srcImg = dstImg;
+    }
+}
 
 double
 Image::getScaleFromMipMapLevel(unsigned int level)
@@ -2338,14 +2831,22 @@ Bitmap::copyRowPortion(int x1,
                        int y,
                        const Bitmap& other)
 {
-    const char* srcBitmap = other.getBitmapAt(x1, y);
-    char* dstBitmap = getBitmapAt(x1, y);
-    const char* end = dstBitmap + (x2 - x1);
-
-    while (dstBitmap < end) {
-        *dstBitmap = /**srcBitmap == PIXEL_UNAVAILABLE ? 0 : */ *srcBitmap;
-        ++dstBitmap;
-        ++srcBitmap;
+    if (x1 >= x2) {
+        return;
+    }
+    std::vector<char> scratch;
+    setRow( y, x1, x2, other.getRow(y, x1, x2, &scratch) );
+
+    if (_storage == eBitmapStorageTiles) {
+        // The rows are copied in order: once the last row of a tile is copied, its pixels may be freed
+        int tx1, ty1, tx2, ty2;
+        getTileRange(RectI(x1, y, x2, y + 1), &tx1, &ty1, &tx2, &ty2);
+        for (int tx = tx1; tx < tx2; ++tx) {
+            const int tileIndex = ty1 * _tilesPerRow + tx;
+            if (getTileRect(tileIndex).y2 == y + 1) {
+                compactTile(tileIndex);
+            }
+        }
     }
 }
 
@@ -2363,21 +2864,31 @@ Bitmap::copyBitmapPortion(const RectI& roi,
     assert(roi.x1 >= _bounds.x1 && roi.x2 <= _bounds.x2 && roi.y1 >= _bounds.y1 && roi.y2 <= _bounds.y2);
     assert(roi.x1 >= other._bounds.x1 && roi.x2 <= other._bounds.x2 && roi.y1 >= other._bounds.y1 && roi.y2 <= other._bounds.y2);
 
-    int srcRowSize = other._bounds.width();
-    int dstRowSize = _bounds.width();
-    const char* srcBitmap = other.getBitmapAt(roi.x1, roi.y1);
-    char* dstBitmap = getBitmapAt(roi.x1, roi.y1);
-
-    for (int y = roi.y1; y < roi.y2; ++y,
-         srcBitmap += srcRowSize,
-         dstBitmap += dstRowSize) {
-        const char* srcCur = srcBitmap;
-        const char* srcEnd = srcBitmap + roi.width();
-        char* dstCur = dstBitmap;
-        while (srcCur < srcEnd) {
-            *dstCur = /**srcCur == PIXEL_UNAVAILABLE ? 0 : */ *srcCur;
-            ++srcCur;
-            ++dstCur;
+    if ( roi.isNull() ) {
+        return;
+    }
+    if (other._storage == eBitmapStorageTiles) {
+        // Do not go through the pixels if the source is uniform
+        int state = other.getUniformState(roi);
+        if (state >= 0) {
+            markFor(roi, (char)state);
+
+            return;
+        }
+    }
+
+    std::vector<char> scratch;
+    for (int y = roi.y1; y < roi.y2; ++y) {
+        setRow( y, roi.x1, roi.x2, other.getRow(y, roi.x1, roi.x2, &scratch) );
+    }
+
+    if (_storage == eBitmapStorageTiles) {
+        int tx1, ty1, tx2, ty2;
+        getTileRange(roi, &tx1, &ty1, &tx2, &ty2);
+        for (int ty = ty1; ty < ty2; ++ty) {
+            for (int tx = tx1; tx < tx2; ++tx) {
+                compactTile(ty * _tilesPerRow + tx);
+            }
         }
     }
 }
@@ -29,6 +29,7 @@
 
 #include <list>
 #include <map>
+#include <vector>
 #include <algorithm> // min, max
 #include <bitset>
 
@@ -63,12 +64,24 @@ public:
     }
 };
 
+/**
+ * @brief The render state of the pixels of an image: 0 if not rendered, 1 if rendered and 2 (with the trimap) if being
+ * rendered by another thread.
+ * With eBitmapStoragePixels, the state of each pixel is stored. With eBitmapStorageTiles, the state is stored per tile
+ * of NATRON_BITMAP_TILE_SIZE pixels, and the pixels of a tile are only stored while it is partially marked: the images
+ * rendered in one go, such as the ones of the effects that do not support tiles, then only take a few bytes per tile.
+ * Both storages give exactly the same results.
+ **/
 class Bitmap
 {
 public:
-    Bitmap(const RectI & bounds)
-        : _bounds(bounds)
-        , _map( bounds.area() )
+    Bitmap(const RectI & bounds,
+           BitmapStorageEnum storage = eBitmapStoragePixels)
+        : _bounds()
+        , _storage(storage)
+        , _map()
+        , _tilePixels()
+        , _tilesPerRow(0)
         , _dirtyZone()
         , _dirtyZoneSet(false)
     {
@@ -76,37 +89,50 @@ public:
         // "identities" images (i.e: images that are just a link to another image). See EffectInstance :
         // "!!!Note that if isIdentity is true it will allocate an empty image object with 0 bytes of data."
         //assert(!rod.isNull());
-        std::fill(_map.begin(), _map.end(), 0);
+        initialize(bounds);
     }
 
     Bitmap()
         : _bounds()
+        , _storage(eBitmapStoragePixels)
         , _map()
+        , _tilePixels()
+        , _tilesPerRow(0)
         , _dirtyZone()
         , _dirtyZoneSet(false)
     {
     }
 
-    void initialize(const RectI & bounds)
-    {
-        _bounds = bounds;
-        _map.resize( _bounds.area() );
+    void initialize(const RectI & bounds);
 
-        std::fill(_map.begin(), _map.end(), 0);
+    ~Bitmap()
+    {
     }
 
-    ~Bitmap()
+    void setTo1();
+
+    const RectI & getBounds() const
     {
+        return _bounds;
     }
 
-    void setTo1()
+    BitmapStorageEnum getStorage() const
     {
-        std::fill(_map.begin(), _map.end(), 1);
+        return _storage;
     }
 
-    const RectI & getBounds() const
+    /**
+     * @brief Changes the storage, the marked pixels are kept.
+     **/
+    void setStorage(BitmapStorageEnum storage);
+
+    /**
+     * @brief Returns the number of bytes of the bitmap accounted by the cache. The pixels of the partially marked tiles
+     * are not included: they only live while the image is being rendered, and the size of a cache entry must not change.
+     **/
+    std::size_t getMemorySize() const
     {
-        return _bounds;
+        return _map.size();
     }
 
 #if NATRON_ENABLE_TRIMAP
@@ -132,19 +158,37 @@ public:
 
     void swap(Bitmap& other);
 
+    /**
+     * @brief Direct access to the pixels, only with eBitmapStoragePixels.
+     **/
     const char* getBitmap() const
     {
+        assert(_storage == eBitmapStoragePixels);
+
         return &_map.front();
     }
 
     char* getBitmap()
     {
+        assert(_storage == eBitmapStoragePixels);
+
         return &_map.front();
     }
 
     const char* getBitmapAt(int x, int y) const;
     char* getBitmapAt(int x, int y);
 
+    /**
+     * @brief Returns the states of the pixels from x1 to x2 of the row y, which must be in the bounds.
+     * With eBitmapStoragePixels this points in the bitmap, otherwise the states are copied to scratch.
+     **/
+    const char* getRow(int y, int x1, int x2, std::vector<char>* scratch) const;
+
+    /**
+     * @brief Sets the states of the pixels from x1 to x2 of the row y, which must be in the bounds.
+     **/
+    void setRow(int y, int x1, int x2, const char* states);
+
     void copyRowPortion(int x1, int x2, int y, const Bitmap& other);
 
     void copyBitmapPortion(const RectI& roi, const Bitmap& other);
@@ -158,10 +202,46 @@ public:
 private:
     void markFor(const RectI & roi, char value);
 
+    template <int trimap>
+    RectI minimalNonMarkedBboxForStorage(const RectI & roi, bool* isBeingRenderedElsewhere) const;
+
+    template <int trimap>
+    void minimalNonMarkedRectsForStorage(const RectI & roi, std::list<RectI>& ret, bool* isBeingRenderedElsewhere) const;
+
+    void readRow(int y, int x1, int x2, char* states) const;
+
+    // With eBitmapStorageTiles: the tiles covering roi, which must be in the bounds, and the rectangle covered by a tile
+    void getTileRange(const RectI & roi, int* tx1, int* ty1, int* tx2, int* ty2) const;
+    RectI getTileRect(int tileIndex) const;
+
+    // With eBitmapStorageTiles: the pixels of a tile, allocated from its state if it was uniform
+    char* getMixedTilePixels(int tileIndex);
+    void setTileUniform(int tileIndex, char value);
+
+    // With eBitmapStorageTiles: frees the pixels of a tile if they all have the same state
+    void compactTile(int tileIndex);
+
+    // With eBitmapStorageTiles: returns the state of the tiles covering roi if they are all uniform and the same, -1 otherwise
+    int getUniformState(const RectI & roi) const;
+
+    // With eBitmapStorageTiles: returns the part of roi covered by the tiles that are not all rendered
+    RectI getNonRenderedTilesBbox(const RectI & roi) const;
+
+    // With eBitmapStorageTiles: copies the states of the pixels of roi to a bitmap with eBitmapStoragePixels
+    void toPixels(const RectI & roi, Bitmap* pixels) const;
+
 private:
     RectI _bounds;
+    BitmapStorageEnum _storage;
+
+    // With eBitmapStoragePixels, the state of each pixel.
+    // With eBitmapStorageTiles, the state of each tile, or BITMAP_TILE_MIXED if its pixels have different states.
     std::vector<char> _map;
 
+    // With eBitmapStorageTiles, the pixels of the tiles marked BITMAP_TILE_MIXED, empty for the other tiles
+    std::vector<std::vector<char> > _tilePixels;
+    int _tilesPerRow;
+
     /**
      * This represents the zone that has potentially something to render. In minimalNonMarkedRects
      * we intersect the region of interest with the dirty zone. This is useful to optimize the bitmap checking
@@ -206,6 +286,14 @@ public:
 
     bool usesBitMap() const { return _useBitmap; }
 
+    /**
+     * @brief Selects how the render state of the pixels is stored, see Bitmap. This is best called before the memory
+     * is allocated, otherwise the bitmap is converted.
+     **/
+    void setBitmapStorage(BitmapStorageEnum storage);
+
+    BitmapStorageEnum getBitmapStorage() const;
+
     StorageModeEnum getStorageMode() const
     {
         return _params->getStorageInfo().mode;
@@ -219,6 +307,12 @@ public:
                             ViewIdx view,
                             bool draftMode,
                             bool fullScaleWithDownscaleInputs);
+
+    /**
+     * @brief The images of a plane at a mipmap level share their key with the other planes and levels: this tells them
+     * apart for the productions of the node cache (see AppManager::registerImageProduction()).
+     **/
+    static U64 getProductionVariant(unsigned int mipMapLevel, const ImagePlaneDesc& plane);
     static ImageParamsPtr makeParams(const RectD & rod,    // the image rod in canonical coordinates
                                                      const double par,
                                                      unsigned int mipMapLevel,
@@ -302,7 +396,7 @@ public:
         std::size_t dt = dataSize();
         bool got = _entryLock.tryLockForRead();
 
-        dt += _bitmap.getBounds().area();
+        dt += _bitmap.getMemorySize();
         if (got) {
             _entryLock.unlock();
         }
@@ -1002,6 +1096,27 @@ private:
                           bool copyBitMap,
                           Image* output) const;
 
+    /**
+     * @brief Computes the pixels of output in dstRect from this image, which must be twice as large.
+     * This does not take the locks of the images: different rectangles of the same image may be computed concurrently.
+     **/
+    void halveRect(const RectI & dstRect, bool copyBitMap, Image* output) const;
+
+    template <typename PIX>
+    void halveRectForDepth(const RectI & dstRect, bool copyBitMap, Image* output) const;
+
+    struct MipMapLevel
+    {
+        ImagePtr image;
+        RectI roi; // the pixels of the level computed from the previous one
+    };
+
+    /**
+     * @brief Computes the given tile of the last of the mipmap levels of this image, and the parts of the
+     * intermediate levels it depends on. Each level is computed while the tile of the previous one is still in the CPU caches.
+     **/
+    void halveTileThroughLevels(const std::vector<MipMapLevel>* levels, const RectI & tile, bool copyBitMap) const;
+
     /**
      * @brief Same as halveRoI but for 1D only (either width == 1 or height == 1)
      **/
@@ -27,6 +27,7 @@
 #include <algorithm> // min, max
 #include <cassert>
 #include <stdexcept>
+#include <vector>
 
 #ifndef Q_MOC_RUN
 GCC_DIAG_UNUSED_LOCAL_TYPEDEFS_OFF
@@ -37,6 +38,7 @@ GCC_DIAG_UNUSED_LOCAL_TYPEDEFS_ON
 #include <QtCore/QDebug>
 
 #include "Engine/AppManager.h"
+#include "Engine/ImageSIMD.h"
 #include "Engine/Lut.h"
 
 NATRON_NAMESPACE_ENTER
@@ -132,6 +134,67 @@ lutFromColorspace(ViewerColorSpaceEnum cs)
     return lut;
 }
 
+/**
+ * @brief Converts a row of RGBA to RGB, RGB to RGBA or RGBA to a single channel without colorspace conversion,
+ * with the vectorized kernels. This gives the same result as the scalar loop of convertToFormatInternalForColorSpace,
+ * including the error diffusion towards 8-bit.
+ * shuffled holds width * dstNComps values, quantized as well if converting to 8-bit with more than 1 component.
+ **/
+template <typename SRCPIX, typename DSTPIX, int dstMaxValue, int srcNComps, int dstNComps>
+static void
+convertRowSIMD(const SRCPIX* srcPixels,
+               DSTPIX* dstPixels,
+               int width,
+               int channelForAlpha,
+               bool useAlpha0,
+               SRCPIX* shuffled,
+               unsigned short* quantized)
+{
+    ///Convert the components first, in the source bit depth
+    if ( (srcNComps == 4) && (dstNComps == 3) ) {
+        ImageSIMD::removeAlpha( srcPixels, shuffled, width, sizeof(SRCPIX) );
+    } else if ( (srcNComps == 3) && (dstNComps == 4) ) {
+        const SRCPIX alpha = Image::convertPixelDepth<float, SRCPIX>(useAlpha0 ? 0.f : 1.f);
+        ImageSIMD::addAlpha( srcPixels, &alpha, shuffled, width, sizeof(SRCPIX) );
+    } else {
+        assert(srcNComps == 4 && dstNComps == 1);
+        assert(channelForAlpha >= 0 && channelForAlpha <= 3);
+        ImageSIMD::extractChannel( srcPixels, channelForAlpha, shuffled, width, sizeof(SRCPIX) );
+    }
+
+    if ( (dstMaxValue != 255) || (dstNComps == 1) ) {
+        ImageSIMD::convertDepth(shuffled, dstPixels, width * dstNComps);
+
+        return;
+    }
+
+    ///Error diffusion: only the quantization is vectorized, the diffusion itself goes from pixel to pixel
+    ///in the same order as the scalar code.
+    assert(quantized);
+    ImageSIMD::quantizeForDithering(shuffled, quantized, width * dstNComps);
+    const DSTPIX alpha = Image::convertPixelDepth<float, DSTPIX>(useAlpha0 ? 0.f : 1.f);
+    // coverity[dont_call]
+    int start = rand() % width;
+    for (int backward = 0; backward < 2; ++backward) {
+        int x = backward ? start - 1 : start;
+        int end = backward ? -1 : width;
+        int step = backward ? -1 : 1;
+        unsigned error[3] = {
+            0x80, 0x80, 0x80
+        };
+
+        for (; x != end; x += step) {
+            for (int k = 0; k < 3; ++k) {
+                error[k] = (error[k] & 0xff) + quantized[x * dstNComps + k];
+                dstPixels[x * dstNComps + k] = error[k] >> 8;
+            }
+            if (dstNComps == 4) {
+                dstPixels[x * dstNComps + 3] = alpha;
+            }
+        }
+    }
+} // convertRowSIMD
+
 ///Fast version when components are the same
 template <typename SRCPIX, typename DSTPIX, int srcMaxValue, int dstMaxValue>
 void
@@ -162,6 +225,19 @@ Image::convertToFormatInternal_sameComps(const RectI & renderWindow,
     if ( intersection.isNull() ) {
         return;
     }
+    if ( !srcLut && !dstLut && ImageSIMD::isEnabled() ) {
+        ///Without colorspace conversion, all values are converted independently
+        for (int y = 0; y < intersection.height(); ++y) {
+            const SRCPIX* srcPixels = (const SRCPIX*)srcImg.pixelAt(intersection.x1, intersection.y1 + y);
+            DSTPIX* dstPixels = (DSTPIX*)dstImg.pixelAt(intersection.x1, intersection.y1 + y);
+            ImageSIMD::convertDepth(srcPixels, dstPixels, intersection.width() * nComp);
+            if (copyBitmap) {
+                dstImg.copyBitmapRowPortion(intersection.x1, intersection.x2, intersection.y1 + y, srcImg);
+            }
+        }
+
+        return;
+    }
     for (int y = 0; y < intersection.height(); ++y) {
         // coverity[dont_call]
         int start = rand() % intersection.width();
@@ -306,6 +382,30 @@ Image::convertToFormatInternalForColorSpace(const RectI & renderWindow,
     const Color::Lut* const srcLut = useColorspaces ? lutFromColorspace( (ViewerColorSpaceEnum)srcColorSpace ) : 0;
     const Color::Lut* const dstLut = useColorspaces ? lutFromColorspace( (ViewerColorSpaceEnum)dstColorSpace ) : 0;
 
+    if ( ( !useColorspaces || (!srcLut && !dstLut) ) && ImageSIMD::isEnabled() &&
+         ( ( (srcNComps == 4) && (dstNComps == 3) ) || ( (srcNComps == 3) && (dstNComps == 4) ) || ( (srcNComps == 4) && (dstNComps == 1) ) ) ) {
+        ///Note that without colorspace conversion the RGB channels are not unpremultiplied
+        std::vector<SRCPIX> shuffled(renderWindow.width() * dstNComps);
+        std::vector<unsigned short> quantized;
+        if ( (dstMaxValue == 255) && (dstNComps > 1) ) {
+            quantized.resize(renderWindow.width() * dstNComps);
+        }
+        for (int y = 0; y < renderWindow.height(); ++y) {
+            convertRowSIMD<SRCPIX, DSTPIX, dstMaxValue, srcNComps, dstNComps>( (const SRCPIX*)srcImg.pixelAt(renderWindow.x1, renderWindow.y1 + y),
+                                                                                (DSTPIX*)dstImg.pixelAt(renderWindow.x1, renderWindow.y1 + y),
+                                                                                renderWindow.width(),
+                                                                                channelForAlpha,
+                                                                                useAlpha0,
+                                                                                &shuffled[0],
+                                                                                quantized.empty() ? 0 : &quantized[0] );
+        }
+        if (copyBitmap) {
+            dstImg.copyBitmapPortion(renderWindow, srcImg);
+        }
+
+        return;
+    }
+
     for (int y = 0; y < renderWindow.height(); ++y) {
         ///Start of the line for error diffusion
         // coverity[dont_call]
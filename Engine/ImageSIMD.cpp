@@ -0,0 +1,1225 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * Copyright (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "ImageSIMD.h"
+
+#include <algorithm> // min
+#include <cassert>
+#include <cstring> // memcpy
+
+#include "Global/GlobalDefines.h"
+
+#include "Engine/Lut.h"
+
+// The vectorized kernels are only compiled for x86-64, where SSE2 is always available and floats are never
+// computed with the x87 unit, which would not give the same results as the scalar code.
+#if ( defined(__x86_64__) || defined(_M_X64) ) && ( defined(__GNUC__) || defined(_MSC_VER) )
+#define NATRON_IMAGESIMD_X86
+#endif
+
+#ifdef NATRON_IMAGESIMD_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h> // __cpuid, __cpuidex, _xgetbv
+#endif
+
+// gcc and clang only accept the intrinsics of the instruction sets enabled for the function they are used in.
+// Do not add fma here: fused multiply-adds round differently from the scalar code.
+#ifdef __GNUC__
+#define NATRON_TARGET_SSE41 __attribute__( ( target("sse4.1") ) )
+#define NATRON_TARGET_AVX2 __attribute__( ( target("avx2") ) )
+#else
+#define NATRON_TARGET_SSE41
+#define NATRON_TARGET_AVX2
+#endif
+#endif // NATRON_IMAGESIMD_X86
+
+NATRON_NAMESPACE_ENTER
+
+namespace ImageSIMD {
+static InstructionSetEnum
+detectInstructionSet()
+{
+#ifdef NATRON_IMAGESIMD_X86
+#ifdef __GNUC__
+    // may be called before the constructors of libgcc
+    __builtin_cpu_init();
+    if ( __builtin_cpu_supports("avx2") ) {
+        return eInstructionSetAVX2;
+    }
+    if ( __builtin_cpu_supports("sse4.1") ) {
+        return eInstructionSetSSE41;
+    }
+#else
+    int info[4];
+    __cpuid(info, 0);
+    int nIds = info[0];
+    if (nIds >= 1) {
+        __cpuid(info, 1);
+        bool sse41 = (info[2] & (1 << 19) ) != 0;
+        bool osxsave = (info[2] & (1 << 27) ) != 0;
+        bool avx = (info[2] & (1 << 28) ) != 0;
+        // AVX2 also requires the OS to save the YMM registers
+        if ( (nIds >= 7) && osxsave && avx && ( (_xgetbv(0) & 0x6) == 0x6 ) ) {
+            __cpuidex(info, 7, 0);
+            if ( (info[1] & (1 << 5) ) != 0 ) {
+                return eInstructionSetAVX2;
+            }
+        }
+        if (sse41) {
+            return eInstructionSetSSE41;
+        }
+    }
+#endif
+#endif // NATRON_IMAGESIMD_X86
+
+    return eInstructionSetNone;
+}
+
+static const InstructionSetEnum detectedInstructionSet = detectInstructionSet();
+static InstructionSetEnum maxInstructionSet = eInstructionSetAVX2;
+
+InstructionSetEnum
+getInstructionSet()
+{
+    return std::min(detectedInstructionSet, maxInstructionSet);
+}
+
+void
+setMaxInstructionSet(InstructionSetEnum instructionSet)
+{
+    maxInstructionSet = instructionSet;
+}
+
+#ifdef NATRON_IMAGESIMD_X86
+
+// Each kernel converts the first values of the buffer and returns how many were converted,
+// the scalar code takes care of the remaining ones.
+
+/// Same as Color::floatToInt<numvals>: clamping first gives the same result for 0 and 1.
+NATRON_TARGET_SSE41 static inline __m128i
+floatToIntSSE41(__m128 v,
+                __m128 scale)
+{
+    v = _mm_min_ps( _mm_max_ps( v, _mm_setzero_ps() ), _mm_set1_ps(1.f) );
+
+    return _mm_cvttps_epi32( _mm_add_ps( _mm_mul_ps(v, scale), _mm_set1_ps(0.5f) ) );
+}
+
+NATRON_TARGET_AVX2 static inline __m256i
+floatToIntAVX2(__m256 v,
+               __m256 scale)
+{
+    v = _mm256_min_ps( _mm256_max_ps( v, _mm256_setzero_ps() ), _mm256_set1_ps(1.f) );
+
+    return _mm256_cvttps_epi32( _mm256_add_ps( _mm256_mul_ps(v, scale), _mm256_set1_ps(0.5f) ) );
+}
+
+/// Same as Color::intToFloat<numvals>: this is a division, not a multiplication by the inverse
+NATRON_TARGET_SSE41 static inline __m128
+intToFloatSSE41(__m128i v,
+                __m128 maxValue)
+{
+    return _mm_div_ps(_mm_cvtepi32_ps(v), maxValue);
+}
+
+NATRON_TARGET_AVX2 static inline __m256
+intToFloatAVX2(__m256i v,
+               __m256 maxValue)
+{
+    return _mm256_div_ps(_mm256_cvtepi32_ps(v), maxValue);
+}
+
+/// Packs 2 vectors of 8 ints in 0-65535 to 16 shorts, in order
+NATRON_TARGET_AVX2 static inline __m256i
+packUint16AVX2(__m256i a,
+               __m256i b)
+{
+    return _mm256_permute4x64_epi64( _mm256_packus_epi32(a, b), _MM_SHUFFLE(3, 1, 2, 0) );
+}
+
+NATRON_TARGET_SSE41 static std::size_t
+floatToUint8SSE41(const float* src,
+                  unsigned char* dst,
+                  std::size_t n,
+                  float maxValue)
+{
+    const __m128 scale = _mm_set1_ps(maxValue);
+    std::size_t i = 0;
+
+    for (; i + 16 <= n; i += 16) {
+        __m128i a = floatToIntSSE41(_mm_loadu_ps(src + i), scale);
+        __m128i b = floatToIntSSE41(_mm_loadu_ps(src + i + 4), scale);
+        __m128i c = floatToIntSSE41(_mm_loadu_ps(src + i + 8), scale);
+        __m128i d = floatToIntSSE41(_mm_loadu_ps(src + i + 12), scale);
+        _mm_storeu_si128( (__m128i*)(dst + i), _mm_packus_epi16( _mm_packus_epi32(a, b), _mm_packus_epi32(c, d) ) );
+    }
+
+    return i;
+}
+
+NATRON_TARGET_AVX2 static std::size_t
+floatToUint8AVX2(const float* src,
+                 unsigned char* dst,
+                 std::size_t n,
+                 float maxValue)
+{
+    const __m256 scale = _mm256_set1_ps(maxValue);
+    // packs work within 128-bit lanes: this puts the groups of 4 values back in order
+    const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+    std::size_t i = 0;
+
+    for (; i + 32 <= n; i += 32) {
+        __m256i a = floatToIntAVX2(_mm256_loadu_ps(src + i), scale);
+        __m256i b = floatToIntAVX2(_mm256_loadu_ps(src + i + 8), scale);
+        __m256i c = floatToIntAVX2(_mm256_loadu_ps(src + i + 16), scale);
+        __m256i d = floatToIntAVX2(_mm256_loadu_ps(src + i + 24), scale);
+        __m256i packed = _mm256_packus_epi16( _mm256_packus_epi32(a, b), _mm256_packus_epi32(c, d) );
+        _mm256_storeu_si256( (__m256i*)(dst + i), _mm256_permutevar8x32_epi32(packed, order) );
+    }
+
+    return i;
+}
+
+NATRON_TARGET_SSE41 static std::size_t
+floatToUint16SSE41(const float* src,
+                   unsigned short* dst,
+                   std::size_t n,
+                   float maxValue)
+{
+    const __m128 scale = _mm_set1_ps(maxValue);
+    std::size_t i = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        __m128i a = floatToIntSSE41(_mm_loadu_ps(src + i), scale);
+        __m128i b = floatToIntSSE41(_mm_loadu_ps(src + i + 4), scale);
+        _mm_storeu_si128( (__m128i*)(dst + i), _mm_packus_epi32(a, b) );
+    }
+
+    return i;
+}
+
+NATRON_TARGET_AVX2 static std::size_t
+floatToUint16AVX2(const float* src,
+                  unsigned short* dst,
+                  std::size_t n,
+                  float maxValue)
+{
+    const __m256 scale = _mm256_set1_ps(maxValue);
+    std::size_t i = 0;
+
+    for (; i + 16 <= n; i += 16) {
+        __m256i a = floatToIntAVX2(_mm256_loadu_ps(src + i), scale);
+        __m256i b = floatToIntAVX2(_mm256_loadu_ps(src + i + 8), scale);
+        _mm256_storeu_si256( (__m256i*)(dst + i), packUint16AVX2(a, b) );
+    }
+
+    return i;
+}
+
+NATRON_TARGET_SSE41 static std::size_t
+uint8ToFloatSSE41(const unsigned char* src,
+                  float* dst,
+                  std::size_t n)
+{
+    const __m128 maxValue = _mm_set1_ps(255.f);
+    std::size_t i = 0;
+
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128( (const __m128i*)(src + i) );
+        _mm_storeu_ps( dst + i, intToFloatSSE41(_mm_cvtepu8_epi32(v), maxValue) );
+        _mm_storeu_ps( dst + i + 4, intToFloatSSE41(_mm_cvtepu8_epi32( _mm_srli_si128(v, 4) ), maxValue) );
+        _mm_storeu_ps( dst + i + 8, intToFloatSSE41(_mm_cvtepu8_epi32( _mm_srli_si128(v, 8) ), maxValue) );
+        _mm_storeu_ps( dst + i + 12, intToFloatSSE41(_mm_cvtepu8_epi32( _mm_srli_si128(v, 12) ), maxValue) );
+    }
+
+    return i;
+}
+
+NATRON_TARGET_AVX2 static std::size_t
+uint8ToFloatAVX2(const unsigned char* src,
+                 float* dst,
+                 std::size_t n)
+{
+    const __m256 maxValue = _mm256_set1_ps(255.f);
+    std::size_t i = 0;
+
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128( (const __m128i*)(src + i) );
+        _mm256_storeu_ps( dst + i, intToFloatAVX2(_mm256_cvtepu8_epi32(v), maxValue) );
+        _mm256_storeu_ps( dst + i + 8, intToFloatAVX2(_mm256_cvtepu8_epi32( _mm_srli_si128(v, 8) ), maxValue) );
+    }
+
+    return i;
+}
+
+NATRON_TARGET_SSE41 static std::size_t
+uint16ToFloatSSE41(const unsigned short* src,
+                   float* dst,
+                   std::size_t n)
+{
+    const __m128 maxValue = _mm_set1_ps(65535.f);
+    std::size_t i = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        __m128i v = _mm_loadu_si128( (const __m128i*)(src + i) );
+        _mm_storeu_ps( dst + i, intToFloatSSE41(_mm_cvtepu16_epi32(v), maxValue) );
+        _mm_storeu_ps( dst + i + 4, intToFloatSSE41(_mm_cvtepu16_epi32( _mm_srli_si128(v, 8) ), maxValue) );
+    }
+
+    return i;
+}
+
+NATRON_TARGET_AVX2 static std::size_t
+uint16ToFloatAVX2(const unsigned short* src,
+                  float* dst,
+                  std::size_t n)
+{
+    const __m256 maxValue = _mm256_set1_ps(65535.f);
+    std::size_t i = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        _mm256_storeu_ps( dst + i, intToFloatAVX2(_mm256_cvtepu16_epi32( _mm_loadu_si128( (const __m128i*)(src + i) ) ), maxValue) );
+    }
+
+    return i;
+}
+
+NATRON_TARGET_SSE41 static std::size_t
+uint8ToUint16SSE41(const unsigned char* src,
+                   unsigned short* dst,
+                   std::size_t n)
+{
+    std::size_t i = 0;
+
+    for (; i + 16 <= n; i += 16) {
+        // interleaving a byte with itself gives (pix << 8) + pix
+        __m128i v = _mm_loadu_si128( (const __m128i*)(src + i) );
+        _mm_storeu_si128( (__m128i*)(dst + i), _mm_unpacklo_epi8(v, v) );
+        _mm_storeu_si128( (__m128i*)(dst + i + 8), _mm_unpackhi_epi8(v, v) );
+    }
+
+    return i;
+}
+
+/// Same as Color::uint16ToChar, on 32-bit ints since pix + 128 overflows 16 bits
+NATRON_TARGET_SSE41 static inline __m128i
+uint16ToUint8SSE41(__m128i v)
+{
+    v = _mm_add_epi32( v, _mm_set1_epi32(128) );
+
+    return _mm_srli_epi32(_mm_sub_epi32( v, _mm_srli_epi32(v, 8) ), 8);
+}
+
+NATRON_TARGET_SSE41 static std::size_t
+uint16ToUint8SSE41(const unsigned short* src,
+                   unsigned char* dst,
+                   std::size_t n)
+{
+    std::size_t i = 0;
+
+    for (; i + 16 <= n; i += 16) {
+        __m128i lo = _mm_loadu_si128( (const __m128i*)(src + i) );
+        __m128i hi = _mm_loadu_si128( (const __m128i*)(src + i + 8) );
+        __m128i a = uint16ToUint8SSE41( _mm_cvtepu16_epi32(lo) );
+        __m128i b = uint16ToUint8SSE41( _mm_cvtepu16_epi32( _mm_srli_si128(lo, 8) ) );
+        __m128i c = uint16ToUint8SSE41( _mm_cvtepu16_epi32(hi) );
+        __m128i d = uint16ToUint8SSE41( _mm_cvtepu16_epi32( _mm_srli_si128(hi, 8) ) );
+        _mm_storeu_si128( (__m128i*)(dst + i), _mm_packus_epi16( _mm_packus_epi32(a, b), _mm_packus_epi32(c, d) ) );
+    }
+
+    return i;
+}
+
+NATRON_TARGET_SSE41 static std::size_t
+quantizeUint8SSE41(const unsigned char* src,
+                   unsigned short* dst,
+                   std::size_t n)
+{
+    const __m128 maxValue = _mm_set1_ps(255.f);
+    const __m128 scale = _mm_set1_ps( (float)0xff00 );
+    std::size_t i = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        __m128i v = _mm_loadl_epi64( (const __m128i*)(src + i) );
+        __m128i a = floatToIntSSE41(intToFloatSSE41(_mm_cvtepu8_epi32(v), maxValue), scale);
+        __m128i b = floatToIntSSE41(intToFloatSSE41(_mm_cvtepu8_epi32( _mm_srli_si128(v, 4) ), maxValue), scale);
+        _mm_storeu_si128( (__m128i*)(dst + i), _mm_packus_epi32(a, b) );
+    }
+
+    return i;
+}
+
+NATRON_TARGET_AVX2 static std::size_t
+quantizeUint8AVX2(const unsigned char* src,
+                  unsigned short* dst,
+                  std::size_t n)
+{
+    const __m256 maxValue = _mm256_set1_ps(255.f);
+    const __m256 scale = _mm256_set1_ps( (float)0xff00 );
+    std::size_t i = 0;
+
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128( (const __m128i*)(src + i) );
+        __m256i a = floatToIntAVX2(intToFloatAVX2(_mm256_cvtepu8_epi32(v), maxValue), scale);
+        __m256i b = floatToIntAVX2(intToFloatAVX2(_mm256_cvtepu8_epi32( _mm_srli_si128(v, 8) ), maxValue), scale);
+        _mm256_storeu_si256( (__m256i*)(dst + i), packUint16AVX2(a, b) );
+    }
+
+    return i;
+}
+
+NATRON_TARGET_SSE41 static std::size_t
+quantizeUint16SSE41(const unsigned short* src,
+                    unsigned short* dst,
+                    std::size_t n)
+{
+    const __m128 maxValue = _mm_set1_ps(65535.f);
+    const __m128 scale = _mm_set1_ps( (float)0xff00 );
+    std::size_t i = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        __m128i v = _mm_loadu_si128( (const __m128i*)(src + i) );
+        __m128i a = floatToIntSSE41(intToFloatSSE41(_mm_cvtepu16_epi32(v), maxValue), scale);
+        __m128i b = floatToIntSSE41(intToFloatSSE41(_mm_cvtepu16_epi32( _mm_srli_si128(v, 8) ), maxValue), scale);
+        _mm_storeu_si128( (__m128i*)(dst + i), _mm_packus_epi32(a, b) );
+    }
+
+    return i;
+}
+
+NATRON_TARGET_AVX2 static std::size_t
+quantizeUint16AVX2(const unsigned short* src,
+                   unsigned short* dst,
+                   std::size_t n)
+{
+    const __m256 maxValue = _mm256_set1_ps(65535.f);
+    const __m256 scale = _mm256_set1_ps( (float)0xff00 );
+    std::size_t i = 0;
+
+    for (; i + 16 <= n; i += 16) {
+        __m256i a = floatToIntAVX2(intToFloatAVX2(_mm256_cvtepu16_epi32( _mm_loadu_si128( (const __m128i*)(src + i) ) ), maxValue), scale);
+        __m256i b = floatToIntAVX2(intToFloatAVX2(_mm256_cvtepu16_epi32( _mm_loadu_si128( (const __m128i*)(src + i + 8) ) ), maxValue), scale);
+        _mm256_storeu_si256( (__m256i*)(dst + i), packUint16AVX2(a, b) );
+    }
+
+    return i;
+}
+
+// The component conversions shuffle bytes, hence the same code handles all bit depths.
+// A 16 bytes vector holds 4 / elementSize RGBA pixels.
+
+NATRON_TARGET_SSE41 static std::size_t
+removeAlphaSSE41(const unsigned char* src,
+                 unsigned char* dst,
+                 std::size_t nPixels,
+                 int elementSize)
+{
+    const std::size_t pixelsPerVector = 4 / elementSize;
+    const std::size_t dstPixelSize = 3 * elementSize;
+    char mask[16];
+
+    for (int j = 0; j < 16; ++j) {
+        if (j < 12) {
+            int pixel = j / dstPixelSize;
+            int channel = (j % dstPixelSize) / elementSize;
+            mask[j] = (char)(pixel * 4 * elementSize + channel * elementSize + j % elementSize);
+        } else {
+            mask[j] = (char)0x80;
+        }
+    }
+    const __m128i shuffle = _mm_loadu_si128( (const __m128i*)mask );
+    std::size_t i = 0;
+
+    // Each vector gives 12 bytes but 16 are stored: the next store overwrites the 4 extra bytes,
+    // the last ones must not go past the end of the buffer.
+    for (; i * dstPixelSize + 16 <= nPixels * dstPixelSize; i += pixelsPerVector) {
+        __m128i v = _mm_loadu_si128( (const __m128i*)(src + i * 4 * elementSize) );
+        _mm_storeu_si128( (__m128i*)(dst + i * dstPixelSize), _mm_shuffle_epi8(v, shuffle) );
+    }
+
+    return i;
+}
+
+NATRON_TARGET_SSE41 static std::size_t
+addAlphaSSE41(const unsigned char* src,
+              const unsigned char* alpha,
+              unsigned char* dst,
+              std::size_t nPixels,
+              int elementSize)
+{
+    const std::size_t pixelsPerVector = 4 / elementSize;
+    const std::size_t srcPixelSize = 3 * elementSize;
+    char mask[16];
+    char alphaBytes[16];
+
+    for (int j = 0; j < 16; ++j) {
+        int pixel = j / (4 * elementSize);
+        int channel = (j % (4 * elementSize) ) / elementSize;
+        if (channel < 3) {
+            mask[j] = (char)(pixel * srcPixelSize + channel * elementSize + j % elementSize);
+            alphaBytes[j] = 0;
+        } else {
+            mask[j] = (char)0x80;
+            alphaBytes[j] = (char)alpha[j % elementSize];
+        }
+    }
+    const __m128i shuffle = _mm_loadu_si128( (const __m128i*)mask );
+    const __m128i alphaMask = _mm_loadu_si128( (const __m128i*)alphaBytes );
+    std::size_t i = 0;
+
+    // Each vector reads 16 bytes but only uses 12 of them
+    for (; i * srcPixelSize + 16 <= nPixels * srcPixelSize; i += pixelsPerVector) {
+        __m128i v = _mm_loadu_si128( (const __m128i*)(src + i * srcPixelSize) );
+        _mm_storeu_si128( (__m128i*)(dst + i * 4 * elementSize), _mm_or_si128(_mm_shuffle_epi8(v, shuffle), alphaMask) );
+    }
+
+    return i;
+}
+
+NATRON_TARGET_SSE41 static std::size_t
+extractChannelSSE41(const unsigned char* src,
+                    int channel,
+                    unsigned char* dst,
+                    std::size_t nPixels,
+                    int elementSize)
+{
+    const std::size_t pixelsPerVector = 4 / elementSize;
+    // Each input vector gives 4 bytes, which are placed in their own part of the output vector
+    char masks[4][16];
+
+    for (int k = 0; k < 4; ++k) {
+        for (int j = 0; j < 16; ++j) {
+            if ( (j >= 4 * k) && (j < 4 * k + 4) ) {
+                int element = (j - 4 * k) / elementSize;
+                masks[k][j] = (char)(element * 4 * elementSize + channel * elementSize + (j - 4 * k) % elementSize);
+            } else {
+                masks[k][j] = (char)0x80;
+            }
+        }
+    }
+    const __m128i shuffle0 = _mm_loadu_si128( (const __m128i*)masks[0] );
+    const __m128i shuffle1 = _mm_loadu_si128( (const __m128i*)masks[1] );
+    const __m128i shuffle2 = _mm_loadu_si128( (const __m128i*)masks[2] );
+    const __m128i shuffle3 = _mm_loadu_si128( (const __m128i*)masks[3] );
+    std::size_t i = 0;
+
+    for (; i + 4 * pixelsPerVector <= nPixels; i += 4 * pixelsPerVector) {
+        const __m128i* v = (const __m128i*)(src + i * 4 * elementSize);
+        __m128i a = _mm_shuffle_epi8(_mm_loadu_si128(v), shuffle0);
+        __m128i b = _mm_shuffle_epi8(_mm_loadu_si128(v + 1), shuffle1);
+        __m128i c = _mm_shuffle_epi8(_mm_loadu_si128(v + 2), shuffle2);
+        __m128i d = _mm_shuffle_epi8(_mm_loadu_si128(v + 3), shuffle3);
+        _mm_storeu_si128( (__m128i*)(dst + i * elementSize), _mm_or_si128( _mm_or_si128(a, b), _mm_or_si128(c, d) ) );
+    }
+
+    return i;
+}
+
+// The halving kernels add the 4 values in the same order as the scalar code: a + b + c + d,
+// where a and b are in the first row. Multiplying by 0.25 gives exactly the same result as dividing by 4.
+
+NATRON_TARGET_SSE41 static std::size_t
+halveRowsRGBA8SSE41(const unsigned char* row0,
+                    const unsigned char* row1,
+                    unsigned char* dst,
+                    std::size_t nPixels)
+{
+    std::size_t i = 0;
+
+    for (; i + 4 <= nPixels; i += 4) {
+        __m128i sum[2];
+        for (int j = 0; j < 2; ++j) {
+            // 16 bytes hold the 4 source pixels of 2 destination pixels of a row
+            __m128i v0 = _mm_loadu_si128( (const __m128i*)(row0 + (i + j * 2) * 8) );
+            __m128i v1 = _mm_loadu_si128( (const __m128i*)(row1 + (i + j * 2) * 8) );
+            __m128i lo0 = _mm_cvtepu8_epi16(v0);
+            __m128i hi0 = _mm_cvtepu8_epi16( _mm_srli_si128(v0, 8) );
+            __m128i lo1 = _mm_cvtepu8_epi16(v1);
+            __m128i hi1 = _mm_cvtepu8_epi16( _mm_srli_si128(v1, 8) );
+            __m128i a = _mm_unpacklo_epi64(lo0, hi0);
+            __m128i b = _mm_unpackhi_epi64(lo0, hi0);
+            __m128i c = _mm_unpacklo_epi64(lo1, hi1);
+            __m128i d = _mm_unpackhi_epi64(lo1, hi1);
+            sum[j] = _mm_srli_epi16(_mm_add_epi16( _mm_add_epi16( _mm_add_epi16(a, b), c ), d ), 2);
+        }
+        _mm_storeu_si128( (__m128i*)(dst + i * 4), _mm_packus_epi16(sum[0], sum[1]) );
+    }
+
+    return i;
+}
+
+NATRON_TARGET_SSE41 static std::size_t
+halveRowsRGBA16SSE41(const unsigned short* row0,
+                     const unsigned short* row1,
+                     unsigned short* dst,
+                     std::size_t nPixels)
+{
+    std::size_t i = 0;
+
+    for (; i + 2 <= nPixels; i += 2) {
+        __m128i sum[2];
+        for (int j = 0; j < 2; ++j) {
+            // the sum of 4 shorts does not fit in 16 bits
+            __m128i v0 = _mm_loadu_si128( (const __m128i*)(row0 + (i + j) * 8) );
+            __m128i v1 = _mm_loadu_si128( (const __m128i*)(row1 + (i + j) * 8) );
+            __m128i a = _mm_cvtepu16_epi32(v0);
+            __m128i b = _mm_cvtepu16_epi32( _mm_srli_si128(v0, 8) );
+            __m128i c = _mm_cvtepu16_epi32(v1);
+            __m128i d = _mm_cvtepu16_epi32( _mm_srli_si128(v1, 8) );
+            sum[j] = _mm_srli_epi32(_mm_add_epi32( _mm_add_epi32( _mm_add_epi32(a, b), c ), d ), 2);
+        }
+        _mm_storeu_si128( (__m128i*)(dst + i * 4), _mm_packus_epi32(sum[0], sum[1]) );
+    }
+
+    return i;
+}
+
+NATRON_TARGET_SSE41 static inline __m128
+averageSSE41(__m128 a,
+             __m128 b,
+             __m128 c,
+             __m128 d)
+{
+    return _mm_mul_ps( _mm_add_ps( _mm_add_ps( _mm_add_ps(a, b), c ), d ), _mm_set1_ps(0.25f) );
+}
+
+NATRON_TARGET_AVX2 static inline __m256
+averageAVX2(__m256 a,
+            __m256 b,
+            __m256 c,
+            __m256 d)
+{
+    return _mm256_mul_ps( _mm256_add_ps( _mm256_add_ps( _mm256_add_ps(a, b), c ), d ), _mm256_set1_ps(0.25f) );
+}
+
+NATRON_TARGET_SSE41 static std::size_t
+halveRowsFloatSSE41(const float* row0,
+                    const float* row1,
+                    float* dst,
+                    std::size_t nPixels,
+                    int nComps)
+{
+    std::size_t i = 0;
+
+    switch (nComps) {
+    case 1:
+        for (; i + 4 <= nPixels; i += 4) {
+            __m128 v00 = _mm_loadu_ps(row0 + i * 2);
+            __m128 v01 = _mm_loadu_ps(row0 + i * 2 + 4);
+            __m128 v10 = _mm_loadu_ps(row1 + i * 2);
+            __m128 v11 = _mm_loadu_ps(row1 + i * 2 + 4);
+            _mm_storeu_ps( dst + i, averageSSE41( _mm_shuffle_ps( v00, v01, _MM_SHUFFLE(2, 0, 2, 0) ),
+                                                  _mm_shuffle_ps( v00, v01, _MM_SHUFFLE(3, 1, 3, 1) ),
+                                                  _mm_shuffle_ps( v10, v11, _MM_SHUFFLE(2, 0, 2, 0) ),
+                                                  _mm_shuffle_ps( v10, v11, _MM_SHUFFLE(3, 1, 3, 1) ) ) );
+        }
+        break;
+    case 2:
+        for (; i + 2 <= nPixels; i += 2) {
+            __m128 v00 = _mm_loadu_ps(row0 + i * 4);
+            __m128 v01 = _mm_loadu_ps(row0 + i * 4 + 4);
+            __m128 v10 = _mm_loadu_ps(row1 + i * 4);
+            __m128 v11 = _mm_loadu_ps(row1 + i * 4 + 4);
+            _mm_storeu_ps( dst + i * 2, averageSSE41( _mm_shuffle_ps( v00, v01, _MM_SHUFFLE(1, 0, 1, 0) ),
+                                                      _mm_shuffle_ps( v00, v01, _MM_SHUFFLE(3, 2, 3, 2) ),
+                                                      _mm_shuffle_ps( v10, v11, _MM_SHUFFLE(1, 0, 1, 0) ),
+                                                      _mm_shuffle_ps( v10, v11, _MM_SHUFFLE(3, 2, 3, 2) ) ) );
+        }
+        break;
+    case 4:
+        for (; i < nPixels; ++i) {
+            _mm_storeu_ps( dst + i * 4, averageSSE41( _mm_loadu_ps(row0 + i * 8), _mm_loadu_ps(row0 + i * 8 + 4),
+                                                      _mm_loadu_ps(row1 + i * 8), _mm_loadu_ps(row1 + i * 8 + 4) ) );
+        }
+        break;
+    default:
+        break;
+    }
+
+    return i;
+}
+
+NATRON_TARGET_AVX2 static std::size_t
+halveRowsFloatAVX2(const float* row0,
+                   const float* row1,
+                   float* dst,
+                   std::size_t nPixels,
+                   int nComps)
+{
+    std::size_t i = 0;
+
+    switch (nComps) {
+    case 1:
+        for (; i + 8 <= nPixels; i += 8) {
+            __m256 v00 = _mm256_loadu_ps(row0 + i * 2);
+            __m256 v01 = _mm256_loadu_ps(row0 + i * 2 + 8);
+            __m256 v10 = _mm256_loadu_ps(row1 + i * 2);
+            __m256 v11 = _mm256_loadu_ps(row1 + i * 2 + 8);
+            // shuffles work within 128-bit lanes: the result holds pixels 0-1, 4-5, 2-3, 6-7
+            __m256 avg = averageAVX2( _mm256_shuffle_ps( v00, v01, _MM_SHUFFLE(2, 0, 2, 0) ),
+                                      _mm256_shuffle_ps( v00, v01, _MM_SHUFFLE(3, 1, 3, 1) ),
+                                      _mm256_shuffle_ps( v10, v11, _MM_SHUFFLE(2, 0, 2, 0) ),
+                                      _mm256_shuffle_ps( v10, v11, _MM_SHUFFLE(3, 1, 3, 1) ) );
+            _mm256_storeu_ps( dst + i, _mm256_castpd_ps( _mm256_permute4x64_pd( _mm256_castps_pd(avg), _MM_SHUFFLE(3, 1, 2, 0) ) ) );
+        }
+        break;
+    case 4:
+        for (; i + 2 <= nPixels; i += 2) {
+            __m256 v00 = _mm256_loadu_ps(row0 + i * 8);
+            __m256 v01 = _mm256_loadu_ps(row0 + i * 8 + 8);
+            __m256 v10 = _mm256_loadu_ps(row1 + i * 8);
+            __m256 v11 = _mm256_loadu_ps(row1 + i * 8 + 8);
+            _mm256_storeu_ps( dst + i * 4, averageAVX2( _mm256_permute2f128_ps(v00, v01, 0x20), _mm256_permute2f128_ps(v00, v01, 0x31),
+                                                        _mm256_permute2f128_ps(v10, v11, 0x20), _mm256_permute2f128_ps(v10, v11, 0x31) ) );
+        }
+        break;
+    default:
+        break;
+    }
+
+    return i;
+}
+
+// The products are computed in double and rounded to float as the scalar code does: there is no fused multiply-add.
+NATRON_TARGET_SSE41 static std::size_t
+linearToLutIndexesSSE41(const float* src,
+                        double gain,
+                        double offset,
+                        unsigned short* dst,
+                        std::size_t n)
+{
+    const __m128d g = _mm_set1_pd(gain);
+    const __m128d o = _mm_set1_pd(offset);
+    std::size_t i = 0;
+
+    for (; i + 4 <= n; i += 4) {
+        __m128 v = _mm_loadu_ps(src + i);
+        __m128d lo = _mm_add_pd( _mm_mul_pd(_mm_cvtps_pd(v), g), o );
+        __m128d hi = _mm_add_pd( _mm_mul_pd(_mm_cvtps_pd( _mm_movehl_ps(v, v) ), g), o );
+        __m128 f = _mm_movelh_ps( _mm_cvtpd_ps(lo), _mm_cvtpd_ps(hi) );
+        __m128i hipart = _mm_srli_epi32(_mm_castps_si128(f), 16);
+        _mm_storel_epi64( (__m128i*)(dst + i), _mm_packus_epi32(hipart, hipart) );
+    }
+
+    return i;
+}
+
+NATRON_TARGET_AVX2 static std::size_t
+linearToLutIndexesAVX2(const float* src,
+                       double gain,
+                       double offset,
+                       unsigned short* dst,
+                       std::size_t n)
+{
+    const __m256d g = _mm256_set1_pd(gain);
+    const __m256d o = _mm256_set1_pd(offset);
+    std::size_t i = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        __m256 v = _mm256_loadu_ps(src + i);
+        __m256d lo = _mm256_add_pd( _mm256_mul_pd(_mm256_cvtps_pd( _mm256_castps256_ps128(v) ), g), o );
+        __m256d hi = _mm256_add_pd( _mm256_mul_pd(_mm256_cvtps_pd( _mm256_extractf128_ps(v, 1) ), g), o );
+        __m128i hipartLo = _mm_srli_epi32(_mm_castps_si128( _mm256_cvtpd_ps(lo) ), 16);
+        __m128i hipartHi = _mm_srli_epi32(_mm_castps_si128( _mm256_cvtpd_ps(hi) ), 16);
+        _mm_storeu_si128( (__m128i*)(dst + i), _mm_packus_epi32(hipartLo, hipartHi) );
+    }
+
+    return i;
+}
+
+// Returns the index of the first block of values that contains a value different from value
+NATRON_TARGET_SSE41 static std::size_t
+findFirstNotEqualSSE41(const char* src,
+                       char value,
+                       std::size_t n)
+{
+    const __m128i v = _mm_set1_epi8(value);
+    std::size_t i = 0;
+
+    for (; i + 16 <= n; i += 16) {
+        __m128i eq = _mm_cmpeq_epi8(_mm_loadu_si128( (const __m128i*)(src + i) ), v);
+        if (_mm_movemask_epi8(eq) != 0xffff) {
+            break;
+        }
+    }
+
+    return i;
+}
+
+NATRON_TARGET_AVX2 static std::size_t
+findFirstNotEqualAVX2(const char* src,
+                      char value,
+                      std::size_t n)
+{
+    const __m256i v = _mm256_set1_epi8(value);
+    std::size_t i = 0;
+
+    for (; i + 32 <= n; i += 32) {
+        __m256i eq = _mm256_cmpeq_epi8(_mm256_loadu_si256( (const __m256i*)(src + i) ), v);
+        if (_mm256_movemask_epi8(eq) != -1) {
+            break;
+        }
+    }
+
+    return i;
+}
+
+#endif // NATRON_IMAGESIMD_X86
+
+template <typename PIX>
+static void
+halveRowsScalar(const PIX* row0,
+                const PIX* row1,
+                PIX* dst,
+                std::size_t begin,
+                std::size_t nPixels,
+                int nComps)
+{
+    for (std::size_t i = begin; i < nPixels; ++i) {
+        for (int k = 0; k < nComps; ++k) {
+            const PIX a = row0[i * 2 * nComps + k];
+            const PIX b = row0[(i * 2 + 1) * nComps + k];
+            const PIX c = row1[i * 2 * nComps + k];
+            const PIX d = row1[(i * 2 + 1) * nComps + k];
+            dst[i * nComps + k] = (a + b + c + d) / 4;
+        }
+    }
+}
+
+void
+convertDepth(const unsigned char* src,
+             unsigned char* dst,
+             std::size_t n)
+{
+    std::memcpy( dst, src, n * sizeof(unsigned char) );
+}
+
+void
+convertDepth(const unsigned char* src,
+             unsigned short* dst,
+             std::size_t n)
+{
+    std::size_t i = 0;
+
+#ifdef NATRON_IMAGESIMD_X86
+    if ( getInstructionSet() != eInstructionSetNone ) {
+        i = uint8ToUint16SSE41(src, dst, n);
+    }
+#endif
+    for (; i < n; ++i) {
+        dst[i] = Color::charToUint16(src[i]);
+    }
+}
+
+void
+convertDepth(const unsigned char* src,
+             float* dst,
+             std::size_t n)
+{
+    std::size_t i = 0;
+
+#ifdef NATRON_IMAGESIMD_X86
+    switch ( getInstructionSet() ) {
+    case eInstructionSetAVX2:
+        i = uint8ToFloatAVX2(src, dst, n);
+        break;
+    case eInstructionSetSSE41:
+        i = uint8ToFloatSSE41(src, dst, n);
+        break;
+    case eInstructionSetNone:
+        break;
+    }
+#endif
+    for (; i < n; ++i) {
+        dst[i] = Color::intToFloat<256>(src[i]);
+    }
+}
+
+void
+convertDepth(const unsigned short* src,
+             unsigned char* dst,
+             std::size_t n)
+{
+    std::size_t i = 0;
+
+#ifdef NATRON_IMAGESIMD_X86
+    if ( getInstructionSet() != eInstructionSetNone ) {
+        i = uint16ToUint8SSE41(src, dst, n);
+    }
+#endif
+    for (; i < n; ++i) {
+        dst[i] = Color::uint16ToChar(src[i]);
+    }
+}
+
+void
+convertDepth(const unsigned short* src,
+             unsigned short* dst,
+             std::size_t n)
+{
+    std::memcpy( dst, src, n * sizeof(unsigned short) );
+}
+
+void
+convertDepth(const unsigned short* src,
+             float* dst,
+             std::size_t n)
+{
+    std::size_t i = 0;
+
+#ifdef NATRON_IMAGESIMD_X86
+    switch ( getInstructionSet() ) {
+    case eInstructionSetAVX2:
+        i = uint16ToFloatAVX2(src, dst, n);
+        break;
+    case eInstructionSetSSE41:
+        i = uint16ToFloatSSE41(src, dst, n);
+        break;
+    case eInstructionSetNone:
+        break;
+    }
+#endif
+    for (; i < n; ++i) {
+        dst[i] = Color::intToFloat<65536>(src[i]);
+    }
+}
+
+void
+convertDepth(const float* src,
+             unsigned char* dst,
+             std::size_t n)
+{
+    std::size_t i = 0;
+
+#ifdef NATRON_IMAGESIMD_X86
+    switch ( getInstructionSet() ) {
+    case eInstructionSetAVX2:
+        i = floatToUint8AVX2(src, dst, n, 255.f);
+        break;
+    case eInstructionSetSSE41:
+        i = floatToUint8SSE41(src, dst, n, 255.f);
+        break;
+    case eInstructionSetNone:
+        break;
+    }
+#endif
+    for (; i < n; ++i) {
+        dst[i] = (unsigned char)Color::floatToInt<256>(src[i]);
+    }
+}
+
+void
+convertDepth(const float* src,
+             unsigned short* dst,
+             std::size_t n)
+{
+    std::size_t i = 0;
+
+#ifdef NATRON_IMAGESIMD_X86
+    switch ( getInstructionSet() ) {
+    case eInstructionSetAVX2:
+        i = floatToUint16AVX2(src, dst, n, 65535.f);
+        break;
+    case eInstructionSetSSE41:
+        i = floatToUint16SSE41(src, dst, n, 65535.f);
+        break;
+    case eInstructionSetNone:
+        break;
+    }
+#endif
+    for (; i < n; ++i) {
+        dst[i] = (unsigned short)Color::floatToInt<65536>(src[i]);
+    }
+}
+
+void
+convertDepth(const float* src,
+             float* dst,
+             std::size_t n)
+{
+    std::memcpy( dst, src, n * sizeof(float) );
+}
+
+void
+quantizeForDithering(const unsigned char* src,
+                     unsigned short* dst,
+                     std::size_t n)
+{
+    std::size_t i = 0;
+
+#ifdef NATRON_IMAGESIMD_X86
+    switch ( getInstructionSet() ) {
+    case eInstructionSetAVX2:
+        i = quantizeUint8AVX2(src, dst, n);
+        break;
+    case eInstructionSetSSE41:
+        i = quantizeUint8SSE41(src, dst, n);
+        break;
+    case eInstructionSetNone:
+        break;
+    }
+#endif
+    for (; i < n; ++i) {
+        dst[i] = (unsigned short)Color::floatToInt<0xff01>( Color::intToFloat<256>(src[i]) );
+    }
+}
+
+void
+quantizeForDithering(const unsigned short* src,
+                     unsigned short* dst,
+                     std::size_t n)
+{
+    std::size_t i = 0;
+
+#ifdef NATRON_IMAGESIMD_X86
+    switch ( getInstructionSet() ) {
+    case eInstructionSetAVX2:
+        i = quantizeUint16AVX2(src, dst, n);
+        break;
+    case eInstructionSetSSE41:
+        i = quantizeUint16SSE41(src, dst, n);
+        break;
+    case eInstructionSetNone:
+        break;
+    }
+#endif
+    for (; i < n; ++i) {
+        dst[i] = (unsigned short)Color::floatToInt<0xff01>( Color::intToFloat<65536>(src[i]) );
+    }
+}
+
+void
+quantizeForDithering(const float* src,
+                     unsigned short* dst,
+                     std::size_t n)
+{
+    std::size_t i = 0;
+
+#ifdef NATRON_IMAGESIMD_X86
+    switch ( getInstructionSet() ) {
+    case eInstructionSetAVX2:
+        i = floatToUint16AVX2(src, dst, n, (float)0xff00);
+        break;
+    case eInstructionSetSSE41:
+        i = floatToUint16SSE41(src, dst, n, (float)0xff00);
+        break;
+    case eInstructionSetNone:
+        break;
+    }
+#endif
+    for (; i < n; ++i) {
+        dst[i] = (unsigned short)Color::floatToInt<0xff01>(src[i]);
+    }
+}
+
+void
+removeAlpha(const void* src,
+            void* dst,
+            std::size_t nPixels,
+            int elementSize)
+{
+    assert(elementSize == 1 || elementSize == 2 || elementSize == 4);
+    const unsigned char* srcBytes = (const unsigned char*)src;
+    unsigned char* dstBytes = (unsigned char*)dst;
+    std::size_t i = 0;
+
+#ifdef NATRON_IMAGESIMD_X86
+    if ( getInstructionSet() != eInstructionSetNone ) {
+        i = removeAlphaSSE41(srcBytes, dstBytes, nPixels, elementSize);
+    }
+#endif
+    for (; i < nPixels; ++i) {
+        std::memcpy(dstBytes + i * 3 * elementSize, srcBytes + i * 4 * elementSize, 3 * elementSize);
+    }
+}
+
+void
+addAlpha(const void* src,
+         const void* alpha,
+         void* dst,
+         std::size_t nPixels,
+         int elementSize)
+{
+    assert(elementSize == 1 || elementSize == 2 || elementSize == 4);
+    const unsigned char* srcBytes = (const unsigned char*)src;
+    const unsigned char* alphaBytes = (const unsigned char*)alpha;
+    unsigned char* dstBytes = (unsigned char*)dst;
+    std::size_t i = 0;
+
+#ifdef NATRON_IMAGESIMD_X86
+    if ( getInstructionSet() != eInstructionSetNone ) {
+        i = addAlphaSSE41(srcBytes, alphaBytes, dstBytes, nPixels, elementSize);
+    }
+#endif
+    for (; i < nPixels; ++i) {
+        std::memcpy(dstBytes + i * 4 * elementSize, srcBytes + i * 3 * elementSize, 3 * elementSize);
+        std::memcpy(dstBytes + i * 4 * elementSize + 3 * elementSize, alphaBytes, elementSize);
+    }
+}
+
+void
+extractChannel(const void* src,
+               int channel,
+               void* dst,
+               std::size_t nPixels,
+               int elementSize)
+{
+    assert(elementSize == 1 || elementSize == 2 || elementSize == 4);
+    assert(channel >= 0 && channel < 4);
+    const unsigned char* srcBytes = (const unsigned char*)src;
+    unsigned char* dstBytes = (unsigned char*)dst;
+    std::size_t i = 0;
+
+#ifdef NATRON_IMAGESIMD_X86
+    if ( getInstructionSet() != eInstructionSetNone ) {
+        i = extractChannelSSE41(srcBytes, channel, dstBytes, nPixels, elementSize);
+    }
+#endif
+    for (; i < nPixels; ++i) {
+        std::memcpy(dstBytes + i * elementSize, srcBytes + (i * 4 + channel) * elementSize, elementSize);
+    }
+}
+
+void
+halveRows(const unsigned char* row0,
+          const unsigned char* row1,
+          unsigned char* dst,
+          std::size_t nPixels,
+          int nComps)
+{
+    std::size_t i = 0;
+
+#ifdef NATRON_IMAGESIMD_X86
+    if ( (nComps == 4) && ( getInstructionSet() != eInstructionSetNone ) ) {
+        i = halveRowsRGBA8SSE41(row0, row1, dst, nPixels);
+    }
+#endif
+    halveRowsScalar(row0, row1, dst, i, nPixels, nComps);
+}
+
+void
+halveRows(const unsigned short* row0,
+          const unsigned short* row1,
+          unsigned short* dst,
+          std::size_t nPixels,
+          int nComps)
+{
+    std::size_t i = 0;
+
+#ifdef NATRON_IMAGESIMD_X86
+    if ( (nComps == 4) && ( getInstructionSet() != eInstructionSetNone ) ) {
+        i = halveRowsRGBA16SSE41(row0, row1, dst, nPixels);
+    }
+#endif
+    halveRowsScalar(row0, row1, dst, i, nPixels, nComps);
+}
+
+void
+halveRows(const float* row0,
+          const float* row1,
+          float* dst,
+          std::size_t nPixels,
+          int nComps)
+{
+    std::size_t i = 0;
+
+#ifdef NATRON_IMAGESIMD_X86
+    switch ( getInstructionSet() ) {
+    case eInstructionSetAVX2:
+        i = halveRowsFloatAVX2(row0, row1, dst, nPixels, nComps);
+        // 2 components pixels only have an SSE version
+        if (i == 0) {
+            i = halveRowsFloatSSE41(row0, row1, dst, nPixels, nComps);
+        }
+        break;
+    case eInstructionSetSSE41:
+        i = halveRowsFloatSSE41(row0, row1, dst, nPixels, nComps);
+        break;
+    case eInstructionSetNone:
+        break;
+    }
+#endif
+    halveRowsScalar(row0, row1, dst, i, nPixels, nComps);
+}
+
+void
+linearToLutIndexes(const float* src,
+                   double gain,
+                   double offset,
+                   unsigned short* dst,
+                   std::size_t n)
+{
+    std::size_t i = 0;
+
+#ifdef NATRON_IMAGESIMD_X86
+    switch ( getInstructionSet() ) {
+    case eInstructionSetAVX2:
+        i = linearToLutIndexesAVX2(src, gain, offset, dst, n);
+        break;
+    case eInstructionSetSSE41:
+        i = linearToLutIndexesSSE41(src, gain, offset, dst, n);
+        break;
+    case eInstructionSetNone:
+        break;
+    }
+#endif
+    for (; i < n; ++i) {
+        float v = (float)(src[i] * gain + offset);
+        U32 bits;
+        std::memcpy( &bits, &v, sizeof(bits) );
+        dst[i] = (unsigned short)(bits >> 16);
+    }
+}
+
+std::size_t
+findFirstNotEqual(const char* src,
+                  char value,
+                  std::size_t n)
+{
+    std::size_t i = 0;
+
+#ifdef NATRON_IMAGESIMD_X86
+    switch ( getInstructionSet() ) {
+    case eInstructionSetAVX2:
+        i = findFirstNotEqualAVX2(src, value, n);
+        break;
+    case eInstructionSetSSE41:
+        i = findFirstNotEqualSSE41(src, value, n);
+        break;
+    case eInstructionSetNone:
+        break;
+    }
+#endif
+    for (; i < n; ++i) {
+        if (src[i] != value) {
+            return i;
+        }
+    }
+
+    return n;
+}
+} // namespace ImageSIMD
+
+NATRON_NAMESPACE_EXIT
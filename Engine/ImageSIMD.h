@@ -0,0 +1,126 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * Copyright (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+#ifndef NATRON_ENGINE_IMAGESIMD_H
+#define NATRON_ENGINE_IMAGESIMD_H
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include <cstddef>
+
+#include "Engine/EngineFwd.h"
+
+NATRON_NAMESPACE_ENTER
+
+/**
+ * @brief Vectorized kernels of the image conversions and of the mipmaps. The instruction set is selected at runtime
+ * from the features of the CPU and every kernel has a scalar fallback, used for the remaining values and on other CPUs.
+ * The kernels give exactly the same results as the scalar code of the Image class.
+ **/
+namespace ImageSIMD {
+enum InstructionSetEnum
+{
+    eInstructionSetNone = 0,
+    eInstructionSetSSE41,
+    eInstructionSetAVX2
+};
+
+/**
+ * @brief Returns the best instruction set supported by the CPU, capped by setMaxInstructionSet().
+ **/
+InstructionSetEnum getInstructionSet();
+
+/**
+ * @brief Caps the instruction set used by the kernels. Passing eInstructionSetNone forces the scalar code,
+ * this is used to compare both implementations.
+ **/
+void setMaxInstructionSet(InstructionSetEnum instructionSet);
+
+inline bool
+isEnabled()
+{
+    return getInstructionSet() != eInstructionSetNone;
+}
+
+/**
+ * @brief Converts n values to another bit depth, as Image::convertPixelDepth does.
+ **/
+void convertDepth(const unsigned char* src, unsigned char* dst, std::size_t n);
+void convertDepth(const unsigned char* src, unsigned short* dst, std::size_t n);
+void convertDepth(const unsigned char* src, float* dst, std::size_t n);
+void convertDepth(const unsigned short* src, unsigned char* dst, std::size_t n);
+void convertDepth(const unsigned short* src, unsigned short* dst, std::size_t n);
+void convertDepth(const unsigned short* src, float* dst, std::size_t n);
+void convertDepth(const float* src, unsigned char* dst, std::size_t n);
+void convertDepth(const float* src, unsigned short* dst, std::size_t n);
+void convertDepth(const float* src, float* dst, std::size_t n);
+
+/**
+ * @brief Computes Color::floatToInt<0xff01>() of n values converted to float: these are the values accumulated
+ * by the error diffusion when converting to 8-bit.
+ **/
+void quantizeForDithering(const unsigned char* src, unsigned short* dst, std::size_t n);
+void quantizeForDithering(const unsigned short* src, unsigned short* dst, std::size_t n);
+void quantizeForDithering(const float* src, unsigned short* dst, std::size_t n);
+
+/**
+ * @brief RGBA to RGB conversion of nPixels pixels whose components are elementSize (1, 2 or 4) bytes.
+ **/
+void removeAlpha(const void* src, void* dst, std::size_t nPixels, int elementSize);
+
+/**
+ * @brief RGB to RGBA conversion of nPixels pixels whose components are elementSize (1, 2 or 4) bytes.
+ * alpha points to the elementSize bytes of the alpha value.
+ **/
+void addAlpha(const void* src, const void* alpha, void* dst, std::size_t nPixels, int elementSize);
+
+/**
+ * @brief Copies the given channel of nPixels RGBA pixels whose components are elementSize (1, 2 or 4) bytes.
+ **/
+void extractChannel(const void* src, int channel, void* dst, std::size_t nPixels, int elementSize);
+
+/**
+ * @brief Averages the 2x2 blocks of pixels of 2 consecutive rows into nPixels pixels, as Image::halveRoI does
+ * for the blocks that are entirely inside the source image. row0 and row1 hold 2 * nPixels pixels.
+ **/
+void halveRows(const unsigned char* row0, const unsigned char* row1, unsigned char* dst, std::size_t nPixels, int nComps);
+void halveRows(const unsigned short* row0, const unsigned short* row1, unsigned short* dst, std::size_t nPixels, int nComps);
+void halveRows(const float* row0, const float* row1, float* dst, std::size_t nPixels, int nComps);
+
+/**
+ * @brief Computes v = src[i] * gain + offset in double for n values, and the 16 high bits of v rounded to float:
+ * these are the indexes in the look-up tables of Color::Lut, see Lut::toColorSpaceUint8xxFromLinearFloatHipartFast().
+ **/
+void linearToLutIndexes(const float* src, double gain, double offset, unsigned short* dst, std::size_t n);
+
+/**
+ * @brief Returns the index of the first of the n values that is not equal to value, or n if they all are.
+ * This scans the rows of the render bitmap of the images, see Bitmap.
+ **/
+std::size_t findFirstNotEqual(const char* src, char value, std::size_t n);
+} // namespace ImageSIMD
+
+NATRON_NAMESPACE_EXIT
+
+#endif // NATRON_ENGINE_IMAGESIMD_H
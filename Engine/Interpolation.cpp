@@ -417,16 +417,18 @@ Interpolation::solveQuartic(double c0,
  * Note that for CATMULL-ROM you must use the function interpolate_catmullRom
  * which will compute the derivatives for you.
  **/
-double
-Interpolation::interpolate(double tcur,
-                           const double vcur,              //start control point
-                           const double vcurDerivRight, //being the derivative dv/dt at tcur
-                           const double vnextDerivLeft, //being the derivative dv/dt at tnext
-                           double tnext,
-                           const double vnext,               //end control point
-                           double currentTime,
-                           KeyframeTypeEnum interp,
-                           KeyframeTypeEnum interpNext)
+void
+Interpolation::interpolationCoeffs(double tcur,
+                                   const double vcur,              //start control point
+                                   const double vcurDerivRight, //being the derivative dv/dt at tcur
+                                   const double vnextDerivLeft, //being the derivative dv/dt at tnext
+                                   double tnext,
+                                   const double vnext,               //end control point
+                                   KeyframeTypeEnum interp,
+                                   KeyframeTypeEnum interpNext,
+                                   double *t0,
+                                   double *t1,
+                                   double coeffs[4])
 {
     double P0 = vcur;
     double P3 = vnext;
@@ -454,16 +456,42 @@ Interpolation::interpolate(double tcur,
         P3 = P0 + P0pr;
         tnext = tcur + 1;
     }
-    double c0, c1, c2, c3;
-    hermiteToCubicCoeffs(P0, P0pr, P3pl, P3, &c0, &c1, &c2, &c3);
+    hermiteToCubicCoeffs(P0, P0pr, P3pl, P3, &coeffs[0], &coeffs[1], &coeffs[2], &coeffs[3]);
+    *t0 = tcur;
+    *t1 = tnext;
+}
 
-    const double t = (currentTime - tcur) / (tnext - tcur);
-    double ret = cubicEval(c0, c1, c2, c3, t);
+double
+Interpolation::interpolateWithCoeffs(const double coeffs[4],
+                                     double t0,
+                                     double t1,
+                                     double currentTime)
+{
+    const double t = (currentTime - t0) / (t1 - t0);
+
+    return cubicEval(coeffs[0], coeffs[1], coeffs[2], coeffs[3], t);
+}
+
+double
+Interpolation::interpolate(double tcur,
+                           const double vcur,              //start control point
+                           const double vcurDerivRight, //being the derivative dv/dt at tcur
+                           const double vnextDerivLeft, //being the derivative dv/dt at tnext
+                           double tnext,
+                           const double vnext,               //end control point
+                           double currentTime,
+                           KeyframeTypeEnum interp,
+                           KeyframeTypeEnum interpNext)
+{
+    double t0, t1;
+    double coeffs[4];
+
+    interpolationCoeffs(tcur, vcur, vcurDerivRight, vnextDerivLeft, tnext, vnext, interp, interpNext, &t0, &t1, coeffs);
 
     // cubicDerive: divide the result by (tnext-tcur)
 
     // cubicIntegrate: multiply the result by (tnext-tcur)
-    return ret;
+    return interpolateWithCoeffs(coeffs, t0, t1, currentTime);
 }
 
 /// derive at currentTime. The derivative is with respect to currentTime
@@ -49,6 +49,23 @@ double interpolate(double tcur, const double vcur, //start control point
                    KeyframeTypeEnum interp,
                    KeyframeTypeEnum interpNext) WARN_UNUSED_RETURN;
 
+/**
+ * @brief Computes the cubic used by interpolate() between the control points P0(tcur,vcur) and P3(tnext,vnext):
+ * the value at 'currentTime' is interpolateWithCoeffs(coeffs, *t0, *t1, currentTime), which gives exactly the result of
+ * interpolate(). The coefficients only depend on the control points, so that they can be computed once per curve segment.
+ **/
+void interpolationCoeffs(double tcur, const double vcur, //start control point
+                         const double vcurDerivRight, //being the derivative dv/dt at tcur
+                         const double vnextDerivLeft, //being the derivative dv/dt at tnext
+                         double tnext, const double vnext, //end control point
+                         KeyframeTypeEnum interp,
+                         KeyframeTypeEnum interpNext,
+                         double *t0,
+                         double *t1,
+                         double coeffs[4]);
+
+double interpolateWithCoeffs(const double coeffs[4], double t0, double t1, double currentTime) WARN_UNUSED_RETURN;
+
 /// derive at currentTime. The derivative is with respect to currentTime
 double derive(double tcur, const double vcur, //start control point
               const double vcurDerivRight, //being the derivative dv/dt at tcur
@@ -50,6 +50,7 @@
 #include "Engine/KnobSerialization.h"
 #include "Engine/KnobTypes.h"
 #include "Engine/LibraryBinary.h"
+#include "Engine/NativeExpression.h"
 #include "Engine/Node.h"
 #include "Engine/Project.h"
 #include "Engine/StringAnimationManager.h"
@@ -226,10 +227,14 @@ struct Expr
     ///The list of pair<knob, dimension> dpendencies for an expression
     std::list<std::pair<KnobIWPtr, int> > dependencies;
 
-    //PyObject* code;
+    ///The Python function defined by validateExpression(), looked up once (new ref)
+    PyObject* function;
+
+    ///The expression compiled to be evaluated without Python, if possible
+    NativeExpressionPtr native;
 
     Expr()
-        : expression(), originalExpression(), exprInvalid(), hasRet(false) /*, code(0)*/ {}
+        : expression(), originalExpression(), exprInvalid(), hasRet(false), function(0), native() {}
 };
 
 struct KnobHelperPrivate
@@ -414,6 +419,8 @@ struct KnobHelperPrivate
 
     std::string declarePythonVariables(bool addTab, int dimension);
 
+    PyObject* getExpressionFunction(const std::string& funcExecScript);
+
     bool shouldUseGuiCurve() const
     {
         if (!holder) {
@@ -435,6 +442,12 @@ KnobHelper::KnobHelper(KnobHolder* holder,
 
 KnobHelper::~KnobHelper()
 {
+    for (std::size_t i = 0; i < _imp->expressions.size(); ++i) {
+        if ( _imp->expressions[i].function && Py_IsInitialized() ) {
+            PythonGILLocker pgl;
+            Py_DECREF(_imp->expressions[i].function);
+        }
+    }
 }
 
 void
@@ -2356,6 +2369,32 @@ KnobHelperPrivate::declarePythonVariables(bool addTab,
     return ss.str();
 } // KnobHelperPrivate::declarePythonVariables
 
+PyObject*
+KnobHelperPrivate::getExpressionFunction(const std::string& funcExecScript)
+{
+    ///funcExecScript is "ret = <function>", as returned by validateExpression()
+    const std::string prefix("ret = ");
+
+    if (funcExecScript.compare(0, prefix.size(), prefix) != 0) {
+        return 0;
+    }
+    bool isDefined = false;
+    PyObject* function = NATRON_PYTHON_NAMESPACE::getAttrRecursive(funcExecScript.substr( prefix.size() ), NATRON_PYTHON_NAMESPACE::getMainModule(), &isDefined);
+    if (!isDefined) {
+        // getAttrRecursive returns the parent object when the attribute is not defined
+        PyErr_Clear();
+
+        return 0;
+    }
+    if ( !PyCallable_Check(function) ) {
+        Py_DECREF(function);
+
+        return 0;
+    }
+
+    return function; // new ref
+}
+
 void
 KnobHelperPrivate::parseListenersFromExpression(int dimension)
 {
@@ -2700,6 +2739,16 @@ KnobHelper::setExpressionInternal(int dimension,
         }
     }
 
+    ///Look up the function once and try to compile the expression so that it does not need Python
+    PyObject* function = 0;
+    NativeExpressionPtr native;
+    if ( exprInvalid.empty() ) {
+        function = _imp->getExpressionFunction(exprCpy);
+        if (!hasRetVariable) {
+            native = NativeExpression::compile(expression, shared_from_this(), dimension);
+        }
+    }
+
     //Set internal fields
 
     {
@@ -2708,9 +2757,8 @@ KnobHelper::setExpressionInternal(int dimension,
         _imp->expressions[dimension].expression = exprCpy;
         _imp->expressions[dimension].originalExpression = expression;
         _imp->expressions[dimension].exprInvalid = exprInvalid;
-
-        ///This may throw an exception upon failure
-        //NATRON_PYTHON_NAMESPACE::compilePyScript(exprCpy, &_imp->expressions[dimension].code);
+        _imp->expressions[dimension].function = function;
+        _imp->expressions[dimension].native = native;
     }
 
     if ( getHolder() ) {
@@ -2800,8 +2848,9 @@ KnobHelper::clearExpression(int dimension,
         _imp->expressions[dimension].expression.clear();
         _imp->expressions[dimension].originalExpression.clear();
         _imp->expressions[dimension].exprInvalid.clear();
-        //Py_XDECREF(_imp->expressions[dimension].code); //< new ref
-        //_imp->expressions[dimension].code = 0;
+        Py_XDECREF(_imp->expressions[dimension].function); //< new ref
+        _imp->expressions[dimension].function = 0;
+        _imp->expressions[dimension].native.reset();
     }
     KnobIPtr thisShared = shared_from_this();
     {
@@ -2918,16 +2967,66 @@ KnobHelper::executeExpression(double time,
                               PyObject** ret,
                               std::string* error) const
 {
+    PythonGILLocker pgl;
     std::string expr;
+    PyObject* function;
     {
         QMutexLocker k(&_imp->expressionMutex);
         expr = _imp->expressions[dimension].expression;
+        function = _imp->expressions[dimension].function;
+        Py_XINCREF(function);
     }
-    std::stringstream ss;
 
-    ss << expr << '(' << time << ", " <<  view << ")\n";
+    if (!function) {
+        std::stringstream ss;
+
+        ss << expr << '(' << time << ", " <<  view << ")\n";
+
+        return executeExpression(ss.str(), ret, error);
+    }
+
+    ///Call the function directly rather than parsing a script calling it
+    PyObject* mainModule = NATRON_PYTHON_NAMESPACE::getMainModule();
+    PyErr_Clear();
+
+    PyObject* frameObj = NativeExpression::isIntegerFrame(time) ? PyInt_FromLong( (long)time ) : PyFloat_FromDouble(time);
+    PyObject* viewObj = PyInt_FromLong( (int)view );
+    *ret = PyObject_CallFunctionObjArgs(function, frameObj, viewObj, NULL);
+    Py_XDECREF(frameObj);
+    Py_XDECREF(viewObj);
+    Py_DECREF(function);
+
+    bool ok = catchErrors(mainModule, error);
+    if (!*ret || !ok) {
+        Py_XDECREF(*ret);
+        *ret = 0;
+        if ( error->empty() ) {
+            *error = "Expression evaluation failed";
+        }
+
+        return false;
+    }
+
+    return true;
+}
+
+bool
+KnobHelper::executeNativeExpression(double time,
+                                    ViewIdx view,
+                                    int dimension,
+                                    double* value,
+                                    bool* isInt) const
+{
+    if ( !NativeExpression::isEnabled() ) {
+        return false;
+    }
+    NativeExpressionPtr native;
+    {
+        QMutexLocker k(&_imp->expressionMutex);
+        native = _imp->expressions[dimension].native;
+    }
 
-    return executeExpression(ss.str(), ret, error);
+    return native && native->evaluate(time, view, value, isInt);
 }
 
 
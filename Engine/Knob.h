@@ -1454,6 +1454,13 @@ protected:
     template <typename T>
     static T pyObjectToType(PyObject* o);
 
+    /**
+     * @brief Converts the result of a native expression as pyObjectToType() would convert the Python object.
+     * Returns false if the conversion must be done by Python.
+     **/
+    template <typename T>
+    static bool nativeValueToType(double value, bool isInt, T* ret);
+
     virtual void refreshListenersAfterValueChange(ViewSpec view, ValueChangedReasonEnum reason, int dimension) OVERRIDE FINAL;
 
 public:
@@ -1588,6 +1595,12 @@ protected:
     ///The return value must be Py_DECRREF
     bool executeExpression(double time, ViewIdx view, int dimension, PyObject** ret, std::string* error) const;
 
+    /**
+     * @brief Evaluates the expression without Python if it is simple enough, see NativeExpression.
+     * Returns false if the expression must be run by executeExpression().
+     **/
+    bool executeNativeExpression(double time, ViewIdx view, int dimension, double* value, bool* isInt) const;
+
 public:
 
     /// The return value must be Py_DECRREF
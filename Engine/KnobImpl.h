@@ -387,6 +387,53 @@ KnobHelper::pyObjectToType(PyObject* o)
     return s != NULL ? std::string(s) : std::string();
 }
 
+template <>
+bool
+KnobHelper::nativeValueToType(double value,
+                              bool isInt,
+                              int* ret)
+{
+    if (!isInt) {
+        // let Python decide how a float converts to an int
+        return false;
+    }
+    *ret = (int)value;
+
+    return true;
+}
+
+template <>
+bool
+KnobHelper::nativeValueToType(double value,
+                              bool /*isInt*/,
+                              bool* ret)
+{
+    *ret = value != 0.;
+
+    return true;
+}
+
+template <>
+bool
+KnobHelper::nativeValueToType(double value,
+                              bool /*isInt*/,
+                              double* ret)
+{
+    *ret = value;
+
+    return true;
+}
+
+template <>
+bool
+KnobHelper::nativeValueToType(double /*value*/,
+                              bool /*isInt*/,
+                              std::string* /*ret*/)
+{
+    // string parameters are always evaluated by Python
+    return false;
+}
+
 inline unsigned int
 hashFunction(unsigned int a)
 {
@@ -427,11 +474,19 @@ Knob<T>::evaluateExpression(double time,
                             T* value,
                             std::string* error)
 {
-    PythonGILLocker pgl;
-    PyObject *ret;
-
     ///Reset the random state to reproduce the sequence
     randomSeed( time, hashFunction(dimension) );
+
+    ///Simple expressions do not need the GIL
+    double nativeValue;
+    bool nativeIsInt;
+    if ( executeNativeExpression(time, view, dimension, &nativeValue, &nativeIsInt) &&
+         nativeValueToType<T>(nativeValue, nativeIsInt, value) ) {
+        return true;
+    }
+
+    PythonGILLocker pgl;
+    PyObject *ret;
     bool exprOk = executeExpression(time, view, dimension, &ret, error);
     if (!exprOk) {
         return false;
@@ -449,11 +504,22 @@ Knob<T>::evaluateExpression_pod(double time,
                                 double* value,
                                 std::string* error)
 {
-    PythonGILLocker pgl;
-    PyObject *ret;
-
     ///Reset the random state to reproduce the sequence
     randomSeed( time, hashFunction(dimension) );
+
+    ///Simple expressions do not need the GIL
+    bool nativeIsInt;
+    if ( executeNativeExpression(time, view, dimension, value, &nativeIsInt) ) {
+        if (nativeIsInt) {
+            // as the conversion of a Python int below
+            *value = (int)*value;
+        }
+
+        return true;
+    }
+
+    PythonGILLocker pgl;
+    PyObject *ret;
     bool exprOk = executeExpression(time, view, dimension, &ret, error);
     if (!exprOk) {
         return false;
@@ -219,6 +219,50 @@ public:
         return std::make_pair( key_type(), V() );
     }
 
+    // Purge, among the nCandidates least-recently-used elements that can be evicted,
+    // the one with the lowest priority(element)
+    template <typename PriorityFunctor>
+    std::pair<key_type, V> evictLowestPriority(const PriorityFunctor & priority,
+                                               int nCandidates)
+    {
+        typename key_to_value_type::iterator found = _key_to_value.end();
+        typename std::list<V>::iterator foundValue;
+        typename key_tracker_type::iterator foundKey;
+        double lowestPriority = 0.;
+        int nVisited = 0;
+
+        for (typename key_tracker_type::iterator it = _key_tracker.begin(); it != _key_tracker.end() && nVisited < nCandidates; ++it) {
+            typename key_to_value_type::iterator values = _key_to_value.find(*it);
+            for (typename std::list<V>::iterator it2 = values->second.first.begin(); it2 != values->second.first.end() && nVisited < nCandidates; ++it2) {
+                if ( (*it2).use_count() != 1 ) {
+                    continue;
+                }
+                double p = priority(*it2);
+                if ( ( found == _key_to_value.end() ) || (p < lowestPriority) ) {
+                    found = values;
+                    foundValue = it2;
+                    foundKey = it;
+                    lowestPriority = p;
+                }
+                ++nVisited;
+            }
+        }
+        if ( found == _key_to_value.end() ) {
+            return std::make_pair( key_type(), V() );
+        }
+
+        std::pair<key_type, V> ret = std::make_pair(found->first, *foundValue);
+        if (found->second.first.size() == 1) {
+            // Erase both elements to completely purge record
+            _key_to_value.erase(found);
+            _key_tracker.erase(foundKey);
+        } else {
+            found->second.first.erase(foundValue);
+        }
+
+        return ret;
+    }
+
     unsigned int size()
     {
         return _container.size();
@@ -332,6 +376,45 @@ public:
         return std::make_pair( key_type(), V() );
     }
 
+    // Purge, among the nCandidates least-recently-used elements that can be evicted,
+    // the one with the lowest priority(element)
+    template <typename PriorityFunctor>
+    std::pair<key_type, V> evictLowestPriority(const PriorityFunctor & priority,
+                                               int nCandidates)
+    {
+        typename container_type::right_iterator found = _container.right.end();
+        typename std::list<V>::iterator foundValue;
+        double lowestPriority = 0.;
+        int nVisited = 0;
+
+        for (typename container_type::right_iterator it = _container.right.begin(); it != _container.right.end() && nVisited < nCandidates; ++it) {
+            for (typename std::list<V>::iterator it2 = it->first.begin(); it2 != it->first.end() && nVisited < nCandidates; ++it2) {
+                if ( (*it2).use_count() != 1 ) {
+                    continue;
+                }
+                double p = priority(*it2);
+                if ( ( found == _container.right.end() ) || (p < lowestPriority) ) {
+                    found = it;
+                    foundValue = it2;
+                    lowestPriority = p;
+                }
+                ++nVisited;
+            }
+        }
+        if ( found == _container.right.end() ) {
+            return std::make_pair( key_type(), V() );
+        }
+
+        std::pair<key_type, V> ret = std::make_pair(found->second, *foundValue);
+        if (found->first.size() == 1) {
+            _container.right.erase(found);
+        } else {
+            found->first.erase(foundValue);
+        }
+
+        return ret;
+    }
+
     unsigned int size()
     {
         return _container.size();
@@ -453,6 +536,50 @@ public:
         return std::make_pair( key_type(), V() );
     }
 
+    // Purge, among the nCandidates least-recently-used elements that can be evicted,
+    // the one with the lowest priority(element)
+    template <typename PriorityFunctor>
+    std::pair<key_type, V> evictLowestPriority(const PriorityFunctor & priority,
+                                               int nCandidates)
+    {
+        typename key_to_value_type::iterator found = _key_to_value.end();
+        typename std::list<V>::iterator foundValue;
+        typename key_tracker_type::iterator foundKey;
+        double lowestPriority = 0.;
+        int nVisited = 0;
+
+        for (typename key_tracker_type::iterator it = _key_tracker.begin(); it != _key_tracker.end() && nVisited < nCandidates; ++it) {
+            typename key_to_value_type::iterator values = _key_to_value.find(*it);
+            for (typename std::list<V>::iterator it2 = values->second.first.begin(); it2 != values->second.first.end() && nVisited < nCandidates; ++it2) {
+                if ( (*it2).use_count() != 1 ) {
+                    continue;
+                }
+                double p = priority(*it2);
+                if ( ( found == _key_to_value.end() ) || (p < lowestPriority) ) {
+                    found = values;
+                    foundValue = it2;
+                    foundKey = it;
+                    lowestPriority = p;
+                }
+                ++nVisited;
+            }
+        }
+        if ( found == _key_to_value.end() ) {
+            return std::make_pair( key_type(), V() );
+        }
+
+        std::pair<key_type, V> ret = std::make_pair(found->first, *foundValue);
+        if (found->second.first.size() == 1) {
+            // Erase both elements to completely purge record
+            _key_to_value.erase(found);
+            _key_tracker.erase(foundKey);
+        } else {
+            found->second.first.erase(foundValue);
+        }
+
+        return ret;
+    }
+
     unsigned int size()
     {
         return _key_to_value.size();
@@ -560,6 +687,45 @@ public:
         return std::make_pair( key_type(), V() );
     }
 
+    // Purge, among the nCandidates least-recently-used elements that can be evicted,
+    // the one with the lowest priority(element)
+    template <typename PriorityFunctor>
+    std::pair<key_type, V> evictLowestPriority(const PriorityFunctor & priority,
+                                               int nCandidates)
+    {
+        typename container_type::right_iterator found = _container.right.end();
+        typename std::list<V>::iterator foundValue;
+        double lowestPriority = 0.;
+        int nVisited = 0;
+
+        for (typename container_type::right_iterator it = _container.right.begin(); it != _container.right.end() && nVisited < nCandidates; ++it) {
+            for (typename std::list<V>::iterator it2 = it->first.begin(); it2 != it->first.end() && nVisited < nCandidates; ++it2) {
+                if ( (*it2).use_count() != 1 ) {
+                    continue;
+                }
+                double p = priority(*it2);
+                if ( ( found == _container.right.end() ) || (p < lowestPriority) ) {
+                    found = it;
+                    foundValue = it2;
+                    lowestPriority = p;
+                }
+                ++nVisited;
+            }
+        }
+        if ( found == _container.right.end() ) {
+            return std::make_pair( key_type(), V() );
+        }
+
+        std::pair<key_type, V> ret = std::make_pair(found->second, *foundValue);
+        if (found->first.size() == 1) {
+            _container.right.erase(found);
+        } else {
+            found->first.erase(foundValue);
+        }
+
+        return ret;
+    }
+
     unsigned int size()
     {
         return _container.size();
@@ -662,6 +828,45 @@ public:
         return std::make_pair( key_type(), V() );
     }
 
+    // Purge, among the nCandidates least-recently-used elements that can be evicted,
+    // the one with the lowest priority(element)
+    template <typename PriorityFunctor>
+    std::pair<key_type, V> evictLowestPriority(const PriorityFunctor & priority,
+                                               int nCandidates)
+    {
+        typename container_type::right_iterator found = _container.right.end();
+        typename std::list<V>::iterator foundValue;
+        double lowestPriority = 0.;
+        int nVisited = 0;
+
+        for (typename container_type::right_iterator it = _container.right.begin(); it != _container.right.end() && nVisited < nCandidates; ++it) {
+            for (typename std::list<V>::iterator it2 = it->first.begin(); it2 != it->first.end() && nVisited < nCandidates; ++it2) {
+                if ( (*it2).use_count() != 1 ) {
+                    continue;
+                }
+                double p = priority(*it2);
+                if ( ( found == _container.right.end() ) || (p < lowestPriority) ) {
+                    found = it;
+                    foundValue = it2;
+                    lowestPriority = p;
+                }
+                ++nVisited;
+            }
+        }
+        if ( found == _container.right.end() ) {
+            return std::make_pair( key_type(), V() );
+        }
+
+        std::pair<key_type, V> ret = std::make_pair(found->second, *foundValue);
+        if (found->first.size() == 1) {
+            _container.right.erase(found);
+        } else {
+            found->first.erase(foundValue);
+        }
+
+        return ret;
+    }
+
     unsigned int size()
     {
         return _container.size();
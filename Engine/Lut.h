@@ -214,6 +214,16 @@ public:
      */
     unsigned short toColorSpaceUint8xxFromLinearFloatFast(float v) const;
 
+    /* @brief Same as toColorSpaceUint8xxFromLinearFloatFast(), from the 16 high bits of the float value,
+     * as computed by ImageSIMD::linearToLutIndexes().
+     */
+    unsigned short toColorSpaceUint8xxFromLinearFloatHipartFast(unsigned short hipart) const
+    {
+        assert(init_);
+
+        return toFunc_hipart_to_uint8xx[hipart];
+    }
+
     /* @brief Converts a float ranging in [0 - 1.f] in linear color-space using the look-up tables.
      * @return An unsigned short in [0 - 65535] in the destination color-space.
      * This function uses localluy linear approximations of the transfer function.
@@ -33,6 +33,8 @@
 #include <sys/stat.h>
 #include <sys/types.h>     // struct stat.
 #include <unistd.h>        // sysconf.
+#include <algorithm>       // min
+#include <climits>         // INT_MAX
 #include <cstring>
 #include <cerrno>
 #include <cstdio>
@@ -40,20 +42,101 @@
 #include <sstream> // stringstream
 #include <iostream>
 #include <cassert>
+#include <list>
+#include <map>
 #include <stdexcept>
 
+#include <QtCore/QMutex>
+
 #include "Global/GlobalDefines.h"
 #include "Global/StrUtils.h"
 
 #define MIN_FILE_SIZE 4096
 
+// At most this many prefetched files are remembered to count the prefetch hits
+#define NATRON_MEMORY_FILE_MAX_PREFETCHED_FILES 4096
+
 NATRON_NAMESPACE_ENTER
 
+NATRON_NAMESPACE_ANONYMOUS_ENTER
+
+// The files prefetched by MemoryFile::prefetchFile() that were not opened since
+struct PrefetchedFiles
+{
+    QMutex lock;
+
+    // Whether each file was prefetched for a forward playback
+    std::map<std::string, bool> paths;
+
+    // The same paths, the oldest first
+    std::list<std::string> order;
+    U64 nPrefetched;
+    U64 nHits;
+
+    PrefetchedFiles()
+        : lock()
+        , paths()
+        , order()
+        , nPrefetched(0)
+        , nHits(0)
+    {
+    }
+
+    // Returns false if the path was already prefetched
+    bool add(const std::string& path,
+             bool forward)
+    {
+        QMutexLocker k(&lock);
+
+        if ( !paths.insert( std::make_pair(path, forward) ).second ) {
+            return false;
+        }
+        order.push_back(path);
+        if (order.size() > NATRON_MEMORY_FILE_MAX_PREFETCHED_FILES) {
+            paths.erase( order.front() );
+            order.pop_front();
+        }
+        ++nPrefetched;
+
+        return true;
+    }
+
+    void remove(const std::string& path)
+    {
+        QMutexLocker k(&lock);
+
+        paths.erase(path);
+        order.remove(path);
+    }
+
+    // Returns true if the file was prefetched for a forward playback
+    bool notifyOpened(const std::string& path)
+    {
+        QMutexLocker k(&lock);
+        std::map<std::string, bool>::iterator found = paths.find(path);
+
+        if ( found == paths.end() ) {
+            return false;
+        }
+        bool forward = found->second;
+        paths.erase(found);
+        order.remove(path);
+        ++nHits;
+
+        return forward;
+    }
+};
+
+static PrefetchedFiles prefetchedFiles;
+
+NATRON_NAMESPACE_ANONYMOUS_EXIT
+
 struct MemoryFilePrivate
 {
     std::string path; //< filepath of the backing file
     char* data; //< pointer to the beginning of the mapped file
     size_t size; //< the effective size of the file
+    bool readForward; //< the file was prefetched for a forward playback: it is read from the beginning to the end
 #if defined(__NATRON_UNIX__)
     int file_handle; //< unix file handle
 #elif defined(__NATRON_WIN32__)
@@ -67,6 +150,7 @@ struct MemoryFilePrivate
         : path(filepath)
         , data(0)
         , size(0)
+        , readForward(false)
 #if defined(__NATRON_UNIX__)
         , file_handle(-1)
 #elif defined(__NATRON_WIN32__)
@@ -190,6 +274,7 @@ MemoryFilePrivate::openInternal(MemoryFile::FileOpenModeEnum open_mode)
         } else {
             size = sbuf.st_size;
         }
+        readForward = prefetchedFiles.notifyOpened(path);
     }
 #elif defined(__NATRON_WIN32__)
 
@@ -266,6 +351,7 @@ MemoryFilePrivate::openInternal(MemoryFile::FileOpenModeEnum open_mode)
         } else {
             throw std::runtime_error("MemoryFile EXC : Failed to create mapping.");
         }
+        readForward = prefetchedFiles.notifyOpened(path);
     }
 
 #endif // if defined(__NATRON_UNIX__)
@@ -289,6 +375,85 @@ MemoryFile::path() const
     return _imp->path;
 }
 
+bool
+MemoryFile::prefetch()
+{
+    if (!_imp->data) {
+        return false;
+    }
+#if defined(__NATRON_UNIX__)
+#ifdef MADV_SEQUENTIAL
+    // A new mapping has the normal advice: the random accesses, e.g. when scrubbing or playing backward, keep it
+    if ( _imp->readForward && (_imp->size >= NATRON_MEMORY_FILE_SEQUENTIAL_MIN_SIZE) ) {
+        ::madvise(_imp->data, _imp->size, MADV_SEQUENTIAL);
+    }
+#endif
+#ifdef MADV_WILLNEED
+    // Starts the reads and returns without waiting for them
+    return ::madvise(_imp->data, _imp->size, MADV_WILLNEED) == 0;
+#else
+
+    return false;
+#endif
+#else // !__NATRON_UNIX__
+
+    return false;
+#endif
+}
+
+bool
+MemoryFile::prefetchFile(const std::string & filepath,
+                         bool forward)
+{
+#if defined(__NATRON_UNIX__) && ( defined(POSIX_FADV_WILLNEED) || defined(F_RDADVISE) )
+    if ( !prefetchedFiles.add(filepath, forward) ) {
+        return false;
+    }
+    int fd = ::open(filepath.c_str(), O_RDONLY);
+    if (fd == -1) {
+        prefetchedFiles.remove(filepath);
+
+        return false;
+    }
+    bool ok;
+#if defined(POSIX_FADV_WILLNEED)
+    // Starts the reads and returns without waiting for them
+    ok = ::posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED) == 0;
+#else
+    // Mac OS X has no posix_fadvise()
+    struct stat sbuf;
+    ok = ::fstat(fd, &sbuf) == 0;
+    if (ok) {
+        struct radvisory advice;
+        advice.ra_offset = 0;
+        advice.ra_count = (int)std::min( sbuf.st_size, (off_t)INT_MAX );
+        ok = ::fcntl(fd, F_RDADVISE, &advice) != -1;
+    }
+#endif
+    ::close(fd);
+    if (!ok) {
+        prefetchedFiles.remove(filepath);
+    }
+
+    return ok;
+#else
+    Q_UNUSED(filepath);
+    Q_UNUSED(forward);
+
+    return false;
+#endif
+}
+
+void
+MemoryFile::getPrefetchStatistics(U64* nPrefetched,
+                                  U64* nHits)
+{
+    QMutexLocker k(&prefetchedFiles.lock);
+
+    *nPrefetched = prefetchedFiles.nPrefetched;
+    *nHits = prefetchedFiles.nHits;
+}
+
 void
 MemoryFile::resize(size_t new_size)
 {
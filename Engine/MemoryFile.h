@@ -33,6 +33,9 @@
 #include "Global/Enums.h"
 #include "Engine/EngineFwd.h"
 
+// The files of at least this size prefetched for a forward playback are read sequentially, see MemoryFile::prefetch()
+#define NATRON_MEMORY_FILE_SEQUENTIAL_MIN_SIZE (4 * 1024 * 1024)
+
 NATRON_NAMESPACE_ENTER
 
 struct MemoryFilePrivate;
@@ -145,6 +148,30 @@ public:
      **/
     bool flush(FlushTypeEnum type, void* data, std::size_t size);
 
+    /**
+     * @brief Asks the system to read the whole file from the disk in the background, so that its pages are resident
+     * by the time they are read instead of faulting one after the other in the thread that reads them.
+     * The files of at least NATRON_MEMORY_FILE_SEQUENTIAL_MIN_SIZE bytes that were prefetched with prefetchFile()
+     * for a forward playback are also advised to be read sequentially, so that the faults that remain read ahead in
+     * larger chunks. The others keep the normal advice of the system.
+     * Returns false if the file is not mapped or the system does not support it.
+     **/
+    bool prefetch();
+
+    /**
+     * @brief Same as prefetch() for a file that is not opened: its pages are read in the system cache in the
+     * background without mapping it. The next MemoryFile opened on this path counts as a prefetch hit.
+     * forward is true if the file is prefetched for a forward playback, see prefetch().
+     * Returns false if the file was already prefetched and not opened since, or if the system does not support it.
+     **/
+    static bool prefetchFile(const std::string & filepath, bool forward);
+
+    /**
+     * @brief nPrefetched is the number of files prefetched with prefetchFile(), nHits how many of them were opened
+     * afterwards.
+     **/
+    static void getPrefetchStatistics(U64* nPrefetched, U64* nHits);
+
     /**
      * @brief Returns the filepath of the backing file.
      **/
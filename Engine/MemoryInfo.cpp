@@ -420,4 +420,22 @@ getAmountFreePhysicalRAM()
 #endif
 }
 
+U64
+getMajorPageFaultCount()
+{
+    // On Windows, PROCESS_MEMORY_COUNTERS::PageFaultCount also counts the soft faults, which do not read from the disk:
+    // the count is unavailable there.
+#if defined(__unix__) || defined(__unix) || defined(unix) || (defined(__APPLE__) && defined(__MACH__ ) )
+    struct rusage rusage;
+    if (getrusage(RUSAGE_SELF, &rusage) != 0) {
+        return 0;
+    }
+
+    return (U64)rusage.ru_majflt;
+#else
+
+    return 0;
+#endif
+}
+
 NATRON_NAMESPACE_EXIT
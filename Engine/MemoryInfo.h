@@ -66,6 +66,12 @@ std::size_t getCurrentRSS( );
 
 std::size_t getAmountFreePhysicalRAM();
 
+/**
+ * Returns the number of page faults of the process that required reading from the disk,
+ * or zero if the value cannot be determined on this OS, such as Windows.
+ */
+U64 getMajorPageFaultCount();
+
 NATRON_NAMESPACE_EXIT
 
 #endif // ifndef Engine_MemoryInfo_h
@@ -0,0 +1,1245 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * Copyright (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "NativeExpression.h"
+
+#include <cassert>
+#include <cctype> // isspace, isdigit, isalpha
+#include <cmath>
+#include <cstdlib> // strtod
+#include <cstring> // strlen, strchr
+#include <stdexcept>
+#include <vector>
+
+#include <QtCore/QAtomicInt>
+
+#if !defined(SBK_RUN) && !defined(Q_MOC_RUN)
+GCC_DIAG_UNUSED_LOCAL_TYPEDEFS_OFF
+#include <boost/math/special_functions/fpclassify.hpp>
+GCC_DIAG_UNUSED_LOCAL_TYPEDEFS_ON
+#endif
+
+#include "Engine/AppInstance.h"
+#include "Engine/AppManager.h"
+#include "Engine/EffectInstance.h"
+#include "Engine/Knob.h"
+#include "Engine/KnobTypes.h"
+#include "Engine/Node.h"
+#include "Engine/NodeGroup.h"
+
+// Beyond this value, Python integers are no longer exactly represented by a double
+#define NATIVE_EXPRESSION_MAX_INT 9007199254740992. // 2^53
+
+#ifndef M_PI
+#define M_PI        3.14159265358979323846264338327950288   /* pi             */
+#endif
+#ifndef M_E
+#define M_E         2.71828182845904523536028747135266250   /* e              */
+#endif
+
+// Maximum depth of the evaluation stack
+#define NATIVE_EXPRESSION_MAX_STACK 32
+
+NATRON_NAMESPACE_ENTER
+
+namespace {
+enum OpEnum
+{
+    eOpConstant = 0,
+    eOpFrame,
+    eOpView,
+    eOpAdd,
+    eOpSub,
+    eOpMul,
+    eOpDiv,
+    eOpFloorDiv,
+    eOpMod,
+    eOpPow,
+    eOpNeg,
+    eOpFunction,
+    eOpKnobValue, // dimension on the stack
+    eOpKnobValueAtTime, // time and dimension on the stack
+    eOpCurve // time and dimension on the stack
+};
+
+enum FunctionEnum
+{
+    eFunctionSin = 0,
+    eFunctionCos,
+    eFunctionTan,
+    eFunctionAsin,
+    eFunctionAcos,
+    eFunctionAtan,
+    eFunctionAtan2,
+    eFunctionSinh,
+    eFunctionCosh,
+    eFunctionTanh,
+    eFunctionExp,
+    eFunctionLog,
+    eFunctionLog10,
+    eFunctionSqrt,
+    eFunctionPow,
+    eFunctionFabs,
+    eFunctionFmod,
+    eFunctionHypot,
+    eFunctionFloor,
+    eFunctionCeil,
+    eFunctionTrunc,
+    eFunctionDegrees,
+    eFunctionRadians,
+    eFunctionAbs,
+    eFunctionMin,
+    eFunctionMax,
+    eFunctionInt,
+    eFunctionFloat
+};
+
+struct FunctionDesc
+{
+    const char* name;
+    FunctionEnum function;
+    int minArgs;
+    int maxArgs;
+    bool isBuiltin; // a Python builtin, otherwise it comes from the math module
+};
+
+const FunctionDesc functions[] = {
+    { "sin", eFunctionSin, 1, 1, false },
+    { "cos", eFunctionCos, 1, 1, false },
+    { "tan", eFunctionTan, 1, 1, false },
+    { "asin", eFunctionAsin, 1, 1, false },
+    { "acos", eFunctionAcos, 1, 1, false },
+    { "atan", eFunctionAtan, 1, 1, false },
+    { "atan2", eFunctionAtan2, 2, 2, false },
+    { "sinh", eFunctionSinh, 1, 1, false },
+    { "cosh", eFunctionCosh, 1, 1, false },
+    { "tanh", eFunctionTanh, 1, 1, false },
+    { "exp", eFunctionExp, 1, 1, false },
+    { "log", eFunctionLog, 1, 2, false },
+    { "log10", eFunctionLog10, 1, 1, false },
+    { "sqrt", eFunctionSqrt, 1, 1, false },
+    { "pow", eFunctionPow, 2, 2, false },
+    { "fabs", eFunctionFabs, 1, 1, false },
+    { "fmod", eFunctionFmod, 2, 2, false },
+    { "hypot", eFunctionHypot, 2, 2, false },
+    { "floor", eFunctionFloor, 1, 1, false },
+    { "ceil", eFunctionCeil, 1, 1, false },
+    { "trunc", eFunctionTrunc, 1, 1, false },
+    { "degrees", eFunctionDegrees, 1, 1, false },
+    { "radians", eFunctionRadians, 1, 1, false },
+    { "abs", eFunctionAbs, 1, 1, true },
+    { "min", eFunctionMin, 2, NATIVE_EXPRESSION_MAX_STACK, true },
+    { "max", eFunctionMax, 2, NATIVE_EXPRESSION_MAX_STACK, true },
+    { "int", eFunctionInt, 1, 1, true },
+    { "float", eFunctionFloat, 1, 1, true },
+};
+
+enum KnobTypeEnum
+{
+    eKnobTypeInt = 0, // KnobInt and KnobChoice
+    eKnobTypeDouble, // KnobDouble and KnobColor
+    eKnobTypeBool // KnobBool
+};
+
+struct Instruction
+{
+    OpEnum op;
+    double value; // eOpConstant
+    bool isInt; // eOpConstant
+    int index; // the function or the knob reference
+    int nArgs; // eOpFunction
+
+    Instruction(OpEnum op_ = eOpConstant)
+        : op(op_)
+        , value(0.)
+        , isInt(false)
+        , index(-1)
+        , nArgs(0)
+    {
+    }
+};
+
+/**
+ * @brief A value of the evaluation stack: a Python int or float.
+ **/
+struct Value
+{
+    double v;
+    bool isInt;
+};
+
+struct Token
+{
+    enum TypeEnum
+    {
+        eTypeNumber,
+        eTypeName,
+        eTypeOperator,
+        eTypeEnd
+    };
+
+    TypeEnum type;
+    std::string text;
+    double number;
+    bool isInt;
+};
+} // anon namespace
+
+struct KnobReference
+{
+    KnobIWPtr knob;
+    NodeWPtr node; // the node must still be activated, otherwise Python would not find it
+    KnobTypeEnum type;
+};
+
+struct NativeExpressionPrivate
+{
+    std::vector<Instruction> program; // in reverse polish notation
+    std::vector<KnobReference> knobs;
+    KnobIWPtr thisKnob; // for curve()
+};
+
+// Read by the render threads evaluating the expressions
+static QAtomicInt nativeExpressionsEnabled(1);
+
+NativeExpression::NativeExpression()
+    : _imp( new NativeExpressionPrivate() )
+{
+}
+
+NativeExpression::~NativeExpression()
+{
+}
+
+void
+NativeExpression::setEnabled(bool enabled)
+{
+    nativeExpressionsEnabled.fetchAndStoreRelaxed(enabled ? 1 : 0);
+}
+
+bool
+NativeExpression::isEnabled()
+{
+    return (int)nativeExpressionsEnabled != 0;
+}
+
+bool
+NativeExpression::isIntegerFrame(double time)
+{
+    // The expressions used to be run from a string such as "expression0(12, 0)" formatted
+    // by a stringstream: integral times which were not printed in exponent form were Python ints.
+    return time == std::floor(time) && std::fabs(time) < 1e6;
+}
+
+/////////////////////////////// Parsing
+
+namespace {
+/**
+ * @brief Splits the expression in tokens. Returns false if it contains something else than
+ * numbers, names and the arithmetic operators.
+ **/
+bool
+tokenize(const std::string& expression,
+         std::vector<Token>* tokens)
+{
+    std::size_t i = 0;
+    const std::size_t n = expression.size();
+
+    while (i < n) {
+        const char c = expression[i];
+        if ( (c == ' ') || (c == '\t') ) {
+            ++i;
+            continue;
+        }
+        if (c == '#') {
+            // a comment, until the end of the line
+            break;
+        }
+        Token tok;
+        tok.number = 0.;
+        tok.isInt = false;
+        if ( std::isdigit( (unsigned char)c ) || ( (c == '.') && (i + 1 < n) && std::isdigit( (unsigned char)expression[i + 1] ) ) ) {
+            std::size_t start = i;
+            bool isInt = true;
+            while ( i < n && std::isdigit( (unsigned char)expression[i] ) ) {
+                ++i;
+            }
+            if ( (i < n) && (expression[i] == '.') ) {
+                isInt = false;
+                ++i;
+                while ( i < n && std::isdigit( (unsigned char)expression[i] ) ) {
+                    ++i;
+                }
+            }
+            if ( (i < n) && ( (expression[i] == 'e') || (expression[i] == 'E') ) ) {
+                isInt = false;
+                ++i;
+                if ( (i < n) && ( (expression[i] == '+') || (expression[i] == '-') ) ) {
+                    ++i;
+                }
+                if ( (i >= n) || !std::isdigit( (unsigned char)expression[i] ) ) {
+                    return false;
+                }
+                while ( i < n && std::isdigit( (unsigned char)expression[i] ) ) {
+                    ++i;
+                }
+            }
+            // hexadecimal, octal, complex literals or a name starting with a digit
+            if ( (i < n) && ( std::isalnum( (unsigned char)expression[i] ) || (expression[i] == '_') || (expression[i] == '.') ) ) {
+                return false;
+            }
+            tok.text = expression.substr(start, i - start);
+            if ( isInt && (tok.text.size() > 1) && (tok.text[0] == '0') ) {
+                // octal in Python 2, invalid in Python 3
+                return false;
+            }
+            tok.type = Token::eTypeNumber;
+            tok.number = std::strtod(tok.text.c_str(), 0);
+            tok.isInt = isInt;
+            if ( isInt && (tok.number > NATIVE_EXPRESSION_MAX_INT) ) {
+                return false;
+            }
+        } else if ( std::isalpha( (unsigned char)c ) || (c == '_') ) {
+            std::size_t start = i;
+            while ( i < n && ( std::isalnum( (unsigned char)expression[i] ) || (expression[i] == '_') ) ) {
+                ++i;
+            }
+            tok.type = Token::eTypeName;
+            tok.text = expression.substr(start, i - start);
+        } else {
+            static const char* const operators[] = { "**", "//", "+", "-", "*", "/", "%", "(", ")", ",", ".", 0 };
+            bool found = false;
+            for (int k = 0; operators[k]; ++k) {
+                std::size_t len = std::strlen(operators[k]);
+                if (expression.compare(i, len, operators[k]) == 0) {
+                    tok.type = Token::eTypeOperator;
+                    tok.text = operators[k];
+                    i += len;
+                    found = true;
+                    break;
+                }
+            }
+            if (!found) {
+                return false;
+            }
+        }
+        tokens->push_back(tok);
+    }
+    Token end;
+    end.type = Token::eTypeEnd;
+    end.number = 0.;
+    end.isInt = false;
+    tokens->push_back(end);
+
+    return true;
+} // tokenize
+
+/**
+ * @brief Recursive descent parser of the Python arithmetic expressions, with the same precedence rules:
+ * arith := term (('+'|'-') term)*
+ * term := factor (('*'|'/'|'//'|'%') factor)*
+ * factor := ('+'|'-') factor | power
+ * power := atom ['**' factor]
+ * It throws std::invalid_argument when the expression cannot be evaluated natively.
+ **/
+class ExpressionParser
+{
+public:
+
+    ExpressionParser(const std::vector<Token>& tokens,
+                     const KnobIPtr& knob,
+                     int dimension,
+                     NativeExpressionPrivate* expr)
+        : _tokens(tokens)
+        , _pos(0)
+        , _knob(knob)
+        , _dimension(dimension)
+        , _expr(expr)
+        , _depth(0)
+        , _maxDepth(0)
+        , _node()
+        , _group()
+        , _siblings()
+        , _mainDict(0)
+        , _mathModule(0)
+    {
+        EffectInstance* effect = dynamic_cast<EffectInstance*>( knob->getHolder() );
+        if (!effect) {
+            throw std::invalid_argument("not an effect parameter");
+        }
+        _node = effect->getNode();
+        if (!_node) {
+            throw std::invalid_argument("no node");
+        }
+        NodeCollectionPtr collection = _node->getGroup();
+        if (!collection) {
+            throw std::invalid_argument("no group");
+        }
+        NodeGroup* isParentGrp = dynamic_cast<NodeGroup*>( collection.get() );
+        if (isParentGrp) {
+            _group = isParentGrp->getNode();
+        }
+        // the nodes declared by KnobHelperPrivate::declarePythonVariables()
+        _siblings = collection->getNodes();
+        _mainDict = PyModule_GetDict( NATRON_PYTHON_NAMESPACE::getMainModule() );
+        _mathModule = PyImport_ImportModule("math"); // new ref
+        PyErr_Clear();
+    }
+
+    ~ExpressionParser()
+    {
+        Py_XDECREF(_mathModule);
+    }
+
+    void parse()
+    {
+        parseArith();
+        if (peek().type != Token::eTypeEnd) {
+            throw std::invalid_argument("unexpected token");
+        }
+        assert(_depth == 1);
+    }
+
+private:
+
+    const Token& peek() const
+    {
+        return _tokens[_pos];
+    }
+
+    bool isOperator(const char* op) const
+    {
+        const Token& tok = peek();
+
+        return tok.type == Token::eTypeOperator && tok.text == op;
+    }
+
+    void expect(const char* op)
+    {
+        if ( !isOperator(op) ) {
+            throw std::invalid_argument("unexpected token");
+        }
+        ++_pos;
+    }
+
+    std::string expectName()
+    {
+        const Token& tok = peek();
+
+        if (tok.type != Token::eTypeName) {
+            throw std::invalid_argument("expected a name");
+        }
+        ++_pos;
+
+        return tok.text;
+    }
+
+    /// Appends an instruction which pops nPop values and pushes one
+    void emit(const Instruction& instr,
+              int nPop)
+    {
+        _depth += 1 - nPop;
+        assert(_depth >= 1);
+        if (_depth > _maxDepth) {
+            _maxDepth = _depth;
+            if (_maxDepth > NATIVE_EXPRESSION_MAX_STACK) {
+                throw std::invalid_argument("expression too complex");
+            }
+        }
+        _expr->program.push_back(instr);
+    }
+
+    void emitConstant(double value,
+                      bool isInt)
+    {
+        Instruction instr(eOpConstant);
+
+        instr.value = value;
+        instr.isInt = isInt;
+        emit(instr, 0);
+    }
+
+    void parseArith()
+    {
+        parseTerm();
+        for (;;) {
+            if ( isOperator("+") ) {
+                ++_pos;
+                parseTerm();
+                emit(Instruction(eOpAdd), 2);
+            } else if ( isOperator("-") ) {
+                ++_pos;
+                parseTerm();
+                emit(Instruction(eOpSub), 2);
+            } else {
+                break;
+            }
+        }
+    }
+
+    void parseTerm()
+    {
+        parseFactor();
+        for (;;) {
+            OpEnum op;
+            if ( isOperator("*") ) {
+                op = eOpMul;
+            } else if ( isOperator("/") ) {
+                op = eOpDiv;
+            } else if ( isOperator("//") ) {
+                op = eOpFloorDiv;
+            } else if ( isOperator("%") ) {
+                op = eOpMod;
+            } else {
+                break;
+            }
+            ++_pos;
+            parseFactor();
+            emit(Instruction(op), 2);
+        }
+    }
+
+    void parseFactor()
+    {
+        if ( isOperator("-") ) {
+            ++_pos;
+            parseFactor();
+            emit(Instruction(eOpNeg), 1);
+        } else if ( isOperator("+") ) {
+            // +True is an int
+            ++_pos;
+            parseFactor();
+            emitConstant(0., true);
+            emit(Instruction(eOpAdd), 2);
+        } else {
+            parsePower();
+        }
+    }
+
+    void parsePower()
+    {
+        parseAtom();
+        if ( isOperator("**") ) {
+            ++_pos;
+            parseFactor();
+            emit(Instruction(eOpPow), 2);
+        }
+    }
+
+    /// Parses the arguments of a call, after the opening parenthesis. Returns the number of arguments.
+    int parseArguments()
+    {
+        expect("(");
+        int nArgs = 0;
+        if ( isOperator(")") ) {
+            ++_pos;
+
+            return 0;
+        }
+        for (;;) {
+            parseArith();
+            ++nArgs;
+            if ( isOperator(",") ) {
+                ++_pos;
+            } else {
+                break;
+            }
+        }
+        expect(")");
+
+        return nArgs;
+    }
+
+    void parseAtom()
+    {
+        const Token& tok = peek();
+
+        if (tok.type == Token::eTypeNumber) {
+            ++_pos;
+            emitConstant(tok.number, tok.isInt);
+        } else if ( isOperator("(") ) {
+            ++_pos;
+            parseArith();
+            expect(")");
+        } else if (tok.type == Token::eTypeName) {
+            ++_pos;
+            parseName(tok.text);
+        } else {
+            throw std::invalid_argument("unexpected token");
+        }
+        if ( isOperator(".") || isOperator("(") ) {
+            // attributes of numbers, calling a number...
+            throw std::invalid_argument("unexpected token");
+        }
+    }
+
+    NodePtr findSibling(const std::string& name) const
+    {
+        for (NodesList::const_iterator it = _siblings.begin(); it != _siblings.end(); ++it) {
+            if ( (*it)->isActivated() && !(*it)->getParentMultiInstance() && ( (*it)->getScriptName_mt_safe() == name ) ) {
+                return *it;
+            }
+        }
+
+        return NodePtr();
+    }
+
+    /**
+     * @brief Resolves a name in the same order as Python does in the function defined by KnobHelper::validateExpression():
+     * the variables declared last in the function hide the previous ones, and the arguments and globals come last.
+     **/
+    void parseName(const std::string& name)
+    {
+        if (name == "dimension") {
+            emitConstant(_dimension, true);
+
+            return;
+        }
+        if (name == "curve") {
+            // thisParam.curve(time, dimension = 0)
+            int nArgs = parseArguments();
+            if ( (nArgs < 1) || (nArgs > 2) ) {
+                throw std::invalid_argument("curve() takes 1 or 2 arguments");
+            }
+            if (nArgs == 1) {
+                emitConstant(0., true);
+            }
+            emit(Instruction(eOpCurve), 2);
+
+            return;
+        }
+        if ( (name == "random") || (name == "randomInt") ) {
+            throw std::invalid_argument("random is only available in Python");
+        }
+        if (name == "thisParam") {
+            parseKnob(_knob, _node);
+
+            return;
+        }
+        if (name == "thisNode") {
+            parseNodeAttribute(_node);
+
+            return;
+        }
+        if (name == "thisGroup") {
+            if (!_group) {
+                // the application
+                throw std::invalid_argument("thisGroup is not a node");
+            }
+            parseNodeAttribute(_group);
+
+            return;
+        }
+        NodePtr sibling = findSibling(name);
+        if (sibling) {
+            parseNodeAttribute(sibling);
+
+            return;
+        }
+        if (name == "app") {
+            throw std::invalid_argument("app is only available in Python");
+        }
+        if (name == "view") {
+            emit(Instruction(eOpView), 0);
+
+            return;
+        }
+        if (name == "frame") {
+            emit(Instruction(eOpFrame), 0);
+
+            return;
+        }
+        parseGlobal(name);
+    }
+
+    /// Checks that the global name was not replaced by the scripts of the user
+    bool isUnmodifiedGlobal(const std::string& name,
+                            bool isBuiltin) const
+    {
+        PyObject* global = PyDict_GetItemString( _mainDict, name.c_str() ); // borrowed ref
+
+        if (isBuiltin) {
+            return !global;
+        }
+        if (!global || !_mathModule) {
+            return false;
+        }
+        PyObject* attr = PyObject_GetAttrString( _mathModule, name.c_str() ); // new ref
+        PyErr_Clear();
+        bool ret = attr == global;
+        Py_XDECREF(attr);
+
+        return ret;
+    }
+
+    void parseGlobal(const std::string& name)
+    {
+        if ( (name == "pi") || (name == "e") ) {
+            if ( !isUnmodifiedGlobal(name, false) ) {
+                throw std::invalid_argument("unknown name");
+            }
+            emitConstant(name == "pi" ? M_PI : M_E, false);
+
+            return;
+        }
+        for (std::size_t i = 0; i < sizeof(functions) / sizeof(functions[0]); ++i) {
+            const FunctionDesc& desc = functions[i];
+            if (name != desc.name) {
+                continue;
+            }
+            if ( !isUnmodifiedGlobal(name, desc.isBuiltin) ) {
+                throw std::invalid_argument("unknown name");
+            }
+            int nArgs = parseArguments();
+            if ( (nArgs < desc.minArgs) || (nArgs > desc.maxArgs) ) {
+                throw std::invalid_argument("wrong number of arguments");
+            }
+            Instruction instr(eOpFunction);
+            instr.index = (int)desc.function;
+            instr.nArgs = nArgs;
+            emit(instr, nArgs);
+
+            return;
+        }
+        throw std::invalid_argument("unknown name");
+    }
+
+    /// node.param
+    void parseNodeAttribute(const NodePtr& node)
+    {
+        expect(".");
+        std::string paramName = expectName();
+        KnobIPtr knob = node->getKnobByName(paramName);
+        if (!knob) {
+            // a method of the node, or a node inside a group
+            throw std::invalid_argument("not a parameter");
+        }
+        parseKnob(knob, node);
+    }
+
+    /// param.getValue(), param.getValueAtTime(), param.get()
+    void parseKnob(const KnobIPtr& knob,
+                   const NodePtr& node)
+    {
+        KnobReference ref;
+
+        ref.knob = knob;
+        ref.node = node;
+        // same tests as Effect::createParamWrapperForKnob()
+        int dims = knob->getDimension();
+        bool isColor = false;
+        bool hasDimensionArg = true; // BooleanParam and ChoiceParam have a single dimension
+        if ( dynamic_cast<KnobInt*>( knob.get() ) ) {
+            ref.type = eKnobTypeInt;
+        } else if ( dynamic_cast<KnobDouble*>( knob.get() ) ) {
+            ref.type = eKnobTypeDouble;
+        } else if ( dynamic_cast<KnobBool*>( knob.get() ) ) {
+            ref.type = eKnobTypeBool;
+            hasDimensionArg = false;
+        } else if ( dynamic_cast<KnobChoice*>( knob.get() ) ) {
+            ref.type = eKnobTypeInt;
+            hasDimensionArg = false;
+        } else if ( dynamic_cast<KnobColor*>( knob.get() ) ) {
+            ref.type = eKnobTypeDouble;
+            isColor = true;
+        } else {
+            throw std::invalid_argument("unsupported parameter type");
+        }
+        if ( hasDimensionArg && !isColor && ( (dims < 1) || (dims > 3) ) ) {
+            throw std::invalid_argument("unsupported parameter type");
+        }
+
+        expect(".");
+        std::string method = expectName();
+        Instruction instr;
+        instr.index = (int)_expr->knobs.size();
+        if (method == "getValue") {
+            // getValue(dimension = 0)
+            int nArgs = parseArguments();
+            if ( nArgs > (hasDimensionArg ? 1 : 0) ) {
+                throw std::invalid_argument("wrong number of arguments");
+            }
+            if (nArgs == 0) {
+                emitConstant(0., true);
+            }
+            instr.op = eOpKnobValue;
+            emit(instr, 1);
+        } else if (method == "getValueAtTime") {
+            // getValueAtTime(time, dimension = 0)
+            int nArgs = parseArguments();
+            if ( (nArgs < 1) || ( nArgs > (hasDimensionArg ? 2 : 1) ) ) {
+                throw std::invalid_argument("wrong number of arguments");
+            }
+            if (nArgs == 1) {
+                emitConstant(0., true);
+            }
+            instr.op = eOpKnobValueAtTime;
+            emit(instr, 2);
+        } else if (method == "get") {
+            // get() or get(frame), returning a tuple for multi-dimensional parameters
+            int nArgs = parseArguments();
+            if (nArgs > 1) {
+                throw std::invalid_argument("wrong number of arguments");
+            }
+            int dimension = 0;
+            if ( isColor || (hasDimensionArg && dims > 1) ) {
+                expect(".");
+                std::string member = expectName();
+                const char* const members = isColor ? "rgba" : (dims == 2 ? "xy" : "xyz");
+                const char* found = member.size() == 1 ? std::strchr(members, member[0]) : 0;
+                if (!found) {
+                    throw std::invalid_argument("unknown member");
+                }
+                dimension = (int)(found - members);
+            }
+            emitConstant(dimension, true);
+            instr.op = nArgs == 0 ? eOpKnobValue : eOpKnobValueAtTime;
+            emit(instr, nArgs + 1);
+        } else {
+            throw std::invalid_argument("unsupported method");
+        }
+        _expr->knobs.push_back(ref);
+    } // parseKnob
+
+    const std::vector<Token>& _tokens;
+    std::size_t _pos;
+    KnobIPtr _knob;
+    int _dimension;
+    NativeExpressionPrivate* _expr;
+    int _depth;
+    int _maxDepth;
+    NodePtr _node;
+    NodePtr _group;
+    NodesList _siblings;
+    PyObject* _mainDict;
+    PyObject* _mathModule;
+};
+} // anon namespace
+
+NativeExpressionPtr
+NativeExpression::compile(const std::string& expression,
+                          const KnobIPtr& knob,
+                          int dimension)
+{
+    NativeExpressionPtr ret;
+
+    if ( !knob || (dimension < 0) ) {
+        return ret;
+    }
+    std::vector<Token> tokens;
+    if ( !tokenize(expression, &tokens) ) {
+        return ret;
+    }
+    ret.reset( new NativeExpression() );
+    ret->_imp->thisKnob = knob;
+    try {
+        ExpressionParser parser(tokens, knob, dimension, ret->_imp.get());
+        parser.parse();
+    } catch (const std::invalid_argument&) {
+        ret.reset();
+    }
+
+    return ret;
+}
+
+/////////////////////////////// Evaluation
+
+namespace {
+inline bool
+isIntegerResultExact(double v)
+{
+    return std::fabs(v) <= NATIVE_EXPRESSION_MAX_INT;
+}
+
+/// Python's float_divmod()
+inline void
+pythonDivMod(double a,
+             double b,
+             double* div,
+             double* mod)
+{
+    double m = std::fmod(a, b);
+    double d = (a - m) / b;
+
+    if (m != 0.) {
+        if ( (b < 0) != (m < 0) ) {
+            m += b;
+            d -= 1.;
+        }
+    } else {
+        m = b < 0 ? -0. : 0.;
+    }
+    double floordiv;
+    if (d != 0.) {
+        floordiv = std::floor(d);
+        if (d - floordiv > 0.5) {
+            floordiv += 1.;
+        }
+    } else {
+        floordiv = a / b < 0 ? -0. : 0.;
+    }
+    *div = floordiv;
+    *mod = m;
+}
+
+bool
+binaryOp(OpEnum op,
+         const Value& a,
+         const Value& b,
+         Value* r)
+{
+    const bool bothInt = a.isInt && b.isInt;
+
+    switch (op) {
+    case eOpAdd:
+        r->v = a.v + b.v;
+        r->isInt = bothInt;
+        break;
+    case eOpSub:
+        r->v = a.v - b.v;
+        r->isInt = bothInt;
+        break;
+    case eOpMul:
+        r->v = a.v * b.v;
+        r->isInt = bothInt;
+        break;
+    case eOpDiv:
+        if (b.v == 0.) {
+            return false; // ZeroDivisionError
+        }
+#if PY_MAJOR_VERSION >= 3
+        r->v = a.v / b.v;
+        r->isInt = false;
+#else
+        if (bothInt) {
+            double mod;
+            pythonDivMod(a.v, b.v, &r->v, &mod);
+            r->isInt = true;
+        } else {
+            r->v = a.v / b.v;
+            r->isInt = false;
+        }
+#endif
+        break;
+    case eOpFloorDiv:
+    case eOpMod: {
+        if (b.v == 0.) {
+            return false; // ZeroDivisionError
+        }
+        double div, mod;
+        pythonDivMod(a.v, b.v, &div, &mod);
+        r->v = op == eOpFloorDiv ? div : mod;
+        r->isInt = bothInt;
+        break;
+    }
+    case eOpPow:
+        if ( (a.v == 0.) && (b.v < 0.) ) {
+            return false; // ZeroDivisionError
+        }
+        if ( (a.v < 0.) && ( b.v != std::floor(b.v) ) ) {
+            return false; // complex result
+        }
+        r->v = std::pow(a.v, b.v);
+        r->isInt = bothInt && b.v >= 0.;
+        if ( (boost::math::isinf)(r->v) && (boost::math::isfinite)(a.v) && (boost::math::isfinite)(b.v) ) {
+            return false; // OverflowError
+        }
+        break;
+    default:
+        assert(false);
+
+        return false;
+    } // switch
+
+    // Python integers have an arbitrary precision
+    return !r->isInt || isIntegerResultExact(r->v);
+} // binaryOp
+
+bool
+callFunction(FunctionEnum function,
+             const Value* args,
+             int nArgs,
+             Value* r)
+{
+    // Python's math.degrees() and math.radians()
+    static const double degToRad = M_PI / 180.0;
+
+    r->isInt = false;
+    switch (function) {
+    case eFunctionSin:
+        r->v = std::sin(args[0].v);
+        break;
+    case eFunctionCos:
+        r->v = std::cos(args[0].v);
+        break;
+    case eFunctionTan:
+        r->v = std::tan(args[0].v);
+        break;
+    case eFunctionAsin:
+        r->v = std::asin(args[0].v);
+        break;
+    case eFunctionAcos:
+        r->v = std::acos(args[0].v);
+        break;
+    case eFunctionAtan:
+        r->v = std::atan(args[0].v);
+        break;
+    case eFunctionAtan2:
+        r->v = std::atan2(args[0].v, args[1].v);
+        break;
+    case eFunctionSinh:
+        r->v = std::sinh(args[0].v);
+        break;
+    case eFunctionCosh:
+        r->v = std::cosh(args[0].v);
+        break;
+    case eFunctionTanh:
+        r->v = std::tanh(args[0].v);
+        break;
+    case eFunctionExp:
+        r->v = std::exp(args[0].v);
+        break;
+    case eFunctionLog:
+        if (nArgs == 2) {
+            double den = std::log(args[1].v);
+            if (den == 0.) {
+                return false; // ZeroDivisionError
+            }
+            r->v = std::log(args[0].v) / den;
+        } else {
+            r->v = std::log(args[0].v);
+        }
+        break;
+    case eFunctionLog10:
+        r->v = std::log10(args[0].v);
+        break;
+    case eFunctionSqrt:
+        r->v = std::sqrt(args[0].v);
+        break;
+    case eFunctionPow:
+        r->v = std::pow(args[0].v, args[1].v);
+        break;
+    case eFunctionFabs:
+        r->v = std::fabs(args[0].v);
+        break;
+    case eFunctionFmod:
+        r->v = std::fmod(args[0].v, args[1].v);
+        break;
+    case eFunctionHypot:
+        r->v = ::hypot(args[0].v, args[1].v);
+        break;
+    case eFunctionFloor:
+        r->v = std::floor(args[0].v);
+#if PY_MAJOR_VERSION >= 3
+        r->isInt = true;
+#endif
+        break;
+    case eFunctionCeil:
+        r->v = std::ceil(args[0].v);
+#if PY_MAJOR_VERSION >= 3
+        r->isInt = true;
+#endif
+        break;
+    case eFunctionTrunc:
+    case eFunctionInt:
+        r->v = args[0].v < 0 ? std::ceil(args[0].v) : std::floor(args[0].v);
+        r->isInt = true;
+        break;
+    case eFunctionDegrees:
+        r->v = args[0].v / degToRad;
+        break;
+    case eFunctionRadians:
+        r->v = args[0].v * degToRad;
+        break;
+    case eFunctionAbs:
+        r->v = std::fabs(args[0].v);
+        r->isInt = args[0].isInt;
+        break;
+    case eFunctionMin:
+    case eFunctionMax:
+        // Python returns the first of the equal values
+        *r = args[0];
+        for (int i = 1; i < nArgs; ++i) {
+            if ( (boost::math::isnan)(args[i].v) || (boost::math::isnan)(r->v) ) {
+                return false; // comparisons with NaN
+            }
+            if ( (function == eFunctionMin) ? (args[i].v < r->v) : (args[i].v > r->v) ) {
+                *r = args[i];
+            }
+        }
+        break;
+    case eFunctionFloat:
+        r->v = args[0].v;
+        break;
+    } // switch
+
+    // math domain errors and overflows raise exceptions in Python
+    bool argsFinite = true;
+    for (int i = 0; i < nArgs; ++i) {
+        if ( !(boost::math::isfinite)(args[i].v) ) {
+            argsFinite = false;
+        }
+    }
+    if ( argsFinite && !(boost::math::isfinite)(r->v) ) {
+        return false;
+    }
+    if ( r->isInt && ( !(boost::math::isfinite)(r->v) || !isIntegerResultExact(r->v) ) ) {
+        return false;
+    }
+
+    return true;
+} // callFunction
+
+template <typename KNOB>
+double
+getKnobValue(KNOB* knob,
+             bool atTime,
+             double time,
+             int dimension)
+{
+    // same calls as the Python parameters
+    return atTime ? (double)knob->getValueAtTime(time, dimension) : (double)knob->getValue(dimension);
+}
+} // anon namespace
+
+bool
+NativeExpression::evaluate(double time,
+                           ViewIdx view,
+                           double* value,
+                           bool* isInt) const
+{
+    Value stack[NATIVE_EXPRESSION_MAX_STACK];
+    int top = 0; // number of values on the stack
+
+    for (std::vector<Instruction>::const_iterator it = _imp->program.begin(); it != _imp->program.end(); ++it) {
+        switch (it->op) {
+        case eOpConstant:
+            stack[top].v = it->value;
+            stack[top].isInt = it->isInt;
+            ++top;
+            break;
+        case eOpFrame:
+            stack[top].v = time;
+            stack[top].isInt = isIntegerFrame(time);
+            ++top;
+            break;
+        case eOpView:
+            stack[top].v = (int)view;
+            stack[top].isInt = true;
+            ++top;
+            break;
+        case eOpAdd:
+        case eOpSub:
+        case eOpMul:
+        case eOpDiv:
+        case eOpFloorDiv:
+        case eOpMod:
+        case eOpPow: {
+            assert(top >= 2);
+            Value r;
+            if ( !binaryOp(it->op, stack[top - 2], stack[top - 1], &r) ) {
+                return false;
+            }
+            --top;
+            stack[top - 1] = r;
+            break;
+        }
+        case eOpNeg:
+            assert(top >= 1);
+            stack[top - 1].v = -stack[top - 1].v;
+            break;
+        case eOpFunction: {
+            assert(top >= it->nArgs);
+            Value r;
+            if ( !callFunction( (FunctionEnum)it->index, &stack[top - it->nArgs], it->nArgs, &r ) ) {
+                return false;
+            }
+            top -= it->nArgs;
+            stack[top] = r;
+            ++top;
+            break;
+        }
+        case eOpKnobValue:
+        case eOpKnobValueAtTime: {
+            const bool atTime = it->op == eOpKnobValueAtTime;
+            assert( top >= (atTime ? 2 : 1) );
+            const Value& dimension = stack[top - 1];
+            const double t = atTime ? stack[top - 2].v : 0.;
+            if (!dimension.isInt) {
+                return false; // TypeError
+            }
+            const KnobReference& ref = _imp->knobs[it->index];
+            KnobIPtr knob = ref.knob.lock();
+            NodePtr node = ref.node.lock();
+            if ( !knob || !node || !node->isActivated() ) {
+                return false; // NameError
+            }
+            Value r;
+            switch (ref.type) {
+            case eKnobTypeInt:
+                r.v = getKnobValue(static_cast<KnobIntBase*>( knob.get() ), atTime, t, (int)dimension.v);
+                r.isInt = true;
+                break;
+            case eKnobTypeDouble:
+                r.v = getKnobValue(static_cast<KnobDoubleBase*>( knob.get() ), atTime, t, (int)dimension.v);
+                r.isInt = false;
+                break;
+            case eKnobTypeBool:
+                r.v = getKnobValue(static_cast<KnobBoolBase*>( knob.get() ), atTime, t, (int)dimension.v);
+                r.isInt = true; // bool is a subclass of int
+                break;
+            }
+            top -= atTime ? 2 : 1;
+            stack[top] = r;
+            ++top;
+            break;
+        }
+        case eOpCurve: {
+            assert(top >= 2);
+            const Value& dimension = stack[top - 1];
+            if (!dimension.isInt) {
+                return false; // TypeError
+            }
+            KnobIPtr knob = _imp->thisKnob.lock();
+            if (!knob) {
+                return false;
+            }
+            Value r;
+            r.v = knob->getRawCurveValueAt(stack[top - 2].v, ViewSpec::current(), (int)dimension.v);
+            r.isInt = false;
+            top -= 2;
+            stack[top] = r;
+            ++top;
+            break;
+        }
+        } // switch
+    }
+    assert(top == 1);
+    *value = stack[0].v;
+    *isInt = stack[0].isInt;
+
+    return true;
+} // NativeExpression::evaluate
+
+NATRON_NAMESPACE_EXIT
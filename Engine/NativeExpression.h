@@ -0,0 +1,92 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * Copyright (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+#ifndef NATRON_ENGINE_NATIVEEXPRESSION_H
+#define NATRON_ENGINE_NATIVEEXPRESSION_H
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include <string>
+
+#if !defined(Q_MOC_RUN) && !defined(SBK_RUN)
+#include <boost/scoped_ptr.hpp>
+#endif
+
+#include "Engine/ViewIdx.h"
+
+#include "Engine/EngineFwd.h"
+
+NATRON_NAMESPACE_ENTER
+
+struct NativeExpressionPrivate;
+
+/**
+ * @brief A knob expression evaluated without Python.
+ * Only the single-line expressions made of numbers, arithmetic operators, the functions of the math module,
+ * frame, view, dimension, curve() and the values of other parameters are compiled: they are evaluated
+ * with the same rules as Python (integers and floats are distinguished) and do not need the GIL.
+ * Whenever Python would raise an error (division by zero, math domain error, a node that was removed...)
+ * the evaluation fails and the expression must be run by Python, which will report the error.
+ **/
+class NativeExpression
+{
+    NativeExpression();
+
+public:
+
+    ~NativeExpression();
+
+    /**
+     * @brief Compiles the given expression of a dimension of knob.
+     * Returns NULL if the expression cannot be evaluated natively.
+     * Must be called with the Python GIL held.
+     **/
+    static NativeExpressionPtr compile(const std::string& expression, const KnobIPtr& knob, int dimension);
+
+    /**
+     * @brief Evaluates the expression at the given time and view. isInt is set to true if the result
+     * is a Python int (or bool) and to false if it is a float.
+     * Returns false if the expression must be run by Python instead.
+     **/
+    bool evaluate(double time, ViewIdx view, double* value, bool* isInt) const WARN_UNUSED_RETURN;
+
+    /**
+     * @brief Returns true if the given time is passed to the expression as a Python int rather than a float.
+     **/
+    static bool isIntegerFrame(double time);
+
+    /**
+     * @brief When disabled, all the expressions are run by Python. This is used to compare both implementations.
+     **/
+    static void setEnabled(bool enabled);
+    static bool isEnabled();
+
+private:
+
+    boost::scoped_ptr<NativeExpressionPrivate> _imp;
+};
+
+NATRON_NAMESPACE_EXIT
+
+#endif // NATRON_ENGINE_NATIVEEXPRESSION_H
@@ -775,6 +775,22 @@ Node::getHashValue() const
     return _imp->hash.value();
 }
 
+RenderPlanConstPtr
+Node::getRenderPlan() const
+{
+    QMutexLocker k(&_imp->renderPlanMutex);
+
+    return _imp->renderPlan;
+}
+
+void
+Node::setRenderPlan(const RenderPlanConstPtr& plan)
+{
+    QMutexLocker k(&_imp->renderPlanMutex);
+
+    _imp->renderPlan = plan;
+}
+
 std::string
 Node::getCacheID() const
 {
@@ -882,14 +898,13 @@ Node::computeHashInternal()
 } // Node::computeHashInternal
 
 void
-Node::computeHashRecursive(std::list<Node*>& marked)
+Node::computeHashRecursive(std::set<Node*>& marked)
 {
-    if ( std::find(marked.begin(), marked.end(), this) != marked.end() ) {
+    if ( !marked.insert(this).second ) {
         return;
     }
 
     bool hasChanged = computeHashInternal();
-    marked.push_back(this);
     if (!hasChanged) {
         //Nothing changed, no need to recurse on outputs
         return;
@@ -976,7 +991,7 @@ Node::computeHash()
 
         return;
     }
-    std::list<Node*> marked;
+    std::set<Node*> marked;
     computeHashRecursive(marked);
 } // computeHash
 
@@ -4916,7 +4931,7 @@ Node::onEffectKnobValueChanged(KnobI* what,
             ///When a group is disabled we have to force a hash change of all nodes inside otherwise the image will stay cached
 
             NodesList nodes = isGroup->getNodes();
-            std::list<Node*> markedNodes;
+            std::set<Node*> markedNodes;
             for (NodesList::iterator it = nodes.begin(); it != nodes.end(); ++it) {
                 //This will not trigger a hash recomputation
                 (*it)->incrementKnobsAge_internal();
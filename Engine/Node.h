@@ -222,6 +222,12 @@ public:
      **/
     U64 getHashValue() const;
 
+    /**
+     * @brief The plan of the last render of the tree whose root is this node, see RenderPlan.
+     **/
+    RenderPlanConstPtr getRenderPlan() const;
+    void setRenderPlan(const RenderPlanConstPtr& plan);
+
     virtual std::string getCacheID() const OVERRIDE FINAL;
 
     /**
@@ -1332,7 +1338,7 @@ private:
 
     bool setStreamWarningInternal(StreamWarningEnum warning, const QString& message);
 
-    void computeHashRecursive(std::list<Node*>& marked);
+    void computeHashRecursive(std::set<Node*>& marked);
 
     /**
      * @brief Refreshes the node hash depending on its context (knobs age, inputs etc...)
@@ -175,6 +175,8 @@ public:
         , renderInstancesSharedMutex(QMutex::Recursive)
         , knobsAge(0)
         , knobsAgeMutex()
+        , renderPlanMutex()
+        , renderPlan()
         , masterNodeMutex()
         , masterNode()
         , nodeLinks()
@@ -359,6 +361,8 @@ public:
     U64 knobsAge; //< the age of the knobs in this effect. It gets incremented every times the effect has its evaluate() function called.
     mutable QReadWriteLock knobsAgeMutex; //< protects knobsAge and hash
     Hash64 hash; //< recomputed every time knobsAge is changed.
+    mutable QMutex renderPlanMutex; //< protects renderPlan
+    RenderPlanConstPtr renderPlan; //< the nodes of the last render of the tree whose root is this node
     mutable QMutex masterNodeMutex; //< protects masterNode and nodeLinks
     NodeWPtr masterNode; //< this points to the master when the node is a clone
     KnobLinkList nodeLinks; //< these point to the parents of the params links
@@ -0,0 +1,404 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * Copyright (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "NumaTopology.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+#if defined(__NATRON_LINUX__)
+#include <sched.h>         // sched_setaffinity
+#include <sys/syscall.h>   // SYS_mbind
+#include <unistd.h>        // syscall
+#endif
+
+#include <QtCore/QAtomicInt>
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+#include <QtCore/QMutex>
+#include <QtCore/QStringList>
+#include <QtCore/QThread>
+
+// The memory policy of mbind() that places the pages on a node if it has free memory, see <numaif.h>
+#define NATRON_NUMA_MPOL_PREFERRED 1
+
+NATRON_NAMESPACE_ENTER
+
+// The NUMA node the current thread is bound to, or -1
+static NATRON_THREAD_LOCAL int currentThreadNode = -1;
+
+#if defined(__NATRON_LINUX__)
+// The CPUs the thread could run on before it was bound, restored when it is unbound
+static NATRON_THREAD_LOCAL cpu_set_t unboundAffinity;
+static NATRON_THREAD_LOCAL bool hasUnboundAffinity = false;
+#endif
+
+NATRON_NAMESPACE_ANONYMOUS_ENTER
+
+struct NumaNode
+{
+    // The node number of the system, -1 for a simulated node
+    int systemNode;
+    std::vector<int> cpus;
+
+    // The number of threads bound to this node
+    int nBoundThreads;
+
+    NumaNode()
+        : systemNode(-1)
+        , cpus()
+        , nBoundThreads(0)
+    {
+    }
+};
+
+struct NumaTopologyPrivate
+{
+    // Protects the nodes
+    QMutex lock;
+    bool loaded;
+    std::vector<NumaNode> nodes;
+    QAtomicInt enabled;
+
+    NumaTopologyPrivate()
+        : lock()
+        , loaded(false)
+        , nodes()
+        , enabled(0)
+    {
+    }
+
+    static NumaTopologyPrivate& instance()
+    {
+        static NumaTopologyPrivate topology;
+
+        return topology;
+    }
+
+    // The nodes of the machine, read once
+    std::vector<NumaNode>& getNodes()
+    {
+        // must be locked
+        if (!loaded) {
+            loaded = true;
+            load();
+        }
+
+        return nodes;
+    }
+
+    void load();
+};
+
+static bool
+parseNodeList(const std::string& spec,
+              std::vector<NumaNode>* nodes)
+{
+    std::size_t start = 0;
+
+    while ( start <= spec.size() ) {
+        std::size_t end = spec.find(';', start);
+        if (end == std::string::npos) {
+            end = spec.size();
+        }
+        NumaNode node;
+        if ( !NumaTopology::parseCpuList(spec.substr(start, end - start), &node.cpus) ) {
+            return false;
+        }
+        nodes->push_back(node);
+        start = end + 1;
+    }
+
+    return !nodes->empty();
+}
+
+void
+NumaTopologyPrivate::load()
+{
+    // must be locked
+    const char* simulated = std::getenv(NATRON_NUMA_NODES_ENV_VAR);
+    if ( simulated && parseNodeList(simulated, &nodes) ) {
+        return;
+    }
+    nodes.clear();
+
+#if defined(__NATRON_LINUX__)
+    QDir nodesDir( QString::fromUtf8("/sys/devices/system/node") );
+    QStringList nodeDirs = nodesDir.entryList(QStringList( QString::fromUtf8("node*") ), QDir::Dirs);
+    std::vector<std::pair<int, QString> > systemNodes;
+    for (int i = 0; i < nodeDirs.size(); ++i) {
+        bool ok;
+        int systemNode = nodeDirs[i].mid(4).toInt(&ok);
+        if (ok) {
+            systemNodes.push_back( std::make_pair(systemNode, nodeDirs[i]) );
+        }
+    }
+    std::sort( systemNodes.begin(), systemNodes.end() );
+    for (std::size_t i = 0; i < systemNodes.size(); ++i) {
+        QFile cpuList( nodesDir.absoluteFilePath(systemNodes[i].second + QString::fromUtf8("/cpulist")) );
+        if ( !cpuList.open(QIODevice::ReadOnly) ) {
+            continue;
+        }
+        NumaNode node;
+        node.systemNode = systemNodes[i].first;
+        // memory-only nodes have no CPU
+        if ( NumaTopology::parseCpuList(QString::fromUtf8( cpuList.readAll() ).trimmed().toStdString(), &node.cpus) &&
+             !node.cpus.empty() ) {
+            nodes.push_back(node);
+        }
+    }
+#endif
+
+    if ( nodes.empty() ) {
+        NumaNode node;
+        int nCpus = std::max(1, QThread::idealThreadCount() );
+        for (int i = 0; i < nCpus; ++i) {
+            node.cpus.push_back(i);
+        }
+        nodes.push_back(node);
+    }
+}
+
+static void
+restoreCurrentThreadAffinity()
+{
+#if defined(__NATRON_LINUX__)
+    if (hasUnboundAffinity) {
+        ::sched_setaffinity( 0, sizeof(unboundAffinity), &unboundAffinity );
+        hasUnboundAffinity = false;
+    }
+#endif
+}
+
+static void
+setCurrentThreadAffinity(const std::vector<int>& cpus)
+{
+#if defined(__NATRON_LINUX__)
+    if ( cpus.empty() ) {
+        return;
+    }
+    hasUnboundAffinity = ::sched_getaffinity( 0, sizeof(unboundAffinity), &unboundAffinity ) == 0;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (std::size_t i = 0; i < cpus.size(); ++i) {
+        if (cpus[i] < CPU_SETSIZE) {
+            CPU_SET(cpus[i], &set);
+        }
+    }
+    ::sched_setaffinity(0, sizeof(set), &set);
+#else
+    Q_UNUSED(cpus);
+#endif
+}
+
+NATRON_NAMESPACE_ANONYMOUS_EXIT
+
+
+bool
+NumaTopology::parseCpuList(const std::string& list,
+                           std::vector<int>* cpus)
+{
+    std::vector<int> ret;
+    std::size_t start = 0;
+
+    while ( start <= list.size() ) {
+        std::size_t end = list.find(',', start);
+        if (end == std::string::npos) {
+            end = list.size();
+        }
+        std::string range = list.substr(start, end - start);
+        std::size_t dash = range.find('-');
+        char* parseEnd;
+        long first = std::strtol(range.c_str(), &parseEnd, 10);
+        if ( (parseEnd == range.c_str()) || (first < 0) ) {
+            return false;
+        }
+        long last = first;
+        if (dash != std::string::npos) {
+            const char* lastStr = range.c_str() + dash + 1;
+            last = std::strtol(lastStr, &parseEnd, 10);
+            if ( (parseEnd == lastStr) || (last < first) ) {
+                return false;
+            }
+        }
+        if (*parseEnd != '\0') {
+            return false;
+        }
+        for (long cpu = first; cpu <= last; ++cpu) {
+            ret.push_back( (int)cpu );
+        }
+        start = end + 1;
+    }
+    if ( ret.empty() ) {
+        return false;
+    }
+    cpus->swap(ret);
+
+    return true;
+}
+
+bool
+NumaTopology::setSimulatedTopology(const std::string& spec)
+{
+    std::vector<NumaNode> nodes;
+
+    if ( !parseNodeList(spec, &nodes) ) {
+        return false;
+    }
+    NumaTopologyPrivate& topology = NumaTopologyPrivate::instance();
+    QMutexLocker k(&topology.lock);
+    topology.loaded = true;
+    topology.nodes.swap(nodes);
+
+    return true;
+}
+
+void
+NumaTopology::setEnabled(bool enabled)
+{
+    NumaTopologyPrivate::instance().enabled.fetchAndStoreRelaxed(enabled ? 1 : 0);
+}
+
+bool
+NumaTopology::isEnabled()
+{
+    return (int)NumaTopologyPrivate::instance().enabled != 0;
+}
+
+int
+NumaTopology::getNodeCount()
+{
+    NumaTopologyPrivate& topology = NumaTopologyPrivate::instance();
+    QMutexLocker k(&topology.lock);
+
+    return (int)topology.getNodes().size();
+}
+
+std::vector<int>
+NumaTopology::getNodeCpus(int node)
+{
+    NumaTopologyPrivate& topology = NumaTopologyPrivate::instance();
+    QMutexLocker k(&topology.lock);
+    std::vector<NumaNode>& nodes = topology.getNodes();
+
+    if ( (node < 0) || ( node >= (int)nodes.size() ) ) {
+        return std::vector<int>();
+    }
+
+    return nodes[node].cpus;
+}
+
+int
+NumaTopology::bindCurrentThread()
+{
+    if ( !isEnabled() ) {
+        return -1;
+    }
+    if (currentThreadNode >= 0) {
+        return currentThreadNode;
+    }
+
+    NumaTopologyPrivate& topology = NumaTopologyPrivate::instance();
+    std::vector<int> cpus;
+    {
+        QMutexLocker k(&topology.lock);
+        std::vector<NumaNode>& nodes = topology.getNodes();
+        int node = 0;
+        for (int i = 1; i < (int)nodes.size(); ++i) {
+            if (nodes[i].nBoundThreads < nodes[node].nBoundThreads) {
+                node = i;
+            }
+        }
+        ++nodes[node].nBoundThreads;
+        currentThreadNode = node;
+        if (nodes.size() > 1) {
+            cpus = nodes[node].cpus;
+        }
+    }
+
+    // Fails if none of the CPUs exist, which may happen with a simulated topology: the thread is then left unbound
+    setCurrentThreadAffinity(cpus);
+
+    return currentThreadNode;
+}
+
+void
+NumaTopology::unbindCurrentThread()
+{
+    if (currentThreadNode < 0) {
+        return;
+    }
+    NumaTopologyPrivate& topology = NumaTopologyPrivate::instance();
+    {
+        QMutexLocker k(&topology.lock);
+        std::vector<NumaNode>& nodes = topology.getNodes();
+        if ( currentThreadNode < (int)nodes.size() ) {
+            --nodes[currentThreadNode].nBoundThreads;
+        }
+        currentThreadNode = -1;
+    }
+    restoreCurrentThreadAffinity();
+}
+
+int
+NumaTopology::getCurrentThreadNode()
+{
+    return isEnabled() ? currentThreadNode : -1;
+}
+
+void
+NumaTopology::placeOnCurrentThreadNode(void* ptr,
+                                       std::size_t size)
+{
+    int node = getCurrentThreadNode();
+
+    if (node < 0) {
+        return;
+    }
+#if defined(__NATRON_LINUX__) && defined(SYS_mbind)
+    int systemNode;
+    {
+        NumaTopologyPrivate& topology = NumaTopologyPrivate::instance();
+        QMutexLocker k(&topology.lock);
+        std::vector<NumaNode>& nodes = topology.getNodes();
+        if ( (nodes.size() < 2) || ( node >= (int)nodes.size() ) ) {
+            return;
+        }
+        systemNode = nodes[node].systemNode;
+    }
+    const int bitsPerWord = 8 * sizeof(unsigned long);
+    if ( (systemNode < 0) || (systemNode >= 16 * bitsPerWord) ) {
+        return;
+    }
+    unsigned long mask[16] = {0};
+    mask[systemNode / bitsPerWord] = 1UL << (systemNode % bitsPerWord);
+    // only a hint: the pages go elsewhere if the node is full
+    ::syscall(SYS_mbind, ptr, size, NATRON_NUMA_MPOL_PREFERRED, mask, (unsigned long)(16 * bitsPerWord), 0);
+#else
+    Q_UNUSED(ptr);
+    Q_UNUSED(size);
+#endif
+}
+
+NATRON_NAMESPACE_EXIT
@@ -0,0 +1,97 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * Copyright (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+#ifndef NATRON_ENGINE_NUMATOPOLOGY_H
+#define NATRON_ENGINE_NUMATOPOLOGY_H
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Environment variable describing a simulated topology, e.g. "0-3;4-7" for 2 nodes of 4 CPUs
+#define NATRON_NUMA_NODES_ENV_VAR "NATRON_NUMA_NODES"
+
+NATRON_NAMESPACE_ENTER
+
+/**
+ * @brief The NUMA nodes of the machine, for the opt-in NUMA rendering mode.
+ * On a machine with several sockets, the memory of an image is on the node of the thread that first wrote it, and
+ * reading it from the other socket is slower. When the mode is enabled, the threads rendering the frames and the
+ * workers of the TaskScheduler are bound to a node: the images they allocate are then local to that node, the
+ * TaskScheduler workers prefer the tasks forked by the threads of their node, the BufferPool only recycles the buffers
+ * of the node of the calling thread and the cache returns the entries of that node first.
+ * The topology is read from /sys/devices/system/node on Linux. It may be simulated by setting the
+ * NATRON_NUMA_NODES environment variable to the CPU lists of the nodes separated by semicolons, in which case
+ * the threads are bound to these CPUs but the memory placement is left to the system.
+ * Without either, the machine has a single node and binding the threads has no effect.
+ **/
+class NumaTopology
+{
+    NumaTopology();
+
+public:
+
+    /**
+     * @brief Parses a CPU list in the format of the Linux sysfs, e.g. "0-3,8,10-11". Returns false if it is invalid.
+     **/
+    static bool parseCpuList(const std::string& list, std::vector<int>* cpus);
+
+    /**
+     * @brief Replaces the topology of the machine by the nodes described by spec, in the format of
+     * NATRON_NUMA_NODES_ENV_VAR. Returns false and leaves the topology unchanged if spec is invalid.
+     **/
+    static bool setSimulatedTopology(const std::string& spec);
+
+    static void setEnabled(bool enabled);
+    static bool isEnabled();
+
+    static int getNodeCount();
+    static std::vector<int> getNodeCpus(int node);
+
+    /**
+     * @brief If the NUMA mode is enabled, binds the calling thread to the node that has the fewest bound threads and
+     * returns it. Returns -1 otherwise. The thread must call unbindCurrentThread() before it exits, which gives it back
+     * the CPUs it could run on before.
+     **/
+    static int bindCurrentThread();
+    static void unbindCurrentThread();
+
+    /**
+     * @brief Returns the node the calling thread is bound to, or -1 if it is not bound or the NUMA mode is disabled.
+     **/
+    static int getCurrentThreadNode();
+
+    /**
+     * @brief Asks the system to place the pages of the given memory on the node of the calling thread, even if they
+     * are first written by another thread. ptr must be aligned on a page. Only effective on Linux for the nodes of
+     * the machine.
+     **/
+    static void placeOnCurrentThreadNode(void* ptr, std::size_t size);
+};
+
+NATRON_NAMESPACE_EXIT
+
+#endif // NATRON_ENGINE_NUMATOPOLOGY_H
@@ -108,6 +108,7 @@ CLANG_DIAG_ON(unknown-pragmas)
 #include "Engine/Settings.h"
 #include "Engine/StandardPaths.h"
 #include "Engine/TLSHolder.h"
+#include "Engine/TaskScheduler.h"
 #include "Engine/ThreadPool.h"
 
 //An effect may not use more than this amount of threads
@@ -1359,14 +1360,11 @@ OfxHost::multiThread(OfxThreadFunctionV1 func,
             threadIndexes[i] = i;
         }
 
-        /// DON'T set the maximum thread count, this is a global application setting, and see the documentation excerpt above
-        //QThreadPool::globalInstance()->setMaxThreadCount(nThreads);
-        QFuture<OfxStatus> future = QtConcurrent::mapped( threadIndexes, boost::bind(threadFunctionWrapper, func, _1, nThreads, spawnerThread, customArg) );
-        future.waitForFinished();
-        ///DON'T reset back to the original value the maximum thread count
-        //QThreadPool::globalInstance()->setMaxThreadCount(QThread::idealThreadCount());
+        /// The task scheduler runs at most its number of threads at the same time, see the documentation excerpt above.
+        /// If the plug-in calls multiThread from a spawned thread, the nested calls are run by the same scheduler.
+        std::vector<OfxStatus> status = TaskScheduler::mapped( threadIndexes, boost::bind(threadFunctionWrapper, func, _1, nThreads, spawnerThread, customArg) );
 
-        for (QFuture<OfxStatus>::const_iterator it = future.begin(); it != future.end(); ++it) {
+        for (std::vector<OfxStatus>::const_iterator it = status.begin(); it != status.end(); ++it) {
             OfxStatus stat = *it;
             if (stat != kOfxStatOK) {
                 return stat;
@@ -1438,23 +1436,6 @@ OfxHost::multiThreadNumCPUS(unsigned int *nCPUs) const
     if (nThreadsToRender == -1) {
         *nCPUs = 1;
     } else {
-        // activeThreadCount may be negative (for example if releaseThread() is called)
-        int activeThreadsCount = QThreadPool::globalInstance()->activeThreadCount();
-
-        // Add the number of threads already running by the multiThreadSuite + parallel renders
-#ifndef NATRON_PLAYBACK_USES_THREAD_POOL
-        activeThreadsCount += appPTR->getNRunningThreads();
-#endif
-
-        // Clamp to 0
-        activeThreadsCount = std::max( 0, activeThreadsCount);
-
-        assert(activeThreadsCount >= 0);
-
-        // better than QThread::idealThreadCount();, because it can be set by a global preference:
-        int maxThreadsCount = QThreadPool::globalInstance()->maxThreadCount();
-        assert(maxThreadsCount >= 0);
-
         if (nThreadsPerEffect == 0) {
             ///Simple heuristic: limit 1 effect to start at most 8 threads because otherwise it might spend too much
             ///time scheduling than just processing
@@ -1470,10 +1451,46 @@ OfxHost::multiThreadNumCPUS(unsigned int *nCPUs) const
                } else {
                 nThreadsPerEffect = NATRON_MULTI_THREAD_SUITE_MAX_NUM_CPU;
                }*/
+
+            ///If the scheduler split the threads between the frames rendered in parallel, stick to the share of this frame
+            OfxHostDataTLSPtr tls = _imp->tlsData->getTLSData();
+            if (tls && tls->lastEffectCallingMainEntry) {
+                OfxEffectInstancePtr effect = tls->lastEffectCallingMainEntry->getOfxEffectInstance();
+                ParallelRenderArgsPtr frameArgs = effect ? effect->getParallelRenderArgsTLS() : ParallelRenderArgsPtr();
+                if (frameArgs && (frameArgs->threadBudget > 0) ) {
+                    nThreadsPerEffect = std::min(nThreadsPerEffect, frameArgs->threadBudget);
+                }
+            }
+        }
+
+        if ( appPTR->getUseThreadPool() ) {
+            ///The task scheduler never runs more threads than it has, and the threads that are busy simply do not
+            ///pick the tasks: there is no need to guess how many threads are free. The current thread runs tasks too
+            ///if it is not one of the scheduler.
+            int nThreads = TaskScheduler::getThreadCount() + (TaskScheduler::isWorkerThread() ? 0 : 1);
+            *nCPUs = std::max( 1, std::min(nThreads, nThreadsPerEffect) );
+        } else {
+            // activeThreadCount may be negative (for example if releaseThread() is called)
+            int activeThreadsCount = QThreadPool::globalInstance()->activeThreadCount();
+
+            // Add the number of threads already running by the multiThreadSuite + parallel renders
+#ifndef NATRON_PLAYBACK_USES_THREAD_POOL
+            activeThreadsCount += appPTR->getNRunningThreads();
+#endif
+
+            // Clamp to 0
+            activeThreadsCount = std::max( 0, activeThreadsCount);
+
+            assert(activeThreadsCount >= 0);
+
+            // better than QThread::idealThreadCount();, because it can be set by a global preference:
+            int maxThreadsCount = QThreadPool::globalInstance()->maxThreadCount();
+            assert(maxThreadsCount >= 0);
+
+            ///+1 because the current thread is going to wait during the multiThread call so we're better off
+            ///not counting it.
+            *nCPUs = std::max( 1, std::min(maxThreadsCount - activeThreadsCount + 1, nThreadsPerEffect) );
         }
-        ///+1 because the current thread is going to wait during the multiThread call so we're better off
-        ///not counting it.
-        *nCPUs = std::max( 1, std::min(maxThreadsCount - activeThreadsCount + 1, nThreadsPerEffect) );
     }
 
     return kOfxStatOK;
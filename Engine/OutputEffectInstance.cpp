@@ -67,6 +67,7 @@ GCC_DIAG_UNUSED_LOCAL_TYPEDEFS_ON
 #include "Engine/PluginMemory.h"
 #include "Engine/Project.h"
 #include "Engine/RenderStats.h"
+#include "Engine/RenderThreadBudget.h"
 #include "Engine/RotoContext.h"
 #include "Engine/RotoDrawableItem.h"
 #include "Engine/Settings.h"
@@ -438,6 +439,27 @@ OutputEffectInstance::reportStats(int time,
     }
 
     ofile << "Time spent to render frame (wall clock time): " << Timer::printAsTime(wallTime, false).toStdString() << std::endl;
+
+    // How the scheduler split the threads when the number of parallel renders is automatic
+    RenderEnginePtr engine = getRenderEngine();
+    RenderThreadBudgetStats budget = engine ? engine->getThreadBudgetStats() : RenderThreadBudgetStats();
+    if (budget.adaptive) {
+        ofile << "Frames rendered in parallel: " << budget.parallelRenders;
+        if (budget.converged) {
+            ofile << " (converged)" << std::endl;
+        } else {
+            ofile << " (searching)" << std::endl;
+        }
+        ofile << "Threads per frame render: " << budget.threadsPerRender << std::endl;
+        if (budget.framesPerSecond > 0.) {
+            ofile << "Measured throughput: " << budget.framesPerSecond << " frames per second, "
+                  << Timer::printAsTime(budget.averageFrameTime, false).toStdString() << " per frame" << std::endl;
+        }
+        if ( !budget.heaviestNode.empty() ) {
+            ofile << "Heaviest node: " << budget.heaviestNode << ", " << (int)(budget.heaviestNodeShare * 100.)
+                  << "% of the time spent rendering" << std::endl;
+        }
+    }
     for (std::map<NodePtr, NodeRenderStats >::const_iterator it = stats.begin(); it != stats.end(); ++it) {
         ofile << "------------------------------- " << it->first->getScriptName_mt_safe() << "------------------------------- " << std::endl;
         ofile << "Time spent rendering: " << Timer::printAsTime(it->second.getTotalTimeSpentRendering(), false).toStdString() << std::endl;
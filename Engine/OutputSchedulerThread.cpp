@@ -29,6 +29,7 @@
 #include <list>
 #include <algorithm> // min, max
 #include <cassert>
+#include <cstdlib> // abs
 #include <stdexcept>
 #include <sstream> // stringstream
 
@@ -55,10 +56,12 @@
 #include "Engine/Image.h"
 #include "Engine/KnobFile.h"
 #include "Engine/Node.h"
+#include "Engine/NumaTopology.h"
 #include "Engine/OpenGLViewerI.h"
 #include "Engine/GenericSchedulerThreadWatcher.h"
 #include "Engine/Project.h"
 #include "Engine/RenderStats.h"
+#include "Engine/RenderThreadBudget.h"
 #include "Engine/RotoContext.h"
 #include "Engine/Settings.h"
 #include "Engine/Timer.h"
@@ -90,6 +93,10 @@
 
 #define NATRON_SCHEDULER_ABORT_AFTER_X_UNSUCCESSFUL_ITERATIONS 5000
 
+// When a frame of the playback is found in the viewer cache, the textures of the frames this far ahead of the ones
+// being rendered are read from the disk cache in the background
+#define NATRON_PLAYBACK_PREFETCH_FRAMES 4
+
 NATRON_NAMESPACE_ENTER
 
 
@@ -242,6 +249,9 @@ struct OutputSchedulerThreadPrivate
     QMutex bufferedOutputMutex;
     int lastBufferedOutputSize;
 
+    // Splits the threads between the parallel renders and within them when the number of parallel renders is automatic
+    RenderThreadBudget threadBudget;
+
 
     OutputSchedulerThreadPrivate(RenderEngine* engine,
                                  const OutputEffectInstancePtr& effect,
@@ -281,6 +291,7 @@ struct OutputSchedulerThreadPrivate
 #endif
         , bufferedOutputMutex()
         , lastBufferedOutputSize(0)
+        , threadBudget()
     {
     }
 
@@ -704,6 +715,7 @@ OutputSchedulerThread::pushFramesToRenderInternal(int startingFrame,
 
     PlaybackModeEnum pMode = _imp->engine->getPlaybackMode();
     RenderDirectionEnum newDirection = direction;
+    const int maxFramesAhead = getMaxFramesAhead();
     if (firstFrame == lastFrame) {
         _imp->framesToRender.push_back(startingFrame);
 #ifdef TRACE_SCHEDULER
@@ -713,6 +725,10 @@ OutputSchedulerThread::pushFramesToRenderInternal(int startingFrame,
     } else {
         ///Push 2x the count of threads to be sure no one will be waiting
         while ( (int)_imp->framesToRender.size() < nThreads * 2 ) {
+            ///Do not render further than the bounded lookahead, the next frames are pushed once the output device processed a frame
+            if ( (maxFramesAhead >= 0) && (std::abs(startingFrame - _imp->expectFrameToRender) > maxFramesAhead * frameStep) ) {
+                break;
+            }
             _imp->framesToRender.push_back(startingFrame);
 #ifdef TRACE_SCHEDULER
             QString pushDirectionStr = newDirection == eRenderDirectionForward ? QLatin1String("Forward") : QLatin1String("Backward");
@@ -1035,6 +1051,16 @@ OutputSchedulerThread::startRender()
     // Start measuring
     _imp->renderTimer.reset(new TimeLapse);
 
+#ifndef NATRON_PLAYBACK_USES_THREAD_POOL
+    // When the number of parallel renders is automatic, search it from the throughput of the renders that are not
+    // regulated by a frame rate
+    if ( (appPTR->getCurrentSettings()->getNumberOfParallelRenders() == 0) && !isFPSRegulationNeeded() ) {
+        _imp->threadBudget.start( appPTR->getHardwareIdealThreadCount() );
+    } else {
+        _imp->threadBudget.stop();
+    }
+#endif
+
     ///We will push frame to renders starting at startingFrame.
     ///They will be in the range determined by firstFrame-lastFrame
     int startingFrame;
@@ -1191,6 +1217,7 @@ OutputSchedulerThread::stopRender()
 
     bool wasAborted = isBeingAborted();
 
+    _imp->threadBudget.stop();
 
     ///Notify everyone that the render is finished
     _imp->engine->s_renderFinished(wasAborted ? 1 : 0);
@@ -1519,6 +1546,25 @@ OutputSchedulerThread::adjustNumberOfThreads(int* newNThreads,
 
     *lastNThreads = currentParallelRenders;
 
+    if ( (userSettingParallelThreads == 0) && _imp->threadBudget.isActive() ) {
+        ///The number of parallel renders is measured: the threads left to each render are used by the render itself,
+        ///so the threads running in the application are not a sign of free cores
+        optimalNThreads = std::max(1, _imp->threadBudget.getParallelRenders());
+        if (currentParallelRenders < optimalNThreads) {
+            QMutexLocker l(&_imp->renderThreadsMutex);
+
+            _imp->appendRunnable( createRunnable() );
+            *newNThreads = currentParallelRenders + 1;
+        } else if (currentParallelRenders > optimalNThreads) {
+            stopRenderThreads(1);
+            *newNThreads = currentParallelRenders - 1;
+        } else {
+            *newNThreads = currentParallelRenders;
+        }
+
+        return;
+    }
+
     if (userSettingParallelThreads == 0) {
         ///User wants it to be automatically computed, do a simple heuristic: launch as many parallel renders
         ///as there are cores
@@ -1566,6 +1612,13 @@ OutputSchedulerThread::notifyFrameRendered(int frame,
     if (stats) {
         double timeSpentForFrame;
         std::map<NodePtr, NodeRenderStats > statResults = stats->getStats(&timeSpentForFrame);
+        if ( isLastView && _imp->threadBudget.isActive() ) {
+            std::map<std::string, double> nodeTimes;
+            for (std::map<NodePtr, NodeRenderStats >::const_iterator it = statResults.begin(); it != statResults.end(); ++it) {
+                nodeTimes[it->first->getFullyQualifiedName()] += it->second.getTotalTimeSpentRendering();
+            }
+            _imp->threadBudget.notifyFrameRendered(_imp->renderTimer->getTimeSinceCreation(), timeSpentForFrame, nodeTimes);
+        }
         if ( !statResults.empty() ) {
             effect->reportStats(frame, viewIndex, timeSpentForFrame, statResults);
         }
@@ -1618,26 +1671,26 @@ OutputSchedulerThread::notifyFrameRendered(int frame,
         }
         //renderingIsFinished = _imp->renderFinished;
     } else {
-        nbTotalFrames = std::floor( (double)(runArgs->lastFrame - runArgs->firstFrame + 1) / runArgs->frameStep );
+        // The frames are processed in order by the scheduler thread: the frame is the last one done
+        nbTotalFrames = std::ceil( (double)(runArgs->lastFrame - runArgs->firstFrame + 1) / runArgs->frameStep );
         if (runArgs->processTimelineDirection == eRenderDirectionForward) {
-            nbFramesRendered = (frame - runArgs->firstFrame) / runArgs->frameStep;
+            nbFramesRendered = (frame - runArgs->firstFrame) / runArgs->frameStep + 1;
         } else {
-            nbFramesRendered = (runArgs->lastFrame - frame) / runArgs->frameStep;
+            nbFramesRendered = (runArgs->lastFrame - frame) / runArgs->frameStep + 1;
         }
     } // if (policy == eSchedulingPolicyFFA) {
 
     double fractionDone = 0.;
     assert(nbTotalFrames > 0);
     if (nbTotalFrames != 0) {
-        QMutexLocker k(&_imp->renderFinishedMutex);
-        fractionDone = (double)_imp->nFramesRendered / nbTotalFrames;
+        fractionDone = (double)nbFramesRendered / nbTotalFrames;
     }
     assert(_imp->renderTimer);
     double timeSpentSinceStartSec = _imp->renderTimer->getTimeSinceCreation();
     double estimatedFps = (double)nbFramesRendered / timeSpentSinceStartSec;
     // total estimated time is: timeSpentSinceStartSec / fractionDone
     // remaining time is thus:
-    double timeRemaining = (nbTotalFrames <= 0 || _imp->nFramesRendered <= 0) ? -1. : timeSpentSinceStartSec / fractionDone - timeSpentSinceStartSec;
+    double timeRemaining = (nbTotalFrames <= 0 || nbFramesRendered <= 0) ? -1. : timeSpentSinceStartSec / fractionDone - timeSpentSinceStartSec;
 
     // If running in background, notify to the pipe that we rendered a frame
     if (isBackground) {
@@ -1906,6 +1959,18 @@ OutputSchedulerThread::getNActiveRenderThreads() const
     return _imp->getNActiveRenderThreads();
 }
 
+int
+OutputSchedulerThread::getThreadsPerRender() const
+{
+    return _imp->threadBudget.getThreadsPerRender();
+}
+
+RenderThreadBudgetStats
+OutputSchedulerThread::getThreadBudgetStats() const
+{
+    return _imp->threadBudget.getStats();
+}
+
 void
 OutputSchedulerThread::stopRenderThreads(int nThreadsToStop)
 {
@@ -2056,6 +2121,9 @@ RenderThreadTask::run()
 #ifndef NATRON_PLAYBACK_USES_THREAD_POOL
     notifyIsRunning(true);
 
+    // In NUMA mode, the frames rendered by this thread allocate their images on its node
+    NumaTopology::bindCurrentThread();
+
     for (;; ) {
         bool enableRenderStats;
         std::vector<ViewIdx> viewsToRender;
@@ -2081,6 +2149,7 @@ RenderThreadTask::run()
         QMutexLocker l(&_imp->mustQuitMutex);
         _imp->hasQuit = true;
     }
+    NumaTopology::unbindCurrentThread();
     notifyIsRunning(false);
     _imp->scheduler->notifyThreadAboutToQuit(this);
 #else // NATRON_PLAYBACK_USES_THREAD_POOL
@@ -2142,6 +2211,9 @@ DefaultScheduler::DefaultScheduler(RenderEngine* engine,
     , _effect(effect)
     , _currentTimeMutex()
     , _currentTime(0)
+    , _readAheadMutex()
+    , _readAheadInput()
+    , _readAheadFrames(0)
 {
     engine->setPlaybackMode(ePlaybackModeOnce);
 }
@@ -2253,19 +2325,26 @@ private:
             // Do not catch exceptions: if an exception occurs here it is probably fatal, since
             // it comes from Natron itself. All exceptions from plugins are already caught
             // by the HostSupport library.
-            EffectInstancePtr activeInputToRender;
-            //if (renderDirectly) {
-            activeInputToRender = output;
-            WriteNode* isWriteNode = dynamic_cast<WriteNode*>( output.get() );
-            if (isWriteNode) {
-                NodePtr embeddedWriter = isWriteNode->getEmbeddedWriter();
-                if (embeddedWriter) {
-                    activeInputToRender = embeddedWriter->getEffectInstance();
+            // When the writer is sequential, render its input and let the scheduler thread encode the frames in order
+            DefaultScheduler* defaultScheduler = dynamic_cast<DefaultScheduler*>(_imp->scheduler);
+            EffectInstancePtr activeInputToRender = defaultScheduler ? defaultScheduler->getReadAheadInput() : EffectInstancePtr();
+            const bool renderDirectly = !activeInputToRender;
+            U64 activeInputToRenderHash;
+            if (renderDirectly) {
+                activeInputToRender = output;
+                WriteNode* isWriteNode = dynamic_cast<WriteNode*>( output.get() );
+                if (isWriteNode) {
+                    NodePtr embeddedWriter = isWriteNode->getEmbeddedWriter();
+                    if (embeddedWriter) {
+                        activeInputToRender = embeddedWriter->getEffectInstance();
+                    }
                 }
+                activeInputToRenderHash = isWriteNode ? isWriteNode->getHash() : activeInputToRender->getHash();
+            } else {
+                activeInputToRenderHash = activeInputToRender->getHash();
             }
             assert(activeInputToRender);
             NodePtr activeInputNode = activeInputToRender->getNode();
-            U64 activeInputToRenderHash = isWriteNode ? isWriteNode->getHash() : activeInputToRender->getHash();
             const double par = activeInputToRender->getAspectRatio(-1);
             const bool isRenderDueToRenderInteraction = false;
             const bool isSequentialRender = true;
@@ -2322,6 +2401,7 @@ private:
                                                          false,
                                                          false,
                                                          stats);
+                frameRenderArgs.setThreadBudget( _imp->scheduler->getThreadsPerRender() );
 
                 {
                     FrameRequestMap request;
@@ -2361,13 +2441,17 @@ private:
                 }
 
                 ///If we need sequential rendering, pass the image to the output scheduler that will ensure the sequential ordering
-                /*if (!renderDirectly) {
-                    for (std::map<ImagePlaneDesc,ImagePtr>::iterator it = planes.begin(); it != planes.end(); ++it) {
-                        _imp->scheduler->appendToBuffer(time, viewsToRender[view], stats, boost::dynamic_pointer_cast<BufferableObject>(it->second));
+                if (!renderDirectly) {
+                    // The writer reads a single plane from its input
+                    if ( planes.empty() ) {
+                        _imp->scheduler->notifyRenderFailure("Error caught while rendering");
+
+                        return;
                     }
-                   } else {*/
-                _imp->scheduler->notifyFrameRendered(time, viewsToRender[view], viewsToRender, stats, eSchedulingPolicyFFA);
-                //}
+                    _imp->scheduler->appendToBuffer( time, viewsToRender[view], stats, boost::dynamic_pointer_cast<BufferableObject>(planes.begin()->second) );
+                } else {
+                    _imp->scheduler->notifyFrameRendered(time, viewsToRender[view], viewsToRender, stats, eSchedulingPolicyFFA);
+                }
             }
         } catch (const std::exception& e) {
             _imp->scheduler->notifyRenderFailure( std::string("Error while rendering: ") + e.what() );
@@ -2410,8 +2494,16 @@ DefaultScheduler::processFrame(const BufferedFrames& frames)
 
     ///Writers render to scale 1 always
     RenderScale scale(1.);
-    OutputEffectInstancePtr effect = _effect.lock();
-    U64 hash = effect->getHash();
+    OutputEffectInstancePtr output = _effect.lock();
+    EffectInstancePtr effect = output;
+    WriteNode* isWriteNode = dynamic_cast<WriteNode*>( output.get() );
+    if (isWriteNode) {
+        NodePtr embeddedWriter = isWriteNode->getEmbeddedWriter();
+        if (embeddedWriter) {
+            effect = embeddedWriter->getEffectInstance();
+        }
+    }
+    U64 hash = isWriteNode ? isWriteNode->getHash() : effect->getHash();
     bool isProjectFormat;
     RectD rod;
     RectI roi;
@@ -2533,12 +2625,30 @@ DefaultScheduler::handleRenderFailure(const std::string& errorMessage)
 SchedulingPolicyEnum
 DefaultScheduler::getSchedulingPolicy() const
 {
-    /*SequentialPreferenceEnum sequentiallity = _effect.lock()->getSequentialPreference();
-       if (sequentiallity == eSequentialPreferenceNotSequential) {*/
-    return eSchedulingPolicyFFA;
-    /*} else {
+    // A sequential writer reading ahead encodes the frames in order on the scheduler thread, see processFrame()
+    QMutexLocker k(&_readAheadMutex);
+
+    if (_readAheadFrames > 0) {
         return eSchedulingPolicyOrdered;
-       }*/
+    } else {
+        return eSchedulingPolicyFFA;
+    }
+}
+
+int
+DefaultScheduler::getMaxFramesAhead() const
+{
+    QMutexLocker k(&_readAheadMutex);
+
+    return _readAheadFrames > 0 ? _readAheadFrames : -1;
+}
+
+EffectInstancePtr
+DefaultScheduler::getReadAheadInput() const
+{
+    QMutexLocker k(&_readAheadMutex);
+
+    return _readAheadInput.lock();
 }
 
 void
@@ -2566,8 +2676,31 @@ DefaultScheduler::aboutToStartRender()
 
     // Activate the internal writer node for a write node
     WriteNode* isWriter = dynamic_cast<WriteNode*>( effect.get() );
+    EffectInstancePtr writer = effect;
     if (isWriter) {
         isWriter->onSequenceRenderStarted();
+        NodePtr embeddedWriter = isWriter->getEmbeddedWriter();
+        if (embeddedWriter) {
+            writer = embeddedWriter->getEffectInstance();
+        }
+    }
+
+    // A sequential writer encodes 1 frame at a time: while it encodes a frame, the render threads render its input
+    // for the next ones. The lookahead is bounded since the frames rendered ahead are held in the buffer.
+    {
+        QMutexLocker k(&_readAheadMutex);
+        _readAheadInput.reset();
+        _readAheadFrames = 0;
+#ifndef NATRON_PLAYBACK_USES_THREAD_POOL
+        SequentialPreferenceEnum pref = writer->getSequentialPreference();
+        int readAheadFrames = appPTR->getCurrentSettings()->getWriterReadAheadFrames();
+        EffectInstancePtr input = writer->getInput(0);
+        if ( (readAheadFrames > 0) && input && (args->viewsToRender.size() == 1) &&
+             ( (pref == eSequentialPreferenceOnlySequential) || (pref == eSequentialPreferencePreferSequential) ) ) {
+            _readAheadInput = input;
+            _readAheadFrames = readAheadFrames;
+        }
+#endif
     }
 
     std::string cb = effect->getNode()->getBeforeRenderCallback();
@@ -2622,6 +2755,12 @@ DefaultScheduler::onRenderStopped(bool aborted)
         effect->setKnobsFrozen(false);
     }
 
+    {
+        QMutexLocker k(&_readAheadMutex);
+        _readAheadInput.reset();
+        _readAheadFrames = 0;
+    }
+
     {
         QString longText = QString::fromUtf8( effect->getScriptName_mt_safe().c_str() ) + tr(" ==> Rendering finished");
         appPTR->writeToOutputPipe(longText, QString::fromUtf8(kRenderingFinishedStringShort), true);
@@ -2793,6 +2932,24 @@ public:
 
 private:
 
+    // The frame was found in the viewer cache: the next frames in the direction of the playback are likely to be
+    // cached as well
+    void prefetchNextFrames(const ViewerInstancePtr& viewer,
+                            const UpdateViewerParams& params,
+                            int time)
+    {
+        RenderDirectionEnum direction;
+        std::vector<ViewIdx> views;
+
+        _imp->scheduler->getLastRunArgs(&direction, &views);
+        int step = (direction == eRenderDirectionForward) ? 1 : -1;
+        // The frames right after this one are being looked up by the other render threads
+        int nFrames = _imp->scheduler->getNRenderThreads() + NATRON_PLAYBACK_PREFETCH_FRAMES;
+        for (int i = 1; i <= nFrames; ++i) {
+            viewer->prefetchCachedTextures(params, time + i * step, direction == eRenderDirectionForward);
+        }
+    }
+
     virtual void renderFrame(int time,
                              const std::vector<ViewIdx>& viewsToRender,
                              bool enableRenderStats)
@@ -2855,6 +3012,9 @@ private:
             for (int i = 0; i < 2; ++i) {
                 if (args[i] && args[i]->params) {
                     if ( ( (args[i]->params->nbCachedTile > 0) && ( args[i]->params->nbCachedTile == (int)args[i]->params->tiles.size() ) ) || args[i]->params->isViewerPaused ) {
+                        if (!args[i]->params->isViewerPaused) {
+                            prefetchNextFrames(viewer, *args[i]->params, time);
+                        }
                         toAppend.push_back(args[i]->params);
                         args[i].reset();
                     }
@@ -3358,6 +3518,12 @@ RenderEngine::getDesiredFPS() const
     return _imp->scheduler ? _imp->scheduler->getDesiredFPS() : 24;
 }
 
+RenderThreadBudgetStats
+RenderEngine::getThreadBudgetStats() const
+{
+    return _imp->scheduler ? _imp->scheduler->getThreadBudgetStats() : RenderThreadBudgetStats();
+}
+
 void
 RenderEngine::notifyFrameProduced(const BufferableObjectPtrList& frames,
                                   const RenderStatsPtr& stats,
@@ -296,6 +296,17 @@ public:
      **/
     int getNActiveRenderThreads() const;
 
+    /**
+     * @brief Returns the number of threads each frame render may use when the number of parallel renders is
+     * measured, or 0 if the renders are not limited.
+     **/
+    int getThreadsPerRender() const;
+
+    /**
+     * @brief Returns how the threads are currently split between the frames rendered in parallel.
+     **/
+    RenderThreadBudgetStats getThreadBudgetStats() const;
+
 #ifndef NATRON_PLAYBACK_USES_THREAD_POOL
     /**
      * @brief Called by render-threads to pick some work to do or to get asleep if there's nothing to do
@@ -391,6 +402,12 @@ protected:
      **/
     virtual SchedulingPolicyEnum getSchedulingPolicy() const = 0;
 
+    /**
+     * @brief With eSchedulingPolicyOrdered, returns how many frames after the frame expected by the output device
+     * may be rendered by the render threads, or -1 if this is not bounded. The frames rendered ahead are held in the buffer.
+     **/
+    virtual int getMaxFramesAhead() const { return -1; }
+
     /**
      * @brief Returns the last successful render time.
      * This makes sense only for Viewers to keep the timeline in sync with what is displayed.
@@ -483,6 +500,13 @@ public:
 
     virtual ~DefaultScheduler();
 
+    /**
+     * @brief When the writer is sequential, the render threads render its input ahead of the frame being encoded
+     * and the scheduler thread encodes the frames in order, see aboutToStartRender().
+     * Returns the input to render, or NULL if the render threads render the writer directly.
+     **/
+    EffectInstancePtr getReadAheadInput() const;
+
 private:
 
     virtual void processFrame(const BufferedFrames& frames) OVERRIDE FINAL;
@@ -499,11 +523,17 @@ private:
 
     virtual void handleRenderFailure(const std::string& errorMessage) OVERRIDE FINAL;
     virtual SchedulingPolicyEnum getSchedulingPolicy() const OVERRIDE FINAL;
+    virtual int getMaxFramesAhead() const OVERRIDE FINAL;
     virtual void aboutToStartRender() OVERRIDE FINAL;
     virtual void onRenderStopped(bool aborted) OVERRIDE FINAL;
     OutputEffectInstanceWPtr _effect;
     mutable QMutex _currentTimeMutex;
     int _currentTime;
+
+    // Protects _readAheadInput and _readAheadFrames, which are set by aboutToStartRender() for the current render
+    mutable QMutex _readAheadMutex;
+    EffectInstanceWPtr _readAheadInput;
+    int _readAheadFrames;
 };
 
 
@@ -692,6 +722,11 @@ public:
      **/
     double getDesiredFPS() const;
 
+    /**
+     * @brief Returns how the internal scheduler currently splits the threads between the frames rendered in parallel
+     **/
+    RenderThreadBudgetStats getThreadBudgetStats() const;
+
     /**
      * @brief Quit all processing, making sure all threads are finished, this is not blocking
      **/
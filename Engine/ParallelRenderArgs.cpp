@@ -29,6 +29,8 @@
 
 #include <boost/scoped_ptr.hpp>
 
+#include <QtCore/QMutex>
+
 #include "Engine/AbortableRenderInfo.h"
 #include "Engine/AppManager.h"
 #include "Engine/Settings.h"
@@ -40,6 +42,7 @@
 #include "Engine/OSGLContext.h"
 #include "Engine/RotoContext.h"
 #include "Engine/RotoDrawableItem.h"
+#include "Engine/Timer.h"
 #include "Engine/ViewIdx.h"
 
 NATRON_NAMESPACE_ENTER
@@ -686,6 +689,169 @@ getAllUpstreamNodesRecursiveWithDependencies_internal(const NodePtr& node,
 } // getAllUpstreamNodesRecursiveWithDependencies_internal
 
 
+/**
+ * @brief Appends the nodes of dependenciesMap upstream of node to sorted, the inputs of each node before it.
+ **/
+static void
+sortUpstreamFirst(const NodePtr& node,
+                  const FindDependenciesMap& dependenciesMap,
+                  std::set<NodePtr>& visited,
+                  std::vector<NodePtr>* sorted)
+{
+    if ( !node || ( dependenciesMap.find(node) == dependenciesMap.end() ) || !visited.insert(node).second ) {
+        return;
+    }
+    int maxInputs = node->getNInputs();
+    for (int i = 0; i < maxInputs; ++i) {
+        sortUpstreamFirst(node->getInput(i), dependenciesMap, visited, sorted);
+    }
+    sorted->push_back(node);
+}
+
+NATRON_NAMESPACE_ANONYMOUS_ENTER
+
+struct RenderPlanStatistics
+{
+    QMutex lock;
+    U64 nBuilt;
+    U64 nReused;
+    double buildTime;
+
+    RenderPlanStatistics()
+        : lock()
+        , nBuilt(0)
+        , nReused(0)
+        , buildTime(0.)
+    {
+    }
+};
+
+NATRON_NAMESPACE_ANONYMOUS_EXIT
+
+static RenderPlanStatistics renderPlanStatistics;
+
+RenderPlan::RenderPlan()
+    : _items()
+{
+}
+
+RenderPlanConstPtr
+RenderPlan::getPlan(const NodePtr& treeRoot)
+{
+    assert(treeRoot);
+    RenderPlanConstPtr plan = treeRoot->getRenderPlan();
+
+    if ( plan && plan->isUpToDate() ) {
+        QMutexLocker k(&renderPlanStatistics.lock);
+        ++renderPlanStatistics.nReused;
+
+        return plan;
+    }
+
+    TimeLapse timer;
+    plan = build(treeRoot);
+    treeRoot->setRenderPlan(plan);
+    double elapsed = timer.getTimeSinceCreation();
+
+    QMutexLocker k(&renderPlanStatistics.lock);
+    ++renderPlanStatistics.nBuilt;
+    renderPlanStatistics.buildTime += elapsed;
+
+    return plan;
+}
+
+RenderPlanConstPtr
+RenderPlan::build(const NodePtr& treeRoot)
+{
+    // Any change upstream changes the hash of the tree root: reading it before walking the graph ensures that
+    // the plan is built again if the graph changes meanwhile
+    U64 treeRootHash = treeRoot->getHashValue();
+    FindDependenciesMap dependenciesMap;
+
+    getAllUpstreamNodesRecursiveWithDependencies_internal(treeRoot, dependenciesMap);
+
+    std::vector<NodePtr> sorted;
+    {
+        std::set<NodePtr> visited;
+        sortUpstreamFirst(treeRoot, dependenciesMap, visited, &sorted);
+        // the nodes that are only reached through expressions
+        for (FindDependenciesMap::const_iterator it = dependenciesMap.begin(); it != dependenciesMap.end(); ++it) {
+            if ( visited.insert(it->first).second ) {
+                sorted.push_back(it->first);
+            }
+        }
+    }
+
+    boost::shared_ptr<RenderPlan> plan(new RenderPlan);
+    plan->_items.resize( sorted.size() );
+    for (std::size_t i = 0; i < sorted.size(); ++i) {
+        const NodePtr& node = sorted[i];
+        Item& item = plan->_items[i];
+        item.node = node;
+        item.hash = node == treeRoot ? treeRootHash : node->getHashValue();
+        item.visitsCount = dependenciesMap[node].visitCounter;
+
+        RotoContextPtr roto = node->getRotoContext();
+        item.hasRotoContext = (bool)roto;
+        item.rotoAge = 0;
+        if (roto) {
+            item.rotoAge = roto->getAge();
+            NodesList rotoPaintNodes;
+            roto->getRotoPaintTreeNodes(&rotoPaintNodes);
+            for (NodesList::iterator it = rotoPaintNodes.begin(); it != rotoPaintNodes.end(); ++it) {
+                PlanNode rotoPaintNode;
+                rotoPaintNode.node = *it;
+                rotoPaintNode.hash = (*it)->getHashValue();
+
+                // For rotopaint nodes, since the tree internally is always the same for all renders (it doesn't depend where the viewer is connected) the visits count is the  number of output nodes
+                NodesWList outputs;
+                (*it)->getOutputs_mt_safe(outputs);
+                rotoPaintNode.visitsCount = (int)outputs.size();
+                item.rotoPaintNodes.push_back(rotoPaintNode);
+            }
+        }
+    }
+
+    return plan;
+} // RenderPlan::build
+
+bool
+RenderPlan::isUpToDate() const
+{
+    for (std::vector<Item>::const_iterator it = _items.begin(); it != _items.end(); ++it) {
+        NodePtr node = it->node.lock();
+        if ( !node || ( node->getHashValue() != it->hash ) ) {
+            return false;
+        }
+        if (it->hasRotoContext) {
+            RotoContextPtr roto = node->getRotoContext();
+            if ( !roto || ( roto->getAge() != it->rotoAge ) ) {
+                return false;
+            }
+            for (std::vector<PlanNode>::const_iterator it2 = it->rotoPaintNodes.begin(); it2 != it->rotoPaintNodes.end(); ++it2) {
+                NodePtr rotoPaintNode = it2->node.lock();
+                if ( !rotoPaintNode || ( rotoPaintNode->getHashValue() != it2->hash ) ) {
+                    return false;
+                }
+            }
+        }
+    }
+
+    return true;
+}
+
+void
+RenderPlan::getStatistics(U64* nBuilt,
+                          U64* nReused,
+                          double* buildTime)
+{
+    QMutexLocker k(&renderPlanStatistics.lock);
+
+    *nBuilt = renderPlanStatistics.nBuilt;
+    *nReused = renderPlanStatistics.nReused;
+    *buildTime = renderPlanStatistics.buildTime;
+}
+
 ParallelRenderArgsSetter::ParallelRenderArgsSetter(double time,
                                                    ViewIdx view,
                                                    bool isRenderUserInteraction,
@@ -699,6 +865,8 @@ ParallelRenderArgsSetter::ParallelRenderArgsSetter(double time,
                                                    bool draftMode,
                                                    const RenderStatsPtr& stats)
     :  argsMap()
+    , nodes()
+    , plan()
 {
     assert(treeRoot);
 
@@ -715,13 +883,16 @@ ParallelRenderArgsSetter::ParallelRenderArgsSetter(double time,
 
     bool doNanHandling = appPTR->getCurrentSettings()->isNaNHandlingEnabled();
 
-    FindDependenciesMap dependenciesMap;
-    getAllUpstreamNodesRecursiveWithDependencies_internal(treeRoot, dependenciesMap);
-
+    plan = RenderPlan::getPlan(treeRoot);
+    const std::vector<RenderPlan::Item>& items = plan->getItems();
 
-    for (FindDependenciesMap::iterator it = dependenciesMap.begin(); it != dependenciesMap.end(); ++it) {
+    for (std::vector<RenderPlan::Item>::const_iterator it = items.begin(); it != items.end(); ++it) {
 
-        const NodePtr& node = it->first;
+        NodePtr node = it->node.lock();
+        if (!node) {
+            // deleted since the plan was checked
+            continue;
+        }
         nodes.push_back(node);
 
         EffectInstancePtr liveInstance = node->getEffectInstance();
@@ -730,25 +901,28 @@ ParallelRenderArgsSetter::ParallelRenderArgsSetter(double time,
         RenderSafetyEnum safety = node->getCurrentRenderThreadSafety();
         PluginOpenGLRenderSupport glSupport = node->getCurrentOpenGLRenderSupport();
         NodesList rotoPaintNodes;
-        RotoContextPtr roto = node->getRotoContext();
-        if (roto) {
-            roto->getRotoPaintTreeNodes(&rotoPaintNodes);
+        for (std::vector<RenderPlan::PlanNode>::const_iterator it2 = it->rotoPaintNodes.begin(); it2 != it->rotoPaintNodes.end(); ++it2) {
+            NodePtr rotoPaintNode = it2->node.lock();
+            if (rotoPaintNode) {
+                rotoPaintNodes.push_back(rotoPaintNode);
+            }
         }
 
         {
             U64 nodeHash = node->getHashValue();
             liveInstance->setParallelRenderArgsTLS(time, view, isRenderUserInteraction, isSequential, nodeHash,
-                                                   abortInfo, treeRoot, it->second.visitCounter, NodeFrameRequestPtr(), glContext,  textureIndex, timeline, isAnalysis, duringPaintStrokeCreation, rotoPaintNodes, safety, glSupport, doNanHandling, draftMode, stats);
+                                                   abortInfo, treeRoot, it->visitsCount, NodeFrameRequestPtr(), glContext,  textureIndex, timeline, isAnalysis, duringPaintStrokeCreation, rotoPaintNodes, safety, glSupport, doNanHandling, draftMode, stats);
         }
-        for (NodesList::iterator it2 = rotoPaintNodes.begin(); it2 != rotoPaintNodes.end(); ++it2) {
-            U64 nodeHash = (*it2)->getHashValue();
 
-            // For rotopaint nodes, since the tree internally is always the same for all renders (it doesn't depend where the viewer is connected) the visits count is the  number of output nodes
-            NodesWList outputs;
-            (*it2)->getOutputs_mt_safe(outputs);
-            int visitsCounter = (int)outputs.size();
+        for (std::vector<RenderPlan::PlanNode>::const_iterator it2 = it->rotoPaintNodes.begin(); it2 != it->rotoPaintNodes.end(); ++it2) {
+            NodePtr rotoPaintNode = it2->node.lock();
+            if (!rotoPaintNode) {
+                continue;
+            }
+            U64 nodeHash = rotoPaintNode->getHashValue();
 
-            (*it2)->getEffectInstance()->setParallelRenderArgsTLS(time, view, isRenderUserInteraction, isSequential, nodeHash, abortInfo, treeRoot, visitsCounter, NodeFrameRequestPtr(), glContext, textureIndex, timeline, isAnalysis, activeRotoPaintNode && (*it2)->isDuringPaintStrokeCreation(), NodesList(), (*it2)->getCurrentRenderThreadSafety(),  (*it2)->getCurrentOpenGLRenderSupport(),doNanHandling, draftMode, stats);
+            // For rotopaint nodes, since the tree internally is always the same for all renders (it doesn't depend where the viewer is connected) the visits count is the  number of output nodes
+            rotoPaintNode->getEffectInstance()->setParallelRenderArgsTLS(time, view, isRenderUserInteraction, isSequential, nodeHash, abortInfo, treeRoot, it2->visitsCount, NodeFrameRequestPtr(), glContext, textureIndex, timeline, isAnalysis, activeRotoPaintNode && rotoPaintNode->isDuringPaintStrokeCreation(), NodesList(), rotoPaintNode->getCurrentRenderThreadSafety(),  rotoPaintNode->getCurrentOpenGLRenderSupport(),doNanHandling, draftMode, stats);
         }
 
         if ( node->isMultiInstance() ) {
@@ -779,32 +953,38 @@ ParallelRenderArgsSetter::ParallelRenderArgsSetter(double time,
 void
 ParallelRenderArgsSetter::updateNodesRequest(const FrameRequestMap& request)
 {
-    for (NodesList::iterator it = nodes.begin(); it != nodes.end(); ++it) {
+    if (!plan) {
+        return;
+    }
+    const std::vector<RenderPlan::Item>& items = plan->getItems();
+    for (std::vector<RenderPlan::Item>::const_iterator it = items.begin(); it != items.end(); ++it) {
+        NodePtr node = it->node.lock();
+        if (!node) {
+            continue;
+        }
         {
-            FrameRequestMap::const_iterator foundRequest = request.find(*it);
+            FrameRequestMap::const_iterator foundRequest = request.find(node);
             if ( foundRequest != request.end() ) {
-                (*it)->getEffectInstance()->setNodeRequestThreadLocal(foundRequest->second);
+                node->getEffectInstance()->setNodeRequestThreadLocal(foundRequest->second);
             }
         }
 
-        NodesList rotoPaintNodes;
-        RotoContextPtr roto = (*it)->getRotoContext();
-        if (roto) {
-            roto->getRotoPaintTreeNodes(&rotoPaintNodes);
-        }
-
-        for (NodesList::iterator it2 = rotoPaintNodes.begin(); it2 != rotoPaintNodes.end(); ++it2) {
-            FrameRequestMap::const_iterator foundRequest = request.find(*it2);
+        for (std::vector<RenderPlan::PlanNode>::const_iterator it2 = it->rotoPaintNodes.begin(); it2 != it->rotoPaintNodes.end(); ++it2) {
+            NodePtr rotoPaintNode = it2->node.lock();
+            if (!rotoPaintNode) {
+                continue;
+            }
+            FrameRequestMap::const_iterator foundRequest = request.find(rotoPaintNode);
             if ( foundRequest != request.end() ) {
-                (*it2)->getEffectInstance()->setNodeRequestThreadLocal(foundRequest->second);
+                rotoPaintNode->getEffectInstance()->setNodeRequestThreadLocal(foundRequest->second);
             }
         }
 
-        if ( (*it)->isMultiInstance() ) {
+        if ( node->isMultiInstance() ) {
             ///If the node has children, set the thread-local storage on them too, even if they do not render, it can be useful for expressions
             ///on parameters.
             NodesList children;
-            (*it)->getChildrenMultiInstance(&children);
+            node->getChildrenMultiInstance(&children);
             for (NodesList::iterator it2 = children.begin(); it2 != children.end(); ++it2) {
                 FrameRequestMap::const_iterator foundRequest = request.find(*it2);
                 if ( foundRequest != request.end() ) {
@@ -815,8 +995,40 @@ ParallelRenderArgsSetter::updateNodesRequest(const FrameRequestMap& request)
     }
 }
 
+void
+ParallelRenderArgsSetter::setThreadBudget(int nThreads)
+{
+    if (!plan) {
+        return;
+    }
+    const std::vector<RenderPlan::Item>& items = plan->getItems();
+    for (std::vector<RenderPlan::Item>::const_iterator it = items.begin(); it != items.end(); ++it) {
+        NodePtr node = it->node.lock();
+        if (!node) {
+            continue;
+        }
+        ParallelRenderArgsPtr args = node->getEffectInstance()->getParallelRenderArgsTLS();
+        if (args) {
+            args->threadBudget = nThreads;
+        }
+
+        for (std::vector<RenderPlan::PlanNode>::const_iterator it2 = it->rotoPaintNodes.begin(); it2 != it->rotoPaintNodes.end(); ++it2) {
+            NodePtr rotoPaintNode = it2->node.lock();
+            if (!rotoPaintNode) {
+                continue;
+            }
+            ParallelRenderArgsPtr rotoPaintArgs = rotoPaintNode->getEffectInstance()->getParallelRenderArgsTLS();
+            if (rotoPaintArgs) {
+                rotoPaintArgs->threadBudget = nThreads;
+            }
+        }
+    }
+}
+
 ParallelRenderArgsSetter::ParallelRenderArgsSetter(const boost::shared_ptr<std::map<NodePtr, ParallelRenderArgsPtr> >& args)
     : argsMap(args)
+    , nodes()
+    , plan()
 {
     // Ensure this thread gets an OpenGL context for the render of the frame
     OSGLContextPtr glContext;
@@ -885,6 +1097,7 @@ ParallelRenderArgs::ParallelRenderArgs()
     , stats()
     , openGLContext()
     , textureIndex(0)
+    , threadBudget(0)
     , currentThreadSafety(eRenderSafetyInstanceSafe)
     , currentOpenglSupport(ePluginOpenGLRenderSupportNone)
     , isRenderResponseToUserInteraction(false)
@@ -30,6 +30,7 @@
 #include <set>
 #include <map>
 #include <list>
+#include <vector>
 
 #if !defined(Q_MOC_RUN) && !defined(SBK_RUN)
 #include <boost/shared_ptr.hpp>
@@ -123,6 +124,10 @@ public:
     ///The texture index of the viewer being rendered, only useful for abortable renders
     int textureIndex;
 
+    ///The number of threads this frame render may use for the host frame threading and the multi-thread suite,
+    ///when the scheduler splits the threads between the frames rendered in parallel. 0 if not limited.
+    int threadBudget;
+
     ///Current thread safety: it might change in the case of the rotopaint: while drawing, the safety is instance safe,
     ///whereas afterwards we revert back to the plug-in thread safety
     RenderSafetyEnum currentThreadSafety;
@@ -245,10 +250,69 @@ public:
 typedef std::map<NodePtr, NodeFrameRequestPtr> FrameRequestMap;
 
 
+/**
+ * @brief The nodes whose thread-local arguments are set by ParallelRenderArgsSetter to render a tree: the nodes upstream
+ * of the tree root, the nodes they depend on through expressions and the nodes of their roto paint trees.
+ * Finding them walks the graph and the expressions of all the parameters of these nodes: the plan is built once and reused
+ * by the renders of the following frames until one of its nodes changes, that is when its hash changes (on any change of a
+ * parameter, an expression or a connection upstream) or when it is deleted.
+ **/
+class RenderPlan
+{
+public:
+
+    struct PlanNode
+    {
+        NodeWPtr node;
+        U64 hash;
+        int visitsCount; //< the number of times the node is visited by the tree
+    };
+
+    struct Item
+        : public PlanNode
+    {
+        // If the node has a roto context, the age of the context and the nodes of its roto paint tree
+        bool hasRotoContext;
+        U64 rotoAge;
+        std::vector<PlanNode> rotoPaintNodes;
+    };
+
+    /**
+     * @brief Returns the plan of the tree whose root is treeRoot: the last one built for this tree if none
+     * of its nodes changed since, otherwise a new one.
+     **/
+    static RenderPlanConstPtr getPlan(const NodePtr& treeRoot);
+
+    /**
+     * @brief The nodes of the tree, the nodes upstream first
+     **/
+    const std::vector<Item>& getItems() const
+    {
+        return _items;
+    }
+
+    /**
+     * @brief The number of plans built and reused since the application started, and the time spent
+     * building them, in seconds.
+     **/
+    static void getStatistics(U64* nBuilt, U64* nReused, double* buildTime);
+
+private:
+
+    RenderPlan();
+
+    static RenderPlanConstPtr build(const NodePtr& treeRoot);
+
+    bool isUpToDate() const;
+
+    std::vector<Item> _items;
+};
+
 class ParallelRenderArgsSetter
 {
     boost::shared_ptr<std::map<NodePtr, ParallelRenderArgsPtr> > argsMap;
     NodesList nodes;
+    RenderPlanConstPtr plan;
 
 protected:
 
@@ -280,6 +344,12 @@ public:
 
     void updateNodesRequest(const FrameRequestMap& request);
 
+    /**
+     * @brief Limits the number of threads that the nodes of the tree may use to render this frame, see
+     * ParallelRenderArgs::threadBudget.
+     **/
+    void setThreadBudget(int nThreads);
+
     virtual ~ParallelRenderArgsSetter();
 };
 
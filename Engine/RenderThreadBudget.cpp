@@ -0,0 +1,288 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * Copyright (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "RenderThreadBudget.h"
+
+#include <algorithm>
+
+#include <QtCore/QMutexLocker>
+
+// A window is measured over at least this many frames, and at least as many frames as there are parallel renders
+#define NATRON_THREAD_BUDGET_MIN_WINDOW_FRAMES 4
+
+// A window lasts at least this many seconds, so that the throughput of fast renders is not only noise
+#define NATRON_THREAD_BUDGET_MIN_WINDOW_DURATION 0.5
+
+// A candidate must render this much more frames per second than the best split to replace it
+#define NATRON_THREAD_BUDGET_MIN_IMPROVEMENT 0.05
+
+// Once converged, the search restarts if the throughput changes by more than this
+#define NATRON_THREAD_BUDGET_MAX_DRIFT 0.2
+
+NATRON_NAMESPACE_ENTER
+
+RenderThreadBudgetStats::RenderThreadBudgetStats()
+    : adaptive(false)
+    , converged(false)
+    , parallelRenders(0)
+    , threadsPerRender(0)
+    , framesPerSecond(0.)
+    , averageFrameTime(0.)
+    , heaviestNode()
+    , heaviestNodeShare(0.)
+{
+}
+
+RenderThreadBudget::RenderThreadBudget()
+    : _lock()
+    , _active(false)
+    , _nHardwareThreads(1)
+    , _parallelRenders(1)
+    , _bestParallelRenders(1)
+    , _bestFramesPerSecond(0.)
+    , _step(0)
+    , _direction(1)
+    , _triedOtherDirection(false)
+    , _framesToSkip(0)
+    , _windowStart(0.)
+    , _windowFrames(0)
+    , _windowFrameTime(0.)
+    , _windowNodeTimes()
+    , _lastFramesPerSecond(0.)
+    , _lastAverageFrameTime(0.)
+    , _lastHeaviestNode()
+    , _lastHeaviestNodeShare(0.)
+{
+}
+
+RenderThreadBudget::~RenderThreadBudget()
+{
+}
+
+void
+RenderThreadBudget::start(int nHardwareThreads)
+{
+    QMutexLocker k(&_lock);
+
+    _active = true;
+    _nHardwareThreads = std::max(1, nHardwareThreads);
+
+    // Start in the middle, with 2 threads per render, and first look at twice or half as many parallel renders
+    _parallelRenders = std::max(1, _nHardwareThreads / 2);
+    _bestParallelRenders = _parallelRenders;
+    _bestFramesPerSecond = 0.;
+    _step = (_nHardwareThreads > 1) ? std::max(1, _nHardwareThreads / 4) : 0;
+    _direction = 1;
+    _triedOtherDirection = false;
+    _framesToSkip = 0;
+    _lastFramesPerSecond = 0.;
+    _lastAverageFrameTime = 0.;
+    _lastHeaviestNode.clear();
+    _lastHeaviestNodeShare = 0.;
+    resetWindow(0.);
+}
+
+void
+RenderThreadBudget::stop()
+{
+    QMutexLocker k(&_lock);
+
+    _active = false;
+}
+
+bool
+RenderThreadBudget::isActive() const
+{
+    QMutexLocker k(&_lock);
+
+    return _active;
+}
+
+void
+RenderThreadBudget::resetWindow(double now)
+{
+    // must be locked
+    _windowStart = now;
+    _windowFrames = 0;
+    _windowFrameTime = 0.;
+    _windowNodeTimes.clear();
+}
+
+void
+RenderThreadBudget::setParallelRenders(int parallelRenders,
+                                       double now)
+{
+    // must be locked
+    if (parallelRenders != _parallelRenders) {
+        _framesToSkip = _parallelRenders;
+        _parallelRenders = parallelRenders;
+    }
+    resetWindow(now);
+}
+
+void
+RenderThreadBudget::moveToNextCandidate()
+{
+    // must be locked
+    while (_step > 0) {
+        int candidate = _bestParallelRenders + _direction * _step;
+        if ( (candidate >= 1) && (candidate <= _nHardwareThreads) ) {
+            setParallelRenders(candidate, _windowStart);
+
+            return;
+        }
+        if (!_triedOtherDirection) {
+            _direction = -_direction;
+            _triedOtherDirection = true;
+        } else {
+            _step /= 2;
+            _triedOtherDirection = false;
+        }
+    }
+    setParallelRenders(_bestParallelRenders, _windowStart);
+}
+
+void
+RenderThreadBudget::notifyFrameRendered(double now,
+                                        double frameTime,
+                                        const std::map<std::string, double>& nodeTimes)
+{
+    QMutexLocker k(&_lock);
+
+    if (!_active) {
+        return;
+    }
+
+    if (_framesToSkip > 0) {
+        --_framesToSkip;
+        if (_framesToSkip == 0) {
+            resetWindow(now);
+        }
+
+        return;
+    }
+
+    ++_windowFrames;
+    _windowFrameTime += frameTime;
+    for (std::map<std::string, double>::const_iterator it = nodeTimes.begin(); it != nodeTimes.end(); ++it) {
+        _windowNodeTimes[it->first] += it->second;
+    }
+
+    double elapsed = now - _windowStart;
+    if ( (_windowFrames < std::max(NATRON_THREAD_BUDGET_MIN_WINDOW_FRAMES, _parallelRenders)) ||
+         (elapsed < NATRON_THREAD_BUDGET_MIN_WINDOW_DURATION) ) {
+        return;
+    }
+
+    double framesPerSecond = _windowFrames / elapsed;
+    _lastFramesPerSecond = framesPerSecond;
+    _lastAverageFrameTime = _windowFrameTime / _windowFrames;
+    _lastHeaviestNode.clear();
+    _lastHeaviestNodeShare = 0.;
+    double heaviestNodeTime = 0.;
+    for (std::map<std::string, double>::const_iterator it = _windowNodeTimes.begin(); it != _windowNodeTimes.end(); ++it) {
+        if (it->second > heaviestNodeTime) {
+            heaviestNodeTime = it->second;
+            _lastHeaviestNode = it->first;
+        }
+    }
+    if (_windowFrameTime > 0.) {
+        _lastHeaviestNodeShare = std::min(1., heaviestNodeTime / _windowFrameTime);
+    }
+    _windowStart = now;
+
+    if (_step == 0) {
+        // Converged: keep the split unless the renders became much lighter or heavier
+        if ( (framesPerSecond < _bestFramesPerSecond * (1. - NATRON_THREAD_BUDGET_MAX_DRIFT)) ||
+             (framesPerSecond > _bestFramesPerSecond * (1. + NATRON_THREAD_BUDGET_MAX_DRIFT)) ) {
+            _bestParallelRenders = _parallelRenders;
+            _bestFramesPerSecond = framesPerSecond;
+            _step = std::max(1, _nHardwareThreads / 4);
+            _direction = (_parallelRenders < _nHardwareThreads) ? 1 : -1;
+            _triedOtherDirection = false;
+            moveToNextCandidate();
+        } else {
+            resetWindow(now);
+        }
+    } else if (_bestFramesPerSecond <= 0.) {
+        // The first window
+        _bestParallelRenders = _parallelRenders;
+        _bestFramesPerSecond = framesPerSecond;
+        moveToNextCandidate();
+    } else if ( framesPerSecond > _bestFramesPerSecond * (1. + NATRON_THREAD_BUDGET_MIN_IMPROVEMENT) ) {
+        // Keep going in the same direction: the other one leads back to the previous best split
+        _bestParallelRenders = _parallelRenders;
+        _bestFramesPerSecond = framesPerSecond;
+        _triedOtherDirection = true;
+        moveToNextCandidate();
+    } else {
+        if (!_triedOtherDirection) {
+            _direction = -_direction;
+            _triedOtherDirection = true;
+        } else {
+            _step /= 2;
+            _triedOtherDirection = false;
+        }
+        moveToNextCandidate();
+    }
+} // RenderThreadBudget::notifyFrameRendered
+
+int
+RenderThreadBudget::getParallelRenders() const
+{
+    QMutexLocker k(&_lock);
+
+    return _active ? _parallelRenders : 0;
+}
+
+int
+RenderThreadBudget::getThreadsPerRender() const
+{
+    QMutexLocker k(&_lock);
+
+    return _active ? std::max(1, _nHardwareThreads / _parallelRenders) : 0;
+}
+
+RenderThreadBudgetStats
+RenderThreadBudget::getStats() const
+{
+    QMutexLocker k(&_lock);
+    RenderThreadBudgetStats ret;
+
+    if (!_active) {
+        return ret;
+    }
+    ret.adaptive = true;
+    ret.converged = (_step == 0);
+    ret.parallelRenders = _parallelRenders;
+    ret.threadsPerRender = std::max(1, _nHardwareThreads / _parallelRenders);
+    ret.framesPerSecond = _lastFramesPerSecond;
+    ret.averageFrameTime = _lastAverageFrameTime;
+    ret.heaviestNode = _lastHeaviestNode;
+    ret.heaviestNodeShare = _lastHeaviestNodeShare;
+
+    return ret;
+}
+
+NATRON_NAMESPACE_EXIT
@@ -0,0 +1,158 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * Copyright (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+#ifndef NATRON_ENGINE_RENDERTHREADBUDGET_H
+#define NATRON_ENGINE_RENDERTHREADBUDGET_H
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include <map>
+#include <string>
+
+#include <QtCore/QMutex>
+
+#include "Engine/EngineFwd.h"
+
+NATRON_NAMESPACE_ENTER
+
+/**
+ * @brief The split of the threads decided by a RenderThreadBudget, as written in the render statistics.
+ **/
+struct RenderThreadBudgetStats
+{
+    // False if the number of parallel renders is not measured, in which case the other fields are meaningless
+    bool adaptive;
+
+    // True once the best number of parallel renders was found
+    bool converged;
+    int parallelRenders;
+    int threadsPerRender;
+
+    // Measured over the last window, 0 until a window was measured
+    double framesPerSecond;
+    double averageFrameTime;
+
+    // The node that took the most time to render in the last window, if the renders were profiled, and its share
+    // of the time spent to render the frames
+    std::string heaviestNode;
+    double heaviestNodeShare;
+
+    RenderThreadBudgetStats();
+};
+
+/**
+ * @brief Splits the threads of the machine between the frames of a sequence rendered in parallel and the threads
+ * that each of these renders may use for the host frame threading and the OFX multi-thread suite.
+ * Running as many parallel renders as there are cores, each of them starting as many threads as there are cores,
+ * over-subscribes the machine when the nodes are heavy, while a single render leaves most cores idle when
+ * the nodes do not thread well. Instead, the number of frames rendered per second is measured over windows of
+ * frames, and the number of parallel renders is searched by a pattern search: it moves by a step in one direction
+ * while the throughput improves, tries the other direction, then halves the step until it reaches 0. The search
+ * restarts when the throughput of the chosen split changes, e.g. when the sequence becomes heavier.
+ * Each parallel render may then use the threads left to it by the others.
+ * This class only computes the decisions: the caller passes the time of the frames rendered and applies them.
+ * It is thread-safe.
+ **/
+class RenderThreadBudget
+{
+public:
+
+    RenderThreadBudget();
+
+    ~RenderThreadBudget();
+
+    /**
+     * @brief Starts measuring the renders of a new sequence on a machine with the given number of threads.
+     **/
+    void start(int nHardwareThreads);
+
+    /**
+     * @brief Stops measuring: isActive() returns false until start() is called again.
+     **/
+    void stop();
+
+    bool isActive() const;
+
+    /**
+     * @brief To be called when a frame has been rendered, possibly from the render thread.
+     * @param now The time in seconds since the render started
+     * @param frameTime The wall-clock time spent rendering the frame, in seconds
+     * @param nodeTimes The time spent rendering each node for this frame, empty if the render was not profiled
+     **/
+    void notifyFrameRendered(double now, double frameTime, const std::map<std::string, double>& nodeTimes);
+
+    /**
+     * @brief Returns the number of frames to render in parallel, or 0 if not active.
+     **/
+    int getParallelRenders() const;
+
+    /**
+     * @brief Returns the number of threads each parallel render may use, or 0 if not active.
+     **/
+    int getThreadsPerRender() const;
+
+    RenderThreadBudgetStats getStats() const;
+
+private:
+
+    void resetWindow(double now);
+
+    void moveToNextCandidate();
+
+    void setParallelRenders(int parallelRenders, double now);
+
+    mutable QMutex _lock;
+    bool _active;
+    int _nHardwareThreads;
+
+    // The split that is being measured
+    int _parallelRenders;
+
+    // The state of the pattern search: the best split measured so far, the step and the direction of the next
+    // candidate, and whether the other direction was tried at this step. The search is over when _step is 0.
+    int _bestParallelRenders;
+    double _bestFramesPerSecond;
+    int _step;
+    int _direction;
+    bool _triedOtherDirection;
+
+    // The frames that were rendering when the split changed were started with the previous one: they are skipped
+    int _framesToSkip;
+
+    // The current window
+    double _windowStart;
+    int _windowFrames;
+    double _windowFrameTime;
+    std::map<std::string, double> _windowNodeTimes;
+
+    // The last window measured
+    double _lastFramesPerSecond;
+    double _lastAverageFrameTime;
+    std::string _lastHeaviestNode;
+    double _lastHeaviestNodeShare;
+};
+
+NATRON_NAMESPACE_EXIT
+
+#endif // NATRON_ENGINE_RENDERTHREADBUDGET_H
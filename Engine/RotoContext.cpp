@@ -63,10 +63,12 @@ GCC_DIAG_UNUSED_LOCAL_TYPEDEFS_ON
 #include "Engine/MemoryInfo.h" // printAsRAM
 #include "Engine/NodeSerialization.h"
 #include "Engine/Interpolation.h"
+#include "Engine/Project.h"
 #include "Engine/RenderStats.h"
 #include "Engine/RotoContextSerialization.h"
 #include "Engine/RotoDrawableItem.h"
 #include "Engine/RotoLayer.h"
+#include "Engine/RotoRasterizer.h"
 #include "Engine/RotoStrokeItem.h"
 #include "Engine/Settings.h"
 #include "Engine/TimeLine.h"
@@ -101,6 +103,9 @@ GCC_DIAG_UNUSED_LOCAL_TYPEDEFS_ON
 // http://www.davidrevoy.com/article182/calibrating-wacom-stylus-pressure-on-krita
 #define ROTO_PRESSURE_LEVELS 512
 
+// The largest distance in pixels a shape may move between two of its motion blur samples
+#define ROTO_MOTION_BLUR_SAMPLE_DISTANCE 1.
+
 #ifndef M_PI
 #define M_PI        3.14159265358979323846264338327950288   /* pi             */
 #endif
@@ -2722,14 +2727,23 @@ RotoDrawableItem::renderMaskFromStroke(const ImagePlaneDesc& components,
 
     ///compute an enhanced hash different from the one of the merge node of the item in order to differentiate within the cache
     ///the output image of the node and the mask image.
+    ///The mask only depends on the item: unlike the hash of the merge node, this hash does not depend on the inputs of
+    ///the merge node, so that the masks of the items above an item that changed stay in the cache.
     U64 rotoHash;
     {
+        NodePtr mergeNode = getMergeNode();
         Hash64 hash;
-        U64 mergeNodeHash = getMergeNode()->getEffectInstance()->getRenderHash();
-        hash.append(mergeNodeHash);
+        ///The age of the merge node is incremented on any change of the item, see incrementNodesAge()
+        hash.append( mergeNode->getKnobsAge() );
+        Hash64_appendQString( &hash, QString::fromUtf8( mergeNode->getFullyQualifiedName().c_str() ) );
+        hash.append( node->getApp()->getProject()->getProjectCreationTime() );
+#ifdef NATRON_ROTO_INVERTIBLE
+        ///An inverted mask covers the RoD of the source of the Roto
+        hash.append( mergeNode->getEffectInstance()->getRenderHash() );
+#endif
         hash.computeHash();
         rotoHash = hash.value();
-        assert(mergeNodeHash != rotoHash);
+        assert(mergeNode->getEffectInstance()->getRenderHash() != rotoHash);
     }
     boost::scoped_ptr<ImageKey> key( new ImageKey(this,
                                                   rotoHash,
@@ -2894,6 +2908,27 @@ RotoDrawableItem::renderMaskInternal(const RectI & roi,
 
     double opacity = getOpacity(time);
 
+    // The native rasterizers are opt-in: the edges of their shapes are not exactly the ones cairo renders
+    bool nativeRasterizer = appPTR->getCurrentSettings()->isNativeRotoRasterizerEnabled();
+    if ( nativeRasterizer && isBezier && !isBezier->isOpenBezier() ) {
+        // Closed shapes are rasterized from their triangles directly into the image, without a cairo surface
+        RotoRasterizer rasterizer;
+        RotoContextPrivate::renderBezier_native(&rasterizer, isBezier, time, startTime, endTime, timeStep, mipmapLevel);
+        rasterizer.render(roi, shapeColor, opacity, inverted, image.get());
+
+        return image;
+    }
+
+    if ( nativeRasterizer && ( isStroke || ( isBezier && isBezier->isOpenBezier() ) ) ) {
+        // The dots are stamped directly into the image. As with cairo, the opacity is in the dots, and applied once
+        // more to the open Beziers
+        RotoStrokeRasterizer rasterizer(doBuildUp);
+        RotoContextPrivate::renderStroke_native(&rasterizer, strokes, 0, this, opacity, time, mipmapLevel);
+        rasterizer.render(roi, shapeColor, isBezier ? opacity : 1., inverted, image.get());
+
+        return image;
+    }
+
     ////Allocate the cairo temporary buffer
     CairoImageWrapper imgWrapper;
 
@@ -3078,15 +3113,13 @@ getRenderDotParams(double alpha,
 }
 
 double
-RotoContextPrivate::renderStroke(cairo_t* cr,
-                                 std::vector<cairo_pattern_t*>& dotPatterns,
-                                 const std::list<std::list<std::pair<Point, double> > >& strokes,
-                                 double distToNext,
-                                 const RotoDrawableItem* stroke,
-                                 bool doBuildup,
-                                 double alpha,
-                                 double time,
-                                 unsigned int mipmapLevel)
+RotoContextPrivate::renderStrokeDots(const DotRenderer& dotRenderer,
+                                     const std::list<std::list<std::pair<Point, double> > >& strokes,
+                                     double distToNext,
+                                     const RotoDrawableItem* stroke,
+                                     double alpha,
+                                     double time,
+                                     unsigned int mipmapLevel)
 {
     if ( strokes.empty() ) {
         return distToNext;
@@ -3096,8 +3129,6 @@ RotoContextPrivate::renderStroke(cairo_t* cr,
         return distToNext;
     }
 
-    assert(dotPatterns.size() == ROTO_PRESSURE_LEVELS);
-
     KnobDoublePtr brushSizeKnob = stroke->getBrushSizeKnob();
     double brushSize = brushSizeKnob->getValueAtTime(time);
     KnobDoublePtr brushSpacingKnob = stroke->getBrushSpacingKnob();
@@ -3128,7 +3159,6 @@ RotoContextPrivate::renderStroke(cairo_t* cr,
     if (mipmapLevel != 0) {
         brushSizePixel = std::max( 1., brushSizePixel / (1 << mipmapLevel) );
     }
-    cairo_set_operator(cr, doBuildup ? CAIRO_OPERATOR_OVER : CAIRO_OPERATOR_LIGHTEN);
 
 
     for (std::list<std::list<std::pair<Point, double> > >::const_iterator strokeIt = strokes.begin(); strokeIt != strokes.end(); ++strokeIt) {
@@ -3156,7 +3186,7 @@ RotoContextPrivate::renderStroke(cairo_t* cr,
             double internalDotRadius, externalDotRadius, spacing;
             std::vector<std::pair<double, double> > opacityStops;
             getRenderDotParams(alpha, brushSizePixel, brushHardness, brushSpacing, it->second, pressureAffectsOpacity, pressureAffectsSize, pressureAffectsHardness, &internalDotRadius, &externalDotRadius, &spacing, &opacityStops);
-            renderDot(cr, &dotPatterns, it->first, internalDotRadius, externalDotRadius, it->second, doBuildup, opacityStops, alpha);
+            dotRenderer(it->first, internalDotRadius, externalDotRadius, it->second, opacityStops, alpha);
             continue;
         }
 
@@ -3183,7 +3213,7 @@ RotoContextPrivate::renderStroke(cairo_t* cr,
                 double internalDotRadius, externalDotRadius, spacing;
                 std::vector<std::pair<double, double> > opacityStops;
                 getRenderDotParams(alpha, brushSizePixel, brushHardness, brushSpacing, pressure, pressureAffectsOpacity, pressureAffectsSize, pressureAffectsHardness, &internalDotRadius, &externalDotRadius, &spacing, &opacityStops);
-                renderDot(cr, &dotPatterns, center, internalDotRadius, externalDotRadius, pressure, doBuildup, opacityStops, alpha);
+                dotRenderer(center, internalDotRadius, externalDotRadius, pressure, opacityStops, alpha);
 
                 distToNext += spacing;
             }
@@ -3197,7 +3227,39 @@ RotoContextPrivate::renderStroke(cairo_t* cr,
 
 
     return distToNext;
-} // RotoContextPrivate::renderStroke
+} // RotoContextPrivate::renderStrokeDots
+
+double
+RotoContextPrivate::renderStroke(cairo_t* cr,
+                                 std::vector<cairo_pattern_t*>& dotPatterns,
+                                 const std::list<std::list<std::pair<Point, double> > >& strokes,
+                                 double distToNext,
+                                 const RotoDrawableItem* stroke,
+                                 bool doBuildup,
+                                 double alpha,
+                                 double time,
+                                 unsigned int mipmapLevel)
+{
+    assert(dotPatterns.size() == ROTO_PRESSURE_LEVELS);
+
+    cairo_set_operator(cr, doBuildup ? CAIRO_OPERATOR_OVER : CAIRO_OPERATOR_LIGHTEN);
+
+    return renderStrokeDots(boost::bind(&RotoContextPrivate::renderDot, cr, &dotPatterns, _1, _2, _3, _4, doBuildup, _5, _6),
+                            strokes, distToNext, stroke, alpha, time, mipmapLevel);
+}
+
+double
+RotoContextPrivate::renderStroke_native(RotoStrokeRasterizer* rasterizer,
+                                        const std::list<std::list<std::pair<Point, double> > >& strokes,
+                                        double distToNext,
+                                        const RotoDrawableItem* stroke,
+                                        double alpha,
+                                        double time,
+                                        unsigned int mipmapLevel)
+{
+    return renderStrokeDots(boost::bind(&RotoStrokeRasterizer::addDot, rasterizer, _1, _2, _3, _4, _5, _6),
+                            strokes, distToNext, stroke, alpha, time, mipmapLevel);
+}
 
 bool
 RotoContext::allocateAndRenderSingleDotStroke(int brushSizePixel,
@@ -3252,10 +3314,12 @@ RotoContextPrivate::renderBezier(cairo_t* cr,
         return;
     }
 
+    // The samples that renderBezier_native() renders: a shape that moves slowly needs fewer of them
+    std::vector<double> sampleTimes;
+    getMotionBlurSampleTimes(bezier, time, startTime, endTime, mbFrameStep, mipmapLevel, &sampleTimes);
 
-
-    for (double t = startTime; t <= endTime; t+=mbFrameStep) {
-
+    for (std::size_t i = 0; i < sampleTimes.size(); ++i) {
+        double t = sampleTimes[i];
         double fallOff = bezier->getFeatherFallOff(t);
         double featherDist = bezier->getFeatherDistance(t);
         double shapeColor[3];
@@ -3284,13 +3348,9 @@ RotoContextPrivate::renderBezier(cairo_t* cr,
 
 
 #ifdef ROTO_RENDER_TRIANGLES_ONLY
-        std::list<RotoFeatherVertex> featherMesh;
-        std::list<RotoTriangleFans> internalFans;
-        std::list<RotoTriangles> internalTriangles;
-        std::list<RotoTriangleStrips> internalStrips;
-        computeTriangles(bezier, t, mipmapLevel, featherDist, &featherMesh, &internalFans, &internalTriangles, &internalStrips);
-        renderFeather_cairo(featherMesh, shapeColor, fallOff, mesh);
-        renderInternalShape_cairo(internalTriangles, internalFans, internalStrips, shapeColor, mesh);
+        RotoBezierTrianglesPtr triangles = getTriangles(bezier, t, mipmapLevel, featherDist);
+        renderFeather_cairo(triangles->featherMesh, shapeColor, fallOff, mesh);
+        renderInternalShape_cairo(triangles->internalTriangles, triangles->internalFans, triangles->internalStrips, shapeColor, mesh);
         Q_UNUSED(opacity);
 #else
         renderFeather(bezier, t, mipmapLevel, shapeColor, opacity, featherDist, fallOff, mesh);
@@ -4007,6 +4067,8 @@ RotoContextPrivate::computeTriangles(const Bezier * bezier, double time, unsigne
     // From README: if you know that all polygons lie in the x-y plane, call
     // gluTessNormal(tess, 0.0, 0.0, 1.0) before rendering any polygons.
     libtess_gluTessNormal(tesselator, 0, 0, 1);
+    // Same fill rule as the cairo path of the shape
+    libtess_gluTessProperty(tesselator, LIBTESS_GLU_TESS_WINDING_RULE, LIBTESS_GLU_TESS_WINDING_NONZERO);
     libtess_gluTessBeginPolygon(tesselator, (void*)&tessData);
     libtess_gluTessBeginContour(tesselator);
 
@@ -4145,6 +4207,379 @@ RotoContextPrivate::renderInternalShape_cairo(const std::list<RotoTriangles>& tr
 }
 
 
+RotoBezierTrianglesPtr
+RotoContextPrivate::getTriangles(const Bezier* bezier,
+                                 double time,
+                                 unsigned int mipmapLevel,
+                                 double featherDist)
+{
+    // The precision used by computeTriangles()
+#ifdef ROTO_BEZIER_EVAL_ITERATIVE
+    int error = -1;
+#else
+    double error = 1;
+#endif
+    U64 age;
+    RotoBezierTrianglesPtr cached = bezier->getCachedTriangles(time, mipmapLevel, error, featherDist, &age);
+
+    if (cached) {
+        return cached;
+    }
+
+    boost::shared_ptr<RotoBezierTriangles> triangles(new RotoBezierTriangles);
+    computeTriangles(bezier, time, mipmapLevel, featherDist, &triangles->featherMesh, &triangles->internalFans, &triangles->internalTriangles, &triangles->internalStrips);
+    bezier->setCachedTriangles(time, mipmapLevel, error, featherDist, age, triangles);
+
+    return triangles;
+}
+
+namespace {
+struct RotoMotionBlurSample
+{
+    double time;
+    Transform::Matrix3x3 transform;
+    double featherDist;
+    double fallOff;
+
+    // The control points and feather points with their tangents, before the transform
+    std::vector<Point> points;
+};
+
+static void
+appendPointAtTime(const BezierCP& cp,
+                  double time,
+                  std::vector<Point>* points)
+{
+    Point p, left, right;
+
+    cp.getPositionAtTime(false, time, ViewIdx(0), &p.x, &p.y);
+    cp.getLeftBezierPointAtTime(false, time, ViewIdx(0), &left.x, &left.y);
+    cp.getRightBezierPointAtTime(false, time, ViewIdx(0), &right.x, &right.y);
+    points->push_back(p);
+    points->push_back(left);
+    points->push_back(right);
+}
+
+static bool
+hasSamePoints(const std::vector<Point>& a,
+              const std::vector<Point>& b)
+{
+    if ( a.size() != b.size() ) {
+        return false;
+    }
+    for (std::size_t i = 0; i < a.size(); ++i) {
+        if ( (a[i].x != b[i].x) || (a[i].y != b[i].y) ) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static Point
+applyTransform(const Transform::Matrix3x3& m,
+               const Point& p)
+{
+    Transform::Point3D p3(p.x, p.y, 1.);
+
+    p3 = Transform::matApply(m, p3);
+    Point ret;
+    ret.x = p3.x / p3.z;
+    ret.y = p3.y / p3.z;
+
+    return ret;
+}
+
+// Returns the length of the longest path followed by a point of the shape over the samples, in canonical coordinates
+static double
+getMaxPathLength(const std::vector<RotoMotionBlurSample>& samples)
+{
+    double maxLength = 0.;
+
+    for (std::size_t i = 0; i < samples[0].points.size(); ++i) {
+        double length = 0.;
+        Point prev = applyTransform(samples[0].transform, samples[0].points[i]);
+        for (std::size_t j = 1; j < samples.size(); ++j) {
+            if ( samples[j].points.size() != samples[0].points.size() ) {
+                // Control points were added during the shutter: blur with all the samples
+                return std::numeric_limits<double>::infinity();
+            }
+            Point cur = applyTransform(samples[j].transform, samples[j].points[i]);
+            length += std::sqrt( (cur.x - prev.x) * (cur.x - prev.x) + (cur.y - prev.y) * (cur.y - prev.y) );
+            prev = cur;
+        }
+        maxLength = std::max(maxLength, length);
+    }
+
+    return maxLength;
+}
+
+// A rotation followed by a translation moves the triangles of a shape, and its feather, without changing them
+static bool
+isRigidTransform(const Transform::Matrix3x3& m)
+{
+    const double eps = 1e-9;
+
+    if ( (std::abs(m.g) > eps) || (std::abs(m.h) > eps) || (std::abs(m.i - 1.) > eps) ) {
+        return false;
+    }
+
+    return std::abs(m.a * m.a + m.d * m.d - 1.) < eps &&
+           std::abs(m.b * m.b + m.e * m.e - 1.) < eps &&
+           std::abs(m.a * m.b + m.d * m.e) < eps &&
+           (m.a * m.e - m.b * m.d) > 0.;
+}
+
+static void
+moveFeatherMesh(const Transform::Matrix3x3& m,
+                std::list<RotoFeatherVertex>* vertices)
+{
+    for (std::list<RotoFeatherVertex>::iterator it = vertices->begin(); it != vertices->end(); ++it) {
+        double x = it->x;
+        it->x = m.a * x + m.b * it->y + m.c;
+        it->y = m.d * x + m.e * it->y + m.f;
+    }
+}
+
+static void
+movePoints(const Transform::Matrix3x3& m,
+           std::list<Point>* points)
+{
+    for (std::list<Point>::iterator it = points->begin(); it != points->end(); ++it) {
+        double x = it->x;
+        it->x = m.a * x + m.b * it->y + m.c;
+        it->y = m.d * x + m.e * it->y + m.f;
+    }
+}
+
+// Evaluates the shape at each motion blur sample of the shutter, all at once, and only keeps the samples needed for
+// the shape to move at most ROTO_MOTION_BLUR_SAMPLE_DISTANCE pixels between two of them
+static void
+getMotionBlurSamples(const Bezier* bezier,
+                     double time,
+                     double startTime,
+                     double endTime,
+                     double mbFrameStep,
+                     unsigned int mipmapLevel,
+                     std::vector<RotoMotionBlurSample>* samples)
+{
+    for (double t = startTime; t <= endTime; t += mbFrameStep) {
+        RotoMotionBlurSample sample;
+        sample.time = t;
+        sample.featherDist = bezier->getFeatherDistance(t);
+        sample.fallOff = bezier->getFeatherFallOff(t);
+
+        ///Adjust the feather distance so it takes the mipmap level into account
+        if (mipmapLevel != 0) {
+            sample.featherDist /= (1 << mipmapLevel);
+        }
+        samples->push_back(sample);
+    }
+    if (samples->size() <= 1) {
+        return;
+    }
+
+    BezierCPs cps = bezier->getControlPoints_mt_safe();
+    BezierCPs fps = bezier->getFeatherPoints_mt_safe();
+    for (std::size_t i = 0; i < samples->size(); ++i) {
+        RotoMotionBlurSample& sample = (*samples)[i];
+        bezier->getTransformAtTime(sample.time, &sample.transform);
+        for (BezierCPs::const_iterator it = cps.begin(); it != cps.end(); ++it) {
+            appendPointAtTime(**it, sample.time, &sample.points);
+        }
+        for (BezierCPs::const_iterator it = fps.begin(); it != fps.end(); ++it) {
+            appendPointAtTime(**it, sample.time, &sample.points);
+        }
+    }
+
+    // A shape that moves slowly needs fewer samples than requested: keep them evenly spread over the shutter
+    double pathLength = getMaxPathLength(*samples) / (1 << mipmapLevel);
+    double nSamples = std::ceil(pathLength / ROTO_MOTION_BLUR_SAMPLE_DISTANCE) + 1.;
+    if ( nSamples < (double)samples->size() ) {
+        std::vector<RotoMotionBlurSample> kept;
+        if (nSamples <= 1.) {
+            std::size_t nearest = 0;
+            for (std::size_t i = 1; i < samples->size(); ++i) {
+                if ( std::abs( (*samples)[i].time - time ) < std::abs( (*samples)[nearest].time - time ) ) {
+                    nearest = i;
+                }
+            }
+            kept.push_back( (*samples)[nearest] );
+        } else {
+            for (int i = 0; i < (int)nSamples; ++i) {
+                kept.push_back( (*samples)[(std::size_t)( i * (samples->size() - 1) / (nSamples - 1.) + 0.5 )] );
+            }
+        }
+        samples->swap(kept);
+    }
+}
+} // anon namespace
+
+void
+RotoContextPrivate::getMotionBlurSampleTimes(const Bezier* bezier,
+                                             double time,
+                                             double startTime,
+                                             double endTime,
+                                             double mbFrameStep,
+                                             unsigned int mipmapLevel,
+                                             std::vector<double>* times)
+{
+    std::vector<RotoMotionBlurSample> samples;
+
+    getMotionBlurSamples(bezier, time, startTime, endTime, mbFrameStep, mipmapLevel, &samples);
+    for (std::size_t i = 0; i < samples.size(); ++i) {
+        times->push_back(samples[i].time);
+    }
+}
+
+void
+RotoContextPrivate::renderBezier_native(RotoRasterizer* rasterizer,
+                                        const Bezier* bezier,
+                                        double time,
+                                        double startTime,
+                                        double endTime,
+                                        double mbFrameStep,
+                                        unsigned int mipmapLevel)
+{
+    ///render the bezier only if finished (closed) and activated
+    if ( !bezier->isCurveFinished() || !bezier->isActivated(time) || ( bezier->getControlPointsCount() <= 1 ) ) {
+        return;
+    }
+
+    std::vector<RotoMotionBlurSample> samples;
+    getMotionBlurSamples(bezier, time, startTime, endTime, mbFrameStep, mipmapLevel, &samples);
+    if ( samples.empty() ) {
+        return;
+    }
+
+    // When the shape only moves rigidly during the shutter, it is tessellated once and its triangles are moved
+    // to each sample
+    bool reuseTriangles = false;
+    Transform::Matrix3x3 invTransform;
+    if (samples.size() > 1) {
+        double det = Transform::matDeterminant(samples[0].transform);
+        reuseTriangles = det != 0.;
+        if (reuseTriangles) {
+            invTransform = Transform::matInverse(samples[0].transform, det);
+        }
+        for (std::size_t i = 1; i < samples.size() && reuseTriangles; ++i) {
+            reuseTriangles = samples[i].featherDist == samples[0].featherDist &&
+                             hasSamePoints(samples[i].points, samples[0].points) &&
+                             isRigidTransform( Transform::matMul(samples[i].transform, invTransform) );
+        }
+    }
+
+    // As with cairo, each sample is composited over the previous ones
+    RotoBezierTrianglesPtr triangles;
+    for (std::size_t i = 0; i < samples.size(); ++i) {
+        rasterizer->beginShape(samples[i].fallOff);
+
+        if ( !reuseTriangles || (i == 0) ) {
+            triangles = getTriangles(bezier, samples[i].time, mipmapLevel, samples[i].featherDist);
+            renderFeather_native(triangles->featherMesh, rasterizer);
+            renderInternalShape_native(triangles->internalTriangles, triangles->internalFans, triangles->internalStrips, rasterizer);
+            continue;
+        }
+
+        // The motion from the first sample, in pixels
+        Transform::Matrix3x3 motion = Transform::matMul(samples[i].transform, invTransform);
+        double pot = 1 << mipmapLevel;
+        motion.c /= pot;
+        motion.f /= pot;
+
+        std::list<RotoFeatherVertex> movedFeatherMesh = triangles->featherMesh;
+        std::list<RotoTriangleFans> movedFans = triangles->internalFans;
+        std::list<RotoTriangles> movedTriangles = triangles->internalTriangles;
+        std::list<RotoTriangleStrips> movedStrips = triangles->internalStrips;
+        moveFeatherMesh(motion, &movedFeatherMesh);
+        for (std::list<RotoTriangleFans>::iterator it = movedFans.begin(); it != movedFans.end(); ++it) {
+            movePoints(motion, &it->vertices);
+        }
+        for (std::list<RotoTriangles>::iterator it = movedTriangles.begin(); it != movedTriangles.end(); ++it) {
+            movePoints(motion, &it->vertices);
+        }
+        for (std::list<RotoTriangleStrips>::iterator it = movedStrips.begin(); it != movedStrips.end(); ++it) {
+            movePoints(motion, &it->vertices);
+        }
+        renderFeather_native(movedFeatherMesh, rasterizer);
+        renderInternalShape_native(movedTriangles, movedFans, movedStrips, rasterizer);
+    }
+} // RotoContextPrivate::renderBezier_native
+
+void
+RotoContextPrivate::renderFeather_native(const std::list<RotoFeatherVertex>& vertices,
+                                         RotoRasterizer* rasterizer)
+{
+    // Roto feather is rendered as triangles
+    assert(vertices.size() % 3 == 0);
+
+    std::list<RotoFeatherVertex>::const_iterator it = vertices.begin();
+    for (std::size_t i = 0; i + 3 <= vertices.size(); i += 3) {
+        const RotoFeatherVertex& v0 = *it;
+        ++it;
+        const RotoFeatherVertex& v1 = *it;
+        ++it;
+        const RotoFeatherVertex& v2 = *it;
+        ++it;
+        Point p0, p1, p2;
+        p0.x = v0.x;
+        p0.y = v0.y;
+        p1.x = v1.x;
+        p1.y = v1.y;
+        p2.x = v2.x;
+        p2.y = v2.y;
+        rasterizer->addFeatherTriangle(p0, v0.isInner, p1, v1.isInner, p2, v2.isInner);
+    }
+}
+
+void
+RotoContextPrivate::renderInternalShape_native(const std::list<RotoTriangles>& triangles,
+                                               const std::list<RotoTriangleFans>& fans,
+                                               const std::list<RotoTriangleStrips>& strips,
+                                               RotoRasterizer* rasterizer)
+{
+    for (std::list<RotoTriangles>::const_iterator it = triangles.begin(); it != triangles.end(); ++it) {
+        assert(it->vertices.size() % 3 == 0);
+
+        std::list<Point>::const_iterator it2 = it->vertices.begin();
+        for (std::size_t i = 0; i + 3 <= it->vertices.size(); i += 3) {
+            const Point& p0 = *it2;
+            ++it2;
+            const Point& p1 = *it2;
+            ++it2;
+            const Point& p2 = *it2;
+            ++it2;
+            rasterizer->addTriangle(p0, p1, p2);
+        }
+    }
+    for (std::list<RotoTriangleFans>::const_iterator it = fans.begin(); it != fans.end(); ++it) {
+        assert(it->vertices.size() >= 3);
+
+        std::list<Point>::const_iterator cur = it->vertices.begin();
+        const Point& fanStart = *cur;
+        ++cur;
+        std::list<Point>::const_iterator next = cur;
+        ++next;
+        for (; next != it->vertices.end(); ++next, ++cur) {
+            rasterizer->addTriangle(fanStart, *cur, *next);
+        }
+    }
+    for (std::list<RotoTriangleStrips>::const_iterator it = strips.begin(); it != strips.end(); ++it) {
+        assert(it->vertices.size() >= 3);
+
+        std::list<Point>::const_iterator cur = it->vertices.begin();
+        const Point* prevPrev = &(*cur);
+        ++cur;
+        const Point* prev = &(*cur);
+        ++cur;
+        for (; cur != it->vertices.end(); ++cur) {
+            rasterizer->addTriangle(*prevPrev, *prev, *cur);
+            prevPrev = prev;
+            prev = &(*cur);
+        }
+    }
+} // RotoContextPrivate::renderInternalShape_native
+
 void
 RotoContextPrivate::renderInternalShape(double time,
                                         unsigned int mipmapLevel,
@@ -36,6 +36,7 @@
 #include <stdexcept>
 
 #if !defined(Q_MOC_RUN) && !defined(SBK_RUN)
+#include <boost/function.hpp>
 #include <boost/shared_ptr.hpp>
 #include <boost/weak_ptr.hpp>
 #endif
@@ -56,6 +57,7 @@ CLANG_DIAG_ON(uninitialized)
 #include "Global/GlobalDefines.h"
 
 #include "Engine/AppManager.h"
+#include "Engine/Bezier.h"
 #include "Engine/BezierCP.h"
 #include "Engine/Curve.h"
 #include "Engine/EffectInstance.h"
@@ -396,6 +398,69 @@ struct RotoTriangles
     std::list<Point> vertices;
 };
 
+/**
+ * @brief The triangles of a Bezier as computed by RotoContextPrivate::computeTriangles()
+ **/
+struct RotoBezierTriangles
+{
+    std::list<RotoFeatherVertex> featherMesh;
+    std::list<RotoTriangleFans> internalFans;
+    std::list<RotoTriangles> internalTriangles;
+    std::list<RotoTriangleStrips> internalStrips;
+};
+
+/**
+ * @brief An entry of the evaluation cache of a Bezier: the curves evaluated with the same arguments, and the triangles
+ * computed from them. Each of them is computed on first use.
+ **/
+struct BezierEvaluation
+{
+    bool useGuiCurves;
+    double time;
+    unsigned int mipMapLevel;
+#ifdef ROTO_BEZIER_EVAL_ITERATIVE
+    int nbPointsPerSegment;
+#else
+    double errorScale;
+#endif
+    // The transform is part of the key, since it may change without the shape being edited, e.g. with an expression
+    Transform::Matrix3x3 transform;
+
+    bool hasContour;
+    std::list<std::list<ParametricPoint> > contour;
+    RectD contourBBox;
+
+    // Evaluated with evaluateIfEqual set to true
+    bool hasFeatherContour;
+    std::list<std::list<ParametricPoint> > featherContour;
+    RectD featherContourBBox;
+
+    // The triangles for a single feather distance
+    double featherDist;
+    RotoBezierTrianglesPtr triangles;
+
+    BezierEvaluation()
+        : useGuiCurves(false)
+        , time(0)
+        , mipMapLevel(0)
+#ifdef ROTO_BEZIER_EVAL_ITERATIVE
+        , nbPointsPerSegment(0)
+#else
+        , errorScale(0)
+#endif
+        , transform()
+        , hasContour(false)
+        , contour()
+        , contourBBox()
+        , hasFeatherContour(false)
+        , featherContour()
+        , featherContourBBox()
+        , featherDist(0)
+        , triangles()
+    {
+    }
+};
+
 struct BezierPrivate
 {
     BezierCPs points; //< the control points of the curve
@@ -413,6 +478,12 @@ struct BezierPrivate
     mutable QMutex guiCopyMutex;
     bool mustCopyGui;
 
+    // The evaluations of the curve, the most recently used first. The cache is cleared, and its age incremented,
+    // whenever the shape is edited: the evaluations computed from the previous shape are not inserted afterwards.
+    mutable QMutex evaluationCacheMutex;
+    mutable std::list<BezierEvaluation> evaluationCache;
+    mutable U64 evaluationCacheAge;
+
     BezierPrivate(bool isOpenBezier)
         : points()
         , featherPoints()
@@ -425,6 +496,9 @@ struct BezierPrivate
         , isOpenBezier(isOpenBezier)
         , guiCopyMutex()
         , mustCopyGui(false)
+        , evaluationCacheMutex()
+        , evaluationCache()
+        , evaluationCacheAge(0)
     {
     }
 
@@ -2218,6 +2292,19 @@ public:
                           bool doBuildUp,
                           const std::vector<std::pair<double, double> >& opacityStops,
                           double opacity);
+    typedef boost::function6<void, const Point&, double, double, double, const std::vector<std::pair<double, double> >&, double> DotRenderer;
+
+    /**
+     * @brief Calls dotRenderer with the center, the internal and external radii, the pressure, the opacity stops and the
+     * opacity of each dot of the strokes. Returns the distance from the last dot to the next one.
+     **/
+    static double renderStrokeDots(const DotRenderer& dotRenderer,
+                                   const std::list<std::list<std::pair<Point, double> > >& strokes,
+                                   double distToNext,
+                                   const RotoDrawableItem* stroke,
+                                   double opacity,
+                                   double time,
+                                   unsigned int mipmapLevel);
     static double renderStroke(cairo_t* cr,
                                std::vector<cairo_pattern_t*>& dotPatterns,
                                const std::list<std::list<std::pair<Point, double> > >& strokes,
@@ -2227,6 +2314,13 @@ public:
                                double opacity,
                                double time,
                                unsigned int mipmapLevel);
+    static double renderStroke_native(RotoStrokeRasterizer* rasterizer,
+                                      const std::list<std::list<std::pair<Point, double> > >& strokes,
+                                      double distToNext,
+                                      const RotoDrawableItem* stroke,
+                                      double opacity,
+                                      double time,
+                                      unsigned int mipmapLevel);
     static void renderBezier(cairo_t* cr, const Bezier* bezier, double opacity, double time, double startTime, double endTime, double mbFrameStep, unsigned int mipmapLevel);
     static void renderFeather(const Bezier * bezier, double time, unsigned int mipmapLevel, double shapeColor[3], double opacity, double featherDist, double fallOff, cairo_pattern_t * mesh);
     static void renderFeather_cairo(const std::list<RotoFeatherVertex>& vertices, double shapeColor[3],  double fallOff, cairo_pattern_t * mesh);
@@ -2235,6 +2329,22 @@ public:
                                           const std::list<RotoTriangleStrips>& strips,
                                           double shapeColor[3],  cairo_pattern_t * mesh);
     static void computeTriangles(const Bezier * bezier, double time, unsigned int mipmapLevel,  double featherDist, std::list<RotoFeatherVertex>* featherMesh, std::list<RotoTriangleFans>* internalFans, std::list<RotoTriangles>* internalTriangles,std::list<RotoTriangleStrips>* internalStrips);
+    /**
+     * @brief Returns the triangles computed by computeTriangles(), from the evaluation cache of the Bezier if possible
+     **/
+    static RotoBezierTrianglesPtr getTriangles(const Bezier* bezier, double time, unsigned int mipmapLevel, double featherDist);
+
+    /**
+     * @brief Returns the times of the motion blur samples of the Bezier that renderBezier() and renderBezier_native()
+     * render, each one composited over the previous ones
+     **/
+    static void getMotionBlurSampleTimes(const Bezier* bezier, double time, double startTime, double endTime, double mbFrameStep, unsigned int mipmapLevel, std::vector<double>* times);
+    static void renderBezier_native(RotoRasterizer* rasterizer, const Bezier* bezier, double time, double startTime, double endTime, double mbFrameStep, unsigned int mipmapLevel);
+    static void renderFeather_native(const std::list<RotoFeatherVertex>& vertices, RotoRasterizer* rasterizer);
+    static void renderInternalShape_native(const std::list<RotoTriangles>& triangles,
+                                           const std::list<RotoTriangleFans>& fans,
+                                           const std::list<RotoTriangleStrips>& strips,
+                                           RotoRasterizer* rasterizer);
     static void renderInternalShape(double time, unsigned int mipmapLevel, double shapeColor[3], double opacity, const Transform::Matrix3x3 & transform, cairo_t * cr, cairo_pattern_t * mesh, const BezierCPs &cps);
     static void bezulate(double time, const BezierCPs& cps, std::list<BezierCPs>* patches);
     static void applyAndDestroyMask(cairo_t* cr, cairo_pattern_t* mesh);
@@ -82,7 +82,7 @@ public:
 
     void setNodesThreadSafetyForRotopainting();
 
-    void incrementNodesAge();
+    virtual void incrementNodesAge();
 
     void refreshNodesConnections();
 
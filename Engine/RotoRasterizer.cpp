@@ -0,0 +1,949 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * Copyright (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "RotoRasterizer.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#if !defined(Q_MOC_RUN) && !defined(SBK_RUN)
+#include <boost/bind.hpp>
+#endif
+
+#include "Engine/Image.h"
+#include "Engine/TaskScheduler.h"
+
+// The number of intervals of the table mapping the feather parameter to the opacity
+#define NATRON_ROTO_FALLOFF_LUT_SIZE 1024
+
+// The rounding errors of the accumulation leave coverages below this outside of the triangles
+#define NATRON_ROTO_MIN_COVERAGE 1e-5f
+
+// The number of intervals of the tables mapping the squared distance to the center of a dot to its opacity
+#define NATRON_ROTO_DOT_LUT_SIZE 4096
+
+#define ROTO_PRESSURE_LEVELS 512
+
+NATRON_NAMESPACE_ENTER
+
+namespace {
+// The feather of a cairo mesh pattern is a degenerated coons patch: its sides from the inner to the outer vertices are
+// cubic curves whose control points are at 1 / (2 * fallOff^2 + 1) and 2 / (fallOff^2 + 2) of the side, and the
+// opacity is linear along the parameter of these curves, not along the side. The mesh is used both as the source
+// and as the mask of the shape (see RotoContextPrivate::applyAndDestroyMask), hence the square.
+static void
+computeFallOffLut(double fallOff,
+                  std::vector<float>* lut)
+{
+    double c1 = 1. / (2. * fallOff * fallOff + 1.);
+    double c2 = 2. / (fallOff * fallOff + 2.);
+
+    lut->resize(NATRON_ROTO_FALLOFF_LUT_SIZE + 1);
+    for (int i = 0; i <= NATRON_ROTO_FALLOFF_LUT_SIZE; ++i) {
+        double s = (double)i / NATRON_ROTO_FALLOFF_LUT_SIZE;
+
+        // The curve is monotonic since 0 <= c1 <= c2 <= 1: find its parameter by bisection
+        double lo = 0.;
+        double hi = 1.;
+        for (int it = 0; it < 40; ++it) {
+            double u = (lo + hi) * 0.5;
+            double v = 1. - u;
+            double pos = 3. * u * v * v * c1 + 3. * u * u * v * c2 + u * u * u;
+            if (pos < s) {
+                lo = u;
+            } else {
+                hi = u;
+            }
+        }
+        double opacity = 1. - (lo + hi) * 0.5;
+        (*lut)[i] = (float)(opacity * opacity);
+    }
+}
+
+static inline float
+fallOffAt(const std::vector<float>& lut,
+          double s)
+{
+    double f = s * NATRON_ROTO_FALLOFF_LUT_SIZE;
+
+    if (f <= 0.) {
+        return lut[0];
+    } else if (f >= NATRON_ROTO_FALLOFF_LUT_SIZE) {
+        return lut[NATRON_ROTO_FALLOFF_LUT_SIZE];
+    }
+    int i = (int)f;
+    float t = (float)(f - i);
+
+    return lut[i] + (lut[i + 1] - lut[i]) * t;
+}
+
+// Adds the signed area at the right of a line to the accumulation buffer of a region, whose rows have stride values.
+// y0 < y1 and the line is inside [0, width] x [0, height]: the area of a row of the region is then the sum of its
+// values up to each pixel.
+static void
+rasterizeLine(double x0,
+              double y0,
+              double x1,
+              double y1,
+              double dir,
+              int height,
+              int stride,
+              float* acc)
+{
+    double dxdy = (x1 - x0) / (y1 - y0);
+    double x = x0;
+    // Keep the rounding errors from leaving the region
+    double xmin = std::min(x0, x1);
+    double xmax = std::max(x0, x1);
+    int yEnd = std::min( height, (int)std::ceil(y1) );
+
+    for (int y = (int)y0; y < yEnd; ++y) {
+        float* row = acc + y * stride;
+        double dy = std::min(y + 1., y1) - std::max( (double)y, y0 );
+        double xnext = std::max( xmin, std::min(xmax, x + dxdy * dy) );
+        double d = dy * dir;
+        double xl = std::min(x, xnext);
+        double xr = std::max(x, xnext);
+        double xlFloor = std::floor(xl);
+        int xli = (int)xlFloor;
+        double xrCeil = std::ceil(xr);
+        int xri = (int)xrCeil;
+
+        if (xri <= xli + 1) {
+            // The line stays in one pixel of the row
+            double xmf = 0.5 * (x + xnext) - xlFloor;
+            row[xli] += (float)(d - d * xmf);
+            row[xli + 1] += (float)(d * xmf);
+        } else {
+            double s = 1. / (xr - xl);
+            double xlf = xl - xlFloor;
+            double a0 = 0.5 * s * (1. - xlf) * (1. - xlf);
+            double xrf = xr - xrCeil + 1.;
+            double am = 0.5 * s * xrf * xrf;
+            row[xli] += (float)(d * a0);
+            if (xri == xli + 2) {
+                row[xli + 1] += (float)( d * (1. - a0 - am) );
+            } else {
+                double a1 = s * (1.5 - xlf);
+                row[xli + 1] += (float)( d * (a1 - a0) );
+                for (int xi = xli + 2; xi < xri - 1; ++xi) {
+                    row[xi] += (float)(d * s);
+                }
+                double a2 = a1 + (xri - xli - 3) * s;
+                row[xri - 1] += (float)( d * (1. - a2 - am) );
+            }
+            row[xri] += (float)(d * am);
+        }
+        x = xnext;
+    }
+} // rasterizeLine
+
+// Same as rasterizeLine() for any line in the coordinates of the region: the parts of the line that are below or above
+// the region are ignored, the parts on its left cover its first column entirely and the parts on its right do not
+// cover it. Splitting the line at the sides of the region, rather than clamping it, keeps the regions seamless.
+static void
+accumulateLine(double x0,
+               double y0,
+               double x1,
+               double y1,
+               double winding,
+               int width,
+               int height,
+               int stride,
+               float* acc)
+{
+    if (y0 == y1) {
+        return;
+    }
+    double dir = winding;
+    if (y0 > y1) {
+        std::swap(x0, x1);
+        std::swap(y0, y1);
+        dir = -winding;
+    }
+    if ( (y1 <= 0.) || (y0 >= height) ) {
+        return;
+    }
+    double dxdy = (x1 - x0) / (y1 - y0);
+    if (y0 < 0.) {
+        x0 -= y0 * dxdy;
+        y0 = 0.;
+    }
+    if (y1 > height) {
+        x1 -= (y1 - height) * dxdy;
+        y1 = height;
+    }
+
+    double ts[4];
+    int nTs = 0;
+    ts[nTs++] = 0.;
+    if (x0 != x1) {
+        double t0 = (0. - x0) / (x1 - x0);
+        double tw = (width - x0) / (x1 - x0);
+        if (t0 > tw) {
+            std::swap(t0, tw);
+        }
+        if ( (t0 > 0.) && (t0 < 1.) ) {
+            ts[nTs++] = t0;
+        }
+        if ( (tw > 0.) && (tw < 1.) ) {
+            ts[nTs++] = tw;
+        }
+    }
+    ts[nTs++] = 1.;
+
+    for (int i = 0; i < nTs - 1; ++i) {
+        double xa = x0 + (x1 - x0) * ts[i];
+        double ya = y0 + (y1 - y0) * ts[i];
+        double xb = x0 + (x1 - x0) * ts[i + 1];
+        double yb = (i + 1 == nTs - 1) ? y1 : y0 + (y1 - y0) * ts[i + 1];
+        if (yb <= ya) {
+            continue;
+        }
+        double xm = (xa + xb) * 0.5;
+        if (xm >= width) {
+            continue;
+        } else if (xm <= 0.) {
+            xa = xb = 0.;
+        } else {
+            xa = std::max( 0., std::min( (double)width, xa ) );
+            xb = std::max( 0., std::min( (double)width, xb ) );
+        }
+        rasterizeLine(xa, ya, xb, yb, dir, height, stride, acc);
+    }
+} // accumulateLine
+
+static RectI
+getTriangleBounds(const Point* p)
+{
+    double xmin = std::min( p[0].x, std::min(p[1].x, p[2].x) );
+    double xmax = std::max( p[0].x, std::max(p[1].x, p[2].x) );
+    double ymin = std::min( p[0].y, std::min(p[1].y, p[2].y) );
+    double ymax = std::max( p[0].y, std::max(p[1].y, p[2].y) );
+
+    return RectI( (int)std::floor(xmin), (int)std::floor(ymin), (int)std::ceil(xmax), (int)std::ceil(ymax) );
+}
+
+// Returns the horizontal extent of the part of the triangle between the rows y0 and y1
+static void
+getTriangleSpan(const Point* p,
+                double y0,
+                double y1,
+                double* xmin,
+                double* xmax)
+{
+    *xmin = std::numeric_limits<double>::infinity();
+    *xmax = -std::numeric_limits<double>::infinity();
+    for (int i = 0; i < 3; ++i) {
+        const Point& a = p[i];
+        const Point& b = p[(i + 1) % 3];
+        double ya = std::max( y0, std::min(a.y, b.y) );
+        double yb = std::min( y1, std::max(a.y, b.y) );
+        if (ya > yb) {
+            continue;
+        }
+        double xa = a.x;
+        double xb = b.x;
+        if (a.y != b.y) {
+            double dxdy = (b.x - a.x) / (b.y - a.y);
+            xa = a.x + (ya - a.y) * dxdy;
+            xb = a.x + (yb - a.y) * dxdy;
+        }
+        *xmin = std::min( *xmin, std::min(xa, xb) );
+        *xmax = std::max( *xmax, std::max(xa, xb) );
+    }
+}
+
+static double
+getSignedArea(const Point& p0,
+              const Point& p1,
+              const Point& p2)
+{
+    return ( (p1.x - p0.x) * (p2.y - p0.y) - (p2.x - p0.x) * (p1.y - p0.y) ) * 0.5;
+}
+
+struct ImageBandArgs
+{
+    unsigned char* pixels;
+    RectI roi;
+    int rowElements;
+    double color[3];
+    double opacity;
+    bool inverted;
+};
+
+template <typename PIX, int maxValue, int dstNComps>
+static void
+writeImageBand(const ImageBandArgs& args,
+               const RectI& band,
+               const float* coverage)
+{
+    const float r = (float)(args.color[0] * args.opacity);
+    const float g = (float)(args.color[1] * args.opacity);
+    const float b = (float)(args.color[2] * args.opacity);
+    const float a = (float)args.opacity;
+    // Round to the nearest integer value, as the floating point coverage is not quantized to 8 bits as cairo's
+    const float rounding = (maxValue == 1) ? 0.f : 0.5f;
+    const int width = band.width();
+
+    for (int y = band.y1; y < band.y2; ++y, coverage += width) {
+        PIX* dstPix = (PIX*)args.pixels + (std::size_t)(y - args.roi.y1) * args.rowElements + (band.x1 - args.roi.x1) * dstNComps;
+
+        for (int x = 0; x < width; ++x, dstPix += dstNComps) {
+            float value = args.inverted ? 1.f - coverage[x] : coverage[x];
+            value *= maxValue;
+            switch (dstNComps) {
+            case 4:
+                dstPix[0] = PIX(value * r + rounding);
+                dstPix[1] = PIX(value * g + rounding);
+                dstPix[2] = PIX(value * b + rounding);
+                dstPix[3] = PIX(value * a + rounding);
+                break;
+            case 1:
+                dstPix[0] = PIX(value * a + rounding);
+                break;
+            case 3:
+                dstPix[0] = PIX(value * r + rounding);
+                dstPix[1] = PIX(value * g + rounding);
+                dstPix[2] = PIX(value * b + rounding);
+                break;
+            case 2:
+                dstPix[0] = PIX(value * r + rounding);
+                dstPix[1] = PIX(value * g + rounding);
+                break;
+            default:
+                break;
+            }
+        }
+    }
+}
+
+template <typename PIX, int maxValue>
+static boost::function2<void, const RectI&, const float*>
+getImageBandWriter(int nComps,
+                   const ImageBandArgs& args)
+{
+    switch (nComps) {
+    case 1:
+
+        return boost::bind(&writeImageBand<PIX, maxValue, 1>, boost::cref(args), _1, _2);
+    case 2:
+
+        return boost::bind(&writeImageBand<PIX, maxValue, 2>, boost::cref(args), _1, _2);
+    case 3:
+
+        return boost::bind(&writeImageBand<PIX, maxValue, 3>, boost::cref(args), _1, _2);
+    case 4:
+
+        return boost::bind(&writeImageBand<PIX, maxValue, 4>, boost::cref(args), _1, _2);
+    default:
+        break;
+    }
+
+    return boost::function2<void, const RectI&, const float*>();
+}
+
+static boost::function2<void, const RectI&, const float*>
+getImageWriter(const Image* image,
+               const ImageBandArgs& args)
+{
+    int nComps = (int)image->getComponentsCount();
+
+    switch ( image->getBitDepth() ) {
+    case eImageBitDepthFloat:
+
+        return getImageBandWriter<float, 1>(nComps, args);
+    case eImageBitDepthByte:
+
+        return getImageBandWriter<unsigned char, 255>(nComps, args);
+    case eImageBitDepthShort:
+
+        return getImageBandWriter<unsigned short, 65535>(nComps, args);
+    case eImageBitDepthHalf:
+    case eImageBitDepthNone:
+        assert(false);
+        break;
+    }
+
+    return boost::function2<void, const RectI&, const float*>();
+}
+
+static void
+writeCoverageBand(float* dst,
+                  const RectI& roi,
+                  const RectI& band,
+                  const float* coverage)
+{
+    for (int y = band.y1; y < band.y2; ++y, coverage += band.width()) {
+        std::memcpy( dst + (std::size_t)(y - roi.y1) * roi.width() + (band.x1 - roi.x1), coverage, band.width() * sizeof(float) );
+    }
+}
+
+// The opacity of cairo's radial gradients is linear between the color stops, and padded
+static double
+getOpacityAt(const std::vector<std::pair<double, double> >& opacityStops,
+             double t)
+{
+    if ( t <= opacityStops.front().first ) {
+        return opacityStops.front().second;
+    }
+    for (std::size_t i = 1; i < opacityStops.size(); ++i) {
+        if (t < opacityStops[i].first) {
+            const std::pair<double, double>& a = opacityStops[i - 1];
+            const std::pair<double, double>& b = opacityStops[i];
+
+            return a.second + (b.second - a.second) * (t - a.first) / (b.first - a.first);
+        }
+    }
+
+    return opacityStops.back().second;
+}
+
+// The gradient of a dot goes from the internal radius, which is innerRatio times the external radius, to the external
+// radius. The table is indexed by the squared distance to the center divided by the squared external radius.
+static void
+computeDotLut(double innerRatio,
+              const std::vector<std::pair<double, double> >& opacityStops,
+              double opacity,
+              std::vector<float>* lut)
+{
+    lut->resize(NATRON_ROTO_DOT_LUT_SIZE + 1);
+    for (int i = 0; i <= NATRON_ROTO_DOT_LUT_SIZE; ++i) {
+        if ( opacityStops.empty() ) {
+            (*lut)[i] = (float)opacity;
+            continue;
+        }
+        // The distance at the middle of the interval of squared distances
+        double r = std::sqrt( (i + 0.5) / NATRON_ROTO_DOT_LUT_SIZE );
+        double t;
+        if (innerRatio < 1.) {
+            t = (r - innerRatio) / (1. - innerRatio);
+        } else {
+            t = r < 1. ? 0. : 1.;
+        }
+        (*lut)[i] = (float)getOpacityAt(opacityStops, t);
+    }
+}
+} // anon namespace
+
+RotoRasterizer::RotoRasterizer()
+    : _triangles()
+    , _shapes()
+{
+}
+
+RotoRasterizer::~RotoRasterizer()
+{
+}
+
+void
+RotoRasterizer::beginShape(double fallOff)
+{
+    _shapes.push_back( Shape() );
+    computeFallOffLut(fallOff, &_shapes.back().fallOffLut);
+}
+
+void
+RotoRasterizer::addTriangle(const Point& p0,
+                            const Point& p1,
+                            const Point& p2)
+{
+    if ( _shapes.empty() ) {
+        beginShape(1.);
+    }
+
+    // Degenerated triangles cover nothing
+    double area = getSignedArea(p0, p1, p2);
+    if (area == 0.) {
+        return;
+    }
+
+    // Orient all triangles the same way, so that the edges shared by two triangles cancel out
+    if (area > 0.) {
+        addEdge(p0, p1);
+        addEdge(p1, p2);
+        addEdge(p2, p0);
+    } else {
+        addEdge(p0, p2);
+        addEdge(p2, p1);
+        addEdge(p1, p0);
+    }
+}
+
+void
+RotoRasterizer::addEdge(const Point& p0,
+                        const Point& p1)
+{
+    std::pair<double, double> a(p0.x, p0.y);
+    std::pair<double, double> b(p1.x, p1.y);
+    std::map<EdgeKey, int>& edges = _shapes.back().edges;
+    std::map<EdgeKey, int>::iterator it;
+
+    if (a < b) {
+        it = edges.insert( std::make_pair(EdgeKey(a, b), 0) ).first;
+        ++it->second;
+    } else {
+        it = edges.insert( std::make_pair(EdgeKey(b, a), 0) ).first;
+        --it->second;
+    }
+    if (it->second == 0) {
+        edges.erase(it);
+    }
+}
+
+void
+RotoRasterizer::addFeatherTriangle(const Point& p0,
+                                   bool isInner0,
+                                   const Point& p1,
+                                   bool isInner1,
+                                   const Point& p2,
+                                   bool isInner2)
+{
+    if ( _shapes.empty() ) {
+        beginShape(1.);
+    }
+
+    // Degenerated triangles, such as the feather of a shape without feather distance, cover nothing
+    if (getSignedArea(p0, p1, p2) == 0.) {
+        return;
+    }
+
+    Triangle t;
+    t.p[0] = p0;
+    t.s[0] = isInner0 ? 0. : 1.;
+    t.p[1] = p1;
+    t.s[1] = isInner1 ? 0. : 1.;
+    t.p[2] = p2;
+    t.s[2] = isInner2 ? 0. : 1.;
+    t.shape = (int)_shapes.size() - 1;
+    _triangles.push_back(t);
+}
+
+void
+RotoRasterizer::renderCoverage(const RectI& roi,
+                               float* coverage) const
+{
+    renderBands( roi, boost::bind(&writeCoverageBand, coverage, roi, _1, _2) );
+}
+
+void
+RotoRasterizer::render(const RectI& roi,
+                       const double shapeColor[3],
+                       double opacity,
+                       bool inverted,
+                       Image* image) const
+{
+    assert( image->getBounds().contains(roi) );
+    Image::WriteAccess acc = image->getWriteRights();
+    ImageBandArgs args;
+    args.pixels = acc.pixelAt(roi.x1, roi.y1);
+    assert(args.pixels);
+    if (!args.pixels) {
+        return;
+    }
+    args.roi = roi;
+    args.rowElements = (int)image->getRowElements();
+    args.color[0] = shapeColor[0];
+    args.color[1] = shapeColor[1];
+    args.color[2] = shapeColor[2];
+    args.opacity = opacity;
+    args.inverted = inverted;
+
+    BandWriter writer = getImageWriter(image, args);
+    if (writer) {
+        renderBands(roi, writer);
+    }
+} // RotoRasterizer::render
+
+void
+RotoRasterizer::renderBands(const RectI& roi,
+                            const BandWriter& writer) const
+{
+    if ( roi.isNull() ) {
+        return;
+    }
+
+    std::vector<Edge> edges;
+    for (std::size_t i = 0; i < _shapes.size(); ++i) {
+        for (std::map<EdgeKey, int>::const_iterator it = _shapes[i].edges.begin(); it != _shapes[i].edges.end(); ++it) {
+            Edge e;
+            e.p[0].x = it->first.first.first;
+            e.p[0].y = it->first.first.second;
+            e.p[1].x = it->first.second.first;
+            e.p[1].y = it->first.second.second;
+            e.winding = it->second;
+            e.shape = (int)i;
+            edges.push_back(e);
+        }
+    }
+
+    int nBands = (roi.height() + NATRON_ROTO_RASTER_BAND_HEIGHT - 1) / NATRON_ROTO_RASTER_BAND_HEIGHT;
+    std::vector<Band> bands(nBands);
+    for (int i = 0; i < nBands; ++i) {
+        int y1 = roi.y1 + i * NATRON_ROTO_RASTER_BAND_HEIGHT;
+        bands[i].rect = RectI( roi.x1, y1, roi.x2, std::min(y1 + NATRON_ROTO_RASTER_BAND_HEIGHT, roi.y2) );
+    }
+
+    // Bin the feather triangles and the edges, keeping them in order so that the shapes are composited in order
+    for (std::size_t i = 0; i < _triangles.size(); ++i) {
+        RectI bounds;
+        if ( !getTriangleBounds(_triangles[i].p).intersect(roi, &bounds) ) {
+            continue;
+        }
+        int b1 = (bounds.y1 - roi.y1) / NATRON_ROTO_RASTER_BAND_HEIGHT;
+        int b2 = (bounds.y2 - 1 - roi.y1) / NATRON_ROTO_RASTER_BAND_HEIGHT;
+        for (int b = b1; b <= b2; ++b) {
+            bands[b].triangles.push_back( (int)i );
+        }
+    }
+    for (std::size_t i = 0; i < edges.size(); ++i) {
+        // An edge covers the pixels on its right, up to the next edge: the edges on the left of the region cover it too
+        const Edge& e = edges[i];
+        int y1 = std::max( roi.y1, (int)std::floor( std::min(e.p[0].y, e.p[1].y) ) );
+        int y2 = std::min( roi.y2, (int)std::ceil( std::max(e.p[0].y, e.p[1].y) ) );
+        if ( (y1 >= y2) || (e.p[0].y == e.p[1].y) || (std::min(e.p[0].x, e.p[1].x) >= roi.x2) ) {
+            continue;
+        }
+        int b1 = (y1 - roi.y1) / NATRON_ROTO_RASTER_BAND_HEIGHT;
+        int b2 = (y2 - 1 - roi.y1) / NATRON_ROTO_RASTER_BAND_HEIGHT;
+        for (int b = b1; b <= b2; ++b) {
+            bands[b].edges.push_back( (int)i );
+        }
+    }
+
+    if (nBands == 1) {
+        renderBand(&bands, &edges, &writer, 0);
+    } else {
+        TaskScheduler::parallelFor( nBands, boost::bind(&RotoRasterizer::renderBand, this, &bands, &edges, &writer, _1) );
+    }
+} // RotoRasterizer::renderBands
+
+void
+RotoRasterizer::renderBand(const std::vector<Band>* bands,
+                           const std::vector<Edge>* edges,
+                           const BandWriter* writer,
+                           int index) const
+{
+    const Band& band = (*bands)[index];
+    const RectI& rect = band.rect;
+    const int width = rect.width();
+    const int height = rect.height();
+    const int stride = width + 2;
+    std::vector<float> coverage(width * height, 0.f);
+
+    if ( !band.triangles.empty() || !band.edges.empty() ) {
+        // The accumulation buffers are allocated when needed, and left zeroed after each use
+        std::vector<float> shapeCoverage;
+        std::vector<float> opaqueAcc;
+        std::vector<float> featherAcc;
+        bool isFirstShape = true;
+
+        std::size_t t = 0;
+        std::size_t e = 0;
+        while ( t < band.triangles.size() || e < band.edges.size() ) {
+            // The next shape on the band
+            int shape = (int)_shapes.size();
+            if ( t < band.triangles.size() ) {
+                shape = _triangles[band.triangles[t]].shape;
+            }
+            if ( e < band.edges.size() ) {
+                shape = std::min( shape, (*edges)[band.edges[e]].shape );
+            }
+            const std::vector<float>& lut = _shapes[shape].fallOffLut;
+
+            // The first shape is rendered directly into the coverage of the band
+            float* shapeDst;
+            if (isFirstShape) {
+                shapeDst = &coverage[0];
+            } else {
+                shapeCoverage.assign(width * height, 0.f);
+                shapeDst = &shapeCoverage[0];
+            }
+
+            // The opacity of a feather triangle varies: accumulate its coverage alone, on its bounds
+            for (; t < band.triangles.size() && _triangles[band.triangles[t]].shape == shape; ++t) {
+                const Triangle& tri = _triangles[band.triangles[t]];
+                RectI region;
+                if ( !getTriangleBounds(tri.p).intersect(rect, &region) ) {
+                    continue;
+                }
+                const Point* p = tri.p;
+                double det = (p[1].x - p[0].x) * (p[2].y - p[0].y) - (p[2].x - p[0].x) * (p[1].y - p[0].y);
+                double dsdx = ( (tri.s[1] - tri.s[0]) * (p[2].y - p[0].y) - (tri.s[2] - tri.s[0]) * (p[1].y - p[0].y) ) / det;
+                double dsdy = ( (p[1].x - p[0].x) * (tri.s[2] - tri.s[0]) - (p[2].x - p[0].x) * (tri.s[1] - tri.s[0]) ) / det;
+
+                if ( featherAcc.empty() ) {
+                    featherAcc.resize(stride * height, 0.f);
+                }
+                const int regionWidth = region.width();
+                const int regionStride = regionWidth + 2;
+                for (int i = 0; i < 3; ++i) {
+                    const Point& a = p[i];
+                    const Point& b = p[(i + 1) % 3];
+                    accumulateLine(a.x - region.x1, a.y - region.y1, b.x - region.x1, b.y - region.y1, 1., regionWidth, region.height(), regionStride, &featherAcc[0]);
+                }
+                for (int y = region.y1; y < region.y2; ++y) {
+                    // The values of the row are 0 outside of the span of the triangle on the row, which may be
+                    // much narrower than its bounds
+                    double spanMin, spanMax;
+                    getTriangleSpan(p, y, y + 1, &spanMin, &spanMax);
+                    int x1 = std::max( 0, (int)std::floor(spanMin) - region.x1 );
+                    int x2 = std::min( regionWidth + 2, (int)std::ceil(spanMax) + 2 - region.x1 );
+                    float* acc = &featherAcc[(y - region.y1) * regionStride];
+                    float* dst = shapeDst + (y - rect.y1) * width + (region.x1 - rect.x1);
+                    double s = tri.s[0] + dsdx * (region.x1 + x1 + 0.5 - p[0].x) + dsdy * (y + 0.5 - p[0].y);
+                    float sum = 0.f;
+                    for (int x = x1; x < x2; ++x, s += dsdx) {
+                        sum += acc[x];
+                        acc[x] = 0.f;
+                        float c = std::min( 1.f, std::fabs(sum) );
+                        if ( (c > NATRON_ROTO_MIN_COVERAGE) && (x < regionWidth) ) {
+                            dst[x] += c * fallOffAt(lut, s);
+                        }
+                    }
+                }
+            }
+
+            // The opaque triangles are only their outline
+            bool hasOpaqueEdges = false;
+            for (; e < band.edges.size() && (*edges)[band.edges[e]].shape == shape; ++e) {
+                if ( opaqueAcc.empty() ) {
+                    opaqueAcc.resize(stride * height, 0.f);
+                }
+                const Edge& edge = (*edges)[band.edges[e]];
+                accumulateLine(edge.p[0].x - rect.x1, edge.p[0].y - rect.y1, edge.p[1].x - rect.x1, edge.p[1].y - rect.y1, edge.winding, width, height, stride, &opaqueAcc[0]);
+                hasOpaqueEdges = true;
+            }
+            if (hasOpaqueEdges) {
+                for (int y = 0; y < height; ++y) {
+                    float* acc = &opaqueAcc[y * stride];
+                    float* dst = shapeDst + y * width;
+                    float sum = 0.f;
+                    for (int x = 0; x < width; ++x) {
+                        sum += acc[x];
+                        acc[x] = 0.f;
+                        float c = std::fabs(sum);
+                        if (c < NATRON_ROTO_MIN_COVERAGE) {
+                            c = 0.f;
+                        }
+                        dst[x] = std::min(1.f, dst[x] + c);
+                    }
+                    acc[width] = 0.f;
+                    acc[width + 1] = 0.f;
+                }
+            }
+
+            if (!isFirstShape) {
+                // Composite the shape over the previous ones
+                for (std::size_t i = 0; i < coverage.size(); ++i) {
+                    float c = std::min(1.f, shapeCoverage[i]);
+                    coverage[i] = c + coverage[i] * (1.f - c);
+                }
+            } else if (!hasOpaqueEdges) {
+                // The feather triangles may overlap
+                for (std::size_t i = 0; i < coverage.size(); ++i) {
+                    coverage[i] = std::min(1.f, coverage[i]);
+                }
+            }
+            isFirstShape = false;
+        }
+    }
+
+    (*writer)(rect, &coverage[0]);
+} // RotoRasterizer::renderBand
+
+RotoStrokeRasterizer::RotoStrokeRasterizer(bool doBuildUp)
+    : _doBuildUp(doBuildUp)
+    , _dots()
+    , _kernels()
+    , _pressureKernels()
+{
+}
+
+RotoStrokeRasterizer::~RotoStrokeRasterizer()
+{
+}
+
+void
+RotoStrokeRasterizer::addDot(const Point& center,
+                             double internalDotRadius,
+                             double externalDotRadius,
+                             double pressure,
+                             const std::vector<std::pair<double, double> >& opacityStops,
+                             double opacity)
+{
+    if (externalDotRadius <= 0.) {
+        return;
+    }
+
+    // The dots of a pressure level have the same kernel, as the patterns of RotoContextPrivate::renderDot()
+    // sometimes, Qt gives a pressure level > 1... so we clamp it
+    int pressureInt = int(std::max( 0., std::min(pressure, 1.) ) * (ROTO_PRESSURE_LEVELS - 1) + 0.5);
+    std::map<int, int>::iterator found = _pressureKernels.find(pressureInt);
+    if ( found == _pressureKernels.end() ) {
+        _kernels.push_back( std::vector<float>() );
+        computeDotLut(internalDotRadius / externalDotRadius, opacityStops, opacity, &_kernels.back());
+        found = _pressureKernels.insert( std::make_pair(pressureInt, (int)_kernels.size() - 1) ).first;
+    }
+
+    Dot dot;
+    dot.center = center;
+    dot.radius = externalDotRadius;
+    dot.kernel = found->second;
+    _dots.push_back(dot);
+}
+
+void
+RotoStrokeRasterizer::renderCoverage(const RectI& roi,
+                                     float* coverage) const
+{
+    renderBands( roi, boost::bind(&writeCoverageBand, coverage, roi, _1, _2) );
+}
+
+void
+RotoStrokeRasterizer::render(const RectI& roi,
+                             const double shapeColor[3],
+                             double opacity,
+                             bool inverted,
+                             Image* image) const
+{
+    assert( image->getBounds().contains(roi) );
+    Image::WriteAccess acc = image->getWriteRights();
+    ImageBandArgs args;
+    args.pixels = acc.pixelAt(roi.x1, roi.y1);
+    assert(args.pixels);
+    if (!args.pixels) {
+        return;
+    }
+    args.roi = roi;
+    args.rowElements = (int)image->getRowElements();
+    args.color[0] = shapeColor[0];
+    args.color[1] = shapeColor[1];
+    args.color[2] = shapeColor[2];
+    args.opacity = opacity;
+    args.inverted = inverted;
+
+    BandWriter writer = getImageWriter(image, args);
+    if (writer) {
+        renderBands(roi, writer);
+    }
+}
+
+void
+RotoStrokeRasterizer::renderBands(const RectI& roi,
+                                  const BandWriter& writer) const
+{
+    if ( roi.isNull() ) {
+        return;
+    }
+
+    // Bin the dots, keeping them in order
+    int nBands = (roi.height() + NATRON_ROTO_RASTER_BAND_HEIGHT - 1) / NATRON_ROTO_RASTER_BAND_HEIGHT;
+    std::vector<std::vector<int> > bands(nBands);
+    for (std::size_t i = 0; i < _dots.size(); ++i) {
+        const Dot& dot = _dots[i];
+        int y1 = std::max( roi.y1, (int)std::floor(dot.center.y - dot.radius) );
+        int y2 = std::min( roi.y2, (int)std::ceil(dot.center.y + dot.radius) );
+        if ( (y1 >= y2) || (dot.center.x + dot.radius <= roi.x1) || (dot.center.x - dot.radius >= roi.x2) ) {
+            continue;
+        }
+        int b1 = (y1 - roi.y1) / NATRON_ROTO_RASTER_BAND_HEIGHT;
+        int b2 = (y2 - 1 - roi.y1) / NATRON_ROTO_RASTER_BAND_HEIGHT;
+        for (int b = b1; b <= b2; ++b) {
+            bands[b].push_back( (int)i );
+        }
+    }
+
+    if (nBands == 1) {
+        renderBand(&roi, &bands, &writer, 0);
+    } else {
+        TaskScheduler::parallelFor( nBands, boost::bind(&RotoStrokeRasterizer::renderBand, this, &roi, &bands, &writer, _1) );
+    }
+}
+
+void
+RotoStrokeRasterizer::renderBand(const RectI* roi,
+                                 const std::vector<std::vector<int> >* bands,
+                                 const BandWriter* writer,
+                                 int index) const
+{
+    const std::vector<int>& dots = (*bands)[index];
+    const int bandY1 = roi->y1 + index * NATRON_ROTO_RASTER_BAND_HEIGHT;
+    const RectI rect( roi->x1, bandY1, roi->x2, std::min(bandY1 + NATRON_ROTO_RASTER_BAND_HEIGHT, roi->y2) );
+    const int width = rect.width();
+    std::vector<float> coverage(width * rect.height(), 0.f);
+    std::vector<float> dotRow(width);
+
+    for (std::size_t i = 0; i < dots.size(); ++i) {
+        const Dot& dot = _dots[dots[i]];
+        const float* lut = &_kernels[dot.kernel][0];
+        const double radius2 = dot.radius * dot.radius;
+        // The squared distances are scaled to the indexes of the table: the pixels outside of the dot are past its end
+        const float scale = (float)(NATRON_ROTO_DOT_LUT_SIZE / radius2);
+        int y1 = std::max( rect.y1, (int)std::floor(dot.center.y - dot.radius) );
+        int y2 = std::min( rect.y2, (int)std::ceil(dot.center.y + dot.radius) );
+
+        for (int y = y1; y < y2; ++y) {
+            double dy = y + 0.5 - dot.center.y;
+            double halfWidth2 = radius2 - dy * dy;
+            if (halfWidth2 <= 0.) {
+                continue;
+            }
+            double halfWidth = std::sqrt(halfWidth2);
+            int x1 = std::max( rect.x1, (int)std::floor(dot.center.x - halfWidth) );
+            int x2 = std::min( rect.x2, (int)std::ceil(dot.center.x + halfWidth) );
+            const int n = x2 - x1;
+            if (n <= 0) {
+                continue;
+            }
+
+            const float dx0 = (float)(x1 + 0.5 - dot.center.x);
+            const float dy2 = (float)(dy * dy) * scale;
+            for (int x = 0; x < n; ++x) {
+                float dx = dx0 + (float)x;
+                float d2 = dx * dx * scale + dy2;
+                dotRow[x] = d2 < (float)NATRON_ROTO_DOT_LUT_SIZE ? lut[(int)d2] : 0.f;
+            }
+
+            float* dst = &coverage[(y - rect.y1) * width + (x1 - rect.x1)];
+            const float* src = &dotRow[0];
+            if (_doBuildUp) {
+                for (int x = 0; x < n; ++x) {
+                    dst[x] = src[x] + dst[x] * (1.f - src[x]);
+                }
+            } else {
+                for (int x = 0; x < n; ++x) {
+                    dst[x] = std::max(dst[x], src[x]);
+                }
+            }
+        }
+    }
+
+    (*writer)(rect, &coverage[0]);
+} // RotoStrokeRasterizer::renderBand
+
+NATRON_NAMESPACE_EXIT
@@ -0,0 +1,239 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * Copyright (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+#ifndef NATRON_ENGINE_ROTORASTERIZER_H
+#define NATRON_ENGINE_ROTORASTERIZER_H
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include <cstddef>
+#include <map>
+#include <utility>
+#include <vector>
+
+#if !defined(Q_MOC_RUN) && !defined(SBK_RUN)
+#include <boost/function.hpp>
+#endif
+
+#include "Global/GlobalDefines.h"
+#include "Engine/RectI.h"
+#include "Engine/EngineFwd.h"
+
+// The height of the bands rendered in parallel
+#define NATRON_ROTO_RASTER_BAND_HEIGHT 32
+
+NATRON_NAMESPACE_ENTER
+
+/**
+ * @brief Renders the triangles of roto shapes, as computed by RotoContextPrivate::computeTriangles(), directly into a
+ * Natron image, without going through a cairo surface.
+ * The coverage of each pixel by a triangle is computed analytically, by accumulating the signed area of its edges
+ * along each row, so that the edges shared by two triangles leave no seam. The internal triangles of a shape are
+ * opaque: the edges they share cancel out when they are added, and only the outline of the shape is rasterized.
+ * The opacity of the feather triangles goes from 1 on their inner vertices to 0 on their outer vertices, with the
+ * same fall-off as the cairo mesh patterns.
+ * Each shape is composited over the previous ones. The motion blur samples of a shape are shapes too, as with
+ * cairo.
+ * The region to render is split into bands of NATRON_ROTO_RASTER_BAND_HEIGHT rows that are rendered in parallel
+ * by the TaskScheduler.
+ **/
+class RotoRasterizer
+{
+public:
+
+    RotoRasterizer();
+
+    ~RotoRasterizer();
+
+    /**
+     * @brief Starts a new shape, composited over the previous ones. The triangles added afterwards belong to it.
+     **/
+    void beginShape(double fallOff);
+
+    /**
+     * @brief Adds an opaque triangle to the current shape. The coordinates are in pixels.
+     **/
+    void addTriangle(const Point& p0, const Point& p1, const Point& p2);
+
+    /**
+     * @brief Adds a triangle of the feather of the current shape: it is opaque on its inner vertices and transparent
+     * on the other ones.
+     **/
+    void addFeatherTriangle(const Point& p0, bool isInner0,
+                            const Point& p1, bool isInner1,
+                            const Point& p2, bool isInner2);
+
+    /**
+     * @brief Writes the coverage of the shapes on roi into coverage, which has roi.width() * roi.height() values,
+     * starting with the bottom row.
+     **/
+    void renderCoverage(const RectI& roi, float* coverage) const;
+
+    /**
+     * @brief Writes the shapes on roi into image as renderMaskInternal does with a cairo surface: each component
+     * is the coverage, possibly inverted, times the shape color and the opacity, and the alpha is the coverage times
+     * the opacity. The image must be float, short or byte and contain roi.
+     **/
+    void render(const RectI& roi,
+                const double shapeColor[3],
+                double opacity,
+                bool inverted,
+                Image* image) const;
+
+private:
+
+    struct Triangle
+    {
+        Point p[3];
+
+        // The feather parameter at each vertex: 0 on the inner vertices, 1 on the outer ones
+        double s[3];
+        int shape;
+    };
+
+    // An edge of the opaque triangles, from its lowest point in lexicographic order to the other
+    typedef std::pair<std::pair<double, double>, std::pair<double, double> > EdgeKey;
+
+    struct Edge
+    {
+        Point p[2];
+
+        // The number of times the edge was added from p[0] to p[1], minus the number of times it was added backwards
+        int winding;
+        int shape;
+    };
+
+    struct Shape
+    {
+        // Maps the feather parameter to the opacity, on NATRON_ROTO_FALLOFF_LUT_SIZE + 1 values
+        std::vector<float> fallOffLut;
+
+        // The winding of each edge of the opaque triangles
+        std::map<EdgeKey, int> edges;
+    };
+
+    struct Band
+    {
+        RectI rect;
+
+        // The indexes of the feather triangles and of the opaque edges that are on the band, in order
+        std::vector<int> triangles;
+        std::vector<int> edges;
+    };
+
+    // Writes the coverage of a band, which has band.width() values per row, to the output
+    typedef boost::function2<void, const RectI&, const float*> BandWriter;
+
+    void addEdge(const Point& p0, const Point& p1);
+
+    void renderBands(const RectI& roi, const BandWriter& writer) const;
+
+    void renderBand(const std::vector<Band>* bands,
+                    const std::vector<Edge>* edges,
+                    const BandWriter* writer,
+                    int index) const;
+
+    std::vector<Triangle> _triangles;
+    std::vector<Shape> _shapes;
+};
+
+/**
+ * @brief Renders the dots of paint strokes, as computed by RotoContextPrivate::renderStroke(), directly into a Natron
+ * image, without going through a cairo surface.
+ * The opacity of a dot only depends on the distance to its center: it is read from a table of the squared distance,
+ * computed once per pressure level from the opacity stops of the radial gradient that cairo would use. Each dot is
+ * composited over the previous ones (build-up) or with their maximum (cairo's LIGHTEN operator), row by row, in
+ * loops without branches that the compiler vectorizes.
+ * The region to render is split into bands of NATRON_ROTO_RASTER_BAND_HEIGHT rows that are rendered in parallel
+ * by the TaskScheduler.
+ **/
+class RotoStrokeRasterizer
+{
+public:
+
+    explicit RotoStrokeRasterizer(bool doBuildUp);
+
+    ~RotoStrokeRasterizer();
+
+    /**
+     * @brief Adds a dot, with the same parameters as RotoContextPrivate::renderDot(). The coordinates are in pixels.
+     * The opacity is only used if there are no opacity stops.
+     **/
+    void addDot(const Point& center,
+                double internalDotRadius,
+                double externalDotRadius,
+                double pressure,
+                const std::vector<std::pair<double, double> >& opacityStops,
+                double opacity);
+
+    /**
+     * @brief Writes the coverage of the dots on roi into coverage, which has roi.width() * roi.height() values,
+     * starting with the bottom row.
+     **/
+    void renderCoverage(const RectI& roi, float* coverage) const;
+
+    /**
+     * @brief Writes the dots on roi into image as renderMaskInternal does with a cairo surface: each component is the
+     * coverage, possibly inverted, times the shape color and the opacity, and the alpha is the coverage times the
+     * opacity. The opacity of a stroke is already in its dots. The image must be float, short or byte and contain roi.
+     **/
+    void render(const RectI& roi,
+                const double shapeColor[3],
+                double opacity,
+                bool inverted,
+                Image* image) const;
+
+private:
+
+    struct Dot
+    {
+        Point center;
+        double radius;
+
+        // The index of the opacity table of the dot
+        int kernel;
+    };
+
+    typedef boost::function2<void, const RectI&, const float*> BandWriter;
+
+    void renderBands(const RectI& roi, const BandWriter& writer) const;
+
+    void renderBand(const RectI* roi,
+                    const std::vector<std::vector<int> >* bands,
+                    const BandWriter* writer,
+                    int index) const;
+
+    bool _doBuildUp;
+    std::vector<Dot> _dots;
+
+    // Maps the squared distance to the center of a dot, divided by its squared radius, to its opacity
+    std::vector<std::vector<float> > _kernels;
+
+    // The index of the kernel of each pressure level
+    std::map<int, int> _pressureKernels;
+};
+
+NATRON_NAMESPACE_EXIT
+
+#endif // NATRON_ENGINE_ROTORASTERIZER_H
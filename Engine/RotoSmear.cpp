@@ -26,6 +26,7 @@
 
 #include <algorithm> // min, max
 #include <cassert>
+#include <cstring> // memcpy
 #include <stdexcept>
 
 #include <boost/algorithm/clamp.hpp>
@@ -140,71 +141,108 @@ RotoSmear::isIdentity(double time,
     return false;
 }
 
-static void
-renderSmearDot(const unsigned char* maskData,
-               const int maskStride,
-               const int maskWidth,
-               const int maskHeight,
-               const Point& prev,
-               const Point& next,
-               const double brushSizePixels,
-               int nComps,
-               const ImagePtr& outputImage)
+RotoSmearDotRenderer::RotoSmearDotRenderer(const unsigned char* maskData,
+                                           int maskStride,
+                                           int maskWidth,
+                                           int maskHeight,
+                                           int nComps)
+    : _maskWidth(maskWidth)
+    , _maskHeight(maskHeight)
+    , _nComps(nComps)
+    , _mask( (std::size_t)maskWidth * maskHeight * nComps )
+    , _src()
 {
-    /// First copy the portion of the image around the previous dot into tmpBuf
+    float* dst = _mask.empty() ? 0 : &_mask[0];
+
+    for (int y = 0; y < maskHeight; ++y, maskData += maskStride) {
+        for (int x = 0; x < maskWidth; ++x) {
+            float maskScale = Image::convertPixelDepth<unsigned char, float>(maskData[x]);
+            for (int k = 0; k < nComps; ++k, ++dst) {
+                *dst = maskScale;
+            }
+        }
+    }
+}
+
+RotoSmearDotRenderer::~RotoSmearDotRenderer()
+{
+}
+
+void
+RotoSmearDotRenderer::renderDot(const Point& prev,
+                                const Point& next,
+                                double brushSizePixels,
+                                double par,
+                                const RectI& bounds,
+                                std::size_t rowElements,
+                                float* pixels)
+{
+    /// First copy the portion of the image around the previous dot
     RectD prevDotRoD(prev.x - brushSizePixels / 2., prev.y - brushSizePixels / 2., prev.x + brushSizePixels / 2., prev.y + brushSizePixels / 2.);
     RectI prevDotBounds;
 
-    prevDotRoD.toPixelEnclosing(0, outputImage->getPixelAspectRatio(), &prevDotBounds);
-    ImagePtr tmpBuf( new Image(outputImage->getComponents(),
-                               prevDotRoD,
-                               prevDotBounds,
-                               0,
-                               outputImage->getPixelAspectRatio(),
-                               outputImage->getBitDepth(),
-                               outputImage->getPremultiplication(),
-                               outputImage->getFieldingOrder(),
-                               false) );
-    tmpBuf->pasteFrom(*outputImage, prevDotBounds, false);
-
-    Image::ReadAccess tmpAcc( tmpBuf.get() );
-    Image::WriteAccess wacc( outputImage.get() );
-    RectI nextDotBounds;
-    nextDotBounds.x1 = next.x - maskWidth / 2;
-    nextDotBounds.x2 = next.x + maskWidth / 2;
-    nextDotBounds.y1 = next.y - maskHeight / 2;
-    nextDotBounds.y2 = next.y + maskHeight / 2;
-
-    const unsigned char* mask_pixels = maskData;
-    int yPrev = prevDotBounds.y1;
-    for (int y = nextDotBounds.y1; y < nextDotBounds.y2;
-         ++y,
-         ++yPrev,
-         mask_pixels += maskStride) {
-        float* dstPixels = (float*)wacc.pixelAt(nextDotBounds.x1, y);
-        assert(dstPixels);
-        if (!dstPixels) {
-            continue;
+    prevDotRoD.toPixelEnclosing(0, par, &prevDotBounds);
+    const int prevWidth = prevDotBounds.width();
+    const int prevHeight = prevDotBounds.height();
+    if ( (prevWidth <= 0) || (prevHeight <= 0) ) {
+        return;
+    }
+    _src.assign( (std::size_t)prevWidth * prevHeight * _nComps, 0.f );
+    RectI srcRect;
+    if ( prevDotBounds.intersect(bounds, &srcRect) ) {
+        for (int y = srcRect.y1; y < srcRect.y2; ++y) {
+            std::memcpy( &_src[( (std::size_t)(y - prevDotBounds.y1) * prevWidth + (srcRect.x1 - prevDotBounds.x1) ) * _nComps],
+                         pixels + (std::size_t)(y - bounds.y1) * rowElements + (std::size_t)(srcRect.x1 - bounds.x1) * _nComps,
+                         srcRect.width() * _nComps * sizeof(float) );
         }
+    }
 
-        int xPrev = prevDotBounds.x1;
-        for (int x = nextDotBounds.x1; x < nextDotBounds.x2;
-             ++x, ++xPrev,
-             dstPixels += nComps) {
-            const float* srcPixels = (const float*)tmpAcc.pixelAt(xPrev, yPrev);
+    RectI nextDotBounds;
+    nextDotBounds.x1 = (int)(next.x - _maskWidth / 2);
+    nextDotBounds.x2 = (int)(next.x + _maskWidth / 2);
+    nextDotBounds.y1 = (int)(next.y - _maskHeight / 2);
+    nextDotBounds.y2 = (int)(next.y + _maskHeight / 2);
+
+    // Only the pixels of the image that have a source and a mask value are blended
+    const int x1 = std::max(nextDotBounds.x1, bounds.x1);
+    const int x2 = std::min( std::min(nextDotBounds.x2, bounds.x2), nextDotBounds.x1 + std::min(prevWidth, _maskWidth) );
+    const int y1 = std::max(nextDotBounds.y1, bounds.y1);
+    const int y2 = std::min( std::min(nextDotBounds.y2, bounds.y2), nextDotBounds.y1 + std::min(prevHeight, _maskHeight) );
+    if ( (x1 >= x2) || (y1 >= y2) ) {
+        return;
+    }
 
-            if (srcPixels) {
-                float mask_scale = Image::convertPixelDepth<unsigned char, float>(mask_pixels[x - nextDotBounds.x1]);
-                float one_minus_mask_scale = 1. - mask_scale;
+    const int n = (x2 - x1) * _nComps;
+    for (int y = y1; y < y2; ++y) {
+        const std::size_t row = y - nextDotBounds.y1;
+        const float* mask = &_mask[(row * _maskWidth + (x1 - nextDotBounds.x1)) * _nComps];
+        const float* src = &_src[(row * prevWidth + (x1 - nextDotBounds.x1)) * _nComps];
+        float* dst = pixels + (std::size_t)(y - bounds.y1) * rowElements + (std::size_t)(x1 - bounds.x1) * _nComps;
 
-                for (int k = 0; k < nComps; ++k) {
-                    dstPixels[k] = srcPixels[k] * mask_scale + dstPixels[k] * one_minus_mask_scale;
-                }
-            } else {
-            }
+        // All the components of the row at once
+        for (int i = 0; i < n; ++i) {
+            dst[i] = src[i] * mask[i] + dst[i] * (1.f - mask[i]);
         }
     }
-} // renderSmearDot
+} // RotoSmearDotRenderer::renderDot
+
+static void
+renderSmearDot(RotoSmearDotRenderer& dotRenderer,
+               const Point& prev,
+               const Point& next,
+               const double brushSizePixels,
+               const ImagePtr& outputImage)
+{
+    Image::WriteAccess wacc( outputImage.get() );
+    const RectI& bounds = outputImage->getBounds();
+    float* pixels = (float*)wacc.pixelAt(bounds.x1, bounds.y1);
+
+    assert(pixels);
+    if (!pixels) {
+        return;
+    }
+    dotRenderer.renderDot(prev, next, brushSizePixels, outputImage->getPixelAspectRatio(), bounds, outputImage->getRowElements(), pixels);
+}
 
 StatusEnum
 RotoSmear::render(const RenderActionArgs& args)
@@ -340,13 +378,13 @@ RotoSmear::render(const RenderActionArgs& args)
 
 
             std::list<std::pair<Point, double> >::iterator it = visiblePortion.begin();
-
+            RotoSmearDotRenderer dotRenderer(maskData, maskStride, maskWidth, maskHeight, nComps);
 
             if (isFirstStrokeTick || !duringPainting) {
                 // This is the very first dot we render
                 prev = *it;
                 ++it;
-                renderSmearDot(maskData, maskStride, maskWidth, maskHeight, prev.first, it->first, brushSizePixel, nComps, plane->second);
+                renderSmearDot(dotRenderer, prev.first, it->first, brushSizePixel, plane->second);
                 didPaint = true;
                 renderPoint = *it;
                 prev = renderPoint;
@@ -409,7 +447,7 @@ RotoSmear::render(const RenderActionArgs& args)
 
                 prevPoint.x = prev.first.x + vx * v.x;
                 prevPoint.y = prev.first.y + vy * v.y;
-                renderSmearDot(maskData, maskStride, maskWidth, maskHeight, prevPoint, renderPoint.first, brushSizePixel, nComps, plane->second);
+                renderSmearDot(dotRenderer, prevPoint, renderPoint.first, brushSizePixel, plane->second);
                 didPaint = true;
                 prev = renderPoint;
                 cur = renderPoint;
@@ -27,11 +27,16 @@
 
 #include "Global/Macros.h"
 
+#include <cstddef>
+#include <vector>
+
 #if !defined(Q_MOC_RUN) && !defined(SBK_RUN)
 #include <boost/scoped_ptr.hpp>
 #endif
 
+#include "Global/GlobalDefines.h"
 #include "Engine/EffectInstance.h"
+#include "Engine/RectI.h"
 #include "Engine/ViewIdx.h"
 #include "Engine/EngineFwd.h"
 
@@ -140,6 +145,54 @@ private:
     boost::scoped_ptr<RotoSmearPrivate> _imp;
 };
 
+/**
+ * @brief Renders the dots of a smear stroke: each dot copies the pixels around the previous position of the brush to
+ * the new position, blended with the mask of the brush.
+ * The mask is converted once to floating point, with a value per component, so that each row of a dot is blended in
+ * a single loop over all of its components. The pixels around the previous position are copied into a buffer that is
+ * reused by all the dots.
+ **/
+class RotoSmearDotRenderer
+{
+public:
+
+    /**
+     * @brief The mask is the 8-bit dot rendered by RotoContext::allocateAndRenderSingleDotStroke()
+     **/
+    RotoSmearDotRenderer(const unsigned char* maskData,
+                         int maskStride,
+                         int maskWidth,
+                         int maskHeight,
+                         int nComps);
+
+    ~RotoSmearDotRenderer();
+
+    /**
+     * @brief Smears a dot from prev to next on a float image with nComps components, whose pixels on bounds start at
+     * pixels, with rowElements values per row. The pixels around prev that are outside of bounds are black and
+     * transparent.
+     **/
+    void renderDot(const Point& prev,
+                   const Point& next,
+                   double brushSizePixels,
+                   double par,
+                   const RectI& bounds,
+                   std::size_t rowElements,
+                   float* pixels);
+
+private:
+
+    int _maskWidth;
+    int _maskHeight;
+    int _nComps;
+
+    // maskHeight rows of maskWidth * nComps values
+    std::vector<float> _mask;
+
+    // The pixels around the previous position of the brush
+    std::vector<float> _src;
+};
+
 NATRON_NAMESPACE_EXIT
 
 #endif // ROTOSMEAR_H
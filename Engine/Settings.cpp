@@ -48,11 +48,13 @@
 #include "Engine/LibraryBinary.h"
 #include "Engine/MemoryInfo.h" // getSystemTotalRAM, isApplication32Bits, printAsRAM
 #include "Engine/Node.h"
+#include "Engine/NumaTopology.h"
 #include "Engine/OSGLContext.h"
 #include "Engine/OutputSchedulerThread.h"
 #include "Engine/Plugin.h"
 #include "Engine/Project.h"
 #include "Engine/StandardPaths.h"
+#include "Engine/TaskScheduler.h"
 #include "Engine/Utils.h"
 #include "Engine/ViewIdx.h"
 #include "Engine/ViewerInstance.h"
@@ -293,6 +295,9 @@ Settings::initializeKnobsThreading()
     _numberOfParallelRenders->setHintToolTip( tr("Controls the number of parallel frame that will be rendered at the same time by the renderer."
                                                  "A value of 0 indicate that %1 should automatically determine "
                                                  "the best number of parallel renders to launch given your CPU activity. "
+                                                 "When rendering a sequence with a Write node, it is found by measuring the number of frames "
+                                                 "rendered per second, and the threads left to each frame are used by its nodes. "
+                                                 "The decisions are written in the render statistics. "
                                                  "Setting a value different than 0 should be done only if you know what you're doing and can lead "
                                                  "in some situations to worse performances. Overall to get the best performances you should have your "
                                                  "CPU at 100% activity without idle times.").arg( QString::fromUtf8(NATRON_APPLICATION_NAME) ) );
@@ -300,6 +305,28 @@ Settings::initializeKnobsThreading()
     _numberOfParallelRenders->setMinimum(0);
     _numberOfParallelRenders->disableSlider();
     _threadingPage->addKnob(_numberOfParallelRenders);
+
+    _writerReadAheadFrames = AppManager::createKnob<KnobInt>( this, tr("Frames read ahead by sequential writers") );
+    _writerReadAheadFrames->setName("writerReadAhead");
+    _writerReadAheadFrames->setHintToolTip( tr("Writers that encode the frames in order (e.g. video files) encode 1 frame at a time. "
+                                               "While a frame is encoded, the input of the writer is rendered for at most this number "
+                                               "of frames ahead, which are held in memory until they are encoded.\n"
+                                               "0: Render the writer and its input one frame after the other.") );
+    _writerReadAheadFrames->setMinimum(0);
+    _writerReadAheadFrames->setMaximum(64);
+    _writerReadAheadFrames->disableSlider();
+    _threadingPage->addKnob(_writerReadAheadFrames);
+
+    _numaRendering = AppManager::createKnob<KnobBool>( this, tr("Bind the renders to the NUMA nodes") );
+    _numaRendering->setName("numaRendering");
+    _numaRendering->setHintToolTip( tr("On machines with several processor sockets, binds each frame rendered in parallel, "
+                                       "the threads it uses and the images it allocates to one NUMA node, so that the images "
+                                       "are read from the memory of the socket that renders them. The cache returns the "
+                                       "images of the node of the render first.\n"
+                                       "This has no effect on machines with a single NUMA node. "
+                                       "The nodes may be simulated by setting the %1 environment variable to the CPU lists "
+                                       "of the nodes separated by semicolons, e.g. \"0-3;4-7\".").arg( QString::fromUtf8(NATRON_NUMA_NODES_ENV_VAR) ) );
+    _threadingPage->addKnob(_numaRendering);
 #endif
 
     _useThreadPool = AppManager::createKnob<KnobBool>( this, tr("Effects use the thread-pool") );
@@ -378,6 +405,14 @@ Settings::initializeKnobsRendering()
                                                                "transformations.").arg( QString::fromUtf8(NATRON_APPLICATION_NAME) ) );
     _activateTransformConcatenationSupport->setName("transformCatSupport");
     _renderingPage->addKnob(_activateTransformConcatenationSupport);
+
+    _nativeRotoRasterizer = AppManager::createKnob<KnobBool>( this, tr("Native roto rasterizer") );
+    _nativeRotoRasterizer->setHintToolTip( tr("When checked, the shapes and the strokes of the Roto and RotoPaint nodes are rendered directly "
+                                              "into the images by %1, in parallel, instead of going through cairo. "
+                                              "This is faster, but the edges of the shapes and strokes may differ slightly from the "
+                                              "renders of the previous versions.").arg( QString::fromUtf8(NATRON_APPLICATION_NAME) ) );
+    _nativeRotoRasterizer->setName("nativeRotoRasterizer");
+    _renderingPage->addKnob(_nativeRotoRasterizer);
 }
 
 void
@@ -1250,6 +1285,25 @@ Settings::initializeKnobsCaching()
     _unreachableRAMLabel->setAsLabel();
     _cachingTab->addKnob(_unreachableRAMLabel);
 
+    _cacheEvictionPolicy = AppManager::createKnob<KnobChoice>( this, tr("Cache eviction policy") );
+    _cacheEvictionPolicy->setName("cacheEvictionPolicy");
+    {
+        std::vector<ChoiceOption> policies;
+        policies.push_back(ChoiceOption("lru",
+                                        tr("Least recently used").toStdString(),
+                                        tr("When the cache is full, the image that was not used for the longest time is removed first.").toStdString() ));
+        policies.push_back(ChoiceOption("cost",
+                                        tr("Cost-aware").toStdString(),
+                                        tr("When the cache is full, among the images that were not used for the longest time, the one that is "
+                                           "the fastest to render again relative to the memory it uses is removed first (GreedyDual-Size). "
+                                           "Images that were expensive to render, such as the output of a Read node decoding a large file, "
+                                           "stay longer in the cache.").toStdString() ));
+        _cacheEvictionPolicy->populateChoices(policies);
+    }
+    _cacheEvictionPolicy->setHintToolTip( tr("How the images to remove from the cache are chosen when it is full."
+                                             " Hover each option with the mouse for a detailed description.") );
+    _cachingTab->addKnob(_cacheEvictionPolicy);
+
     _maxViewerDiskCacheGB = AppManager::createKnob<KnobInt>( this, tr("Maximum playback disk cache size (GiB)") );
     _maxViewerDiskCacheGB->setName("maxViewerDiskCache");
     _maxViewerDiskCacheGB->disableSlider();
@@ -1446,6 +1500,8 @@ Settings::setDefaultValues()
     _numberOfThreads->setDefaultValue(0, 0);
 #ifndef NATRON_PLAYBACK_USES_THREAD_POOL
     _numberOfParallelRenders->setDefaultValue(0, 0);
+    _writerReadAheadFrames->setDefaultValue(4);
+    _numaRendering->setDefaultValue(false);
 #endif
     _useThreadPool->setDefaultValue(true);
     _nThreadsPerEffect->setDefaultValue(0);
@@ -1457,6 +1513,7 @@ Settings::setDefaultValues()
     _pluginUseImageCopyForSource->setDefaultValue(false);
     _activateRGBSupport->setDefaultValue(true);
     _activateTransformConcatenationSupport->setDefaultValue(true);
+    _nativeRotoRasterizer->setDefaultValue(false);
 
     // General/GPU rendering
     //_openglRendererString
@@ -1501,6 +1558,7 @@ Settings::setDefaultValues()
     _aggressiveCaching->setDefaultValue(false);
     _maxRAMPercent->setDefaultValue(50, 0);
     _unreachableRAMPercent->setDefaultValue(5);
+    _cacheEvictionPolicy->setDefaultValue(eCacheEvictionPolicyLRU);
     _maxViewerDiskCacheGB->setDefaultValue(5, 0);
     _maxDiskCacheNodeGB->setDefaultValue(10, 0);
     //_diskCachePath
@@ -2123,6 +2181,7 @@ Settings::restoreSettings(bool useDefault)
         appPTR->setNThreadsPerEffect( getNumberOfThreadsPerEffect() );
         appPTR->setNThreadsToRender( getNumberOfThreads() );
         appPTR->setUseThreadPool( _useThreadPool->getValue() );
+        NumaTopology::setEnabled( isNumaRenderingEnabled() );
         appPTR->setPluginsUseInputImageCopyToRender( _pluginUseImageCopyForSource->getValue() );
     } catch (std::logic_error&) {
         // ignore
@@ -2255,6 +2314,10 @@ Settings::onKnobValueChanged(KnobI* k,
             appPTR->setApplicationsCachesMaximumMemoryPercent( getRamMaximumPercent() );
         }
         setCachingLabels();
+    } else if ( k == _cacheEvictionPolicy.get() ) {
+        if (!_restoringSettings) {
+            appPTR->setApplicationsCachesEvictionPolicy( getCacheEvictionPolicy() );
+        }
     } else if ( k == _diskCachePath.get() ) {
         QString path = QString::fromUtf8(_diskCachePath->getValue().c_str());
         qputenv(NATRON_DISK_CACHE_PATH_ENV_VAR, path.toUtf8());
@@ -2266,14 +2329,21 @@ Settings::onKnobValueChanged(KnobI* k,
         appPTR->setNThreadsToRender(nbThreads);
         if (nbThreads == -1) {
             QThreadPool::globalInstance()->setMaxThreadCount(1);
+            TaskScheduler::setThreadCount(1);
             appPTR->abortAnyProcessing();
         } else if (nbThreads == 0) {
             QThreadPool::globalInstance()->setMaxThreadCount( QThread::idealThreadCount() );
+            TaskScheduler::setThreadCount( QThread::idealThreadCount() );
         } else {
             QThreadPool::globalInstance()->setMaxThreadCount(nbThreads);
+            TaskScheduler::setThreadCount(nbThreads);
         }
     } else if ( k == _nThreadsPerEffect.get() ) {
         appPTR->setNThreadsPerEffect( getNumberOfThreadsPerEffect() );
+#ifndef NATRON_PLAYBACK_USES_THREAD_POOL
+    } else if ( k == _numaRendering.get() ) {
+        NumaTopology::setEnabled( isNumaRenderingEnabled() );
+#endif
     } else if ( k == _ocioConfigKnob.get() ) {
         if (_ocioConfigKnob->getActiveEntry().id == NATRON_CUSTOM_OCIO_CONFIG_NAME) {
             _customOcioConfigFile->setAllDimensionsEnabled(true);
@@ -2485,6 +2555,12 @@ Settings::getRamMaximumPercent() const
     return (double)_maxRAMPercent->getValue() / 100.;
 }
 
+CacheEvictionPolicyEnum
+Settings::getCacheEvictionPolicy() const
+{
+    return (CacheEvictionPolicyEnum)_cacheEvictionPolicy->getValue();
+}
+
 U64
 Settings::getMaximumViewerDiskCacheSize() const
 {
@@ -3058,6 +3134,30 @@ Settings::setNumberOfParallelRenders(int nb)
 #endif
 }
 
+bool
+Settings::isNumaRenderingEnabled() const
+{
+#ifndef NATRON_PLAYBACK_USES_THREAD_POOL
+
+    return _numaRendering->getValue();
+#else
+
+    return false;
+#endif
+}
+
+int
+Settings::getWriterReadAheadFrames() const
+{
+#ifndef NATRON_PLAYBACK_USES_THREAD_POOL
+
+    return _writerReadAheadFrames->getValue();
+#else
+
+    return 0;
+#endif
+}
+
 bool
 Settings::areRGBPixelComponentsSupported() const
 {
@@ -3070,6 +3170,12 @@ Settings::isTransformConcatenationEnabled() const
     return _activateTransformConcatenationSupport->getValue();
 }
 
+bool
+Settings::isNativeRotoRasterizerEnabled() const
+{
+    return _nativeRotoRasterizer->getValue();
+}
+
 bool
 Settings::useGlobalThreadPool() const
 {
@@ -106,6 +106,8 @@ public:
 
     double getRamMaximumPercent() const;
 
+    CacheEvictionPolicyEnum getCacheEvictionPolicy() const;
+
     U64 getMaximumViewerDiskCacheSize() const;
 
     U64 getMaximumDiskCacheNodeSize() const;
@@ -122,6 +124,10 @@ public:
 
     void setNumberOfParallelRenders(int nb);
 
+    int getWriterReadAheadFrames() const;
+
+    bool isNumaRenderingEnabled() const;
+
     int getNumberOfThreadsPerEffect() const;
 
     bool useGlobalThreadPool() const;
@@ -255,6 +261,8 @@ public:
 
     bool isTransformConcatenationEnabled() const;
 
+    bool isNativeRotoRasterizerEnabled() const;
+
     bool useInputAForMergeAutoConnect() const;
 
     /**
@@ -433,6 +441,8 @@ private:
     KnobPagePtr _threadingPage;
     KnobIntPtr _numberOfThreads;
     KnobIntPtr _numberOfParallelRenders;
+    KnobIntPtr _writerReadAheadFrames;
+    KnobBoolPtr _numaRendering;
     KnobBoolPtr _useThreadPool;
     KnobIntPtr _nThreadsPerEffect;
     KnobBoolPtr _renderInSeparateProcess;
@@ -444,6 +454,7 @@ private:
     KnobBoolPtr _pluginUseImageCopyForSource;
     KnobBoolPtr _activateRGBSupport;
     KnobBoolPtr _activateTransformConcatenationSupport;
+    KnobBoolPtr _nativeRotoRasterizer;
 
     // General/GPU rendering
     KnobPagePtr _gpuPage;
@@ -509,6 +520,9 @@ private:
     KnobIntPtr _unreachableRAMPercent;
     KnobStringPtr _unreachableRAMLabel;
 
+    ///How the entries to evict from the images caches are chosen, see CacheEvictionPolicyEnum
+    KnobChoicePtr _cacheEvictionPolicy;
+
     ///The total disk space allowed for all Natron's caches
     KnobIntPtr _maxViewerDiskCacheGB;
     KnobIntPtr _maxDiskCacheNodeGB;
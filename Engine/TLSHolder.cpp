@@ -26,7 +26,14 @@
 #include "TLSHolderImpl.h"
 
 #include <cassert>
+#include <list>
+#include <map>
 #include <stdexcept>
+#include <vector>
+
+#if !defined(Q_MOC_RUN) && !defined(SBK_RUN)
+#include <boost/make_shared.hpp>
+#endif
 
 #include "Engine/OfxClipInstance.h"
 #include "Engine/OfxHost.h"
@@ -34,18 +41,67 @@
 #include "Engine/Project.h"
 #include "Engine/ThreadPool.h"
 
+#include <QtCore/QMutex>
 #include <QtCore/QWaitCondition>
 #include <QtCore/QThread>
 #include <QtCore/QDebug>
 
 NATRON_NAMESPACE_ENTER
 
+// The TLS of the current thread
+static NATRON_THREAD_LOCAL TLSThreadData* currentThreadData = 0;
+
+NATRON_NAMESPACE_ANONYMOUS_ENTER
+
+typedef boost::shared_ptr<TLSThreadData> TLSThreadDataPtr;
+typedef std::map<const QThread*, TLSThreadDataPtr> TLSThreadDataMap;
+
+// The TLS of all threads and the slot indexes in use. It is not a member of AppTLS because the holders may be
+// destroyed after the AppManager.
+struct TLSRegistry
+{
+    QMutex lock;
+    TLSThreadDataMap threads;
+    std::vector<int> freeSlotIndexes;
+    int nSlotIndexes;
+
+    TLSRegistry()
+        : lock()
+        , threads()
+        , freeSlotIndexes()
+        , nSlotIndexes(0)
+    {
+    }
+
+    TLSThreadDataPtr getOrCreateThreadData(const QThread* thread)
+    {
+        // must be locked
+        TLSThreadDataPtr& ret = threads[thread];
+
+        if (!ret) {
+            ret = boost::make_shared<TLSThreadData>();
+        }
+
+        return ret;
+    }
+};
+
+static TLSRegistry registry;
+
+NATRON_NAMESPACE_ANONYMOUS_EXIT
+
+
+TLSHolderBase::TLSHolderBase()
+    : _slotIndex( AppTLS::acquireSlotIndex() )
+{
+}
+
+TLSHolderBase::~TLSHolderBase()
+{
+    AppTLS::releaseSlotIndex(_slotIndex);
+}
 
 AppTLS::AppTLS()
-    : _objectMutex()
-    , _object( new GLobalTLSObject() )
-    , _spawnsMutex()
-    , _spawns()
 {
 }
 
@@ -53,15 +109,150 @@ AppTLS::~AppTLS()
 {
 }
 
+int
+AppTLS::acquireSlotIndex()
+{
+    QMutexLocker k(&registry.lock);
+
+    if ( registry.freeSlotIndexes.empty() ) {
+        return registry.nSlotIndexes++;
+    }
+    int ret = registry.freeSlotIndexes.back();
+    registry.freeSlotIndexes.pop_back();
+
+    return ret;
+}
+
 void
-AppTLS::registerTLSHolder(const TLSHolderBaseConstPtr& holder)
+AppTLS::releaseSlotIndex(int index)
 {
-    //This must be the first time for this thread that we reach here since cleanupTLSForThread() was made, otherwise
-    //the TLS data should always be available on the TLSHolder
+    //The data are destroyed once the locks are released, since their destructor may destroy other holders
+    std::list<boost::shared_ptr<void> > values;
     {
-        QWriteLocker k(&_objectMutex);
-        //The insert call might not succeed because another thread inserted this holder in the set already, that's fine
-        _object->objects.insert(holder);
+        QMutexLocker k(&registry.lock);
+        for (TLSThreadDataMap::iterator it = registry.threads.begin(); it != registry.threads.end(); ++it) {
+            TLSThreadData* data = it->second.get();
+            QMutexLocker l(&data->slotsMutex);
+            if ( index < (int)data->slots.size() ) {
+                TLSThreadData::Slot& slot = data->slots[index];
+                if (slot.value) {
+                    values.push_back(slot.value);
+                    slot.value.reset();
+                }
+                slot.holder.reset();
+            }
+        }
+        //The slot is empty in all threads, another holder may use it
+        registry.freeSlotIndexes.push_back(index);
+    }
+}
+
+TLSThreadData*
+AppTLS::getCurrentThreadData()
+{
+    if (currentThreadData) {
+        return currentThreadData;
+    }
+
+    //First time this thread uses TLS since cleanupTLSForThread() was called: the data may have been created
+    //by softCopy() already
+    QMutexLocker k(&registry.lock);
+    currentThreadData = registry.getOrCreateThreadData( QThread::currentThread() ).get();
+
+    return currentThreadData;
+}
+
+void
+AppTLS::setSlot(TLSThreadData* curThreadData,
+                const TLSHolderBaseConstPtr& holder,
+                const boost::shared_ptr<void>& value)
+{
+    assert(curThreadData == currentThreadData);
+    QMutexLocker k(&curThreadData->slotsMutex);
+    if ( holder->_slotIndex >= (int)curThreadData->slots.size() ) {
+        curThreadData->slots.resize(holder->_slotIndex + 1);
+    }
+    TLSThreadData::Slot& slot = curThreadData->slots[holder->_slotIndex];
+    slot.holder = holder;
+    slot.value = value;
+}
+
+void
+AppTLS::copyTLSInternal(const QThread* fromThread,
+                        TLSThreadData* toThreadData)
+{
+    TLSThreadDataPtr fromThreadData;
+    {
+        QMutexLocker k(&registry.lock);
+        TLSThreadDataMap::iterator found = registry.threads.find(fromThread);
+        if ( found == registry.threads.end() ) {
+            //No TLS for fromThread
+            return;
+        }
+        fromThreadData = found->second;
+    }
+    if (fromThreadData.get() == toThreadData) {
+        return;
+    }
+
+    //Copy the slots of the spawner thread under its lock, since it may modify them at the same time
+    std::vector<std::pair<int, TLSThreadData::Slot> > fromSlots;
+    {
+        QMutexLocker k(&fromThreadData->slotsMutex);
+        for (std::size_t i = 0; i < fromThreadData->slots.size(); ++i) {
+            if (fromThreadData->slots[i].value) {
+                fromSlots.push_back( std::make_pair( (int)i, fromThreadData->slots[i] ) );
+            }
+        }
+    }
+
+    //The holders are kept alive until their slot is set, so that their index cannot be used by another holder meanwhile
+    std::list<TLSHolderBaseConstPtr> holders;
+    std::vector<std::pair<int, TLSThreadData::Slot> > toSlots;
+    for (std::size_t i = 0; i < fromSlots.size(); ++i) {
+        TLSHolderBaseConstPtr holder = fromSlots[i].second.holder.lock();
+        if (!holder) {
+            continue;
+        }
+        boost::shared_ptr<void> value = holder->copyTLSValue(fromSlots[i].second.value);
+        if (value) {
+            holders.push_back(holder);
+            TLSThreadData::Slot slot;
+            slot.holder = holder;
+            slot.value = value;
+            toSlots.push_back( std::make_pair(fromSlots[i].first, slot) );
+        }
+    }
+    if ( toSlots.empty() ) {
+        return;
+    }
+
+    QMutexLocker k(&toThreadData->slotsMutex);
+    for (std::size_t i = 0; i < toSlots.size(); ++i) {
+        if ( toSlots[i].first >= (int)toThreadData->slots.size() ) {
+            toThreadData->slots.resize(toSlots[i].first + 1);
+        }
+        toThreadData->slots[toSlots[i].first] = toSlots[i].second;
+    }
+}
+
+void
+AppTLS::copyTLSFromSpawnerThread(TLSThreadData* curThreadData)
+{
+    assert(curThreadData == currentThreadData);
+    const QThread* spawnerThread = 0;
+    {
+        QMutexLocker k(&registry.lock);
+        if ( !(int)curThreadData->hasSpawner ) {
+            return;
+        }
+        spawnerThread = curThreadData->spawner;
+        //No longer mark this thread as spawned
+        curThreadData->spawner = 0;
+        curThreadData->hasSpawner = 0;
+    }
+    if (spawnerThread) {
+        copyTLSInternal(spawnerThread, curThreadData);
     }
 }
 
@@ -89,17 +280,16 @@ AppTLS::copyTLS(QThread* fromThread,
         return;
     }
 
-    copyAbortInfo(fromThread, toThread);
+    if ( toThread != QThread::currentThread() ) {
+        //Only a thread may add data to its own TLS: let toThread copy it
+        softCopy(fromThread, toThread);
 
-    QReadLocker k(&_objectMutex);
-    const TLSObjects& objectsCRef = _object->objects; // take a const ref, since it's a read lock
-    for (TLSObjects::const_iterator it = objectsCRef.begin();
-         it != objectsCRef.end(); ++it) {
-        TLSHolderBaseConstPtr p = (*it).lock();
-        if (p) {
-            p->copyTLS(fromThread, toThread);
-        }
+        return;
     }
+
+    copyAbortInfo(fromThread, toThread);
+
+    copyTLSInternal( fromThread, getCurrentThreadData() );
 }
 
 void
@@ -112,8 +302,10 @@ AppTLS::softCopy(QThread* fromThread,
 
     copyAbortInfo(fromThread, toThread);
 
-    QWriteLocker k(&_spawnsMutex);
-    _spawns[toThread] = fromThread;
+    QMutexLocker k(&registry.lock);
+    TLSThreadDataPtr data = registry.getOrCreateThreadData(toThread);
+    data->spawner = fromThread;
+    data->hasSpawner = 1;
 }
 
 void
@@ -126,65 +318,24 @@ AppTLS::cleanupTLSForThread()
         isAbortableThread->clearAbortInfo();
     }
 
-    //Cleanup any cached data on the TLSHolder
-    {
-        QWriteLocker l(&_spawnsMutex);
-
-        //This thread was spawned, but TLS not used, do not bother to clean-up
-        ThreadSpawnMap::iterator foundSpawned = _spawns.find(curThread);
-        if ( foundSpawned != _spawns.end() ) {
-            _spawns.erase(foundSpawned);
-
-            return;
-        }
-    }
-    std::list<TLSHolderBaseConstPtr> objectsToClean;
+    //Unregister the TLS of this thread: it is destroyed once the locks are released, since the destructor
+    //of the data may destroy holders
+    TLSThreadDataPtr data;
     {
-        QReadLocker k (&_objectMutex);
-        const TLSObjects& objectsCRef = _object->objects;
-        for (TLSObjects::iterator it = objectsCRef.begin();
-             it != objectsCRef.end();
-             ++it) {
-            TLSHolderBaseConstPtr p = (*it).lock();
-            if (p) {
-                if ( p->canCleanupPerThreadData(curThread) ) {
-                    objectsToClean.push_back(p);
-                }
-            }
+        QMutexLocker k(&registry.lock);
+        TLSThreadDataMap::iterator found = registry.threads.find(curThread);
+        if ( found != registry.threads.end() ) {
+            data = found->second;
+            registry.threads.erase(found);
         }
     }
-    if ( !objectsToClean.empty() ) {
-#if 1
-        // version from 1a0712b
-        // should be OK, since the bug in 1a0712b was in canCleanupPerThreadData
-        QWriteLocker k (&_objectMutex);
-        for (std::list<TLSHolderBaseConstPtr>::iterator it = objectsToClean.begin();
-             it != objectsToClean.end();
-             ++it) {
-            if ( (*it)->cleanupPerThreadData(curThread) ) {
-                TLSObjects::iterator found = _object->objects.find(*it);
-                if ( found != _object->objects.end() ) {
-                    _object->objects.erase(found);
-                }
-            }
-        }
-#else
-        // original version
-        TLSObjects newObjects;
-        QWriteLocker k (&_objectMutex);
-        for (TLSObjects::iterator it = _object->objects.begin();
-             it != _object->objects.end(); ++it) {
-            TLSHolderBaseConstPtr p = (*it).lock();
-            if (p) {
-                if ( !p->cleanupPerThreadData(curThread) ) {
-                    //The TLSHolder still has TLS on it for another thread and is still alive,
-                    //then leave it in the set
-                    newObjects.insert(p);
-                }
-            }
+    currentThreadData = 0;
+    if (data) {
+        std::vector<TLSThreadData::Slot> slots;
+        {
+            QMutexLocker k(&data->slotsMutex);
+            slots.swap(data->slots);
         }
-        _object->objects = newObjects;
-#endif
     }
 } // AppTLS::cleanupTLSForThread
 
@@ -41,6 +41,8 @@
 #include <boost/enable_shared_from_this.hpp>
 #endif
 
+#include <QtCore/QAtomicInt>
+#include <QtCore/QMutex>
 #include <QtCore/QReadWriteLock>
 #include <QtCore/QThread>
 
@@ -58,52 +60,65 @@ public:
     // TODO: enable_shared_from_this
     // constructors should be privatized in any class that derives from boost::enable_shared_from_this<>
 
-    TLSHolderBase() {}
+    TLSHolderBase();
 
 public:
-    virtual ~TLSHolderBase() {}
+    virtual ~TLSHolderBase();
 
 protected:
 
     /**
-     * @brief Returns true if cleanupPerThreadData would do anything OR would return true.
-     * It does not return the same value as cleanupPerThreadData, since cleanupPerThreadData
-     * may do something and return false.
-     * This is much faster than cleanupPerThreadData as it does not take any write lock.
+     * @brief Returns the copy of the data of this holder that a spawned thread inherits from its spawner thread,
+     * or NULL if the spawned thread should create its own data.
      **/
-    virtual bool canCleanupPerThreadData(const QThread* curThread) const = 0;
+    virtual boost::shared_ptr<void> copyTLSValue(const boost::shared_ptr<void>& value) const = 0;
 
-    /**
-     * @brief Must clean-up any data stored for the given thread 'curThread'
-     * @returns True if this object no longer holds any per-thread data
-     **/
-    virtual bool cleanupPerThreadData(const QThread* curThread) const = 0;
-
-    /**
-     * @brief Copy all the TLS from fromThread to toThread
-     **/
-    virtual void copyTLS(const QThread* fromThread, const QThread* toThread) const = 0;
+    //The index of the data of this holder in the TLS of each thread, it is recycled once the holder is destroyed
+    const int _slotIndex;
 };
 
 
 /**
- * @brief Stores globally to the application any thread-local storage object so that it gets
- * destroyed when all threads are shutdown.
+ * @brief The thread-local storage of a thread: the data of each TLSHolder is in the slot at the index of the holder.
+ * Only the thread itself adds data to its slots, and it reads them without taking any lock. The mutex must be held
+ * to modify the slots, and by the other threads to read them: they do so when the TLS is copied to a spawned thread
+ * and when a holder is destroyed.
  **/
-class AppTLS
+struct TLSThreadData
 {
-    //This is the object in the QThreadStorage, it is duplicated on every thread
-
-    typedef std::set<TLSHolderBaseConstWPtr> TLSObjects;
-    struct GLobalTLSObject
+    struct Slot
     {
-        TLSObjects objects;
+        TLSHolderBaseConstWPtr holder;
+        boost::shared_ptr<void> value;
     };
 
-    typedef boost::shared_ptr<GLobalTLSObject> GLobalTLSObjectPtr;
+    QMutex slotsMutex;
+    std::vector<Slot> slots;
 
-    //<spawned thread, spawner thread>
-    typedef std::map<const QThread*, const QThread*> ThreadSpawnMap;
+    //Non-zero if a spawner thread was registered with AppTLS::softCopy() and its TLS was not copied yet
+    QAtomicInt hasSpawner;
+    const QThread* spawner;
+
+    TLSThreadData()
+        : slotsMutex()
+        , slots()
+        , hasSpawner()
+        , spawner(0)
+    {
+    }
+};
+
+
+/**
+ * @brief Stores globally to the application any thread-local storage object so that it gets
+ * destroyed when all threads are shutdown.
+ * The data of the threads are indexed by thread and by holder in a registry, which is only used when a thread
+ * accesses its TLS for the first time, when the TLS is copied to another thread and when it is cleaned up:
+ * a thread finds its own TLSThreadData from a native thread-local variable.
+ **/
+class AppTLS
+{
+    friend class TLSHolderBase;
 
 public:
 
@@ -112,13 +127,8 @@ public:
     virtual ~AppTLS();
 
     /**
-     * @brief Registers the holder as using TLS.
-     **/
-    void registerTLSHolder(const TLSHolderBaseConstPtr& holder);
-
-
-    /**
-     * @brief Copy all the TLS from fromThread to toThread
+     * @brief Copy all the TLS from fromThread to toThread.
+     * If toThread is not the current thread, the copy is made by toThread the first time it needs TLS, as with softCopy().
      **/
     void copyTLS(QThread* fromThread, QThread* toThread);
 
@@ -134,46 +144,38 @@ public:
      **/
     void softCopy(QThread* fromThread, QThread* toThread);
 
-    /**
-     * @brief Same as copyTLS() except that if a spawner thread was register for curThread beforehand
-     * with softCopy() then the TLS will be copied from the spawner thread.
-     * This function also returns the TLS for the given holder for convenience.
-     **/
-    template <typename T>
-    boost::shared_ptr<T> copyTLSFromSpawnerThread(const TLSHolderBase* holder,
-                                                  const QThread* curThread);
-
-
     /**
      * @brief Should be called by any thread using TLS when done to cleanup its TLS
      **/
     void cleanupTLSForThread();
 
-private:
+    /**
+     * @brief Returns the TLS of the current thread, never NULL.
+     **/
+    static TLSThreadData* getCurrentThreadData();
 
-    template <typename T>
-    boost::shared_ptr<T> copyTLSFromSpawnerThreadInternal(const TLSHolderBase* holder,
-                                                          const QThread* curThread,
-                                                          const QThread* spawnerThread);
+    /**
+     * @brief If a spawner thread was registered for the current thread with softCopy(), copy its TLS
+     * to the current thread.
+     **/
+    static void copyTLSFromSpawnerThread(TLSThreadData* curThreadData);
 
+    /**
+     * @brief Sets the data of the holder in the TLS of the current thread.
+     **/
+    static void setSlot(TLSThreadData* curThreadData, const TLSHolderBaseConstPtr& holder, const boost::shared_ptr<void>& value);
 
-    //This is the "TLS" object: it stores a set of all TLSHolder's who used the TLS to clean it up afterwards
-    mutable QReadWriteLock _objectMutex;
-    GLobalTLSObjectPtr _object;
+private:
 
-    //if a thread is a spawned thread, then copy the tls from the spawner thread instead
-    //of creating a new object and no longer mark it as spawned
-    mutable QReadWriteLock _spawnsMutex;
-    ThreadSpawnMap _spawns;
+    static int acquireSlotIndex();
+    static void releaseSlotIndex(int index);
+    static void copyTLSInternal(const QThread* fromThread, TLSThreadData* toThreadData);
 };
 
 
 /**
  * @brief Use this class if you need to hold TLS data on an object.
  * @param T is the data type held in the thread-local storage.
- * @param multipleInstance If true, then the TLS object will be mapped against this object
- * so that there can be multiple instance of it in the global TLS. Otherwise only
- * a single instance of the TLS object will be present.
  **/
 template <typename T>
 class TLSHolder
@@ -181,13 +183,6 @@ class TLSHolder
 {
     friend class AppTLS;
 
-    struct ThreadData
-    {
-        boost::shared_ptr<T> value;
-    };
-
-    typedef std::map<const QThread*, ThreadData> ThreadDataMap;
-
 public:
 
     TLSHolder()
@@ -200,14 +195,7 @@ public:
 
 private:
 
-    virtual bool canCleanupPerThreadData(const QThread* curThread) const OVERRIDE FINAL WARN_UNUSED_RETURN;
-    virtual bool cleanupPerThreadData(const QThread* curThread) const OVERRIDE FINAL WARN_UNUSED_RETURN;
-    virtual void copyTLS(const QThread* fromThread, const QThread* toThread) const OVERRIDE FINAL;
-    boost::shared_ptr<T> copyAndReturnNewTLS(const QThread* fromThread, const QThread* toThread) const WARN_UNUSED_RETURN;
-
-    //Store a cache on the object to be faster than using the getOrCreate... function from AppTLS
-    mutable QReadWriteLock perThreadDataMutex;
-    mutable ThreadDataMap perThreadData;
+    virtual boost::shared_ptr<void> copyTLSValue(const boost::shared_ptr<void>& value) const OVERRIDE FINAL WARN_UNUSED_RETURN;
 };
 
 NATRON_NAMESPACE_EXIT
@@ -0,0 +1,427 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * Copyright (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "TaskScheduler.h"
+
+#include <cassert>
+#include <deque>
+#include <stdexcept>
+#include <string>
+
+#if !defined(Q_MOC_RUN) && !defined(SBK_RUN)
+#include <boost/make_shared.hpp>
+#include <boost/shared_ptr.hpp>
+#endif
+
+#include <QtCore/QAtomicInt>
+#include <QtCore/QMutex>
+#include <QtCore/QThread>
+#include <QtCore/QWaitCondition>
+
+#include "Global/GlobalDefines.h"
+
+#include "Engine/NumaTopology.h"
+#include "Engine/ThreadPool.h"
+
+NATRON_NAMESPACE_ENTER
+
+NATRON_NAMESPACE_ANONYMOUS_ENTER
+
+// A call to parallelFor(): its indexes are claimed one at a time by the threads that run it
+struct TaskRange
+{
+    const TaskScheduler::IndexFunction* func;
+    const int n;
+
+    // The NUMA node of the thread that forked it, -1 if it is not bound
+    const int node;
+    QAtomicInt nextIndex;
+
+    // Protects the fields below
+    QMutex doneMutex;
+    QWaitCondition doneCond;
+    int nDone;
+    bool failed;
+    std::string error;
+
+    TaskRange(const TaskScheduler::IndexFunction* func,
+              int n,
+              int node)
+        : func(func)
+        , n(n)
+        , node(node)
+        , nextIndex(0)
+        , doneMutex()
+        , doneCond()
+        , nDone(0)
+        , failed(false)
+        , error()
+    {
+    }
+
+    bool claim(int* index)
+    {
+        int i = nextIndex.fetchAndAddRelaxed(1);
+
+        if (i >= n) {
+            return false;
+        }
+        *index = i;
+
+        return true;
+    }
+
+    bool isExhausted() const
+    {
+        return (int)nextIndex >= n;
+    }
+
+    void run(int index)
+    {
+        bool failedHere = false;
+        std::string errorHere;
+
+        try {
+            (*func)(index);
+        } catch (const std::exception& e) {
+            failedHere = true;
+            errorHere = e.what();
+        } catch (...) {
+            failedHere = true;
+            errorHere = "Unknown exception in a task";
+        }
+
+        QMutexLocker k(&doneMutex);
+        if (failedHere && !failed) {
+            failed = true;
+            error = errorHere;
+        }
+        ++nDone;
+        if (nDone == n) {
+            doneCond.wakeAll();
+        }
+    }
+
+    // Runs the indexes that are left, then waits for the ones running on other threads
+    void runAndWait()
+    {
+        int index;
+
+        while ( claim(&index) ) {
+            run(index);
+        }
+
+        QMutexLocker k(&doneMutex);
+        while (nDone < n) {
+            doneCond.wait(&doneMutex);
+        }
+    }
+};
+
+typedef boost::shared_ptr<TaskRange> TaskRangePtr;
+typedef std::deque<TaskRangePtr> TaskRangeDeque;
+
+class TaskSchedulerWorker
+    : public QThread
+      , public AbortableThread
+{
+public:
+
+    TaskSchedulerWorker(int index)
+        : QThread()
+        , AbortableThread(this)
+        , index(index)
+        , node(-1)
+        , ranges()
+    {
+        setThreadName("Task scheduler");
+    }
+
+    virtual ~TaskSchedulerWorker()
+    {
+    }
+
+    const int index;
+
+    // The NUMA node this thread is bound to, -1 if it is not bound. Only accessed by this thread.
+    int node;
+
+    // The ranges forked by the tasks running on this thread, protected by the scheduler lock
+    TaskRangeDeque ranges;
+
+private:
+
+    virtual void run() OVERRIDE FINAL;
+};
+
+struct TaskSchedulerPrivate
+{
+    // Protects all the fields
+    QMutex lock;
+    QWaitCondition workAvailable;
+    int threadCount;
+    bool quit;
+    std::vector<TaskSchedulerWorker*> workers;
+
+    // The ranges forked by the threads that are not workers
+    TaskRangeDeque externalRanges;
+
+    // Incremented each time a range is pushed, so that a worker does not sleep after missing it
+    U64 pushCount;
+
+    TaskSchedulerPrivate()
+        : lock()
+        , workAvailable()
+        , threadCount( QThread::idealThreadCount() )
+        , quit(false)
+        , workers()
+        , externalRanges()
+        , pushCount(0)
+    {
+    }
+
+    static TaskSchedulerPrivate& instance()
+    {
+        static TaskSchedulerPrivate scheduler;
+
+        return scheduler;
+    }
+
+    static TaskSchedulerWorker* currentWorker()
+    {
+        return dynamic_cast<TaskSchedulerWorker*>( QThread::currentThread() );
+    }
+
+    void pushRange(TaskSchedulerWorker* worker, const TaskRangePtr& range);
+    void removeRange(TaskSchedulerWorker* worker, const TaskRangePtr& range);
+    TaskRangePtr stealRange(const TaskSchedulerWorker* thief, bool sameNodeOnly);
+    void workerLoop(TaskSchedulerWorker* worker);
+};
+
+// Pops the exhausted ranges from the front of the deque and returns the first one with indexes left, if it was
+// forked on the given node or if node is -1
+TaskRangePtr
+frontRange(TaskRangeDeque& ranges,
+           int node)
+{
+    while ( !ranges.empty() ) {
+        if ( !ranges.front()->isExhausted() ) {
+            if ( (node < 0) || (ranges.front()->node == node) ) {
+                return ranges.front();
+            }
+            break;
+        }
+        ranges.pop_front();
+    }
+
+    return TaskRangePtr();
+}
+
+void
+TaskSchedulerPrivate::pushRange(TaskSchedulerWorker* worker,
+                                const TaskRangePtr& range)
+{
+    QMutexLocker k(&lock);
+
+    if (worker) {
+        worker->ranges.push_back(range);
+    } else {
+        externalRanges.push_back(range);
+    }
+    ++pushCount;
+
+    // Start the workers that are still missing
+    while ( !quit && ( (int)workers.size() < threadCount ) ) {
+        TaskSchedulerWorker* newWorker = new TaskSchedulerWorker( (int)workers.size() );
+        workers.push_back(newWorker);
+        newWorker->start();
+    }
+    // The calling thread runs indexes too
+    for (int i = 1; i < range->n; ++i) {
+        workAvailable.wakeOne();
+    }
+}
+
+void
+TaskSchedulerPrivate::removeRange(TaskSchedulerWorker* worker,
+                                  const TaskRangePtr& range)
+{
+    QMutexLocker k(&lock);
+    TaskRangeDeque& ranges = worker ? worker->ranges : externalRanges;
+
+    // The range was pushed last by this thread, unless it was already popped by a thief
+    for (TaskRangeDeque::reverse_iterator it = ranges.rbegin(); it != ranges.rend(); ++it) {
+        if (*it == range) {
+            ranges.erase( --it.base() );
+            break;
+        }
+    }
+}
+
+TaskRangePtr
+TaskSchedulerPrivate::stealRange(const TaskSchedulerWorker* thief,
+                                 bool sameNodeOnly)
+{
+    int node = sameNodeOnly ? thief->node : -1;
+    // The ranges of the threads that are not workers first, they are the outermost ones
+    TaskRangePtr range = frontRange(externalRanges, node);
+
+    if (range) {
+        return range;
+    }
+    const int nWorkers = (int)workers.size();
+    for (int i = 1; i <= nWorkers; ++i) {
+        TaskSchedulerWorker* victim = workers[(thief->index + i) % nWorkers];
+        range = frontRange(victim->ranges, node);
+        if (range) {
+            return range;
+        }
+    }
+
+    return TaskRangePtr();
+}
+
+void
+TaskSchedulerPrivate::workerLoop(TaskSchedulerWorker* worker)
+{
+    for (;;) {
+        TaskRangePtr range;
+        {
+            QMutexLocker k(&lock);
+            if (quit) {
+                return;
+            }
+            U64 seenPushCount = pushCount;
+            if (worker->index < threadCount) {
+                // In NUMA mode, help the threads of the same node first: their images are in the memory of this node
+                if (worker->node >= 0) {
+                    range = stealRange(worker, true);
+                }
+                if (!range) {
+                    range = stealRange(worker, false);
+                }
+            }
+            if (!range) {
+                if (seenPushCount == pushCount) {
+                    workAvailable.wait(&lock);
+                }
+                continue;
+            }
+        }
+
+        int index;
+        while ( range->claim(&index) ) {
+            range->run(index);
+        }
+    }
+}
+
+void
+TaskSchedulerWorker::run()
+{
+    node = NumaTopology::bindCurrentThread();
+    TaskSchedulerPrivate::instance().workerLoop(this);
+    NumaTopology::unbindCurrentThread();
+}
+
+NATRON_NAMESPACE_ANONYMOUS_EXIT
+
+
+void
+TaskScheduler::parallelFor(int n,
+                           const IndexFunction& func)
+{
+    if (n <= 0) {
+        return;
+    }
+
+    TaskSchedulerPrivate& scheduler = TaskSchedulerPrivate::instance();
+    bool runInCurrentThread = (n == 1);
+    if (!runInCurrentThread) {
+        QMutexLocker k(&scheduler.lock);
+        runInCurrentThread = scheduler.quit || (scheduler.threadCount <= 0);
+    }
+    if (runInCurrentThread) {
+        for (int i = 0; i < n; ++i) {
+            func(i);
+        }
+
+        return;
+    }
+
+    TaskRangePtr range = boost::make_shared<TaskRange>( &func, n, NumaTopology::getCurrentThreadNode() );
+    TaskSchedulerWorker* worker = TaskSchedulerPrivate::currentWorker();
+    scheduler.pushRange(worker, range);
+    range->runAndWait();
+    scheduler.removeRange(worker, range);
+
+    if (range->failed) {
+        throw std::runtime_error(range->error);
+    }
+}
+
+void
+TaskScheduler::setThreadCount(int nThreads)
+{
+    TaskSchedulerPrivate& scheduler = TaskSchedulerPrivate::instance();
+    QMutexLocker k(&scheduler.lock);
+
+    scheduler.threadCount = nThreads;
+    // The workers above the count sleep, the missing ones are started by the next parallelFor()
+    scheduler.workAvailable.wakeAll();
+}
+
+int
+TaskScheduler::getThreadCount()
+{
+    TaskSchedulerPrivate& scheduler = TaskSchedulerPrivate::instance();
+    QMutexLocker k(&scheduler.lock);
+
+    return scheduler.threadCount;
+}
+
+bool
+TaskScheduler::isWorkerThread()
+{
+    return TaskSchedulerPrivate::currentWorker() != 0;
+}
+
+void
+TaskScheduler::shutdown()
+{
+    TaskSchedulerPrivate& scheduler = TaskSchedulerPrivate::instance();
+    std::vector<TaskSchedulerWorker*> workers;
+    {
+        QMutexLocker k(&scheduler.lock);
+        scheduler.quit = true;
+        workers.swap(scheduler.workers);
+        scheduler.workAvailable.wakeAll();
+    }
+    for (std::size_t i = 0; i < workers.size(); ++i) {
+        workers[i]->wait();
+        delete workers[i];
+    }
+}
+
+NATRON_NAMESPACE_EXIT
@@ -0,0 +1,186 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * Copyright (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+#ifndef NATRON_ENGINE_TASKSCHEDULER_H
+#define NATRON_ENGINE_TASKSCHEDULER_H
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include <vector>
+
+#if !defined(Q_MOC_RUN) && !defined(SBK_RUN)
+#include <boost/function.hpp>
+#endif
+
+NATRON_NAMESPACE_ENTER
+
+/**
+ * @brief A work-stealing scheduler for the fork/join parallelism of the renders: the tiles of the host frame threading,
+ * the threads of the OFX multi-thread suite, the bands of the viewer and the tracks.
+ * parallelFor() runs the indexes of a range on the worker threads and on the calling thread. Instead of blocking,
+ * the calling thread runs the indexes that were not taken yet, and only waits for the ones that are running on other
+ * threads. A call made from a task thus never waits for a free thread: nested parallelism neither deadlocks nor
+ * starts more threads than the scheduler has.
+ * Each worker thread has its own deque of ranges. The idle workers steal the oldest range of the other deques, which
+ * is the outermost and largest piece of work, while a thread only helps with the range that it is waiting for, so that
+ * the thread-local storage of the task that it was running is left untouched.
+ * As with QtConcurrent, the scheduler does not copy the thread-local storage: the tasks that need it call
+ * AppTLS::softCopy() or AppTLS::copyTLS() when they are not run by the thread that called parallelFor(), and
+ * AppTLS::cleanupTLSForThread() when they are done. The worker threads are AbortableThread.
+ **/
+class TaskScheduler
+{
+    TaskScheduler();
+
+public:
+
+    typedef boost::function1<void, int> IndexFunction;
+
+    /**
+     * @brief Calls func(i) for each i in [0, n), possibly in parallel, and returns once they all returned.
+     * If a call throws, the first exception is reported by throwing a std::runtime_error once all the calls returned.
+     **/
+    static void parallelFor(int n, const IndexFunction& func);
+
+    /**
+     * @brief Calls func on each item of the sequence, as QtConcurrent::blockingMap does.
+     **/
+    template <typename Sequence, typename Functor>
+    static void map(Sequence& sequence, Functor func);
+
+    /**
+     * @brief Returns the results of func on each item of the sequence, in order, as QtConcurrent::blockingMapped does.
+     * The result type is Functor::result_type, which is defined by boost::bind.
+     **/
+    template <typename Sequence, typename Functor>
+    static std::vector<typename Functor::result_type> mapped(const Sequence& sequence, Functor func);
+
+    /**
+     * @brief Sets the number of worker threads, which are started when needed. The threads calling parallelFor()
+     * also run tasks, in addition to the workers.
+     **/
+    static void setThreadCount(int nThreads);
+    static int getThreadCount();
+
+    /**
+     * @brief Returns true if the current thread is a worker thread of the scheduler.
+     **/
+    static bool isWorkerThread();
+
+    /**
+     * @brief Stops the worker threads, after which the tasks are run by the calling thread.
+     **/
+    static void shutdown();
+
+private:
+
+    // The calls of map() and mapped() on the index of an item
+    template <typename Item, typename Functor>
+    struct MapCall
+    {
+        const std::vector<Item*>* items;
+        mutable Functor func;
+
+        MapCall(const std::vector<Item*>* items,
+                Functor func)
+            : items(items)
+            , func(func)
+        {
+        }
+
+        void operator()(int i) const
+        {
+            func( *(*items)[i] );
+        }
+    };
+
+    // Each result is written in its own struct, since std::vector<bool> packs its values
+    template <typename Result>
+    struct MappedResult
+    {
+        Result value;
+    };
+
+    template <typename Item, typename Functor>
+    struct MappedCall
+    {
+        const std::vector<const Item*>* items;
+        mutable Functor func;
+        std::vector<MappedResult<typename Functor::result_type> >* results;
+
+        MappedCall(const std::vector<const Item*>* items,
+                   Functor func,
+                   std::vector<MappedResult<typename Functor::result_type> >* results)
+            : items(items)
+            , func(func)
+            , results(results)
+        {
+        }
+
+        void operator()(int i) const
+        {
+            (*results)[i].value = func( *(*items)[i] );
+        }
+    };
+};
+
+template <typename Sequence, typename Functor>
+void
+TaskScheduler::map(Sequence& sequence,
+                   Functor func)
+{
+    typedef typename Sequence::value_type Item;
+    std::vector<Item*> items;
+
+    for (typename Sequence::iterator it = sequence.begin(); it != sequence.end(); ++it) {
+        items.push_back( &(*it) );
+    }
+    parallelFor( (int)items.size(), MapCall<Item, Functor>(&items, func) );
+}
+
+template <typename Sequence, typename Functor>
+std::vector<typename Functor::result_type>
+TaskScheduler::mapped(const Sequence& sequence,
+                      Functor func)
+{
+    typedef typename Sequence::value_type Item;
+    std::vector<const Item*> items;
+
+    for (typename Sequence::const_iterator it = sequence.begin(); it != sequence.end(); ++it) {
+        items.push_back( &(*it) );
+    }
+    std::vector<MappedResult<typename Functor::result_type> > results( items.size() );
+    parallelFor( (int)items.size(), MappedCall<Item, Functor>(&items, func, &results) );
+
+    std::vector<typename Functor::result_type> ret( results.size() );
+    for (std::size_t i = 0; i < results.size(); ++i) {
+        ret[i] = results[i].value;
+    }
+
+    return ret;
+}
+
+NATRON_NAMESPACE_EXIT
+
+#endif // NATRON_ENGINE_TASKSCHEDULER_H
@@ -45,6 +45,7 @@ CLANG_DIAG_ON(uninitialized)
 #include "Engine/Project.h"
 #include "Engine/Curve.h"
 #include "Engine/TLSHolder.h"
+#include "Engine/TaskScheduler.h"
 #include "Engine/Transform.h"
 #include "Engine/TrackMarker.h"
 #include "Engine/TrackerContextPrivate.h"
@@ -1883,16 +1884,15 @@ TrackScheduler::threadLoopOnce(const GenericThreadStartArgsPtr& inArgs)
 
 
         while (cur != end) {
-            ///Launch parallel thread for each track using the global thread pool
-            QFuture<bool> future = QtConcurrent::mapped( trackIndexes,
-                                                         boost::bind(&TrackSchedulerPrivate::trackStepFunctor,
-                                                                     _1,
-                                                                     *args,
-                                                                     cur) );
-            future.waitForFinished();
+            ///Track each marker in parallel using the task scheduler
+            std::vector<bool> trackSucceeded = TaskScheduler::mapped( trackIndexes,
+                                                                      boost::bind(&TrackSchedulerPrivate::trackStepFunctor,
+                                                                                  _1,
+                                                                                  *args,
+                                                                                  cur) );
 
             allTrackFailed = true;
-            for (QFuture<bool>::const_iterator it = future.begin(); it != future.end(); ++it) {
+            for (std::vector<bool>::const_iterator it = trackSucceeded.begin(); it != trackSucceeded.end(); ++it) {
                 if ( (*it) ) {
                     allTrackFailed = false;
                     break;
@@ -53,6 +53,7 @@ CLANG_DIAG_ON(deprecated)
 #include "Engine/AppManager.h"
 #include "Engine/Cache.h"
 #include "Engine/Image.h"
+#include "Engine/ImageSIMD.h"
 #include "Engine/Log.h"
 #include "Engine/Lut.h"
 #include "Engine/MemoryFile.h"
@@ -67,6 +68,7 @@ CLANG_DIAG_ON(deprecated)
 #include "Engine/RotoPaint.h"
 #include "Engine/RotoStrokeItem.h"
 #include "Engine/Settings.h"
+#include "Engine/TaskScheduler.h"
 #include "Engine/TimeLine.h"
 #include "Engine/Timer.h"
 #include "Engine/UpdateViewerParams.h"
@@ -79,6 +81,7 @@ CLANG_DIAG_ON(deprecated)
 #endif
 
 #define NATRON_TIME_ELASPED_BEFORE_PROGRESS_REPORT 4. //!< do not display the progress report if estimated total time is less than this (in seconds)
+#define NATRON_VIEWER_RENDER_BAND_BYTES 524288 //!< size of the input rows read by a band of the viewer render, so that they are still in the cache when the texture is written
 
 NATRON_NAMESPACE_ENTER
 
@@ -103,6 +106,17 @@ struct MinMaxVal {
     double max;
 };
 
+/**
+ * @brief A group of rows of the RoI rendered by a single task. When only the RoI is rendered, the rows of the
+ * texture are split into bands that are read once to find the auto-contrast range and once to write the texture,
+ * otherwise there is one band per tile.
+ **/
+struct ViewerRenderBand
+{
+    RectI rect;
+    UpdateViewerParams::CachedTile tile;
+};
+
 NATRON_NAMESPACE_ANONYMOUS_EXIT
 
 static void scaleToTexture8bits(const RectI& roi,
@@ -121,6 +135,16 @@ static void renderFunctor(const RectI& roi,
                           const RenderViewerArgs & args,
                           ViewerInstance* viewer,
                           UpdateViewerParams::CachedTile tile);
+static std::vector<ViewerRenderBand> splitIntoRenderBands(const RectI& roi,
+                                                          const std::list<UpdateViewerParams::CachedTile>& tiles,
+                                                          bool renderOnlyRoI,
+                                                          std::size_t rowBytes);
+static MinMaxVal findBandAutoContrastVminVmax(const ImagePtr inputImage,
+                                              DisplayChannelsEnum channels,
+                                              const ViewerRenderBand& band);
+static void renderBandFunctor(const RenderViewerArgs & args,
+                              ViewerInstance* viewer,
+                              const ViewerRenderBand& band);
 
 /**
  *@brief Actually converting to ARGB... but it is called BGRA by
@@ -830,6 +854,28 @@ ViewerInstance::getRenderViewerArgsAndCheckCache_public(SequenceTime time,
     return stat;
 }
 
+int
+ViewerInstance::prefetchCachedTextures(const UpdateViewerParams& params,
+                                       SequenceTime time,
+                                       bool forward) const
+{
+    int ret = 0;
+
+    for (std::list<UpdateViewerParams::CachedTile>::const_iterator it = params.tiles.begin(); it != params.tiles.end(); ++it) {
+        if (!it->cachedData) {
+            continue;
+        }
+        // Same texture at another frame
+        FrameKey key = it->cachedData->getKey();
+        key.setTime(time);
+        if ( appPTR->prefetchTexture(key, forward) ) {
+            ++ret;
+        }
+    }
+
+    return ret;
+}
+
 void
 ViewerInstance::setupMinimalUpdateViewerParams(const SequenceTime time,
                                                const ViewIdx view,
@@ -1859,12 +1905,24 @@ ViewerInstance::renderViewer_internal(ViewIdx view,
             tileRowElements *= 4;
         }
 
+        // The auto-contrast range is found on the same bands that are then rendered, in reverse order, so that the rows
+        // read last are still in the cache when the texture is written
+        std::size_t rowBytes = 0;
+        if (colorImage) {
+            rowBytes = viewerRenderRoI.width() * colorImage->getComponentsCount() * getSizeOfForBitDepth( colorImage->getBitDepth() );
+        }
+        std::vector<ViewerRenderBand> bands = splitIntoRenderBands(viewerRenderRoI, unCachedTiles, viewerRenderRoiOnly, rowBytes);
+        const bool computeAutoContrast = inArgs.autoContrast && !inArgs.isDoingPartialUpdates;
+
         if (singleThreaded) {
-            if (inArgs.autoContrast && !inArgs.isDoingPartialUpdates) {
-                double vmin, vmax;
-                MinMaxVal vMinMax = findAutoContrastVminVmax(colorImage, inArgs.channels, viewerRenderRoI);
-                vmin = vMinMax.min;
-                vmax = vMinMax.max;
+            if (computeAutoContrast) {
+                double vmin = std::numeric_limits<double>::infinity();
+                double vmax = -std::numeric_limits<double>::infinity();
+                for (std::size_t i = 0; i < bands.size(); ++i) {
+                    MinMaxVal vMinMax = findBandAutoContrastVminVmax(colorImage, inArgs.channels, bands[i]);
+                    vmin = std::min(vmin, vMinMax.min);
+                    vmax = std::max(vmax, vMinMax.max);
+                }
 
                 ///if vmax - vmin is greater than 1 the gain will be really small and we won't see
                 ///anything in the image
@@ -1873,6 +1931,7 @@ ViewerInstance::renderViewer_internal(ViewIdx view,
                 }
                 updateParams->gain = 1 / (vmax - vmin);
                 updateParams->offset = -vmin / ( vmax - vmin);
+                std::reverse( bands.begin(), bands.end() );
             }
 
             const RenderViewerArgs args(colorImage,
@@ -1889,38 +1948,33 @@ ViewerInstance::renderViewer_internal(ViewIdx view,
                                         viewerRenderRoiOnly,
                                         tileRowElements);
             QReadLocker k(&_imp->gammaLookupMutex);
-            for (std::list<UpdateViewerParams::CachedTile>::iterator it = unCachedTiles.begin(); it != unCachedTiles.end(); ++it) {
-                renderFunctor(viewerRenderRoI,
-                              args,
-                              this,
-                              *it);
+            for (std::size_t i = 0; i < bands.size(); ++i) {
+                renderBandFunctor(args, this, bands[i]);
             }
         } else {
-            bool runInCurrentThread = QThreadPool::globalInstance()->activeThreadCount() >= QThreadPool::globalInstance()->maxThreadCount();
-            if ( !runInCurrentThread && (splitRoi.size() > 1) ) {
-                runInCurrentThread = true;
-            }
+            // The bands are run by the task scheduler, which lets this thread render them when its threads are busy
+            bool runInCurrentThread = (splitRoi.size() > 1) || (bands.size() <= 1);
 
 
             ///if autoContrast is enabled, find out the vmin/vmax before rendering and mapping against new values
-            if (inArgs.autoContrast && !inArgs.isDoingPartialUpdates) {
+            if (computeAutoContrast) {
                 double vmin = std::numeric_limits<double>::infinity();
                 double vmax = -std::numeric_limits<double>::infinity();
 
                 if (runInCurrentThread) {
-                    MinMaxVal vMinMax = findAutoContrastVminVmax(colorImage, inArgs.channels, viewerRenderRoI);
-                    vmin = vMinMax.min;
-                    vmax = vMinMax.max;
+                    for (std::size_t i = 0; i < bands.size(); ++i) {
+                        MinMaxVal vMinMax = findBandAutoContrastVminVmax(colorImage, inArgs.channels, bands[i]);
+                        vmin = std::min(vmin, vMinMax.min);
+                        vmax = std::max(vmax, vMinMax.max);
+                    }
                 } else {
-                    std::vector<RectI> splitRects = viewerRenderRoI.splitIntoSmallerRects( appPTR->getMaxThreadCount() );
-                    QFuture<MinMaxVal> future = QtConcurrent::mapped( splitRects,
-                                                                                       boost::bind(findAutoContrastVminVmax,
-                                                                                                   colorImage,
-                                                                                                   inArgs.channels,
-                                                                                                   _1) );
-                    future.waitForFinished();
-                    QList<MinMaxVal> results = future.results();
-                    Q_FOREACH (const MinMaxVal &vMinMax, results) {
+                    std::vector<MinMaxVal> results = TaskScheduler::mapped( bands,
+                                                                            boost::bind(findBandAutoContrastVminVmax,
+                                                                                        colorImage,
+                                                                                        inArgs.channels,
+                                                                                        _1) );
+                    for (std::vector<MinMaxVal>::const_iterator it = results.begin(); it != results.end(); ++it) {
+                        const MinMaxVal& vMinMax = *it;
                         if (vMinMax.min < vmin) {
                             vmin = vMinMax.min;
                         }
@@ -1941,6 +1995,7 @@ ViewerInstance::renderViewer_internal(ViewIdx view,
                     updateParams->gain = 1 / (vmax - vmin);
                     updateParams->offset =  -vmin / (vmax - vmin);
                 }
+                std::reverse( bands.begin(), bands.end() );
             }
 
             const RenderViewerArgs args(colorImage,
@@ -1959,18 +2014,16 @@ ViewerInstance::renderViewer_internal(ViewIdx view,
 
             if (runInCurrentThread) {
                 QReadLocker k(&_imp->gammaLookupMutex);
-                for (std::list<UpdateViewerParams::CachedTile>::iterator it = unCachedTiles.begin(); it != unCachedTiles.end(); ++it) {
-                    renderFunctor(viewerRenderRoI,
-                                  args, this, *it);
+                for (std::size_t i = 0; i < bands.size(); ++i) {
+                    renderBandFunctor(args, this, bands[i]);
                 }
             } else {
                 QReadLocker k(&_imp->gammaLookupMutex);
-                QtConcurrent::map( unCachedTiles,
-                                   boost::bind(&renderFunctor,
-                                               viewerRenderRoI,
-                                               args,
-                                               this,
-                                               _1) ).waitForFinished();
+                TaskScheduler::map( bands,
+                                    boost::bind(&renderBandFunctor,
+                                                args,
+                                                this,
+                                                _1) );
             }
 
             if (inArgs.isDoingPartialUpdates) {
@@ -2043,11 +2096,60 @@ renderFunctor(const RectI& roi,
     }
 }
 
+std::vector<ViewerRenderBand>
+splitIntoRenderBands(const RectI& roi,
+                     const std::list<UpdateViewerParams::CachedTile>& tiles,
+                     bool renderOnlyRoI,
+                     std::size_t rowBytes)
+{
+    std::vector<ViewerRenderBand> bands;
+
+    if ( !renderOnlyRoI || roi.isNull() || (rowBytes == 0) ) {
+        // The tiles are rendered entirely
+        for (std::list<UpdateViewerParams::CachedTile>::const_iterator it = tiles.begin(); it != tiles.end(); ++it) {
+            ViewerRenderBand band;
+            band.rect = roi;
+            band.tile = *it;
+            bands.push_back(band);
+        }
+
+        return bands;
+    }
+
+    const int bandHeight = std::max( 1, (int)(NATRON_VIEWER_RENDER_BAND_BYTES / rowBytes) );
+    for (std::list<UpdateViewerParams::CachedTile>::const_iterator it = tiles.begin(); it != tiles.end(); ++it) {
+        for (int y = roi.y1; y < roi.y2; y += bandHeight) {
+            ViewerRenderBand band;
+            band.rect.set( roi.x1, y, roi.x2, std::min(y + bandHeight, roi.y2) );
+            band.tile = *it;
+            bands.push_back(band);
+        }
+    }
+
+    return bands;
+}
+
+MinMaxVal
+findBandAutoContrastVminVmax(const ImagePtr inputImage,
+                             DisplayChannelsEnum channels,
+                             const ViewerRenderBand& band)
+{
+    return findAutoContrastVminVmax(inputImage, channels, band.rect);
+}
+
+void
+renderBandFunctor(const RenderViewerArgs & args,
+                  ViewerInstance* viewer,
+                  const ViewerRenderBand& band)
+{
+    renderFunctor(band.rect, args, viewer, band.tile);
+}
+
+template <DisplayChannelsEnum channels>
 inline
 MinMaxVal
 findAutoContrastVminVmax_generic(const ImagePtr inputImage,
                                  int nComps,
-                                 DisplayChannelsEnum channels,
                                  const RectI & rect)
 {
     double localVmin = std::numeric_limits<double>::infinity();
@@ -2134,13 +2236,44 @@ findAutoContrastVminVmax_generic(const ImagePtr inputImage,
     return MinMaxVal(localVmin, localVmax);
 } // findAutoContrastVminVmax_generic
 
-template <int nComps>
+template <int nComps, DisplayChannelsEnum channels>
 MinMaxVal
 findAutoContrastVminVmax_internal(const ImagePtr inputImage,
-                                  DisplayChannelsEnum channels,
                                   const RectI & rect)
 {
-    return findAutoContrastVminVmax_generic(inputImage, nComps, channels, rect);
+    return findAutoContrastVminVmax_generic<channels>(inputImage, nComps, rect);
+}
+
+// nComps and channels are constants of the instantiated kernels: the switches on them are resolved at compile time
+template <int nComps>
+MinMaxVal
+findAutoContrastVminVmaxForComponents(const ImagePtr inputImage,
+                                      DisplayChannelsEnum channels,
+                                      const RectI & rect)
+{
+    switch (channels) {
+    case eDisplayChannelsRGB:
+
+        return findAutoContrastVminVmax_internal<nComps, eDisplayChannelsRGB>(inputImage, rect);
+    case eDisplayChannelsY:
+
+        return findAutoContrastVminVmax_internal<nComps, eDisplayChannelsY>(inputImage, rect);
+    case eDisplayChannelsR:
+
+        return findAutoContrastVminVmax_internal<nComps, eDisplayChannelsR>(inputImage, rect);
+    case eDisplayChannelsG:
+
+        return findAutoContrastVminVmax_internal<nComps, eDisplayChannelsG>(inputImage, rect);
+    case eDisplayChannelsB:
+
+        return findAutoContrastVminVmax_internal<nComps, eDisplayChannelsB>(inputImage, rect);
+    case eDisplayChannelsA:
+
+        return findAutoContrastVminVmax_internal<nComps, eDisplayChannelsA>(inputImage, rect);
+    default:
+
+        return findAutoContrastVminVmax_internal<nComps, eDisplayChannelsMatte>(inputImage, rect);
+    }
 }
 
 MinMaxVal
@@ -2151,13 +2284,13 @@ findAutoContrastVminVmax(const ImagePtr inputImage,
     int nComps = inputImage->getComponents().getNumComponents();
 
     if (nComps == 4) {
-        return findAutoContrastVminVmax_internal<4>(inputImage, channels, rect);
+        return findAutoContrastVminVmaxForComponents<4>(inputImage, channels, rect);
     } else if (nComps == 3) {
-        return findAutoContrastVminVmax_internal<3>(inputImage, channels, rect);
+        return findAutoContrastVminVmaxForComponents<3>(inputImage, channels, rect);
     } else if (nComps == 1) {
-        return findAutoContrastVminVmax_internal<1>(inputImage, channels, rect);
+        return findAutoContrastVminVmaxForComponents<1>(inputImage, channels, rect);
     } else {
-        return findAutoContrastVminVmax_generic(inputImage, nComps, channels, rect);
+        return findAutoContrastVminVmaxForComponents<2>(inputImage, channels, rect);
     }
 } // findAutoContrastVminVmax
 
@@ -2391,6 +2524,94 @@ scaleToTexture8bits_generic(const RectI& roi,
     } // for (int y = yRange.first; y < yRange.second;
 } // scaleToTexture8bits_generic
 
+// Same as scaleToTexture8bits_generic for linear RGBA float images converted to a color-space without gamma, luminance
+// or matte: the look-up table indexes of a whole row are computed with the vector instructions before the error diffusion
+template <bool opaque, int rOffset, int gOffset, int bOffset>
+void
+scaleToTexture8bitsLinearFloatRGBA(const RectI& roi,
+                                   const RenderViewerArgs & args,
+                                   const UpdateViewerParams::CachedTile& tile,
+                                   U32* tileBuffer)
+{
+    Image::ReadAccess acc = Image::ReadAccess( args.inputImage.get() );
+
+    if ( (args.renderOnlyRoI && !tile.rect.contains(roi)) || (!args.renderOnlyRoI && !roi.contains(tile.rect)) ) {
+        return;
+    }
+    assert(tile.rect.x2 > tile.rect.x1);
+    assert(args.colorSpace);
+
+    int dstRowElements;
+    U32* dst_pixels;
+    if (args.renderOnlyRoI) {
+        dstRowElements = tile.rect.width();
+        dst_pixels = tileBuffer + (roi.y1 - tile.rect.y1) * dstRowElements + (roi.x1 - tile.rect.x1);
+    } else {
+        dstRowElements = args.tileRowElements;
+        dst_pixels = tileBuffer + (tile.rect.y1 - tile.rectRounded.y1) * args.tileRowElements + (tile.rect.x1 - tile.rectRounded.x1);
+    }
+
+    const int y1 = args.renderOnlyRoI ? roi.y1 : tile.rect.y1;
+    const int y2 = args.renderOnlyRoI ? roi.y2 : tile.rect.y2;
+    const int x1 = args.renderOnlyRoI ? roi.x1 : tile.rect.x1;
+    const int x2 = args.renderOnlyRoI ? roi.x2 : tile.rect.x2;
+    const float* src_pixels = (const float*)acc.pixelAt(x1, y1);
+    const int srcRowElements = (int)args.inputImage->getRowElements();
+    const std::size_t rowValues = (std::size_t)(x2 - x1) * 4;
+    const Color::Lut* colorSpace = args.colorSpace;
+
+    std::vector<unsigned short> indexes(rowValues);
+    std::vector<float> blackRow;
+    if (!src_pixels) {
+        blackRow.resize(rowValues, 0.f);
+    }
+
+    for (int y = y1; y < y2;
+         ++y,
+         dst_pixels += dstRowElements) {
+        ImageSIMD::linearToLutIndexes(src_pixels ? src_pixels : &blackRow[0], args.gain, args.offset, &indexes[0], rowValues);
+
+        // coverity[dont_call]
+        int start = (int)( rand() % (x2 - x1) );
+
+        for (int backward = 0; backward < 2; ++backward) {
+            int index = backward ? start - 1 : start;
+
+            assert( backward == 1 || ( index >= 0 && index < (x2 - x1) ) );
+
+            unsigned error_r = 0x80;
+            unsigned error_g = 0x80;
+            unsigned error_b = 0x80;
+
+            while (index < (x2 - x1) && index >= 0) {
+                const unsigned short* pixIndexes = &indexes[index * 4];
+                int uA;
+                if (opaque) {
+                    uA = 255;
+                } else {
+                    uA = src_pixels ? Color::floatToInt<256>(src_pixels[index * 4 + 3]) : 0;
+                }
+
+                error_r = (error_r & 0xff) + colorSpace->toColorSpaceUint8xxFromLinearFloatHipartFast(pixIndexes[rOffset]);
+                error_g = (error_g & 0xff) + colorSpace->toColorSpaceUint8xxFromLinearFloatHipartFast(pixIndexes[gOffset]);
+                error_b = (error_b & 0xff) + colorSpace->toColorSpaceUint8xxFromLinearFloatHipartFast(pixIndexes[bOffset]);
+                assert(error_r < 0x10000 && error_g < 0x10000 && error_b < 0x10000);
+
+                dst_pixels[index] = toBGRA( (U8)(error_r >> 8), (U8)(error_g >> 8), (U8)(error_b >> 8), uA );
+
+                if (backward) {
+                    --index;
+                } else {
+                    ++index;
+                }
+            }
+        } // for (int backward = 0; backward < 2; ++backward) {
+        if (src_pixels) {
+            src_pixels += srcRowElements;
+        }
+    }
+} // scaleToTexture8bitsLinearFloatRGBA
+
 template <typename PIX, int maxValue, int nComps, bool opaque, bool matteOverlay, int rOffset, int gOffset, int bOffset>
 void
 scaleToTexture8bits_internal(const RectI& roi,
@@ -2399,6 +2620,12 @@ scaleToTexture8bits_internal(const RectI& roi,
                              const UpdateViewerParams::CachedTile& tile,
                              U32* output)
 {
+    if ( !matteOverlay && (nComps == 4) && (sizeof(PIX) == sizeof(float)) && args.colorSpace && !args.srcColorSpace &&
+         (args.gamma == 1.) && (args.channels != eDisplayChannelsY) ) {
+        scaleToTexture8bitsLinearFloatRGBA<opaque, rOffset, gOffset, bOffset>(roi, args, tile, output);
+
+        return;
+    }
     scaleToTexture8bits_generic<PIX, maxValue, opaque, matteOverlay, rOffset, gOffset, bOffset>(roi, args, nComps, viewer, tile, output);
 }
 
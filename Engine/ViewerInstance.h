@@ -125,6 +125,15 @@ public:
                                                                 const RenderStatsPtr& stats,
                                                                 ViewerArgs* outArgs);
 
+    /**
+     * @brief Reads from the disk in the background the textures of the given frame that are only in the disk portion
+     * of the viewer cache, for the tiles of params that were found in the cache. This is called during playback for the
+     * next frames, so that they do not wait for the disk once the render threads look them up. forward is true if
+     * the playback goes forward.
+     * Returns the number of textures prefetched.
+     **/
+    int prefetchCachedTextures(const UpdateViewerParams& params, SequenceTime time, bool forward) const;
+
 private:
     /**
      * @brief Look-up the cache and try to find a matching texture for the portion to render.
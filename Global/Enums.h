@@ -467,6 +467,18 @@ enum StorageModeEnum
     eStorageModeGLTex //< will be allocated as an OpenGL texture
 };
 
+enum BitmapStorageEnum
+{
+    eBitmapStoragePixels = 0, //< the render state of each pixel is stored
+    eBitmapStorageTiles //< the render state is stored per tile, the pixels are only stored for the tiles that are partially rendered
+};
+
+enum CacheEvictionPolicyEnum
+{
+    eCacheEvictionPolicyLRU = 0, //< the least recently used entry is evicted first
+    eCacheEvictionPolicyGreedyDualSize //< among the least recently used entries, the cheapest to recompute relative to its size is evicted first
+};
+
 enum OrientationEnum
 {
     eOrientationHorizontal = 0x1,
@@ -312,6 +312,15 @@ NATRON_VERSION_STRINGIZE__(major, minor)
 #define CLANG_PRAGMA(PRAGMA)
 #endif
 
+// Storage class of the thread-local variables: thread_local is C++11, but all our compilers have an equivalent for POD types.
+#if __cplusplus >= 201103L
+#define NATRON_THREAD_LOCAL thread_local
+#elif defined(_MSC_VER)
+#define NATRON_THREAD_LOCAL __declspec(thread)
+#else
+#define NATRON_THREAD_LOCAL __thread
+#endif
+
 // Warning control from https://svn.boost.org/trac/boost/wiki/Guidelines/WarningsGuidelines
 #if ( ( __GNUC__ * 100) + __GNUC_MINOR__) >= 402
 #define GCC_DIAG_STR(s) # s
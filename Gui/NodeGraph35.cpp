@@ -262,7 +262,16 @@ NodeGraph::updateCacheSizeText()
     QString cacheSizeStr = QDirModelPrivate_size(cacheSize);
     quint64 diskSize = appPTR->getCachesTotalDiskSize();
     QString diskCacheSizeStr = QDirModelPrivate_size(diskSize);
-    QString newText = tr("Memory cache: %1 / Disk cache: %2").arg(cacheSizeStr).arg(diskCacheSizeStr);
+    U64 nHits, nMisses;
+    double recomputeTimeSaved;
+    appPTR->getImageCachesStatistics(&nHits, &nMisses, &recomputeTimeSaved);
+    double hitRate = (nHits + nMisses) ? (100. * nHits) / (nHits + nMisses) : 0.;
+    U64 nPrefetched, nPrefetchHits, nMajorPageFaults;
+    appPTR->getDiskCacheReadStatistics(&nPrefetched, &nPrefetchHits, &nMajorPageFaults);
+    double prefetchHitRate = nPrefetched ? (100. * nPrefetchHits) / nPrefetched : 0.;
+    QString newText = tr("Memory cache: %1 / Disk cache: %2 / Hit rate: %3% / Render time saved: %4s / Disk prefetch hit rate: %5% / Page faults from disk: %6")
+                      .arg(cacheSizeStr).arg(diskCacheSizeStr).arg(hitRate, 0, 'f', 1).arg(recomputeTimeSaved, 0, 'f', 1)
+                      .arg(prefetchHitRate, 0, 'f', 1).arg(nMajorPageFaults);
     if (newText != oldText) {
         _imp->_cacheSizeText->setText(newText);
     }
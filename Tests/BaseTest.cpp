@@ -45,6 +45,7 @@ CLANG_DIAG_ON(unknown-pragmas)
 
 #include "Engine/CreateNodeArgs.h"
 #include "Engine/Node.h"
+#include "Engine/ParallelRenderArgs.h"
 #include "Engine/Project.h"
 #include "Engine/AppManager.h"
 #include "Engine/AppInstance.h"
@@ -320,3 +321,42 @@ TEST_F(BaseTest, SimpleNodeConnections) {
     disconnectNodes(generator, writer, false);
     connectNodes(generator, writer, 0, true);
 }
+
+// The nodes of a tree are found again only when the tree changes
+TEST_F(BaseTest, RenderPlanReuse)
+{
+    NodePtr generator = createNode(_generatorPluginID);
+    NodePtr writer = createNode(_writeOIIOPluginID);
+
+    ASSERT_TRUE(writer && generator);
+    connectNodes(generator, writer, 0, true);
+
+    U64 nBuilt, nReused;
+    double buildTime;
+    appPTR->getRenderPlanStatistics(&nBuilt, &nReused, &buildTime);
+
+    RenderPlanConstPtr plan = RenderPlan::getPlan(writer);
+    ASSERT_TRUE(plan);
+    ASSERT_EQ( 2, (int)plan->getItems().size() );
+    EXPECT_EQ( generator, plan->getItems()[0].node.lock() ) << "The inputs come first";
+    EXPECT_EQ( writer, plan->getItems()[1].node.lock() );
+    EXPECT_EQ( plan, RenderPlan::getPlan(writer) );
+
+    U64 nBuiltAfter, nReusedAfter;
+    appPTR->getRenderPlanStatistics(&nBuiltAfter, &nReusedAfter, &buildTime);
+    EXPECT_EQ(nBuilt + 1, nBuiltAfter);
+    EXPECT_EQ(nReused + 1, nReusedAfter);
+
+    // a parameter upstream changes the hash of the tree
+    KnobDoublePtr knob = boost::dynamic_pointer_cast<KnobDouble>( generator->getKnobByName("noiseZSlope") );
+    ASSERT_TRUE(knob);
+    knob->setValue(0.25);
+    RenderPlanConstPtr newPlan = RenderPlan::getPlan(writer);
+    EXPECT_NE(plan, newPlan);
+    EXPECT_EQ( 2, (int)newPlan->getItems().size() );
+
+    disconnectNodes(generator, writer, true);
+    newPlan = RenderPlan::getPlan(writer);
+    ASSERT_EQ( 1, (int)newPlan->getItems().size() );
+    EXPECT_EQ( writer, newPlan->getItems()[0].node.lock() );
+}
@@ -0,0 +1,565 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * Copyright (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include <cstdlib> // rand
+#include <cstdio> // sprintf
+#include <cstring> // memset, strcpy
+#include <iostream>
+#include <vector>
+#include <gtest/gtest.h>
+
+#include <QtCore/QDir>
+#include <QtCore/QThread>
+
+#include "Engine/AppManager.h"
+#include "Engine/BufferPool.h"
+#include "Engine/Cache.h"
+#include "Engine/CacheIndexFile.h"
+#include "Engine/Image.h"
+#include "Engine/ImagePlaneDesc.h"
+#include "Engine/MemoryFile.h"
+#include "Engine/Settings.h"
+#include "Engine/Timer.h"
+#include "Engine/ViewIdx.h"
+
+NATRON_NAMESPACE_USING
+
+typedef Cache<Image> ImageCache;
+
+static ImageKey
+makeTestKey(U64 nodeHash)
+{
+    return Image::makeKey(0, nodeHash, false, 0, ViewIdx(0), false, false);
+}
+
+static ImageParamsPtr
+makeTestParams()
+{
+    RectD rod(0, 0, 16, 16);
+
+    return Image::makeParams(rod, 1., 0, false, ImagePlaneDesc::getRGBAComponents(), eImageBitDepthFloat, eImagePremultiplicationPremultiplied, eImageFieldingOrderNone);
+}
+
+TEST(Cache, ShardedGetOrCreate)
+{
+    ImageCache cache("CacheTest", NATRON_CACHE_VERSION, 1024 * 1024 * 1024, 1., 8);
+    ASSERT_EQ( (std::size_t)8, cache.getNumberOfBuckets() );
+
+    ImageParamsPtr params = makeTestParams();
+    std::vector<ImagePtr> created;
+    for (U64 i = 0; i < 100; ++i) {
+        ImagePtr image;
+        EXPECT_FALSE( cache.getOrCreate(makeTestKey(i), params, 0, &image) ) << "A fresh cache cannot contain the entry";
+        ASSERT_TRUE(image);
+        created.push_back(image);
+    }
+
+    // Every entry must be found again, whatever bucket it landed in
+    for (U64 i = 0; i < 100; ++i) {
+        ImagePtr image;
+        EXPECT_TRUE( cache.getOrCreate(makeTestKey(i), params, 0, &image) );
+        EXPECT_EQ(created[i], image);
+    }
+
+    std::list<ImagePtr> copy;
+    cache.getCopy(&copy);
+    EXPECT_EQ( created.size(), copy.size() );
+
+    cache.removeEntry(created[42]);
+    std::list<ImagePtr> found;
+    EXPECT_FALSE( cache.get(makeTestKey(42), &found) );
+    EXPECT_TRUE( cache.get(makeTestKey(43), &found) );
+
+    copy.clear();
+    created.clear();
+    found.clear();
+    cache.clear();
+    cache.waitForDeleterThread();
+}
+
+// A sharded cache that is full evicts entries of any bucket to stay within its budget
+TEST(Cache, ShardedEviction)
+{
+    // Room for 10 entries of 16x16 RGBA float
+    const std::size_t entrySize = 16 * 16 * 4 * sizeof(float);
+    ImageCache cache("CacheTest", NATRON_CACHE_VERSION, 10 * entrySize, 1., 8);
+    ImageParamsPtr params = makeTestParams();
+
+    for (U64 i = 0; i < 100; ++i) {
+        ImagePtr image;
+        EXPECT_FALSE( cache.getOrCreate(makeTestKey(i), params, 0, &image) );
+        ASSERT_TRUE(image);
+        image->allocateMemory();
+    }
+    cache.waitForDeleterThread();
+
+    std::list<ImagePtr> copy;
+    cache.getCopy(&copy);
+    EXPECT_LT( copy.size(), (std::size_t)100 );
+    EXPECT_LE( cache.getMemoryCacheSize(), cache.getMaximumMemorySize() + entrySize );
+
+    // The last entry created is the most recently used one
+    std::list<ImagePtr> found;
+    EXPECT_TRUE( cache.get(makeTestKey(99), &found) );
+
+    copy.clear();
+    found.clear();
+    cache.clear();
+    cache.waitForDeleterThread();
+}
+
+TEST(Cache, Statistics)
+{
+    ImageCache cache("CacheTest", NATRON_CACHE_VERSION, 1024 * 1024 * 1024, 1., 8);
+    ImageParamsPtr params = makeTestParams();
+    ImagePtr image;
+
+    EXPECT_FALSE( cache.getOrCreate(makeTestKey(1), params, 0, &image) );
+    ASSERT_TRUE(image);
+    image->addRecomputeCost(2.);
+    image->addRecomputeCost(0.5);
+    EXPECT_EQ( 2.5, image->getRecomputeCost() );
+
+    std::list<ImagePtr> found;
+    EXPECT_TRUE( cache.get(makeTestKey(1), &found) );
+    EXPECT_TRUE( cache.get(makeTestKey(1), &found) );
+    EXPECT_FALSE( cache.get(makeTestKey(2), &found) );
+
+    U64 nHits, nMisses;
+    double recomputeTimeSaved;
+    cache.getStatistics(&nHits, &nMisses, &recomputeTimeSaved);
+    EXPECT_EQ( (U64)2, nHits );
+    EXPECT_EQ( (U64)2, nMisses ) << "getOrCreate() of a new entry is a miss";
+    EXPECT_EQ( 5., recomputeTimeSaved );
+
+    found.clear();
+    image.reset();
+    cache.clear();
+    cache.waitForDeleterThread();
+}
+
+TEST(BufferPool, Recycling)
+{
+    // The images of a format always fall in the same size class, at most 12.5% larger
+    EXPECT_EQ( (std::size_t)100, BufferPool::getSizeClass(100) );
+    EXPECT_EQ( (std::size_t)32 * 1024 * 1024, BufferPool::getSizeClass( (std::size_t)1920 * 1080 * 16 ) );
+    for (std::size_t n = 64 * 1024; n < 1024 * 1024 * 1024; n = n * 3 / 2 + 7) {
+        std::size_t size = BufferPool::getSizeClass(n);
+        EXPECT_GE(size, n);
+        EXPECT_LE(size, n + n / 8);
+        EXPECT_EQ( size, BufferPool::getSizeClass(size) );
+    }
+
+    BufferPool::setMaximumPooledSize(64 * 1024 * 1024);
+    BufferPool::trim(0);
+
+    U64 nHits, nMisses, pooledBytes;
+    double fragmentation;
+    BufferPool::getStatistics(&nHits, &nMisses, &pooledBytes, &fragmentation);
+
+    const U64 nFloats = 3 * 1000 * 1000;
+    const float* data;
+    {
+        RamBuffer<float> buffer;
+        buffer.resize(nFloats);
+        data = buffer.getData();
+        ASSERT_TRUE(data);
+    }
+    // An image of the same size gets the same buffer back
+    RamBuffer<float> buffer;
+    buffer.resize(nFloats - 1);
+    EXPECT_EQ( data, buffer.getData() );
+
+    U64 nHitsAfter, nMissesAfter, pooledBytesAfter;
+    BufferPool::getStatistics(&nHitsAfter, &nMissesAfter, &pooledBytesAfter, &fragmentation);
+    EXPECT_EQ(nHits + 1, nHitsAfter);
+    EXPECT_EQ(nMisses + 1, nMissesAfter);
+    EXPECT_EQ(pooledBytes, pooledBytesAfter);
+    EXPECT_GT(fragmentation, 0.);
+
+    buffer.clear();
+    BufferPool::trim(0);
+    BufferPool::getStatistics(&nHits, &nMisses, &pooledBytes, &fragmentation);
+    EXPECT_EQ( (U64)0, pooledBytes );
+    appPTR->setApplicationsCachesMaximumMemoryPercent( appPTR->getCurrentSettings()->getRamMaximumPercent() );
+}
+
+struct TestEvictionPriority
+{
+    double operator()(const boost::shared_ptr<double>& value) const
+    {
+        return *value;
+    }
+};
+
+TEST(LRUHashTable, EvictLowestPriority)
+{
+    typedef boost::shared_ptr<double> ValuePtr;
+#ifdef NATRON_CACHE_USE_BOOST
+    BoostLRUHashTable<U64, ValuePtr> table;
+#else
+    StlLRUHashTable<U64, ValuePtr> table;
+#endif
+    const double priorities[5] = { 5., 1., 3., 0.5, 0.1 };
+
+    // Entries that are used elsewhere cannot be evicted
+    ValuePtr inUse;
+    for (U64 i = 0; i < 5; ++i) {
+        ValuePtr value = boost::make_shared<double>(priorities[i]);
+        table.insert(i, value);
+        if (i == 4) {
+            inUse = value;
+        }
+    }
+
+    // Only the 3 least recently used entries are candidates
+    EXPECT_EQ( (U64)1, table.evictLowestPriority(TestEvictionPriority(), 3).first );
+    EXPECT_EQ( (U64)3, table.evictLowestPriority(TestEvictionPriority(), 10).first );
+    EXPECT_EQ( (U64)0, table.evict().first );
+    EXPECT_EQ( (U64)2, table.evictLowestPriority(TestEvictionPriority(), 10).first );
+    EXPECT_FALSE( table.evictLowestPriority(TestEvictionPriority(), 10).second );
+}
+
+class CacheProducerThread
+    : public QThread
+{
+    const ImageCache* _cache;
+    ImageKey _key;
+    ImageParamsPtr _params;
+    CacheEntryProductionPtr _production;
+
+public:
+
+    CacheProducerThread(const ImageCache* cache,
+                        const ImageKey& key,
+                        const ImageParamsPtr& params,
+                        const CacheEntryProductionPtr& production)
+        : QThread()
+        , _cache(cache)
+        , _key(key)
+        , _params(params)
+        , _production(production)
+    {
+    }
+
+private:
+
+    virtual void run() OVERRIDE FINAL
+    {
+        QThread::msleep(100);
+        ImagePtr image;
+        _cache->getOrCreate(_key, _params, 0, &image);
+        _cache->finishProduction(_key, _production);
+    }
+};
+
+TEST(Cache, InFlightProduction)
+{
+    ImageCache cache("CacheTest", NATRON_CACHE_VERSION, 1024 * 1024 * 1024, 1., 8);
+    ImageParamsPtr params = makeTestParams();
+    ImageKey key = makeTestKey(1);
+
+    CacheEntryProductionPtr production = cache.registerProduction(key, 0);
+    ASSERT_TRUE(production);
+    EXPECT_FALSE( cache.registerProduction(key, 0) ) << "Only one thread may produce an entry";
+    EXPECT_TRUE( cache.registerProduction(makeTestKey(2), 0) ) << "Unrelated entries are not affected";
+
+    std::list<ImagePtr> found;
+    CacheEntryProductionPtr inFlight;
+    EXPECT_FALSE( cache.get(key, &found, 1, &inFlight) );
+    EXPECT_FALSE(inFlight) << "Other variants of the entry are not waited for";
+    EXPECT_FALSE( cache.get(key, &found, 0, &inFlight) );
+    EXPECT_EQ(production, inFlight);
+
+    // Waking-up the waiters does not finish the production
+    int wakeUps = inFlight->getWakeUps();
+    inFlight->wakeWaiters();
+    EXPECT_FALSE( inFlight->waitForProduction(wakeUps) );
+
+    CacheProducerThread producer(&cache, key, params, production);
+    producer.start();
+    EXPECT_TRUE( inFlight->waitForProduction( inFlight->getWakeUps() ) );
+    EXPECT_TRUE( production->isFinished() );
+
+    // Once the producer is done, the entry is in the cache and no longer in flight
+    inFlight.reset();
+    EXPECT_TRUE( cache.get(key, &found, 0, &inFlight) );
+    EXPECT_FALSE(inFlight);
+    producer.wait();
+
+    // A producer that gave up releases the entry for the next thread
+    production = cache.registerProduction(makeTestKey(3), 0);
+    ASSERT_TRUE(production);
+    cache.finishProduction(makeTestKey(3), production);
+    EXPECT_TRUE( cache.registerProduction(makeTestKey(3), 0) );
+
+    found.clear();
+    cache.clear();
+    cache.waitForDeleterThread();
+}
+
+class CacheLookupThread
+    : public QThread
+{
+    const ImageCache* _cache;
+    ImageParamsPtr _params;
+    U64 _firstHash;
+    int _nKeys;
+    int _nIterations;
+
+public:
+
+    CacheLookupThread(const ImageCache* cache,
+                      const ImageParamsPtr& params,
+                      U64 firstHash,
+                      int nKeys,
+                      int nIterations)
+        : QThread()
+        , _cache(cache)
+        , _params(params)
+        , _firstHash(firstHash)
+        , _nKeys(nKeys)
+        , _nIterations(nIterations)
+    {
+    }
+
+private:
+
+    virtual void run() OVERRIDE FINAL
+    {
+        for (int i = 0; i < _nIterations; ++i) {
+            ImagePtr image;
+            _cache->getOrCreate(makeTestKey( _firstHash + (U64)(i % _nKeys) ), _params, 0, &image);
+        }
+    }
+};
+
+static double
+runLookupBenchmark(unsigned int nBuckets,
+                   int nThreads,
+                   int nIterations)
+{
+    ImageCache cache("CacheTest", NATRON_CACHE_VERSION, 1024 * 1024 * 1024, 1., nBuckets);
+    ImageParamsPtr params = makeTestParams();
+    std::vector<CacheLookupThread*> threads;
+
+    // Each thread works on its own set of images, as render threads of different frames do
+    for (int i = 0; i < nThreads; ++i) {
+        threads.push_back( new CacheLookupThread(&cache, params, (U64)i * 1000, 64, nIterations) );
+    }
+    TimeLapse timer;
+    for (std::size_t i = 0; i < threads.size(); ++i) {
+        threads[i]->start();
+    }
+    for (std::size_t i = 0; i < threads.size(); ++i) {
+        threads[i]->wait();
+        delete threads[i];
+    }
+    double elapsed = timer.getTimeSinceCreation();
+
+    cache.clear();
+    cache.waitForDeleterThread();
+
+    return elapsed;
+}
+
+// Not a correctness test: prints the lookup throughput of a single-lock cache versus a sharded one
+// as the number of threads increases.
+// Disabled by default: run it with --gtest_also_run_disabled_tests.
+TEST(Cache, DISABLED_ContentionBenchmark)
+{
+    const int nIterations = 20000;
+    const int maxThreads = std::max( 2, QThread::idealThreadCount() );
+
+    for (int nThreads = 1; nThreads <= maxThreads; nThreads *= 2) {
+        unsigned int nBuckets = (unsigned int)maxThreads * NATRON_CACHE_BUCKETS_PER_THREAD;
+        double single = runLookupBenchmark(1, nThreads, nIterations);
+        double sharded = runLookupBenchmark(nBuckets, nThreads, nIterations);
+        double nOps = (double)nThreads * nIterations;
+        std::cout << "Cache lookups, " << nThreads << " thread(s): 1 bucket: " << (int)(nOps / std::max(single, 1e-6) )
+                  << " ops/s, " << nBuckets << " buckets: " << (int)(nOps / std::max(sharded, 1e-6) ) << " ops/s" << std::endl;
+    }
+}
+
+TEST(TileCacheFile, AllocFree)
+{
+    const int nTiles = 5000;
+    TileCacheFile file;
+
+    file.initTiles(nTiles);
+    EXPECT_EQ( (std::size_t)0, file.getNumUsedTiles() );
+
+    // Tiles are handed out lowest index first
+    for (int i = 0; i < nTiles; ++i) {
+        int index = file.findFreeTile();
+        ASSERT_EQ(i, index);
+        file.setTileUsed(index, true);
+    }
+    EXPECT_TRUE( file.isFull() );
+    EXPECT_EQ(-1, file.findFreeTile());
+
+    file.setTileUsed(4097, false);
+    file.setTileUsed(63, false);
+    EXPECT_FALSE( file.isTileUsed(63) );
+    EXPECT_EQ( (std::size_t)nTiles - 2, file.getNumUsedTiles() );
+    EXPECT_EQ(63, file.findFreeTile());
+    file.setTileUsed(63, true);
+    EXPECT_EQ(4097, file.findFreeTile());
+    file.setTileUsed(4097, true);
+    EXPECT_EQ(-1, file.findFreeTile());
+}
+
+// Not a correctness test: prints the throughput of tile allocations in a 1M tiles file that is 90% full,
+// compared with the linear scan of a bitset that it replaces.
+// Disabled by default: run it with --gtest_also_run_disabled_tests.
+TEST(TileCacheFile, DISABLED_ChurnBenchmark)
+{
+    const int nTiles = 1 << 20;
+    const int nChurn = 1000000;
+    const int nLinearChurn = 2000;
+
+    TileCacheFile file;
+    std::vector<bool> usedTiles(nTiles, false);
+
+    file.initTiles(nTiles);
+    for (int i = 0; i < nTiles; ++i) {
+        if (i % 10 != 0) {
+            file.setTileUsed(i, true);
+            usedTiles[i] = true;
+        }
+    }
+
+    srand(2018);
+    TimeLapse timer;
+    for (int i = 0; i < nChurn; ++i) {
+        int index = file.findFreeTile();
+        ASSERT_NE(-1, index);
+        file.setTileUsed(index, true);
+        file.setTileUsed(rand() % nTiles, false);
+    }
+    double indexed = timer.getTimeElapsedReset();
+
+    for (int i = 0; i < nLinearChurn; ++i) {
+        for (int j = 0; j < nTiles; ++j) {
+            if (!usedTiles[j]) {
+                usedTiles[j] = true;
+                break;
+            }
+        }
+        usedTiles[rand() % nTiles] = false;
+    }
+    double linear = timer.getTimeElapsedReset();
+
+    std::cout << "Tile allocations in a file of " << nTiles << " tiles: bitmap index: " << (int)(nChurn / std::max(indexed, 1e-6) )
+              << " ops/s, linear scan: " << (int)(nLinearChurn / std::max(linear, 1e-6) ) << " ops/s" << std::endl;
+}
+
+TEST(CacheIndexFile, ReopenAndCompact)
+{
+    const std::string recordsPath = QDir::tempPath().toStdString() + "/CacheIndexFileTest." NATRON_CACHE_FILE_EXT;
+    const std::string payloadPath = QDir::tempPath().toStdString() + "/CacheIndexFileTest_data." NATRON_CACHE_FILE_EXT;
+    const U32 nRecords = 3000;
+
+    {
+        CacheIndexFile index(recordsPath, payloadPath);
+        index.remove();
+        EXPECT_FALSE( index.open(NATRON_CACHE_VERSION) ) << "There is no index yet";
+        for (U32 i = 0; i < nRecords; ++i) {
+            CacheIndexRecord record;
+            std::memset( &record, 0, sizeof(CacheIndexRecord) );
+            record.hash = i;
+            record.size = 2 * i;
+            std::strcpy(record.fileName, "CachePart0");
+            char payload[16];
+            std::sprintf(payload, "p%u", i);
+            EXPECT_EQ( i, index.appendRecord( record, payload, std::strlen(payload) ) );
+        }
+        for (U32 i = 0; i < nRecords; i += 2) {
+            index.removeRecord(i);
+        }
+        index.setClean(true);
+    }
+    {
+        CacheIndexFile index(recordsPath, payloadPath);
+        ASSERT_TRUE( index.open(NATRON_CACHE_VERSION) );
+        EXPECT_EQ( nRecords, index.getNumRecords() );
+        EXPECT_EQ( nRecords / 2, index.getNumRemovedRecords() );
+        const CacheIndexRecord& record = index.getRecord(7);
+        EXPECT_EQ( (U64)14, record.size );
+        EXPECT_EQ( std::string("p7"), std::string(index.getPayload(record), record.payloadSize) );
+
+        index.compact();
+        EXPECT_EQ( nRecords / 2, index.getNumRecords() );
+        EXPECT_EQ( (U32)0, index.getNumRemovedRecords() );
+        EXPECT_EQ( (U64)7, index.getRecord(3).hash );
+        EXPECT_EQ( std::string("p7"), std::string(index.getPayload( index.getRecord(3) ), 2) );
+
+        // The cache was modified and not saved again
+        index.setClean(false);
+    }
+    {
+        CacheIndexFile index(recordsPath, payloadPath);
+        EXPECT_FALSE( index.open(NATRON_CACHE_VERSION) ) << "An index that was not closed properly must be discarded";
+        EXPECT_EQ( (U32)0, index.getNumRecords() );
+        index.setClean(true);
+    }
+    {
+        CacheIndexFile index(recordsPath, payloadPath);
+        EXPECT_FALSE( index.open(NATRON_CACHE_VERSION + 1) ) << "An index of another cache version must be discarded";
+        index.remove();
+    }
+}
+
+TEST(MemoryFile, Prefetch)
+{
+    const std::string path = QDir::tempPath().toStdString() + "/MemoryFilePrefetchTest." NATRON_CACHE_FILE_EXT;
+    const std::size_t size = 2 * NATRON_MEMORY_FILE_SEQUENTIAL_MIN_SIZE;
+
+    {
+        MemoryFile file(path, size, MemoryFile::eFileOpenModeEnumIfExistsTruncateElseCreate);
+        std::memset(file.data(), 1, size);
+        file.flush(MemoryFile::eFlushTypeSync, NULL, 0);
+    }
+
+    U64 nPrefetched, nHits;
+    MemoryFile::getPrefetchStatistics(&nPrefetched, &nHits);
+    bool prefetched = MemoryFile::prefetchFile(path, true);
+    if (prefetched) {
+        EXPECT_FALSE( MemoryFile::prefetchFile(path, true) ) << "The file is already prefetched";
+    }
+
+    MemoryFile file(path, MemoryFile::eFileOpenModeEnumIfExistsKeepElseFail);
+    ASSERT_EQ( size, file.size() );
+    file.prefetch();
+    EXPECT_EQ( 1, file.data()[size - 1] );
+
+    U64 nPrefetchedAfter, nHitsAfter;
+    MemoryFile::getPrefetchStatistics(&nPrefetchedAfter, &nHitsAfter);
+    EXPECT_EQ( nPrefetched + (prefetched ? 1 : 0), nPrefetchedAfter );
+    EXPECT_EQ( nHits + (prefetched ? 1 : 0), nHitsAfter );
+
+    file.remove();
+}
@@ -24,12 +24,22 @@
 
 #include "Global/Macros.h"
 
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <vector>
+
 #include <gtest/gtest.h>
 
+#include <boost/make_shared.hpp>
+#include <boost/shared_ptr.hpp>
+
 #include <QtCore/QString>
 #include <QtCore/QDir>
+#include <QtCore/QThread>
 
 #include "Engine/Curve.h"
+#include "Engine/Timer.h"
 
 NATRON_NAMESPACE_USING
 
@@ -124,3 +134,144 @@ TEST(Curve, Basic)
 }
 
 
+
+// The values read without locking follow the changes of the curve
+TEST(Curve, Snapshot)
+{
+    Curve c;
+
+    EXPECT_EQ( 0., c.getValueAt(3.) );
+    EXPECT_TRUE( c.addKeyFrame( KeyFrame(0., 10., 0., 0., eKeyframeTypeLinear) ) );
+    EXPECT_TRUE( c.addKeyFrame( KeyFrame(10., 20., 0., 0., eKeyframeTypeLinear) ) );
+    EXPECT_EQ( 13., c.getValueAt(3.) );
+
+    EXPECT_TRUE( c.addKeyFrame( KeyFrame(5., 0., 0., 0., eKeyframeTypeLinear) ) );
+    EXPECT_EQ( 4., c.getValueAt(3.) );
+
+    c.setKeyFrameValueAndTime(5., 10., 1, NULL);
+    EXPECT_EQ( 10., c.getValueAt(3.) );
+
+    c.setKeyFrameInterpolation(eKeyframeTypeConstant, 0);
+    EXPECT_EQ( 10., c.getValueAt(3.) );
+    c.setKeyFrameValueAndTime(0., 2., 0, NULL);
+    EXPECT_EQ( 2., c.getValueAt(3.) );
+
+    c.removeKeyFrameWithTime(5.);
+    EXPECT_EQ( 2., c.getValueAt(7.) );
+
+    c.setYRange(0., 1.);
+    EXPECT_EQ( 1., c.getValueAt(3.) );
+    EXPECT_EQ( 2., c.getValueAt(3., false) );
+
+    c.clearKeyFrames();
+    EXPECT_EQ( 0., c.getValueAt(3.) );
+
+    // a periodic curve
+    c.setYRange( -std::numeric_limits<double>::infinity(), std::numeric_limits<double>::infinity() );
+    c.setPeriodic(true);
+    c.setXRange(0., 10.);
+    EXPECT_TRUE( c.addKeyFrame( KeyFrame(0., 0., 0., 0., eKeyframeTypeLinear) ) );
+    EXPECT_TRUE( c.addKeyFrame( KeyFrame(5., 10., 0., 0., eKeyframeTypeLinear) ) );
+    EXPECT_EQ( 4., c.getValueAt(2.) );
+    EXPECT_EQ( 4., c.getValueAt(12.) );
+    EXPECT_EQ( 4., c.getValueAt(-8.) );
+    EXPECT_EQ( 6., c.getValueAt(7.) );
+
+    Curve copy;
+    copy = c;
+    EXPECT_EQ( 6., copy.getValueAt(17.) );
+}
+
+class CurveReaderThread
+    : public QThread
+{
+    const Curve* _curve;
+    int _nEvaluations;
+    double _sum;
+
+public:
+
+    CurveReaderThread(const Curve* curve,
+                      int nEvaluations)
+        : QThread()
+        , _curve(curve)
+        , _nEvaluations(nEvaluations)
+        , _sum(0.)
+    {
+    }
+
+    double getSum() const
+    {
+        return _sum;
+    }
+
+private:
+
+    virtual void run() OVERRIDE FINAL
+    {
+        for (int i = 0; i < _nEvaluations; ++i) {
+            _sum += _curve->getValueAt(i * 0.01);
+        }
+    }
+};
+
+// Concurrent readers of a curve all get the values of a single reader
+TEST(Curve, ConcurrentEvaluation)
+{
+    Curve c;
+
+    for (int i = 0; i < 100; ++i) {
+        EXPECT_TRUE( c.addKeyFrame( KeyFrame( i * 10., std::sin(i * 0.1) ) ) );
+    }
+
+    const int nThreads = 8;
+    std::vector<boost::shared_ptr<CurveReaderThread> > readers;
+    for (int i = 0; i < nThreads; ++i) {
+        readers.push_back( boost::make_shared<CurveReaderThread>(&c, 10000) );
+    }
+    for (int i = 0; i < nThreads; ++i) {
+        readers[i]->start();
+    }
+    for (int i = 0; i < nThreads; ++i) {
+        readers[i]->wait();
+    }
+
+    CurveReaderThread reference(&c, 10000);
+    reference.start();
+    reference.wait();
+    for (int i = 0; i < nThreads; ++i) {
+        EXPECT_EQ( reference.getSum(), readers[i]->getSum() );
+    }
+}
+
+// Not a correctness test: prints the number of evaluations per second of an animation curve by 1 to 64 threads.
+// Disabled by default: run it with --gtest_also_run_disabled_tests.
+TEST(Curve, DISABLED_ConcurrentEvaluationBenchmark)
+{
+    Curve c;
+
+    for (int i = 0; i < 100; ++i) {
+        EXPECT_TRUE( c.addKeyFrame( KeyFrame( i * 10., std::sin(i * 0.1) ) ) );
+    }
+
+    const int nEvaluations = 200000;
+    for (int nThreads = 1; nThreads <= 64; nThreads *= 2) {
+        std::vector<boost::shared_ptr<CurveReaderThread> > readers;
+        for (int i = 0; i < nThreads; ++i) {
+            readers.push_back( boost::make_shared<CurveReaderThread>(&c, nEvaluations) );
+        }
+        TimeLapse timer;
+        for (int i = 0; i < nThreads; ++i) {
+            readers[i]->start();
+        }
+        for (int i = 0; i < nThreads; ++i) {
+            readers[i]->wait();
+        }
+        double elapsed = timer.getTimeSinceCreation();
+        for (int i = 1; i < nThreads; ++i) {
+            EXPECT_EQ( readers[0]->getSum(), readers[i]->getSum() );
+        }
+        std::cout << "Curve evaluations by " << nThreads << " threads: "
+                  << (nThreads * (double)nEvaluations / elapsed) << " per second" << std::endl;
+    }
+}
@@ -0,0 +1,165 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * Copyright (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include <gtest/gtest.h>
+
+#include "BaseTest.h"
+
+#include "Engine/AppManager.h"
+#include "Engine/KnobTypes.h"
+#include "Engine/NativeExpression.h"
+#include "Engine/Node.h"
+#include "Engine/Timer.h"
+#include "Engine/ViewIdx.h"
+
+NATRON_NAMESPACE_USING
+
+static double
+getExpressionValue(const KnobDoublePtr& knob,
+                   double time)
+{
+    // do not return the value computed previously at that time
+    knob->clearExpressionsResults(0);
+
+    return knob->getValueAtTime(time, 0);
+}
+
+// The expressions evaluated natively give the same values as Python
+TEST_F(BaseTest, NativeExpressions)
+{
+    NodePtr generator = createNode(_generatorPluginID);
+    ASSERT_TRUE(generator);
+    KnobDoublePtr knob = boost::dynamic_pointer_cast<KnobDouble>( generator->getKnobByName("noiseZ") );
+    KnobDoublePtr slope = boost::dynamic_pointer_cast<KnobDouble>( generator->getKnobByName("noiseZSlope") );
+    ASSERT_TRUE(knob && slope);
+
+    slope->setValueAtTime(0, 0.25, ViewSpec::all(), 0);
+    slope->setValueAtTime(10, 2., ViewSpec::all(), 0);
+
+    const std::string nodeName = generator->getScriptName_mt_safe();
+    const char* expressions[] = {
+        "frame / 3",
+        "frame // 4 + frame % 4 * 0.5",
+        "-2 ** 2 + 2 ** -1 + (frame - 7) % -3",
+        "sin(frame * pi / 12) + sqrt(abs(frame - 5)) * e",
+        "min(frame, 4.5) + max(1, 2, frame / 2) + floor(frame / 3.) + int(-frame / 7.)",
+        "curve(frame) + curve(frame, 0) * 2 + dimension + view",
+        "thisNode.noiseZSlope.get() * 10 + thisNode.noiseZSlope.getValueAtTime(frame + 2)",
+        "log(frame + 1, 2) + degrees(radians(frame)) + hypot(frame, 3)",
+        0
+    };
+    const double times[] = { 0., 1., 2.5, 7., 12., 13.75 };
+
+    for (int i = 0; expressions[i]; ++i) {
+        knob->setExpression(0, expressions[i], false, true);
+        for (std::size_t t = 0; t < sizeof(times) / sizeof(times[0]); ++t) {
+            NativeExpression::setEnabled(false);
+            double expected = getExpressionValue(knob, times[t]);
+            NativeExpression::setEnabled(true);
+            double actual = getExpressionValue(knob, times[t]);
+            EXPECT_EQ(expected, actual) << expressions[i] << " at " << times[t];
+        }
+        knob->clearExpression(0, true);
+    }
+
+    // Python reports the errors: the native evaluation must give up
+    knob->setExpression(0, "1 / (frame - 3)", false, true);
+    EXPECT_TRUE( knob->isExpressionValid(0, 0) );
+    getExpressionValue(knob, 3.);
+    EXPECT_FALSE( knob->isExpressionValid(0, 0) );
+    getExpressionValue(knob, 4.);
+    EXPECT_TRUE( knob->isExpressionValid(0, 0) );
+    knob->clearExpression(0, true);
+
+    // References to the parameters of the node by its name
+    std::string byName = nodeName + ".noiseZSlope.getValue() + 1";
+    knob->setExpression(0, byName, false, true);
+    EXPECT_EQ( slope->getValueAtTime(4., 0) + 1, getExpressionValue(knob, 4.) );
+    knob->clearExpression(0, true);
+}
+
+// Not a correctness test: prints the evaluation time of an expression run from a script, as it used to be,
+// by calling the cached Python function, and without Python.
+// Disabled by default: run it with --gtest_also_run_disabled_tests.
+TEST_F(BaseTest, DISABLED_ExpressionBenchmark)
+{
+    NodePtr generator = createNode(_generatorPluginID);
+    ASSERT_TRUE(generator);
+    KnobDoublePtr knob = boost::dynamic_pointer_cast<KnobDouble>( generator->getKnobByName("noiseZ") );
+    ASSERT_TRUE(knob);
+
+    const std::string expression = "thisNode.noiseZSlope.getValueAtTime(frame) * 2 + sin(frame / 10.)";
+    const int nEvaluations = 20000;
+
+    knob->setExpression(0, expression, false, true);
+
+    // the script that used to be run for each evaluation
+    std::string result;
+    std::string funcExecScript = knob->validateExpression(expression, 0, false, &result);
+    double script;
+    {
+        TimeLapse timer;
+        for (int i = 0; i < nEvaluations; ++i) {
+            std::stringstream ss;
+            ss << funcExecScript << '(' << i << ", " << 0 << ")\n";
+            PyObject* ret = 0;
+            std::string error;
+            if ( KnobHelper::executeExpression(ss.str(), &ret, &error) ) {
+                PythonGILLocker pgl;
+                Py_DECREF(ret);
+            }
+        }
+        script = timer.getTimeSinceCreation();
+    }
+
+    double function;
+    NativeExpression::setEnabled(false);
+    {
+        TimeLapse timer;
+        for (int i = 0; i < nEvaluations; ++i) {
+            getExpressionValue(knob, i);
+        }
+        function = timer.getTimeSinceCreation();
+    }
+    NativeExpression::setEnabled(true);
+
+    double native;
+    {
+        TimeLapse timer;
+        for (int i = 0; i < nEvaluations; ++i) {
+            getExpressionValue(knob, i);
+        }
+        native = timer.getTimeSinceCreation();
+    }
+    knob->clearExpression(0, true);
+
+    std::cout << "Expression evaluations (" << nEvaluations << "): script: " << script
+              << " s, cached function: " << function << " s, native: " << native << " s" << std::endl;
+}
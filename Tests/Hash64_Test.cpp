@@ -24,9 +24,15 @@
 
 #include "Global/Macros.h"
 
+#include <algorithm> // for_each
 #include <cstdlib>
+#include <vector>
 #include <gtest/gtest.h>
 
+#include <boost/crc.hpp>
+
+#include <QtCore/QString>
+
 #include "Engine/Hash64.h"
 
 NATRON_NAMESPACE_USING
@@ -90,3 +96,58 @@ TEST(Hash64,
     EXPECT_NE(hash1, hash2);
 } // TEST
 
+
+// The compatible hash gives the keys of the previous versions: the CRC-64 of the bytes of all the values
+TEST(Hash64,
+     CRC64Compatibility)
+{
+    Hash64::setAlgorithm(Hash64::eHashAlgorithmCRC64);
+
+    Hash64 hash;
+    std::vector<U64> values;
+    srand(2000);
+    for (int i = 0; i < 100; ++i) {
+        // coverity[dont_call]
+        int v = rand();
+        hash.append<int>(v);
+        values.push_back( Hash64::toU64<int>(v) );
+        hash.append<double>(v * 0.5);
+        values.push_back( Hash64::toU64<double>(v * 0.5) );
+    }
+    QString str = QString::fromUtf8("Blur1");
+    Hash64_appendQString(&hash, str);
+    for (int i = 0; i < str.size(); ++i) {
+        values.push_back( Hash64::toU64<unsigned short>( str[i].unicode() ) );
+    }
+    hash.computeHash();
+
+    const unsigned char* data = reinterpret_cast<const unsigned char*>( &values.front() );
+    boost::crc_optimal<64, 0x42F0E1EBA9EA3693ULL, 0, 0, false, false> crc_64;
+    crc_64 = std::for_each( data, data + values.size() * sizeof(values[0]), crc_64 );
+    EXPECT_EQ( crc_64(), hash.value() );
+
+    Hash64::setAlgorithm(Hash64::eHashAlgorithmFast);
+    hash.reset();
+    EXPECT_EQ( Hash64::eHashAlgorithmFast, hash.getHashAlgorithm() ) << "The algorithm is selected when the hash is reset";
+
+    // the order of the values matters
+    Hash64 hash1, hash2;
+    hash1.append<int>(1);
+    hash1.append<int>(2);
+    hash1.computeHash();
+    hash2.append<int>(2);
+    hash2.append<int>(1);
+    hash2.computeHash();
+    EXPECT_NE(hash1, hash2);
+
+    // so do the strings boundaries
+    hash1.reset();
+    Hash64_appendQString( &hash1, QString::fromUtf8("Blur") );
+    Hash64_appendQString( &hash1, QString::fromUtf8("1") );
+    hash1.computeHash();
+    hash2.reset();
+    Hash64_appendQString( &hash2, QString::fromUtf8("Blu") );
+    Hash64_appendQString( &hash2, QString::fromUtf8("r1") );
+    hash2.computeHash();
+    EXPECT_NE(hash1, hash2);
+}
@@ -24,10 +24,19 @@
 
 #include "Global/Macros.h"
 
+#include <algorithm> // min
+#include <cstdlib> // rand
 #include <cstring>
+#include <iostream>
+#include <limits>
+#include <vector>
 #include <gtest/gtest.h>
 
 #include "Engine/Image.h"
+#include "Engine/ImagePlaneDesc.h"
+#include "Engine/ImageSIMD.h"
+#include "Engine/Lut.h"
+#include "Engine/Timer.h"
 #include "Engine/ViewIdx.h"
 
 NATRON_NAMESPACE_USING
@@ -116,6 +125,136 @@ TEST(BitmapTest,
     EXPECT_TRUE(nonRenderedRects.size() == 3);
 } // TEST
 
+static RectI
+randomRect(const RectI& bounds,
+           int margin)
+{
+    int x1 = bounds.x1 - margin + rand() % ( bounds.width() + margin );
+    int y1 = bounds.y1 - margin + rand() % ( bounds.height() + margin );
+
+    return RectI( x1, y1, x1 + 1 + rand() % 200, y1 + 1 + rand() % 200 );
+}
+
+// The tile storage of the bitmap must give the same render state as the pixel storage
+TEST(BitmapTest, TileStorage)
+{
+    srand(2000);
+    for (int iteration = 0; iteration < 500; ++iteration) {
+        int x1 = rand() % 50 - 25;
+        int y1 = rand() % 50 - 25;
+        RectI bounds( x1, y1, x1 + 1 + rand() % 300, y1 + 1 + rand() % 300 );
+        Bitmap pixels(bounds, eBitmapStoragePixels);
+        Bitmap tiles(bounds, eBitmapStorageTiles);
+
+        for (int i = 0; i < 8; ++i) {
+            RectI rect = randomRect(bounds, 5);
+            switch (rand() % 3) {
+            case 0:
+                pixels.markForRendered(rect);
+                tiles.markForRendered(rect);
+                break;
+            case 1:
+                pixels.markForRendering(rect);
+                tiles.markForRendering(rect);
+                break;
+            default:
+                pixels.clear(rect);
+                tiles.clear(rect);
+                break;
+            }
+        }
+        if (iteration % 4 == 0) {
+            // convert back and forth
+            Bitmap copy(bounds, eBitmapStoragePixels);
+            copy.copyBitmapPortion(bounds, tiles);
+            copy.setStorage(eBitmapStorageTiles);
+            tiles.swap(copy);
+        }
+
+        std::vector<char> scratch;
+        for (int y = bounds.y1; y < bounds.y2; ++y) {
+            ASSERT_EQ( 0, std::memcmp( pixels.getBitmapAt(bounds.x1, y), tiles.getRow(y, bounds.x1, bounds.x2, &scratch), bounds.width() ) );
+        }
+        for (int i = 0; i < 5; ++i) {
+            RectI roi = randomRect(bounds, 10);
+            std::list<RectI> pixelsRects, tilesRects;
+            pixels.minimalNonMarkedRects(roi, pixelsRects);
+            tiles.minimalNonMarkedRects(roi, tilesRects);
+            EXPECT_TRUE(pixelsRects == tilesRects);
+
+            pixelsRects.clear();
+            tilesRects.clear();
+            bool pixelsElsewhere = false, tilesElsewhere = false;
+            pixels.minimalNonMarkedRects_trimap(roi, pixelsRects, &pixelsElsewhere);
+            tiles.minimalNonMarkedRects_trimap(roi, tilesRects, &tilesElsewhere);
+            EXPECT_TRUE(pixelsRects == tilesRects);
+            EXPECT_EQ(pixelsElsewhere, tilesElsewhere);
+            EXPECT_EQ( pixels.isNonMarked(roi), tiles.isNonMarked(roi) );
+        }
+    }
+
+    // A fully rendered 4K image only stores the state of its tiles
+    RectI bounds(0, 0, 4096, 2160);
+    Bitmap tiles(bounds, eBitmapStorageTiles);
+    tiles.markForRendered(bounds);
+    EXPECT_TRUE( tiles.getMemorySize() * 100 < (std::size_t)bounds.area() );
+    std::list<RectI> rects;
+    tiles.minimalNonMarkedRects(bounds, rects);
+    EXPECT_TRUE( rects.empty() );
+}
+
+// Returns the time taken by nLookups look-ups of what is left to render in the whole bitmap
+static double
+runRestToRenderBenchmark(BitmapStorageEnum storage,
+                         const RectI& bounds,
+                         int nRenderedRects,
+                         int nLookups)
+{
+    Bitmap bm(bounds, storage);
+
+    // A partially rendered image: the renders of a few viewer tiles are done, a few others are in progress
+    srand(2000);
+    for (int i = 0; i < nRenderedRects; ++i) {
+        int x1 = bounds.x1 + rand() % bounds.width();
+        int y1 = bounds.y1 + rand() % bounds.height();
+        RectI rect( x1, y1, std::min(x1 + 256, bounds.x2), std::min(y1 + 256, bounds.y2) );
+        if (i % 4 == 0) {
+            bm.markForRendering(rect);
+        } else {
+            bm.markForRendered(rect);
+        }
+    }
+
+    TimeLapse timer;
+    std::size_t nRects = 0;
+    for (int i = 0; i < nLookups; ++i) {
+        std::list<RectI> rects;
+        bool isBeingRenderedElsewhere = false;
+        bm.minimalNonMarkedRects_trimap(bounds, rects, &isBeingRenderedElsewhere);
+        nRects += rects.size();
+    }
+    double elapsed = timer.getTimeSinceCreation();
+    EXPECT_TRUE(nRects > 0);
+
+    return elapsed;
+}
+
+// Not a correctness test: prints the time Image::getRestToRender_trimap() spends in the bitmap of a 4K image
+// with the per-pixel storage versus the tiled one, as the image gets rendered.
+// Disabled by default: run it with --gtest_also_run_disabled_tests.
+TEST(BitmapTest, DISABLED_RestToRenderBenchmark)
+{
+    const RectI bounds(0, 0, 4096, 2160);
+    const int nLookups = 20;
+
+    for (int nRenderedRects = 0; nRenderedRects <= 256; nRenderedRects = nRenderedRects ? nRenderedRects * 4 : 4) {
+        double pixels = runRestToRenderBenchmark(eBitmapStoragePixels, bounds, nRenderedRects, nLookups);
+        double tiles = runRestToRenderBenchmark(eBitmapStorageTiles, bounds, nRenderedRects, nLookups);
+        std::cout << "Rest to render of a 4096x2160 image with " << nRenderedRects << " rendered rect(s): per-pixel: "
+                  << pixels * 1000. / nLookups << " ms, tiled: " << tiles * 1000. / nLookups << " ms" << std::endl;
+    }
+}
+
 TEST(ImageKeyTest, Equality) {
     srand(2000);
     // coverity[dont_call]
@@ -159,3 +298,215 @@ TEST(ImageKeyTest, Difference) {
     ASSERT_TRUE(keyHash1 != keyHash2);
 }
 
+
+static void
+fillRandomPixels(Image* image)
+{
+    Image::WriteAccess acc(image);
+    const RectI bounds = image->getBounds();
+    const int nElements = (int)image->getRowElements();
+
+    for (int y = bounds.y1; y < bounds.y2; ++y) {
+        unsigned char* row = acc.pixelAt(bounds.x1, y);
+        for (int i = 0; i < nElements; ++i) {
+            switch ( image->getBitDepth() ) {
+            case eImageBitDepthByte:
+                row[i] = (unsigned char)(rand() % 256);
+                break;
+            case eImageBitDepthShort:
+                ( (unsigned short*)row )[i] = (unsigned short)(rand() % 65536);
+                break;
+            case eImageBitDepthFloat:
+                // also check the clamping of values outside of [0, 1]
+                ( (float*)row )[i] = (rand() % 14001) / 10000.f - 0.2f;
+                break;
+            default:
+                break;
+            }
+        }
+    }
+}
+
+static bool
+hasSamePixels(const Image* a,
+              const Image* b)
+{
+    Image::ReadAccess accA(a);
+    Image::ReadAccess accB(b);
+    const RectI bounds = a->getBounds();
+    const std::size_t rowSize = a->getRowElements() * getSizeOfForBitDepth( a->getBitDepth() );
+
+    for (int y = bounds.y1; y < bounds.y2; ++y) {
+        if ( std::memcmp(accA.pixelAt(bounds.x1, y), accB.pixelAt(bounds.x1, y), rowSize) != 0 ) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+TEST(ImageConvertTest, SIMDBitExact)
+{
+    const ImageBitDepthEnum depths[3] = { eImageBitDepthByte, eImageBitDepthShort, eImageBitDepthFloat };
+    const ImagePlaneDesc* components[3] = {
+        &ImagePlaneDesc::getRGBAComponents(), &ImagePlaneDesc::getRGBComponents(), &ImagePlaneDesc::getAlphaComponents()
+    };
+    // odd sizes, so that the scalar code also converts the last values of each row
+    const RectI bounds(0, 0, 67, 5);
+    const RectI renderWindow(1, 1, 66, 4);
+    const RectD rod(0, 0, 67, 5);
+
+    for (int srcDepth = 0; srcDepth < 3; ++srcDepth) {
+        for (int srcComps = 0; srcComps < 2; ++srcComps) {
+            Image src(*components[srcComps], rod, bounds, 0, 1., depths[srcDepth], eImagePremultiplicationPremultiplied, eImageFieldingOrderNone);
+            srand(2018);
+            fillRandomPixels(&src);
+
+            for (int dstDepth = 0; dstDepth < 3; ++dstDepth) {
+                for (int dstComps = 0; dstComps < 3; ++dstComps) {
+                    Image expected(*components[dstComps], rod, bounds, 0, 1., depths[dstDepth], eImagePremultiplicationPremultiplied, eImageFieldingOrderNone);
+                    Image actual(*components[dstComps], rod, bounds, 0, 1., depths[dstDepth], eImagePremultiplicationPremultiplied, eImageFieldingOrderNone);
+                    fillRandomPixels(&expected);
+                    {
+                        Image::WriteAccess acc(&actual);
+                        Image::ReadAccess accExpected(&expected);
+                        std::memcpy( acc.pixelAt(0, 0), accExpected.pixelAt(0, 0), bounds.area() * expected.getComponentsCount() * getSizeOfForBitDepth(depths[dstDepth]) );
+                    }
+
+                    // the error diffusion towards 8-bit starts at a random pixel of each row
+                    ImageSIMD::setMaxInstructionSet(ImageSIMD::eInstructionSetNone);
+                    srand(2000);
+                    src.convertToFormat(renderWindow, eViewerColorSpaceLinear, eViewerColorSpaceLinear, -1, false, false, &expected);
+
+                    const ImageSIMD::InstructionSetEnum instructionSets[2] = { ImageSIMD::eInstructionSetSSE41, ImageSIMD::eInstructionSetAVX2 };
+                    for (int i = 0; i < 2; ++i) {
+                        ImageSIMD::setMaxInstructionSet(instructionSets[i]);
+                        if (ImageSIMD::getInstructionSet() != instructionSets[i]) {
+                            // not supported by this CPU
+                            continue;
+                        }
+                        srand(2000);
+                        src.convertToFormat(renderWindow, eViewerColorSpaceLinear, eViewerColorSpaceLinear, -1, false, false, &actual);
+                        EXPECT_TRUE( hasSamePixels(&expected, &actual) ) << "depth " << srcDepth << " -> " << dstDepth
+                                                                         << ", components " << srcComps << " -> " << dstComps
+                                                                         << ", instruction set " << instructionSets[i];
+                    }
+                }
+            }
+        }
+    }
+    ImageSIMD::setMaxInstructionSet(ImageSIMD::eInstructionSetAVX2);
+}
+
+TEST(ImageConvertTest, SIMDAlphaChannel)
+{
+    const RectI bounds(0, 0, 33, 3);
+    const RectD rod(0, 0, 33, 3);
+    Image src(ImagePlaneDesc::getRGBAComponents(), rod, bounds, 0, 1., eImageBitDepthFloat, eImagePremultiplicationPremultiplied, eImageFieldingOrderNone);
+    Image expected(ImagePlaneDesc::getAlphaComponents(), rod, bounds, 0, 1., eImageBitDepthByte, eImagePremultiplicationPremultiplied, eImageFieldingOrderNone);
+    Image actual(ImagePlaneDesc::getAlphaComponents(), rod, bounds, 0, 1., eImageBitDepthByte, eImagePremultiplicationPremultiplied, eImageFieldingOrderNone);
+
+    fillRandomPixels(&src);
+    for (int channel = 0; channel < 4; ++channel) {
+        ImageSIMD::setMaxInstructionSet(ImageSIMD::eInstructionSetNone);
+        src.convertToFormat(bounds, eViewerColorSpaceLinear, eViewerColorSpaceLinear, channel, false, false, &expected);
+        ImageSIMD::setMaxInstructionSet(ImageSIMD::eInstructionSetAVX2);
+        src.convertToFormat(bounds, eViewerColorSpaceLinear, eViewerColorSpaceLinear, channel, false, false, &actual);
+        EXPECT_TRUE( hasSamePixels(&expected, &actual) ) << "channel " << channel;
+    }
+}
+
+TEST(ImageMipMapTest, SIMDBitExact)
+{
+    const ImageBitDepthEnum depths[3] = { eImageBitDepthByte, eImageBitDepthShort, eImageBitDepthFloat };
+    const ImagePlaneDesc* components[2] = {
+        &ImagePlaneDesc::getRGBAComponents(), &ImagePlaneDesc::getAlphaComponents()
+    };
+    // large enough to be split in several tiles, the last level is 65 pixels wide
+    const RectI bounds(0, 0, 520, 296);
+    const RectD rod(0, 0, 520, 296);
+    const unsigned int level = 3;
+    const RectI dstBounds = bounds.downscalePowerOfTwoSmallestEnclosing(level);
+
+    for (int depth = 0; depth < 3; ++depth) {
+        for (int comps = 0; comps < 2; ++comps) {
+            Image src(*components[comps], rod, bounds, 0, 1., depths[depth], eImagePremultiplicationPremultiplied, eImageFieldingOrderNone);
+            Image expected(*components[comps], rod, dstBounds, level, 1., depths[depth], eImagePremultiplicationPremultiplied, eImageFieldingOrderNone);
+            Image actual(*components[comps], rod, dstBounds, level, 1., depths[depth], eImagePremultiplicationPremultiplied, eImageFieldingOrderNone);
+            srand(2018);
+            fillRandomPixels(&src);
+
+            ImageSIMD::setMaxInstructionSet(ImageSIMD::eInstructionSetNone);
+            src.downscaleMipMap(rod, bounds, 0, level, false, &expected);
+            ImageSIMD::setMaxInstructionSet(ImageSIMD::eInstructionSetAVX2);
+            src.downscaleMipMap(rod, bounds, 0, level, false, &actual);
+            EXPECT_TRUE( hasSamePixels(&expected, &actual) ) << "depth " << depth << ", components " << comps;
+        }
+    }
+}
+
+TEST(ImageMipMapTest, UniformImage)
+{
+    // an odd roi: the first and last columns and rows of each level only average 2 pixels
+    const RectI bounds(-3, 1, 301, 180);
+    const RectD rod(-3, 1, 301, 180);
+    const unsigned int level = 2;
+    const RectI dstBounds = bounds.downscalePowerOfTwoSmallestEnclosing(level);
+    Image src(ImagePlaneDesc::getRGBAComponents(), rod, bounds, 0, 1., eImageBitDepthFloat, eImagePremultiplicationPremultiplied, eImageFieldingOrderNone);
+    Image dst(ImagePlaneDesc::getRGBAComponents(), rod, dstBounds, level, 1., eImageBitDepthFloat, eImagePremultiplicationPremultiplied, eImageFieldingOrderNone);
+
+    src.fillBoundsZero();
+    src.fill(bounds, 0.25f, 0.5f, 0.75f, 1.f);
+    dst.fillBoundsZero();
+    src.downscaleMipMap(rod, bounds, 0, level, false, &dst);
+
+    // the pixels computed from the whole roi
+    const RectI halvedRoI = bounds.downscalePowerOfTwoLargestEnclosed(level);
+    Image::ReadAccess acc(&dst);
+    for (int y = halvedRoI.y1; y < halvedRoI.y2; ++y) {
+        for (int x = halvedRoI.x1; x < halvedRoI.x2; ++x) {
+            const float* pix = (const float*)acc.pixelAt(x, y);
+            ASSERT_TRUE(pix[0] == 0.25f && pix[1] == 0.5f && pix[2] == 0.75f && pix[3] == 1.f) << "at " << x << ", " << y;
+        }
+    }
+}
+
+TEST(ImageConvertTest, SIMDLutIndexes)
+{
+    const Color::Lut* srgb = Color::LutManager::sRGBLut();
+    const double gain = 1.7;
+    const double offset = -0.05;
+    // odd count, so that the scalar code also converts the last values
+    const std::size_t n = 1031;
+    std::vector<float> src(n);
+    std::vector<unsigned short> indexes(n);
+
+    srand(2018);
+    for (std::size_t i = 0; i < n; ++i) {
+        src[i] = (rand() % 30001) / 10000.f - 1.f;
+    }
+    src[0] = 0.f;
+    src[1] = -0.f;
+    src[2] = std::numeric_limits<float>::infinity();
+    src[3] = -std::numeric_limits<float>::infinity();
+    src[4] = std::numeric_limits<float>::quiet_NaN();
+    src[5] = 1.f;
+
+    const ImageSIMD::InstructionSetEnum instructionSets[3] = {
+        ImageSIMD::eInstructionSetNone, ImageSIMD::eInstructionSetSSE41, ImageSIMD::eInstructionSetAVX2
+    };
+    for (int i = 0; i < 3; ++i) {
+        ImageSIMD::setMaxInstructionSet(instructionSets[i]);
+        if (ImageSIMD::getInstructionSet() != instructionSets[i]) {
+            // not supported by this CPU
+            continue;
+        }
+        ImageSIMD::linearToLutIndexes(&src[0], gain, offset, &indexes[0], n);
+        for (std::size_t j = 0; j < n; ++j) {
+            const double v = src[j] * gain + offset;
+            EXPECT_EQ( srgb->toColorSpaceUint8xxFromLinearFloatFast(v), srgb->toColorSpaceUint8xxFromLinearFloatHipartFast(indexes[j]) )
+                << "value " << src[j] << ", instruction set " << instructionSets[i];
+        }
+    }
+    ImageSIMD::setMaxInstructionSet(ImageSIMD::eInstructionSetAVX2);
+}
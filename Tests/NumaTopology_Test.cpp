@@ -0,0 +1,121 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * Copyright (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <QtCore/QThread>
+
+#include "Engine/BufferPool.h"
+#include "Engine/NumaTopology.h"
+
+NATRON_NAMESPACE_USING
+
+#define BUFFER_SIZE (1024 * 1024)
+
+// Binds itself to the other node, then allocates and frees a buffer
+class OtherNodeThread
+    : public QThread
+{
+public:
+
+    OtherNodeThread()
+        : QThread()
+        , node(-1)
+        , buffer(0)
+    {
+    }
+
+    int node;
+    void* buffer;
+
+private:
+
+    virtual void run() OVERRIDE FINAL
+    {
+        node = NumaTopology::bindCurrentThread();
+        buffer = BufferPool::allocate(BUFFER_SIZE);
+        BufferPool::deallocate(buffer, BUFFER_SIZE);
+        NumaTopology::unbindCurrentThread();
+    }
+};
+
+TEST(NumaTopology, ParseCpuList)
+{
+    std::vector<int> cpus;
+
+    ASSERT_TRUE( NumaTopology::parseCpuList("0-3,8,10-11", &cpus) );
+    int expected[] = {0, 1, 2, 3, 8, 10, 11};
+    EXPECT_EQ( std::vector<int>( expected, expected + sizeof(expected) / sizeof(expected[0]) ), cpus );
+
+    EXPECT_FALSE( NumaTopology::parseCpuList("", &cpus) );
+    EXPECT_FALSE( NumaTopology::parseCpuList("3-1", &cpus) );
+    EXPECT_FALSE( NumaTopology::parseCpuList("0,a", &cpus) );
+    EXPECT_FALSE( NumaTopology::parseCpuList("0,", &cpus) );
+    // unchanged on failure
+    EXPECT_EQ(7, (int)cpus.size());
+}
+
+TEST(NumaTopology, SimulatedNodes)
+{
+    EXPECT_FALSE( NumaTopology::setSimulatedTopology("0;") );
+    // CPU 0 exists on every machine
+    ASSERT_TRUE( NumaTopology::setSimulatedTopology("0;0") );
+    EXPECT_EQ( 2, NumaTopology::getNodeCount() );
+    EXPECT_EQ( std::vector<int>(1, 0), NumaTopology::getNodeCpus(1) );
+    EXPECT_TRUE( NumaTopology::getNodeCpus(2).empty() );
+
+    // Disabled: nothing is bound
+    NumaTopology::setEnabled(false);
+    EXPECT_EQ( -1, NumaTopology::bindCurrentThread() );
+    EXPECT_EQ( -1, NumaTopology::getCurrentThreadNode() );
+
+    NumaTopology::setEnabled(true);
+    BufferPool::setMaximumPooledSize(16 * BUFFER_SIZE);
+    ASSERT_EQ( 0, NumaTopology::bindCurrentThread() );
+    EXPECT_EQ( 0, NumaTopology::getCurrentThreadNode() );
+
+    void* localBuffer = BufferPool::allocate(BUFFER_SIZE);
+    BufferPool::deallocate(localBuffer, BUFFER_SIZE);
+
+    // The thread is bound to the node with the fewest threads, and does not reuse the buffer of node 0
+    OtherNodeThread thread;
+    thread.start();
+    thread.wait();
+    EXPECT_EQ(1, thread.node);
+    EXPECT_NE(localBuffer, thread.buffer);
+
+    // Node 0 gets its own buffer back, although the one of node 1 was freed last
+    void* buffer = BufferPool::allocate(BUFFER_SIZE);
+    EXPECT_EQ(localBuffer, buffer);
+    BufferPool::deallocate(buffer, BUFFER_SIZE);
+
+    NumaTopology::unbindCurrentThread();
+    EXPECT_EQ( -1, NumaTopology::getCurrentThreadNode() );
+    NumaTopology::setEnabled(false);
+    BufferPool::setMaximumPooledSize(0);
+}
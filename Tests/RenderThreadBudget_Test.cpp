@@ -0,0 +1,111 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * Copyright (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include <cstdlib>
+#include <map>
+#include <string>
+
+#include <gtest/gtest.h>
+
+#include "Engine/RenderThreadBudget.h"
+
+NATRON_NAMESPACE_USING
+
+// A machine on which the throughput grows with the number of parallel renders until they start fighting over
+// the memory bandwidth, then decreases: it is the highest at optimalParallelRenders
+static double
+simulatedFramesPerSecond(int parallelRenders,
+                         int optimalParallelRenders)
+{
+    double d = (double)(parallelRenders - optimalParallelRenders) / optimalParallelRenders;
+
+    return 10. * optimalParallelRenders / (1. + d * d);
+}
+
+// Renders nFrames with the split decided by the budget, with a few percents of noise on the frame times
+static void
+renderFrames(RenderThreadBudget* budget,
+             int optimalParallelRenders,
+             int nFrames,
+             double* now)
+{
+    std::map<std::string, double> nodeTimes;
+
+    for (int i = 0; i < nFrames; ++i) {
+        int parallelRenders = budget->getParallelRenders();
+        double noise = 1. + 0.04 * ( (double)std::rand() / RAND_MAX - 0.5 );
+        double frameDuration = noise / simulatedFramesPerSecond(parallelRenders, optimalParallelRenders);
+        *now += frameDuration;
+        nodeTimes["Blur1"] = 0.75 * frameDuration * parallelRenders;
+        nodeTimes["Read1"] = 0.25 * frameDuration * parallelRenders;
+        budget->notifyFrameRendered(*now, frameDuration * parallelRenders, nodeTimes);
+    }
+}
+
+TEST(RenderThreadBudget, Converges)
+{
+    std::srand(2018);
+
+    RenderThreadBudget budget;
+    EXPECT_FALSE( budget.isActive() );
+    EXPECT_EQ( 0, budget.getParallelRenders() );
+
+    budget.start(32);
+    ASSERT_TRUE( budget.isActive() );
+    double now = 0.;
+    renderFrames(&budget, 6, 2000, &now);
+
+    RenderThreadBudgetStats stats = budget.getStats();
+    EXPECT_TRUE(stats.adaptive);
+    EXPECT_TRUE(stats.converged);
+    EXPECT_NEAR(6, stats.parallelRenders, 1);
+    EXPECT_EQ(32 / stats.parallelRenders, stats.threadsPerRender);
+    EXPECT_GT(stats.framesPerSecond, 0.9 * simulatedFramesPerSecond(6, 6) );
+    EXPECT_EQ(std::string("Blur1"), stats.heaviestNode);
+    EXPECT_NEAR(0.75, stats.heaviestNodeShare, 0.01);
+
+    // The sequence becomes lighter and scales to more parallel renders: the search restarts
+    renderFrames(&budget, 20, 4000, &now);
+    stats = budget.getStats();
+    EXPECT_TRUE(stats.converged);
+    EXPECT_NEAR(20, stats.parallelRenders, 2);
+
+    budget.stop();
+    EXPECT_FALSE( budget.getStats().adaptive );
+    EXPECT_EQ( 0, budget.getThreadsPerRender() );
+}
+
+TEST(RenderThreadBudget, SingleThread)
+{
+    RenderThreadBudget budget;
+
+    budget.start(1);
+    double now = 0.;
+    renderFrames(&budget, 1, 100, &now);
+    EXPECT_TRUE( budget.getStats().converged );
+    EXPECT_EQ( 1, budget.getParallelRenders() );
+    EXPECT_EQ( 1, budget.getThreadsPerRender() );
+}
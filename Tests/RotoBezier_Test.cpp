@@ -0,0 +1,279 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * Copyright (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include <list>
+#include <vector>
+
+#include <boost/make_shared.hpp>
+
+#include <gtest/gtest.h>
+
+#include "BaseTest.h"
+
+#include "Engine/Bezier.h"
+#include "Engine/EffectInstance.h"
+#include "Engine/Node.h"
+#include "Engine/RotoContext.h"
+#include "Engine/RotoContextPrivate.h"
+#include "Engine/RotoRasterizer.h"
+
+#define NB_POINTS_PER_SEGMENT 10
+#define ERROR_SCALE 1.
+
+NATRON_NAMESPACE_USING
+
+static BezierPtr
+makeTestSquare(const NodePtr& roto)
+{
+    RotoContextPtr context = roto->getRotoContext();
+
+    EXPECT_TRUE(context);
+    if (!context) {
+        return BezierPtr();
+    }
+
+    return context->makeSquare(10., 60., 50., 0.);
+}
+
+static RotoBezierTrianglesPtr
+getCachedTriangles(const BezierPtr& bezier,
+                   double time,
+                   U64* age)
+{
+    return bezier->getCachedTriangles(time, 0,
+#ifdef ROTO_BEZIER_EVAL_ITERATIVE
+                                      NB_POINTS_PER_SEGMENT,
+#else
+                                      ERROR_SCALE,
+#endif
+                                      0., age);
+}
+
+// Puts triangles in the evaluation cache at the given time and returns them
+static RotoBezierTrianglesPtr
+cacheTriangles(const BezierPtr& bezier,
+               double time)
+{
+    U64 age;
+    RotoBezierTrianglesPtr triangles = getCachedTriangles(bezier, time, &age);
+
+    if (triangles) {
+        return triangles;
+    }
+    triangles = boost::make_shared<RotoBezierTriangles>();
+    bezier->setCachedTriangles(time, 0,
+#ifdef ROTO_BEZIER_EVAL_ITERATIVE
+                               NB_POINTS_PER_SEGMENT,
+#else
+                               ERROR_SCALE,
+#endif
+                               0., age, triangles);
+
+    return triangles;
+}
+
+static bool
+isCached(const BezierPtr& bezier,
+         double time)
+{
+    U64 age;
+
+    return (bool)getCachedTriangles(bezier, time, &age);
+}
+
+static void
+evaluateContour(const BezierPtr& bezier,
+                std::list<std::list<ParametricPoint> >* contour,
+                RectD* bbox)
+{
+    bezier->evaluateAtTime_DeCasteljau(false, 0., 0,
+#ifdef ROTO_BEZIER_EVAL_ITERATIVE
+                                       NB_POINTS_PER_SEGMENT,
+#else
+                                       ERROR_SCALE,
+#endif
+                                       contour, bbox);
+}
+
+static void
+expectSameContour(const std::list<std::list<ParametricPoint> >& a,
+                  const std::list<std::list<ParametricPoint> >& b)
+{
+    ASSERT_EQ( a.size(), b.size() );
+    std::list<std::list<ParametricPoint> >::const_iterator itB = b.begin();
+    for (std::list<std::list<ParametricPoint> >::const_iterator itA = a.begin(); itA != a.end(); ++itA, ++itB) {
+        ASSERT_EQ( itA->size(), itB->size() );
+        std::list<ParametricPoint>::const_iterator pB = itB->begin();
+        for (std::list<ParametricPoint>::const_iterator pA = itA->begin(); pA != itA->end(); ++pA, ++pB) {
+            EXPECT_EQ(pA->x, pB->x);
+            EXPECT_EQ(pA->y, pB->y);
+            EXPECT_EQ(pA->t, pB->t);
+        }
+    }
+}
+
+// A cached contour is the one a new evaluation computes
+TEST_F(BaseTest, BezierEvaluationCacheHit)
+{
+    NodePtr roto = createNode( QString::fromUtf8(PLUGINID_NATRON_ROTO) );
+    ASSERT_TRUE(roto);
+    BezierPtr bezier = makeTestSquare(roto);
+    ASSERT_TRUE(bezier);
+
+    std::list<std::list<ParametricPoint> > first, cached, fresh;
+    RectD firstBBox, cachedBBox, freshBBox;
+    evaluateContour(bezier, &first, &firstBBox);
+    evaluateContour(bezier, &cached, &cachedBBox);
+    ASSERT_FALSE( cached.empty() );
+    expectSameContour(first, cached);
+    EXPECT_TRUE(firstBBox == cachedBBox);
+
+    // Clears the cache without changing the shape
+    bezier->incrementNodesAge();
+    evaluateContour(bezier, &fresh, &freshBBox);
+    expectSameContour(fresh, cached);
+    EXPECT_TRUE(freshBBox == cachedBBox);
+
+    RotoBezierTrianglesPtr triangles = cacheTriangles(bezier, 0.);
+    U64 age;
+    EXPECT_EQ( triangles, getCachedTriangles(bezier, 0., &age) );
+}
+
+// The edits of the shape invalidate the evaluations
+TEST_F(BaseTest, BezierEvaluationCacheInvalidation)
+{
+    NodePtr roto = createNode( QString::fromUtf8(PLUGINID_NATRON_ROTO) );
+    ASSERT_TRUE(roto);
+    BezierPtr bezier = makeTestSquare(roto);
+    ASSERT_TRUE(bezier);
+
+    cacheTriangles(bezier, 0.);
+    ASSERT_TRUE( isCached(bezier, 0.) );
+    bezier->setKeyframe(10.);
+    EXPECT_FALSE( isCached(bezier, 0.) ) << "setKeyframe";
+
+    cacheTriangles(bezier, 0.);
+    ASSERT_TRUE( isCached(bezier, 0.) );
+    bezier->moveKeyframe(10., 20.);
+    EXPECT_FALSE( isCached(bezier, 0.) ) << "moveKeyframe";
+
+    cacheTriangles(bezier, 0.);
+    ASSERT_TRUE( isCached(bezier, 0.) );
+    bezier->removeKeyframe(20.);
+    EXPECT_FALSE( isCached(bezier, 0.) ) << "removeKeyframe";
+
+    cacheTriangles(bezier, 0.);
+    ASSERT_TRUE( isCached(bezier, 0.) );
+    bezier->movePointByIndex(0, 0., 5., 5.);
+    EXPECT_FALSE( isCached(bezier, 0.) ) << "movePointByIndex";
+
+    cacheTriangles(bezier, 0.);
+    ASSERT_TRUE( isCached(bezier, 0.) );
+    bezier->setKeyFrameInterpolation(eKeyframeTypeLinear, 0);
+    EXPECT_FALSE( isCached(bezier, 0.) ) << "setKeyFrameInterpolation";
+}
+
+// The least recently used evaluation is removed when the cache is full
+TEST_F(BaseTest, BezierEvaluationCacheEviction)
+{
+    NodePtr roto = createNode( QString::fromUtf8(PLUGINID_NATRON_ROTO) );
+    ASSERT_TRUE(roto);
+    BezierPtr bezier = makeTestSquare(roto);
+    ASSERT_TRUE(bezier);
+
+    for (int i = 0; i < NATRON_BEZIER_EVALUATION_CACHE_SIZE; ++i) {
+        cacheTriangles(bezier, i);
+    }
+    // Time 0 becomes the most recently used evaluation, time 1 the least
+    EXPECT_TRUE( isCached(bezier, 0.) );
+    cacheTriangles(bezier, NATRON_BEZIER_EVALUATION_CACHE_SIZE);
+
+    // Look-up the ones that are still there first: a miss adds an evaluation
+    EXPECT_TRUE( isCached(bezier, NATRON_BEZIER_EVALUATION_CACHE_SIZE) );
+    EXPECT_TRUE( isCached(bezier, 0.) );
+    for (int i = 2; i < NATRON_BEZIER_EVALUATION_CACHE_SIZE; ++i) {
+        EXPECT_TRUE( isCached(bezier, i) ) << "time " << i;
+    }
+    EXPECT_FALSE( isCached(bezier, 1.) );
+}
+
+// The transform is part of the key of the evaluations
+TEST_F(BaseTest, BezierEvaluationCacheTransform)
+{
+    NodePtr roto = createNode( QString::fromUtf8(PLUGINID_NATRON_ROTO) );
+    ASSERT_TRUE(roto);
+    BezierPtr bezier = makeTestSquare(roto);
+    ASSERT_TRUE(bezier);
+
+    cacheTriangles(bezier, 0.);
+    ASSERT_TRUE( isCached(bezier, 0.) );
+    bezier->setTransform(0., 10., 0., 1., 1., 0., 0., 0., 0., 0.);
+    EXPECT_FALSE( isCached(bezier, 0.) );
+}
+
+// The motion blur samples rendered in one pass are the samples rendered one at a time, each over the previous ones
+TEST_F(BaseTest, BezierMotionBlurMatchesSamples)
+{
+    NodePtr roto = createNode( QString::fromUtf8(PLUGINID_NATRON_ROTO) );
+    ASSERT_TRUE(roto);
+    BezierPtr bezier = makeTestSquare(roto);
+    ASSERT_TRUE(bezier);
+
+    // The square moves by 100 pixels over the shutter
+    roto->getRotoContext()->setAutoKeyingEnabled(true);
+    bezier->setFeatherDistance(5., 0.);
+    bezier->setTransform(0., 0., 0., 1., 1., 0., 0., 0., 0., 0.);
+    bezier->setTransform(10., 100., 0., 1., 1., 0., 0., 0., 0., 0.);
+
+    RectI roi(0, 0, 200, 120);
+    std::vector<float> coverage(roi.width() * roi.height(), 0.f);
+    {
+        RotoRasterizer rasterizer;
+        RotoContextPrivate::renderBezier_native(&rasterizer, bezier.get(), 5., 0., 10., 1., 0);
+        rasterizer.renderCoverage(roi, &coverage.front());
+    }
+
+    std::vector<double> times;
+    RotoContextPrivate::getMotionBlurSampleTimes(bezier.get(), 5., 0., 10., 1., 0, &times);
+    ASSERT_EQ(11u, times.size());
+    std::vector<float> expected(coverage.size(), 0.f);
+    std::vector<float> sample(coverage.size());
+    for (std::size_t i = 0; i < times.size(); ++i) {
+        RotoRasterizer rasterizer;
+        RotoContextPrivate::renderBezier_native(&rasterizer, bezier.get(), times[i], times[i], times[i], 1., 0);
+        rasterizer.renderCoverage(roi, &sample.front());
+        for (std::size_t p = 0; p < expected.size(); ++p) {
+            expected[p] = sample[p] + expected[p] * (1.f - sample[p]);
+        }
+    }
+
+    for (int y = roi.y1; y < roi.y2; ++y) {
+        for (int x = roi.x1; x < roi.x2; ++x) {
+            std::size_t p = (std::size_t)(y - roi.y1) * roi.width() + (x - roi.x1);
+            EXPECT_NEAR(expected[p], coverage[p], 1e-3) << "(" << x << ", " << y << ")";
+        }
+    }
+}
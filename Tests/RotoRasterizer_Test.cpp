@@ -0,0 +1,381 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * Copyright (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include <algorithm> // max
+#include <cmath>
+#include <list>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <cairo/cairo.h>
+
+#include "Engine/RotoContextPrivate.h"
+#include "Engine/RotoRasterizer.h"
+
+NATRON_NAMESPACE_USING
+
+#define INNER_MIN 20.
+#define INNER_MAX 80.
+#define FEATHER 10.
+#define ROI_SIZE 100
+
+static Point
+makePoint(double x,
+          double y)
+{
+    Point p;
+
+    p.x = x;
+    p.y = y;
+
+    return p;
+}
+
+static void
+addFeatherVertex(double x,
+                 double y,
+                 bool isInner,
+                 std::list<RotoFeatherVertex>* mesh)
+{
+    RotoFeatherVertex v;
+
+    v.x = x;
+    v.y = y;
+    v.isInner = isInner;
+    mesh->push_back(v);
+}
+
+// A square from INNER_MIN to INNER_MAX made of 2 triangles, with a feather of FEATHER pixels made of 2 triangles per side
+static void
+makeSquare(std::list<RotoFeatherVertex>* featherMesh,
+           std::list<RotoTriangles>* triangles)
+{
+    double inner[4][2] = {
+        {INNER_MIN, INNER_MIN}, {INNER_MAX, INNER_MIN}, {INNER_MAX, INNER_MAX}, {INNER_MIN, INNER_MAX}
+    };
+    double outer[4][2] = {
+        {INNER_MIN - FEATHER, INNER_MIN - FEATHER}, {INNER_MAX + FEATHER, INNER_MIN - FEATHER},
+        {INNER_MAX + FEATHER, INNER_MAX + FEATHER}, {INNER_MIN - FEATHER, INNER_MAX + FEATHER}
+    };
+
+    for (int i = 0; i < 4; ++i) {
+        int j = (i + 1) % 4;
+        addFeatherVertex(inner[i][0], inner[i][1], true, featherMesh);
+        addFeatherVertex(outer[i][0], outer[i][1], false, featherMesh);
+        addFeatherVertex(outer[j][0], outer[j][1], false, featherMesh);
+        addFeatherVertex(inner[i][0], inner[i][1], true, featherMesh);
+        addFeatherVertex(outer[j][0], outer[j][1], false, featherMesh);
+        addFeatherVertex(inner[j][0], inner[j][1], true, featherMesh);
+    }
+
+    RotoTriangles t;
+    t.vertices.push_back( makePoint(inner[0][0], inner[0][1]) );
+    t.vertices.push_back( makePoint(inner[1][0], inner[1][1]) );
+    t.vertices.push_back( makePoint(inner[2][0], inner[2][1]) );
+    t.vertices.push_back( makePoint(inner[0][0], inner[0][1]) );
+    t.vertices.push_back( makePoint(inner[2][0], inner[2][1]) );
+    t.vertices.push_back( makePoint(inner[3][0], inner[3][1]) );
+    triangles->push_back(t);
+}
+
+static void
+renderSquare(const RectI& roi,
+             double fallOff,
+             std::vector<float>* coverage)
+{
+    std::list<RotoFeatherVertex> featherMesh;
+    std::list<RotoTriangles> triangles;
+
+    makeSquare(&featherMesh, &triangles);
+
+    RotoRasterizer rasterizer;
+    rasterizer.beginShape(fallOff);
+    RotoContextPrivate::renderFeather_native(featherMesh, &rasterizer);
+    RotoContextPrivate::renderInternalShape_native( triangles, std::list<RotoTriangleFans>(), std::list<RotoTriangleStrips>(), &rasterizer );
+
+    coverage->resize( (std::size_t)roi.width() * roi.height() );
+    rasterizer.renderCoverage(roi, &coverage->front());
+}
+
+TEST(RotoRasterizer, OpaqueArea)
+{
+    RotoRasterizer rasterizer;
+
+    rasterizer.beginShape(1.);
+    // A square from 10.5 to 20.5 made of 2 triangles with opposite orientations
+    rasterizer.addTriangle( makePoint(10.5, 10.5), makePoint(20.5, 10.5), makePoint(20.5, 20.5) );
+    rasterizer.addTriangle( makePoint(10.5, 10.5), makePoint(10.5, 20.5), makePoint(20.5, 20.5) );
+
+    RectI roi(0, 0, 32, 32);
+    std::vector<float> coverage(32 * 32);
+    rasterizer.renderCoverage(roi, &coverage.front());
+
+    double area = 0.;
+    for (std::size_t i = 0; i < coverage.size(); ++i) {
+        area += coverage[i];
+    }
+    EXPECT_NEAR(100., area, 1e-3);
+    // No seam along the diagonal
+    EXPECT_NEAR(1., coverage[15 * 32 + 15], 1e-5);
+    EXPECT_NEAR(0.25, coverage[10 * 32 + 10], 1e-5);
+    EXPECT_NEAR(0.5, coverage[15 * 32 + 10], 1e-5);
+    EXPECT_EQ(0.f, coverage[5 * 32 + 5]);
+}
+
+TEST(RotoRasterizer, BandSeams)
+{
+    // The same square rendered over several bands and on a region of a single band must be the same
+    RectI roi(0, 0, ROI_SIZE, ROI_SIZE);
+    std::vector<float> whole;
+
+    renderSquare(roi, 1., &whole);
+
+    RectI part(0, 40, ROI_SIZE, 40 + NATRON_ROTO_RASTER_BAND_HEIGHT / 2);
+    std::vector<float> coverage;
+    renderSquare(part, 1., &coverage);
+    for (int y = part.y1; y < part.y2; ++y) {
+        for (int x = part.x1; x < part.x2; ++x) {
+            EXPECT_NEAR(whole[y * ROI_SIZE + x], coverage[(y - part.y1) * part.width() + x - part.x1], 1e-5);
+        }
+    }
+}
+
+TEST(RotoRasterizer, FeatherFallOff)
+{
+    RectI roi(0, 0, ROI_SIZE, ROI_SIZE);
+    std::vector<float> coverage;
+
+    renderSquare(roi, 1., &coverage);
+
+    // With a fall-off of 1 the opacity of cairo's mesh is linear, and used twice
+    int y = ROI_SIZE / 2;
+    for (int x = (int)(INNER_MIN - FEATHER); x < (int)INNER_MIN; ++x) {
+        double d = INNER_MIN - (x + 0.5);
+        double expected = (1. - d / FEATHER) * (1. - d / FEATHER);
+        EXPECT_NEAR(expected, coverage[y * ROI_SIZE + x], 1e-2);
+    }
+    EXPECT_EQ(0.f, coverage[y * ROI_SIZE + 2]);
+}
+
+// Returns the largest difference between the A8 cairo surface and the coverage, both on roi, on the pixels of bounds.
+// The pixels of roi outside of bounds must be empty in both.
+static double
+getMaxDifferenceWithCairo(cairo_surface_t* surface,
+                          const std::vector<float>& coverage,
+                          const RectI& roi,
+                          const RectI& bounds)
+{
+    const unsigned char* data = cairo_image_surface_get_data(surface);
+    int stride = cairo_image_surface_get_stride(surface);
+    double maxDiff = 0.;
+
+    for (int y = roi.y1; y < roi.y2; ++y) {
+        for (int x = roi.x1; x < roi.x2; ++x) {
+            unsigned char cairoValue = data[(y - roi.y1) * stride + x - roi.x1];
+            float value = coverage[(y - roi.y1) * roi.width() + x - roi.x1];
+            if ( !bounds.contains(x, y) ) {
+                EXPECT_EQ(0, cairoValue) << "(" << x << ", " << y << ")";
+                EXPECT_EQ(0.f, value) << "(" << x << ", " << y << ")";
+                continue;
+            }
+            maxDiff = std::max( maxDiff, std::fabs(cairoValue / 255. - value) );
+        }
+    }
+
+    return maxDiff;
+}
+
+// The feather of cairo is interpolated on degenerated Coons patches and quantized to 8 bits
+#define CAIRO_MAX_DIFFERENCE (4. / 255.)
+
+// cairo quantizes the image to 8 bits after each dot, and up to 4 dots of the test stroke overlap
+#define CAIRO_STROKE_MAX_DIFFERENCE (6. / 255.)
+
+TEST(RotoRasterizer, MatchesCairo)
+{
+    RectI roi(0, 0, ROI_SIZE, ROI_SIZE);
+    double fallOff = 0.6;
+    std::vector<float> coverage;
+
+    renderSquare(roi, fallOff, &coverage);
+
+    // Render the same triangles with cairo, as RotoContextPrivate::renderBezier does
+    std::list<RotoFeatherVertex> featherMesh;
+    std::list<RotoTriangles> triangles;
+    makeSquare(&featherMesh, &triangles);
+
+    cairo_surface_t* surface = cairo_image_surface_create( CAIRO_FORMAT_A8, roi.width(), roi.height() );
+    ASSERT_EQ(CAIRO_STATUS_SUCCESS, cairo_surface_status(surface));
+    cairo_surface_set_device_offset(surface, -roi.x1, -roi.y1);
+    cairo_t* cr = cairo_create(surface);
+    cairo_set_fill_rule(cr, CAIRO_FILL_RULE_WINDING);
+    cairo_set_antialias(cr, CAIRO_ANTIALIAS_NONE);
+    cairo_set_operator(cr, CAIRO_OPERATOR_OVER);
+
+    double shapeColor[3] = {1., 1., 1.};
+    cairo_pattern_t* mesh = cairo_pattern_create_mesh();
+    RotoContextPrivate::renderFeather_cairo(featherMesh, shapeColor, fallOff, mesh);
+    RotoContextPrivate::renderInternalShape_cairo( triangles, std::list<RotoTriangleFans>(), std::list<RotoTriangleStrips>(), shapeColor, mesh );
+    RotoContextPrivate::applyAndDestroyMask(cr, mesh);
+    cairo_surface_flush(surface);
+
+    // Every pixel of the shape and its feather matches, and nothing is drawn around them
+    RectI bounds( (int)(INNER_MIN - FEATHER), (int)(INNER_MIN - FEATHER), (int)(INNER_MAX + FEATHER), (int)(INNER_MAX + FEATHER) );
+    EXPECT_LE(getMaxDifferenceWithCairo(surface, coverage, roi, bounds), CAIRO_MAX_DIFFERENCE);
+    const unsigned char* data = cairo_image_surface_get_data(surface);
+    int stride = cairo_image_surface_get_stride(surface);
+    EXPECT_EQ(255, data[50 * stride + 50]);
+    EXPECT_NEAR(1., coverage[50 * roi.width() + 50], 1e-5);
+
+    cairo_destroy(cr);
+    cairo_surface_destroy(surface);
+}
+
+// The opacity stops of a brush of hardness 0.5, as computed by getRenderDotParams()
+static void
+getSoftBrushStops(double opacity,
+                  std::vector<std::pair<double, double> >* opacityStops)
+{
+    for (int i = 0; i <= 8; ++i) {
+        double d = i / 8.;
+        double f = std::pow(d, 0.8);
+        double o = f < 0.5 ? 1. - 2. * f * f : 2. * (1. - f) * (1. - f);
+        opacityStops->push_back( std::make_pair(d, o * opacity) );
+    }
+}
+
+TEST(RotoStrokeRasterizer, DotOpacity)
+{
+    std::vector<std::pair<double, double> > opacityStops;
+
+    getSoftBrushStops(1., &opacityStops);
+
+    RotoStrokeRasterizer rasterizer(true);
+    // On the center of the pixels of row 50
+    rasterizer.addDot(makePoint(50., 50.5), 10., 20., 1., opacityStops, 1.);
+
+    RectI roi(0, 0, ROI_SIZE, ROI_SIZE);
+    std::vector<float> coverage(ROI_SIZE * ROI_SIZE);
+    rasterizer.renderCoverage(roi, &coverage.front());
+
+    // The gradient is padded inside of the internal radius, and linear between the stops
+    EXPECT_NEAR(1., coverage[50 * ROI_SIZE + 50], 1e-3);
+    EXPECT_NEAR(1., coverage[50 * ROI_SIZE + 58], 1e-3);
+    for (int i = 0; i < 8; ++i) {
+        double r = 10. + 10. * (i + 0.5) / 8.;
+        int x = (int)(50. + r - 0.5);
+        double t = (x + 0.5 - 50.) / 10. - 1.;
+        int stop = std::min( 7, (int)(t * 8.) );
+        double a = t * 8. - stop;
+        double expected = opacityStops[stop].second + (opacityStops[stop + 1].second - opacityStops[stop].second) * a;
+        EXPECT_NEAR(expected, coverage[50 * ROI_SIZE + x], 1e-2);
+    }
+    EXPECT_EQ(0.f, coverage[50 * ROI_SIZE + 71]);
+    EXPECT_EQ(0.f, coverage[20 * ROI_SIZE + 20]);
+}
+
+TEST(RotoStrokeRasterizer, BuildUp)
+{
+    // 2 hard dots of opacity 0.5 that overlap: they are composited over each other with build-up, and their maximum is
+    // taken without
+    for (int i = 0; i < 2; ++i) {
+        bool doBuildUp = i == 0;
+        RotoStrokeRasterizer rasterizer(doBuildUp);
+        rasterizer.addDot(makePoint(40., 50.), 10., 10., 1., std::vector<std::pair<double, double> >(), 0.5);
+        rasterizer.addDot(makePoint(50., 50.), 10., 10., 1., std::vector<std::pair<double, double> >(), 0.5);
+
+        RectI roi(0, 0, ROI_SIZE, ROI_SIZE);
+        std::vector<float> coverage(ROI_SIZE * ROI_SIZE);
+        rasterizer.renderCoverage(roi, &coverage.front());
+
+        EXPECT_NEAR(0.5, coverage[50 * ROI_SIZE + 35], 1e-5);
+        EXPECT_NEAR(doBuildUp ? 0.75 : 0.5, coverage[50 * ROI_SIZE + 45], 1e-5);
+        EXPECT_NEAR(0.5, coverage[50 * ROI_SIZE + 55], 1e-5);
+        EXPECT_EQ(0.f, coverage[50 * ROI_SIZE + 61]);
+    }
+}
+
+TEST(RotoStrokeRasterizer, BandSeams)
+{
+    // Dots across several bands, rendered on the whole region and on a region of a single band
+    std::vector<std::pair<double, double> > opacityStops;
+
+    getSoftBrushStops(0.8, &opacityStops);
+
+    RotoStrokeRasterizer rasterizer(true);
+    for (int i = 0; i < 10; ++i) {
+        rasterizer.addDot(makePoint(20. + 6. * i, 20. + 6.3 * i), 3., 12., 1., opacityStops, 0.8);
+    }
+
+    RectI roi(0, 0, ROI_SIZE, ROI_SIZE);
+    std::vector<float> whole(ROI_SIZE * ROI_SIZE);
+    rasterizer.renderCoverage(roi, &whole.front());
+
+    RectI part(0, 40, ROI_SIZE, 40 + NATRON_ROTO_RASTER_BAND_HEIGHT / 2);
+    std::vector<float> coverage( part.width() * part.height() );
+    rasterizer.renderCoverage(part, &coverage.front());
+    for (int y = part.y1; y < part.y2; ++y) {
+        for (int x = part.x1; x < part.x2; ++x) {
+            EXPECT_EQ(whole[y * ROI_SIZE + x], coverage[(y - part.y1) * part.width() + x - part.x1]);
+        }
+    }
+}
+
+TEST(RotoStrokeRasterizer, MatchesCairo)
+{
+    std::vector<std::pair<double, double> > opacityStops;
+
+    getSoftBrushStops(0.7, &opacityStops);
+
+    RotoStrokeRasterizer rasterizer(true);
+    for (int i = 0; i < 10; ++i) {
+        rasterizer.addDot(makePoint(20.3 + 6. * i, 20.7 + 5. * i), 4., 15., 1., opacityStops, 0.7);
+    }
+    RectI roi(0, 0, ROI_SIZE, ROI_SIZE);
+    std::vector<float> coverage(ROI_SIZE * ROI_SIZE);
+    rasterizer.renderCoverage(roi, &coverage.front());
+
+    // Render the same dots with cairo, as RotoContextPrivate::renderStroke does
+    cairo_surface_t* surface = cairo_image_surface_create( CAIRO_FORMAT_A8, roi.width(), roi.height() );
+    ASSERT_EQ(CAIRO_STATUS_SUCCESS, cairo_surface_status(surface));
+    cairo_surface_set_device_offset(surface, -roi.x1, -roi.y1);
+    cairo_t* cr = cairo_create(surface);
+    cairo_set_fill_rule(cr, CAIRO_FILL_RULE_WINDING);
+    cairo_set_antialias(cr, CAIRO_ANTIALIAS_NONE);
+    cairo_set_operator(cr, CAIRO_OPERATOR_OVER);
+    for (int i = 0; i < 10; ++i) {
+        RotoContextPrivate::renderDot(cr, 0, makePoint(20.3 + 6. * i, 20.7 + 5. * i), 4., 15., 1., true, opacityStops, 0.7);
+    }
+    cairo_surface_flush(surface);
+
+    // The dots are within 15 pixels of their centers
+    RectI bounds(5, 5, 90, 81);
+    EXPECT_LE(getMaxDifferenceWithCairo(surface, coverage, roi, bounds), CAIRO_STROKE_MAX_DIFFERENCE);
+
+    cairo_destroy(cr);
+    cairo_surface_destroy(surface);
+}
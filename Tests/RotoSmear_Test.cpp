@@ -0,0 +1,209 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * Copyright (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "Engine/RectD.h"
+#include "Engine/RotoSmear.h"
+#include "Engine/Timer.h"
+
+NATRON_NAMESPACE_USING
+
+#define IMAGE_SIZE 256
+#define N_COMPS 4
+#define BRUSH_SIZE 20
+
+static Point
+makePoint(double x,
+          double y)
+{
+    Point p;
+
+    p.x = x;
+    p.y = y;
+
+    return p;
+}
+
+// A soft dot of BRUSH_SIZE pixels, as RotoContext::allocateAndRenderSingleDotStroke renders it
+static void
+makeMask(std::vector<unsigned char>* mask)
+{
+    const int maskSize = BRUSH_SIZE + 1;
+
+    mask->resize(maskSize * maskSize);
+    for (int y = 0; y < maskSize; ++y) {
+        for (int x = 0; x < maskSize; ++x) {
+            double dx = x + 0.5 - BRUSH_SIZE / 2.;
+            double dy = y + 0.5 - BRUSH_SIZE / 2.;
+            double d = std::sqrt(dx * dx + dy * dy) / (BRUSH_SIZE / 2.);
+            (*mask)[y * maskSize + x] = d < 1. ? (unsigned char)( 255. * (1. - d * d) ) : 0;
+        }
+    }
+}
+
+static void
+makeImage(std::vector<float>* image)
+{
+    image->resize(IMAGE_SIZE * IMAGE_SIZE * N_COMPS);
+    for (std::size_t i = 0; i < image->size(); ++i) {
+        (*image)[i] = (float)( (i * 7919) % 1000 ) / 1000.f;
+    }
+}
+
+// The dot, blended pixel by pixel from a copy of the pixels around prev
+static void
+renderDotReference(const std::vector<unsigned char>& mask,
+                   const Point& prev,
+                   const Point& next,
+                   std::vector<float>* image)
+{
+    const int maskSize = BRUSH_SIZE + 1;
+    const RectI bounds(0, 0, IMAGE_SIZE, IMAGE_SIZE);
+    RectD prevDotRoD(prev.x - BRUSH_SIZE / 2., prev.y - BRUSH_SIZE / 2., prev.x + BRUSH_SIZE / 2., prev.y + BRUSH_SIZE / 2.);
+    RectI prevDotBounds;
+
+    prevDotRoD.toPixelEnclosing(0, 1., &prevDotBounds);
+    std::vector<float> src( prevDotBounds.area() * N_COMPS, 0.f );
+    for (int y = prevDotBounds.y1; y < prevDotBounds.y2; ++y) {
+        for (int x = prevDotBounds.x1; x < prevDotBounds.x2; ++x) {
+            if ( bounds.contains(x, y) ) {
+                for (int k = 0; k < N_COMPS; ++k) {
+                    src[( (y - prevDotBounds.y1) * prevDotBounds.width() + x - prevDotBounds.x1 ) * N_COMPS + k] = (*image)[(y * IMAGE_SIZE + x) * N_COMPS + k];
+                }
+            }
+        }
+    }
+
+    int x1 = (int)(next.x - maskSize / 2);
+    int y1 = (int)(next.y - maskSize / 2);
+    int x2 = (int)(next.x + maskSize / 2);
+    int y2 = (int)(next.y + maskSize / 2);
+    for (int y = y1; y < y2; ++y) {
+        for (int x = x1; x < x2; ++x) {
+            int xPrev = prevDotBounds.x1 + x - x1;
+            int yPrev = prevDotBounds.y1 + y - y1;
+            if ( !bounds.contains(x, y) || !prevDotBounds.contains(xPrev, yPrev) ) {
+                continue;
+            }
+            float maskScale = mask[(y - y1) * maskSize + x - x1] / 255.f;
+            for (int k = 0; k < N_COMPS; ++k) {
+                float& dst = (*image)[(y * IMAGE_SIZE + x) * N_COMPS + k];
+                dst = src[( (yPrev - prevDotBounds.y1) * prevDotBounds.width() + xPrev - prevDotBounds.x1 ) * N_COMPS + k] * maskScale + dst * (1.f - maskScale);
+            }
+        }
+    }
+}
+
+TEST(RotoSmear, DotMatchesReference)
+{
+    std::vector<unsigned char> mask;
+    std::vector<float> image;
+
+    makeMask(&mask);
+    makeImage(&image);
+    std::vector<float> expected = image;
+
+    // Dots inside of the image and across its borders
+    RotoSmearDotRenderer dotRenderer(&mask[0], BRUSH_SIZE + 1, BRUSH_SIZE + 1, BRUSH_SIZE + 1, N_COMPS);
+    const RectI bounds(0, 0, IMAGE_SIZE, IMAGE_SIZE);
+    Point prev = makePoint(-5.3, 3.7);
+    for (int i = 0; i < 100; ++i) {
+        Point next = makePoint(prev.x + 2.9, prev.y + 2.6);
+        dotRenderer.renderDot(prev, next, BRUSH_SIZE, 1., bounds, IMAGE_SIZE * N_COMPS, &image[0]);
+        renderDotReference(mask, prev, next, &expected);
+        prev = next;
+    }
+
+    for (std::size_t i = 0; i < image.size(); ++i) {
+        ASSERT_NEAR(expected[i], image[i], 1e-6);
+    }
+}
+
+TEST(RotoSmear, DotStaysInBounds)
+{
+    std::vector<unsigned char> mask;
+
+    makeMask(&mask);
+
+    // The image is a region of a larger buffer, whose other pixels must not change
+    std::vector<float> buffer(IMAGE_SIZE * IMAGE_SIZE * N_COMPS, -1.f);
+    const RectI bounds(0, 0, IMAGE_SIZE / 2, IMAGE_SIZE / 2);
+    for (int y = bounds.y1; y < bounds.y2; ++y) {
+        for (int x = bounds.x1; x < bounds.x2; ++x) {
+            for (int k = 0; k < N_COMPS; ++k) {
+                buffer[(y * IMAGE_SIZE + x) * N_COMPS + k] = 1.f;
+            }
+        }
+    }
+
+    RotoSmearDotRenderer dotRenderer(&mask[0], BRUSH_SIZE + 1, BRUSH_SIZE + 1, BRUSH_SIZE + 1, N_COMPS);
+    dotRenderer.renderDot(makePoint(IMAGE_SIZE / 2 - 2, 12.), makePoint(IMAGE_SIZE / 2 - 8, 12.), BRUSH_SIZE, 1., bounds, IMAGE_SIZE * N_COMPS, &buffer[0]);
+    dotRenderer.renderDot(makePoint(10., IMAGE_SIZE / 2 + 3), makePoint(12., IMAGE_SIZE / 2 - 4), BRUSH_SIZE, 1., bounds, IMAGE_SIZE * N_COMPS, &buffer[0]);
+
+    for (int y = 0; y < IMAGE_SIZE; ++y) {
+        for (int x = 0; x < IMAGE_SIZE; ++x) {
+            if ( !bounds.contains(x, y) ) {
+                ASSERT_EQ(-1.f, buffer[(y * IMAGE_SIZE + x) * N_COMPS]);
+            }
+        }
+    }
+    // The pixels from outside of the image are black and transparent
+    EXPECT_LT(buffer[(12 * IMAGE_SIZE + IMAGE_SIZE / 2 - 1) * N_COMPS], 1.f);
+}
+
+// Not a correctness test: prints the number of dots per second of smear strokes of 100 to 10000 points.
+// Disabled by default: run it with --gtest_also_run_disabled_tests.
+TEST(RotoSmear, DISABLED_StrokeLengthBenchmark)
+{
+    std::vector<unsigned char> mask;
+    std::vector<float> image;
+
+    makeMask(&mask);
+    makeImage(&image);
+
+    const RectI bounds(0, 0, IMAGE_SIZE, IMAGE_SIZE);
+    for (int nPoints = 100; nPoints <= 10000; nPoints *= 10) {
+        RotoSmearDotRenderer dotRenderer(&mask[0], BRUSH_SIZE + 1, BRUSH_SIZE + 1, BRUSH_SIZE + 1, N_COMPS);
+        TimeLapse timer;
+        // A spiral from the center of the image
+        Point prev = makePoint(IMAGE_SIZE / 2., IMAGE_SIZE / 2.);
+        for (int i = 1; i < nPoints; ++i) {
+            double angle = std::sqrt( (double)i ) * 0.5;
+            double radius = std::fmod(i * 0.02, IMAGE_SIZE / 2.);
+            Point next = makePoint( IMAGE_SIZE / 2. + radius * std::cos(angle), IMAGE_SIZE / 2. + radius * std::sin(angle) );
+            dotRenderer.renderDot(prev, next, BRUSH_SIZE, 1., bounds, IMAGE_SIZE * N_COMPS, &image[0]);
+            prev = next;
+        }
+        double elapsed = timer.getTimeSinceCreation();
+        std::cout << "Smear stroke of " << nPoints << " points: "
+                  << (nPoints / elapsed) << " dots per second" << std::endl;
+    }
+}
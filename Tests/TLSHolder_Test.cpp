@@ -0,0 +1,198 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * Copyright (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include <iostream>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#if !defined(Q_MOC_RUN) && !defined(SBK_RUN)
+#include <boost/make_shared.hpp>
+#include <boost/shared_ptr.hpp>
+#endif
+
+#include <QtCore/QThread>
+
+#include "Engine/AppManager.h"
+#include "Engine/EffectInstance.h"
+#include "Engine/TLSHolder.h"
+#include "Engine/Timer.h"
+
+NATRON_NAMESPACE_USING
+
+typedef TLSHolder<EffectInstance::EffectTLSData> EffectTLSHolder;
+typedef boost::shared_ptr<EffectTLSHolder> EffectTLSHolderPtr;
+
+class TLSReaderThread
+    : public QThread
+{
+    EffectTLSHolderPtr _holder;
+    QThread* _spawnerThread;
+    int _nAccesses;
+    int _nRecursions;
+    int _nNotRendering;
+    bool _hadTLS;
+
+public:
+
+    TLSReaderThread(const EffectTLSHolderPtr& holder,
+                    QThread* spawnerThread,
+                    int nAccesses)
+        : QThread()
+        , _holder(holder)
+        , _spawnerThread(spawnerThread)
+        , _nAccesses(nAccesses)
+        , _nRecursions(-1)
+        , _nNotRendering(0)
+        , _hadTLS(false)
+    {
+    }
+
+    // The actionRecursionLevel read from the TLS, or -1 if there was none
+    int getRecursionLevel() const
+    {
+        return _nRecursions;
+    }
+
+    int getNotRenderingCount() const
+    {
+        return _nNotRendering;
+    }
+
+    bool hadTLS() const
+    {
+        return _hadTLS;
+    }
+
+private:
+
+    virtual void run() OVERRIDE FINAL
+    {
+        if (_spawnerThread) {
+            appPTR->getAppTLS()->softCopy(_spawnerThread, this);
+        }
+        EffectInstance::EffectTLSDataPtr tls = _holder->getTLSData();
+        _hadTLS = (bool)tls;
+        if (tls) {
+            _nRecursions = tls->actionRecursionLevel;
+        }
+
+        // What EffectInstance::aborted() does on a thread that is not an AbortableThread
+        for (int i = 0; i < _nAccesses; ++i) {
+            EffectInstance::EffectTLSDataPtr data = _holder->getTLSData();
+            if ( !data || data->frameArgs.empty() ) {
+                ++_nNotRendering;
+            }
+        }
+
+        appPTR->getAppTLS()->cleanupTLSForThread();
+    }
+};
+
+TEST(TLSHolder, SpawnedThreads)
+{
+    EffectTLSHolderPtr holder = boost::make_shared<EffectTLSHolder>();
+
+    EXPECT_FALSE( holder->getTLSData() );
+    holder->getOrCreateTLSData()->actionRecursionLevel = 3;
+    EXPECT_EQ( 3, holder->getTLSData()->actionRecursionLevel );
+
+    // A thread does not see the TLS of another thread...
+    TLSReaderThread reader(holder, 0, 1);
+    reader.start();
+    reader.wait();
+    EXPECT_FALSE( reader.hadTLS() );
+
+    // ...unless it was spawned by it: it gets a copy
+    TLSReaderThread spawned(holder, QThread::currentThread(), 1);
+    spawned.start();
+    spawned.wait();
+    EXPECT_TRUE( spawned.hadTLS() );
+    EXPECT_EQ( 3, spawned.getRecursionLevel() );
+    EXPECT_EQ( 3, holder->getTLSData()->actionRecursionLevel );
+
+    // A new holder does not get the data of a destroyed holder, even if it uses the same slot
+    holder.reset();
+    EffectTLSHolderPtr other = boost::make_shared<EffectTLSHolder>();
+    EXPECT_FALSE( other->getTLSData() );
+}
+
+// Threads spawned by the same thread all get a copy of its TLS, which is not rendering
+TEST(TLSHolder, ConcurrentAccess)
+{
+    EffectTLSHolderPtr holder = boost::make_shared<EffectTLSHolder>();
+
+    holder->getOrCreateTLSData();
+
+    const int nThreads = 8;
+    const int nAccesses = 10000;
+    std::vector<boost::shared_ptr<TLSReaderThread> > readers;
+    for (int i = 0; i < nThreads; ++i) {
+        readers.push_back( boost::make_shared<TLSReaderThread>( holder, QThread::currentThread(), nAccesses ) );
+    }
+    for (int i = 0; i < nThreads; ++i) {
+        readers[i]->start();
+    }
+    for (int i = 0; i < nThreads; ++i) {
+        readers[i]->wait();
+    }
+    for (int i = 0; i < nThreads; ++i) {
+        EXPECT_TRUE( readers[i]->hadTLS() );
+        EXPECT_EQ( nAccesses, readers[i]->getNotRenderingCount() );
+    }
+}
+
+// Not a correctness test: prints the number of TLS accesses per second, as made by EffectInstance::aborted(),
+// by 1 to 64 threads.
+// Disabled by default: run it with --gtest_also_run_disabled_tests.
+TEST(TLSHolder, DISABLED_ConcurrentAccessBenchmark)
+{
+    EffectTLSHolderPtr holder = boost::make_shared<EffectTLSHolder>();
+
+    holder->getOrCreateTLSData();
+
+    const int nAccesses = 200000;
+    for (int nThreads = 1; nThreads <= 64; nThreads *= 2) {
+        std::vector<boost::shared_ptr<TLSReaderThread> > readers;
+        for (int i = 0; i < nThreads; ++i) {
+            readers.push_back( boost::make_shared<TLSReaderThread>( holder, QThread::currentThread(), nAccesses ) );
+        }
+        TimeLapse timer;
+        for (int i = 0; i < nThreads; ++i) {
+            readers[i]->start();
+        }
+        for (int i = 0; i < nThreads; ++i) {
+            readers[i]->wait();
+        }
+        double elapsed = timer.getTimeSinceCreation();
+        for (int i = 0; i < nThreads; ++i) {
+            EXPECT_TRUE( readers[i]->hadTLS() );
+            EXPECT_EQ( nAccesses, readers[i]->getNotRenderingCount() );
+        }
+        std::cout << "TLS accesses by " << nThreads << " threads: "
+                  << (nThreads * (double)nAccesses / elapsed) << " per second" << std::endl;
+    }
+}
@@ -0,0 +1,186 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * Copyright (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include <cmath>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#if !defined(Q_MOC_RUN) && !defined(SBK_RUN)
+#include <boost/bind.hpp>
+#endif
+
+#include <QtCore/QAtomicInt>
+#include <QtCore/QThread>
+#include <QtConcurrentMap> // QtCore on Qt4, QtConcurrent on Qt5
+
+#include "Engine/TaskScheduler.h"
+#include "Engine/Timer.h"
+
+NATRON_NAMESPACE_USING
+
+static int
+square(int i)
+{
+    return i * i;
+}
+
+static void
+countCall(QAtomicInt* nCalls,
+          int /*i*/)
+{
+    nCalls->fetchAndAddRelaxed(1);
+}
+
+// What a plug-in calling the multi-thread suite from its own threads does: each index forks n more
+static void
+nestedCall(QAtomicInt* nCalls,
+           int depth,
+           int n,
+           int /*i*/)
+{
+    if (depth == 0) {
+        nCalls->fetchAndAddRelaxed(1);
+
+        return;
+    }
+    TaskScheduler::parallelFor( n, boost::bind(nestedCall, nCalls, depth - 1, n, _1) );
+}
+
+static void
+throwOnIndex(int failingIndex,
+             int i)
+{
+    if (i == failingIndex) {
+        throw std::runtime_error("failing index");
+    }
+}
+
+TEST(TaskScheduler, Mapped)
+{
+    std::vector<int> indexes(1000);
+
+    for (std::size_t i = 0; i < indexes.size(); ++i) {
+        indexes[i] = (int)i;
+    }
+    std::vector<int> squares = TaskScheduler::mapped( indexes, boost::bind(square, _1) );
+    ASSERT_EQ( indexes.size(), squares.size() );
+    for (std::size_t i = 0; i < squares.size(); ++i) {
+        EXPECT_EQ( (int)(i * i), squares[i] );
+    }
+
+    QAtomicInt nCalls;
+    TaskScheduler::map( indexes, boost::bind(countCall, &nCalls, _1) );
+    EXPECT_EQ( 1000, (int)nCalls );
+}
+
+TEST(TaskScheduler, Nested)
+{
+    // More calls than threads at each level: the callers must run the indexes themselves
+    QAtomicInt nCalls;
+
+    TaskScheduler::parallelFor( 16, boost::bind(nestedCall, &nCalls, 3, 16, _1) );
+    EXPECT_EQ( 16 * 16 * 16 * 16, (int)nCalls );
+}
+
+TEST(TaskScheduler, Exception)
+{
+    EXPECT_THROW( TaskScheduler::parallelFor( 100, boost::bind(throwOnIndex, 42, _1) ), std::runtime_error );
+
+    // The scheduler is still usable
+    QAtomicInt nCalls;
+    TaskScheduler::parallelFor( 100, boost::bind(countCall, &nCalls, _1) );
+    EXPECT_EQ( 100, (int)nCalls );
+}
+
+static double
+burnCycles(int i)
+{
+    double sum = 0.;
+
+    for (int j = 0; j < 20000; ++j) {
+        sum += std::sqrt( (double)(i + j) );
+    }
+
+    return sum;
+}
+
+// The tiles of a host frame threading render, each one calling the multi-thread suite, with the task scheduler
+static void
+schedulerTile(int nThreads,
+              int /*tile*/)
+{
+    std::vector<int> threadIndexes(nThreads);
+
+    for (int i = 0; i < nThreads; ++i) {
+        threadIndexes[i] = i;
+    }
+    TaskScheduler::mapped( threadIndexes, boost::bind(burnCycles, _1) );
+}
+
+// The same with QtConcurrent, as OfxHost::multiThread and renderRoIInternal used to do
+static int
+qtConcurrentTile(int nThreads,
+                 int /*tile*/)
+{
+    QList<int> threadIndexes;
+
+    for (int i = 0; i < nThreads; ++i) {
+        threadIndexes.push_back(i);
+    }
+    QtConcurrent::blockingMapped<QList<double> >( threadIndexes, boost::bind(burnCycles, _1) );
+
+    return 0;
+}
+
+// Not a correctness test: prints the time taken by a nested OFX plug-in render with the task scheduler and
+// with QtConcurrent.
+// Disabled by default: run it with --gtest_also_run_disabled_tests.
+TEST(TaskScheduler, DISABLED_NestedMultiThreadBenchmark)
+{
+    const int nTiles = 64;
+    const int nThreads = QThread::idealThreadCount();
+    std::vector<int> tiles(nTiles);
+    QList<int> qTiles;
+
+    for (int i = 0; i < nTiles; ++i) {
+        tiles[i] = i;
+        qTiles.push_back(i);
+    }
+
+    {
+        TimeLapse timer;
+        TaskScheduler::map( tiles, boost::bind(schedulerTile, nThreads, _1) );
+        std::cout << "Nested render with the task scheduler: " << timer.getTimeSinceCreation() << " s" << std::endl;
+    }
+    {
+        TimeLapse timer;
+        QtConcurrent::blockingMapped<QList<int> >( qTiles, boost::bind(qtConcurrentTile, nThreads, _1) );
+        std::cout << "Nested render with QtConcurrent: " << timer.getTimeSinceCreation() << " s" << std::endl;
+    }
+}
@@ -43,11 +43,20 @@ SOURCES += \
     google-test/src/gtest-all.cc \
     google-mock/src/gmock-all.cc \
     BaseTest.cpp \
+    Cache_Test.cpp \
     Hash64_Test.cpp \
     Image_Test.cpp \
     Lut_Test.cpp \
+    NumaTopology_Test.cpp \
+    RenderThreadBudget_Test.cpp \
+    RotoBezier_Test.cpp \
+    RotoRasterizer_Test.cpp \
+    RotoSmear_Test.cpp \
     KnobFile_Test.cpp \
     Curve_Test.cpp \
+    Expression_Test.cpp \
+    TaskScheduler_Test.cpp \
+    TLSHolder_Test.cpp \
     Tracker_Test.cpp \
     wmain.cpp
 